@@ -0,0 +1,513 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/AsyncFileWriter.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "zeek/zeek-config.h"
+
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif
+
+#include "zeek/util.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+namespace async_io {
+
+// Data is handed to the helper in chunks of this size, unless flushed
+// earlier.
+constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+// How much data a writer may have outstanding before it has to wait.
+constexpr uint64_t MAX_PENDING = 8 * 1024 * 1024;
+
+// The most writes we keep in flight with io_uring at any time.
+constexpr unsigned int QUEUE_DEPTH = 64;
+
+// A writer's outstanding output.
+struct WriterState {
+    uint64_t pending = 0;       // Bytes submitted, but not written yet. Guarded by the service's mutex.
+    std::atomic<int> error = 0; // The errno value of the first failed write.
+};
+
+struct Request {
+    std::shared_ptr<WriterState> state;
+    int fd = -1;
+    uint64_t offset = 0;
+    std::vector<char> data;
+    size_t done = 0; // Bytes written so far.
+};
+
+// Performs the writes of all AsyncFileWriter instances on a single
+// helper thread, which either drives an io_uring instance or writes
+// itself.
+class Service {
+public:
+    static Service& Get() {
+        static Service service;
+        return service;
+    }
+
+    void Submit(std::unique_ptr<Request> req);
+
+    // Blocks until the writer has at most max_pending bytes outstanding.
+    void Wait(WriterState* state, uint64_t max_pending);
+
+    int Error(const WriterState* state) const { return state->error.load(std::memory_order_acquire); }
+
+    const char* Mechanism() const {
+#ifdef USE_IO_URING
+        if ( have_uring )
+            return "io_uring";
+#endif
+        return "thread";
+    }
+
+private:
+    Service();
+    ~Service();
+
+    // Accounts for a finished request and releases it. Must be called
+    // with the mutex held.
+    void Complete(Request* req, int err);
+
+    // Accounts for a finished request without releasing it. Must be
+    // called with the mutex held.
+    void Account(const Request& req, int err);
+
+    void RunThread();
+
+    std::mutex mtx;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::deque<std::unique_ptr<Request>> queue;
+    bool stopping = false;
+    std::thread thread;
+
+#ifdef USE_IO_URING
+    // Queues a write for the request's remaining data. Must be called
+    // with the mutex held.
+    void Prepare(Request* req);
+
+    void RunUring();
+
+    // Fails all outstanding requests once the ring has become unusable.
+    // Must be called with the mutex held.
+    void FailUring(int err);
+
+    bool have_uring = false;
+    struct io_uring ring;
+    std::unordered_set<Request*> in_flight;
+
+    // Set once waiting for completions has failed. From then on,
+    // requests fail right away with this errno value.
+    int uring_error = 0;
+
+    // Requests that were in flight when the ring failed. The kernel may
+    // still access their data, so we only release them after tearing
+    // down the ring.
+    std::vector<Request*> abandoned;
+#endif
+};
+
+Service::Service() {
+#ifdef USE_IO_URING
+    // Kernels without io_uring, or with it disabled, leave us with the
+    // helper thread.
+    have_uring = io_uring_queue_init(QUEUE_DEPTH, &ring, 0) == 0;
+
+    if ( have_uring )
+        thread = std::thread([this] { RunUring(); });
+    else
+#endif
+        thread = std::thread([this] { RunThread(); });
+
+    util::detail::set_thread_name("zk.async-io", thread.native_handle());
+}
+
+Service::~Service() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+
+#ifdef USE_IO_URING
+        if ( have_uring ) {
+            // A request-less no-op wakes up the helper.
+            if ( auto* sqe = io_uring_get_sqe(&ring) ) {
+                io_uring_prep_nop(sqe);
+                io_uring_sqe_set_data(sqe, nullptr);
+                io_uring_submit(&ring);
+            }
+        }
+#endif
+    }
+
+    work_cv.notify_all();
+    thread.join();
+
+#ifdef USE_IO_URING
+    if ( have_uring ) {
+        io_uring_queue_exit(&ring);
+
+        for ( auto* req : abandoned )
+            delete req;
+    }
+#endif
+}
+
+void Service::Submit(std::unique_ptr<Request> req) {
+    std::lock_guard<std::mutex> lock(mtx);
+    req->state->pending += req->data.size();
+
+#ifdef USE_IO_URING
+    if ( have_uring ) {
+        if ( uring_error )
+            Complete(req.release(), uring_error);
+
+        else if ( in_flight.size() < QUEUE_DEPTH ) {
+            in_flight.insert(req.get());
+            Prepare(req.release());
+            io_uring_submit(&ring);
+        }
+        else
+            // The helper picks this up once something completes.
+            queue.push_back(std::move(req));
+
+        return;
+    }
+#endif
+
+    queue.push_back(std::move(req));
+    work_cv.notify_one();
+}
+
+void Service::Wait(WriterState* state, uint64_t max_pending) {
+    std::unique_lock<std::mutex> lock(mtx);
+    done_cv.wait(lock, [state, max_pending] { return state->pending <= max_pending; });
+}
+
+void Service::Complete(Request* req, int err) {
+    Account(*req, err);
+    delete req;
+}
+
+void Service::Account(const Request& req, int err) {
+    req.state->pending -= req.data.size();
+
+    if ( err && ! req.state->error.load(std::memory_order_relaxed) )
+        req.state->error.store(err, std::memory_order_release);
+
+    done_cv.notify_all();
+}
+
+void Service::RunThread() {
+    while ( true ) {
+        std::unique_ptr<Request> req;
+
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            work_cv.wait(lock, [this] { return stopping || ! queue.empty(); });
+
+            if ( queue.empty() )
+                return;
+
+            req = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        int err = 0;
+
+        while ( req->done < req->data.size() ) {
+            ssize_t n = pwrite(req->fd, req->data.data() + req->done, req->data.size() - req->done,
+                               static_cast<off_t>(req->offset + req->done));
+
+            if ( n < 0 ) {
+                if ( errno == EINTR )
+                    continue;
+
+                err = errno;
+                break;
+            }
+
+            if ( n == 0 ) {
+                // Retrying wouldn't get us any further.
+                err = EIO;
+                break;
+            }
+
+            req->done += n;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        Complete(req.release(), err);
+    }
+}
+
+#ifdef USE_IO_URING
+
+void Service::Prepare(Request* req) {
+    // We never have more than QUEUE_DEPTH writes in flight, and submit
+    // each right away, so there's always room.
+    auto* sqe = io_uring_get_sqe(&ring);
+    io_uring_prep_write(sqe, req->fd, req->data.data() + req->done, req->data.size() - req->done,
+                        req->offset + req->done);
+    io_uring_sqe_set_data(sqe, req);
+}
+
+void Service::RunUring() {
+    while ( true ) {
+        struct io_uring_cqe* cqe;
+
+        // Only this thread consumes completions, while submissions happen
+        // under the mutex.
+        if ( int res = io_uring_wait_cqe(&ring, &cqe); res < 0 ) {
+            if ( res == -EINTR )
+                continue;
+
+            // The writers pick up the error with their next operation.
+            std::lock_guard<std::mutex> lock(mtx);
+            FailUring(-res);
+            return;
+        }
+
+        auto* req = static_cast<Request*>(io_uring_cqe_get_data(cqe));
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if ( ! req ) {
+            if ( stopping )
+                return;
+
+            continue;
+        }
+
+        if ( res == -EINTR || res == -EAGAIN ) {
+            Prepare(req);
+            io_uring_submit(&ring);
+            continue;
+        }
+
+        if ( res <= 0 ) {
+            // A write that doesn't make progress won't when retried
+            // either.
+            in_flight.erase(req);
+            Complete(req, res < 0 ? -res : EIO);
+        }
+
+        else if ( req->done + res < req->data.size() ) {
+            // Short write, continue with the rest.
+            req->done += res;
+            Prepare(req);
+        }
+
+        else {
+            in_flight.erase(req);
+            Complete(req, 0);
+        }
+
+        while ( in_flight.size() < QUEUE_DEPTH && ! queue.empty() ) {
+            in_flight.insert(queue.front().get());
+            Prepare(queue.front().release());
+            queue.pop_front();
+        }
+
+        io_uring_submit(&ring);
+    }
+}
+
+void Service::FailUring(int err) {
+    uring_error = err;
+
+    for ( auto* req : in_flight ) {
+        Account(*req, err);
+        abandoned.push_back(req);
+    }
+
+    in_flight.clear();
+
+    for ( auto& req : queue )
+        Complete(req.release(), err);
+
+    queue.clear();
+}
+
+#endif
+
+} // namespace async_io
+
+AsyncFileWriter::AsyncFileWriter(int arg_fd) : fd(arg_fd), state(std::make_shared<async_io::WriterState>()) {
+    // Only regular files support writing at explicit offsets in any
+    // order. With O_APPEND, Linux ignores the offsets.
+    struct stat st;
+    int flags = fcntl(fd, F_GETFL);
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+
+    positional = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && flags >= 0 && ! (flags & O_APPEND) && pos >= 0;
+
+    if ( positional ) {
+        offset = pos;
+        chunk.reserve(async_io::CHUNK_SIZE);
+    }
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    if ( positional ) {
+        Submit();
+        async_io::Service::Get().Wait(state.get(), 0);
+    }
+}
+
+const char* AsyncFileWriter::Mechanism() { return async_io::Service::Get().Mechanism(); }
+
+bool AsyncFileWriter::Write(const char* data, size_t len) {
+    if ( ! positional )
+        return util::safe_write(fd, data, len) || Fail(errno);
+
+    if ( ! CheckError() )
+        return false;
+
+    if ( chunk.size() + len > async_io::CHUNK_SIZE && ! Submit() )
+        return false;
+
+    chunk.insert(chunk.end(), data, data + len);
+
+    if ( chunk.size() >= async_io::CHUNK_SIZE )
+        return Submit();
+
+    return true;
+}
+
+bool AsyncFileWriter::Seek(uint64_t arg_offset) {
+    if ( ! positional )
+        return lseek(fd, static_cast<off_t>(arg_offset), SEEK_SET) >= 0 || Fail(errno);
+
+    if ( ! Submit() )
+        return false;
+
+    offset = arg_offset;
+    return true;
+}
+
+bool AsyncFileWriter::Flush() {
+    if ( ! positional )
+        return true;
+
+    return Submit();
+}
+
+bool AsyncFileWriter::Sync() {
+    if ( ! Flush() )
+        return false;
+
+    if ( positional )
+        async_io::Service::Get().Wait(state.get(), 0);
+
+    return CheckError();
+}
+
+bool AsyncFileWriter::Submit() {
+    if ( chunk.empty() )
+        return CheckError();
+
+    auto& service = async_io::Service::Get();
+
+    // Bound how much of our data the helper holds on to.
+    service.Wait(state.get(), async_io::MAX_PENDING);
+
+    auto req = std::make_unique<async_io::Request>();
+    req->state = state;
+    req->fd = fd;
+    req->offset = offset;
+    req->data = std::move(chunk);
+
+    offset += req->data.size();
+    service.Submit(std::move(req));
+
+    chunk = {};
+    chunk.reserve(async_io::CHUNK_SIZE);
+
+    return CheckError();
+}
+
+bool AsyncFileWriter::CheckError() {
+    if ( int err = async_io::Service::Get().Error(state.get()) )
+        return Fail(err);
+
+    return true;
+}
+
+bool AsyncFileWriter::Fail(int err) {
+    if ( error.empty() ) {
+        char buf[128];
+        util::zeek_strerror_r(err, buf, sizeof(buf));
+        error = buf;
+    }
+
+    errno = err;
+    return false;
+}
+
+TEST_CASE("AsyncFileWriter") {
+    FILE* f = tmpfile();
+    REQUIRE(f);
+
+    auto read_back = [f] {
+        std::string out;
+        char buf[4096];
+        size_t n;
+
+        rewind(f);
+
+        while ( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+            out.append(buf, n);
+
+        return out;
+    };
+
+    std::string expected;
+
+    {
+        AsyncFileWriter w(fileno(f));
+
+        // Small and large writes, across several chunks.
+        for ( int i = 0; i < 100000; ++i ) {
+            auto line = "line " + std::to_string(i) + "\n";
+            CHECK(w.Write(line.data(), line.size()));
+            expected += line;
+        }
+
+        std::string big(3 * async_io::CHUNK_SIZE + 7, 'x');
+        CHECK(w.Write(big.data(), big.size()));
+        expected += big;
+
+        CHECK(w.Sync());
+        CHECK(read_back() == expected);
+
+        // A hole reads back as zeros.
+        CHECK(w.Seek(expected.size() + 10));
+        CHECK(w.Write("end", 3));
+        expected += std::string(10, '\0') + "end";
+    }
+
+    CHECK(read_back() == expected);
+    fclose(f);
+}
+
+} // namespace zeek::detail
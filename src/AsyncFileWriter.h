@@ -0,0 +1,103 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace zeek::detail {
+
+namespace async_io {
+struct WriterState;
+}
+
+/**
+ * Writes to a file descriptor in the background. Data gets collected into
+ * chunks that a process-wide helper performs the actual writes for, through
+ * io_uring if Zeek has been built with liburing and the kernel supports it,
+ * and on a helper thread otherwise. Callers only wait if too much of their
+ * output is still outstanding, or when asking for it explicitly.
+ *
+ * Writes go to explicit file offsets, starting at the descriptor's position
+ * when the writer gets created. Nothing else must write to the descriptor
+ * meanwhile. Descriptors that don't support positioning, like pipes and
+ * terminals, get written to synchronously instead.
+ *
+ * An instance must only be used by one thread at a time.
+ */
+class AsyncFileWriter {
+public:
+    /**
+     * Constructor.
+     *
+     * @param fd The file descriptor to write to. The caller remains
+     * responsible for closing it, after destroying the writer.
+     */
+    explicit AsyncFileWriter(int fd);
+
+    /**
+     * Destructor. Waits for all outstanding writes to complete, ignoring
+     * any errors.
+     */
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    /**
+     * Adds data to the output. Returns false if this or an earlier write
+     * failed, see Error(). Also sets errno in that case.
+     */
+    bool Write(const char* data, size_t len);
+
+    /**
+     * Moves the position of the next write, leaving a hole if it's past
+     * the end of the data written so far. Returns false on errors.
+     */
+    bool Seek(uint64_t offset);
+
+    /**
+     * Hands all buffered data to the helper without waiting for it to be
+     * written. Returns false on errors.
+     */
+    bool Flush();
+
+    /**
+     * Writes out all buffered data and waits for it to complete. Returns
+     * false on errors.
+     */
+    bool Sync();
+
+    /**
+     * Returns a description of the first error encountered.
+     */
+    const std::string& Error() const { return error; }
+
+    /**
+     * Returns the name of the mechanism performing the writes, either
+     * "io_uring" or "thread".
+     */
+    static const char* Mechanism();
+
+private:
+    // Passes the current chunk to the helper.
+    bool Submit();
+
+    // Checks for errors reported by the helper.
+    bool CheckError();
+
+    // Records an errno value as the error.
+    bool Fail(int err);
+
+    int fd;
+    bool positional;
+    uint64_t offset = 0;
+    std::vector<char> chunk;
+    std::shared_ptr<async_io::WriterState> state;
+    std::string error;
+};
+
+} // namespace zeek::detail
@@ -6,6 +6,7 @@
 
 #include "zeek/IntrusivePtr.h"
 #include "zeek/session/Key.h"
+#include "zeek/session/KeyPool.h"
 
 namespace zeek {
 
@@ -21,6 +22,13 @@ class ConnKey {
 public:
     virtual ~ConnKey() = default;
 
+    // ConnKeys are allocated for every new connection, so they come out of
+    // the session key pool rather than the general heap. The virtual
+    // destructor makes sure the size passed to delete is the one of the
+    // actual derived type.
+    static void* operator new(size_t size) { return session::detail::key_pool().Allocate(size); }
+    static void operator delete(void* ptr, size_t size) noexcept { session::detail::key_pool().Release(ptr, size); }
+
     /**
      * Initialization of this key with the current packet.
      *
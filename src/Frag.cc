@@ -164,10 +164,10 @@ void FragReassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n) {
         Weird("fragment_overlap");
 }
 
-void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */) {
+void FragReassembler::BlockInserted(DataBlockList::const_iterator /* it */) {
     auto it = block_list.Begin();
 
-    if ( it->second.seq > 0 || ! frag_size )
+    if ( it->seq > 0 || ! frag_size )
         // For sure don't have it all yet.
         return;
 
@@ -175,7 +175,7 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */) {
 
     // We might have it all - look for contiguous all the way.
     while ( next != block_list.End() ) {
-        if ( it->second.upper != next->second.seq )
+        if ( it->upper != next->seq )
             break;
 
         ++it;
@@ -186,7 +186,7 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */) {
 
     if ( next != block_list.End() ) {
         // We have a hole.
-        if ( it->second.upper >= frag_size ) {
+        if ( it->upper >= frag_size ) {
             // We're stuck.  The point where we stopped is
             // contiguous up through the expected end of
             // the fragment, but there's more stuff still
@@ -198,7 +198,7 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */) {
             // We decide to analyze the contiguous portion now.
             // Extend the fragment up through the end of what
             // we have.
-            frag_size = it->second.upper;
+            frag_size = it->upper;
         }
         else
             return;
@@ -231,10 +231,10 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */) {
     pkt += proto_hdr_len;
 
     for ( it = block_list.Begin(); it != block_list.End(); ++it ) {
-        const auto& b = it->second;
+        const auto& b = *it;
 
         if ( it != block_list.Begin() ) {
-            const auto& prev = std::prev(it)->second;
+            const auto& prev = *std::prev(it);
 
             // If we're above a hole, stop.  This can happen because
             // the logic above regarding a hole that's above the
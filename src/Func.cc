@@ -41,6 +41,7 @@
 #include "zeek/iosource/PktSrc.h"
 #include "zeek/module_util.h"
 #include "zeek/plugin/Manager.h"
+#include "zeek/script_opt/ScriptOpt.h"
 #include "zeek/session/Manager.h"
 
 // Ignore clang-format's reordering of include files here so that it doesn't
@@ -384,6 +385,9 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const {
         if ( spm )
             spm->StartInvocation(this, body.stmts);
 
+        if ( detail::tiered_ZAM_active )
+            detail::note_tiered_ZAM_call(body.stmts.get());
+
         f->Reset(args->size());
 
         try {
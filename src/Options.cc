@@ -184,6 +184,7 @@ static void print_analysis_help() {
     printf("    ZAM	execute scripts using ZAM and all optimizations\n");
     printf("    help	print this list\n");
     printf("    report-uncompilable	print names of functions that can't be compiled\n");
+    printf("    tiered-ZAM	interpret scripts at first, compiling frequently called functions to ZAM\n");
     printf("\n  primarily for developers:\n");
     printf("    dump-uds	dump use-defs to stdout; implies xform\n");
     printf("    dump-xform	dump transformed scripts to stdout; implies xform\n");
@@ -264,6 +265,8 @@ static void set_analysis_option(const char* opt, Options& opts) {
         a_o.inliner = a_o.report_recursive = true;
     else if ( util::streq(opt, "report-uncompilable") )
         a_o.report_uncompilable = true;
+    else if ( util::streq(opt, "tiered-ZAM") )
+        a_o.activate = a_o.tiered_ZAM = true;
     else if ( util::streq(opt, "use-C++") )
         a_o.use_CPP = true;
     else if ( util::streq(opt, "validate-ZAM") )
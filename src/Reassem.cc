@@ -9,6 +9,8 @@
 #include "zeek/Desc.h"
 #include "zeek/Reporter.h"
 
+#include "zeek/3rdparty/doctest.h"
+
 using std::min;
 
 namespace zeek {
@@ -24,8 +26,8 @@ DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq) {
 }
 
 void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* above) const {
-    for ( const auto& e : block_map ) {
-        const auto& b = e.second;
+    for ( auto it = Begin(); it != End(); ++it ) {
+        const auto& b = *it;
 
         if ( b.seq <= seq_cutoff ) {
             if ( b.upper <= seq_cutoff )
@@ -40,140 +42,143 @@ void DataBlockList::DataSize(uint64_t seq_cutoff, uint64_t* below, uint64_t* abo
     }
 }
 
-void DataBlockList::Delete(DataBlockMap::const_iterator it) {
-    const auto& b = it->second;
+void DataBlockList::PopFirst() {
+    ++head;
+
+    if ( head == blocks.size() ) {
+        blocks.clear();
+        head = 0;
+    }
+    else if ( head >= 16 && head >= blocks.size() / 2 ) {
+        // Reclaim the leftovers at the front once they dominate.
+        blocks.erase(blocks.begin(), blocks.begin() + head);
+        head = 0;
+    }
+}
+
+void DataBlockList::DeleteFirst() {
+    auto& b = blocks[head];
     auto size = b.Size();
 
-    block_map.erase(it);
+    delete[] b.block;
+    b.block = nullptr;
+    PopFirst();
+
     total_data_size -= size;
 
     Reassembler::total_size -= size + sizeof(DataBlock);
     Reassembler::sizes[reassembler->rtype] -= size + sizeof(DataBlock);
 }
 
-DataBlock DataBlockList::Remove(DataBlockMap::const_iterator it) {
-    auto b = it->second;
+DataBlock DataBlockList::RemoveFirst() {
+    DataBlock b = std::move(blocks[head]);
     auto size = b.Size();
 
-    block_map.erase(it);
+    PopFirst();
     total_data_size -= size;
 
     return b;
 }
 
 void DataBlockList::Clear() {
-    auto total_db_size = sizeof(DataBlock) * block_map.size();
+    auto total_db_size = sizeof(DataBlock) * NumBlocks();
     auto total = total_data_size + total_db_size;
     Reassembler::total_size -= total;
     Reassembler::sizes[reassembler->rtype] -= total;
     total_data_size = 0;
-    block_map.clear();
+    blocks.clear();
+    head = 0;
 }
 
 void DataBlockList::Append(DataBlock block, uint64_t limit) {
     total_data_size += block.Size();
 
-    block_map.emplace_hint(block_map.end(), block.seq, std::move(block));
+    blocks.push_back(std::move(block));
 
-    while ( block_map.size() > limit )
-        Delete(block_map.begin());
+    while ( NumBlocks() > limit )
+        DeleteFirst();
 }
 
-DataBlockMap::const_iterator DataBlockList::FirstBlockAtOrBefore(uint64_t seq) const {
+DataBlockList::const_iterator DataBlockList::FirstBlockAtOrBefore(uint64_t seq) const {
     // Upper sequence number doesn't matter for the search
-    auto it = block_map.upper_bound(seq);
+    auto it = std::upper_bound(Begin(), End(), seq, [](uint64_t s, const DataBlock& b) { return s < b.seq; });
 
-    if ( it == block_map.end() )
-        return block_map.empty() ? it : std::prev(it);
-
-    if ( it == block_map.begin() )
-        return block_map.end();
+    if ( it == Begin() )
+        return End();
 
     return std::prev(it);
 }
 
-DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
-                                                   DataBlockMap::const_iterator hint) {
+size_t DataBlockList::InsertAt(size_t idx, uint64_t seq, uint64_t upper, const u_char* data) {
     auto size = upper - seq;
-    auto rval = block_map.emplace_hint(hint, seq, DataBlock(data, size, seq));
+
+    if ( idx == head && head > 0 ) {
+        // Reuse the slot a removal from the front left behind.
+        idx = --head;
+        blocks[idx] = DataBlock(data, size, seq);
+    }
+    else
+        blocks.emplace(blocks.begin() + idx, data, size, seq);
 
     total_data_size += size;
     Reassembler::sizes[reassembler->rtype] += size + sizeof(DataBlock);
     Reassembler::total_size += size + sizeof(DataBlock);
 
-    return rval;
+    return idx;
 }
 
-DataBlockMap::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
-                                                   DataBlockMap::const_iterator* hint) {
-    // Empty list.
-    if ( block_map.empty() )
-        return Insert(seq, upper, data, block_map.end());
-
-    const auto& last = block_map.rbegin()->second;
-
-    // Special check for the common case of appending to the end.
-    if ( seq == last.upper )
-        return Insert(seq, upper, data, block_map.end());
-
-    // Find the first block that doesn't come completely before the new data.
-    DataBlockMap::const_iterator it;
-
-    if ( hint )
-        it = *hint;
-    else {
-        it = FirstBlockAtOrBefore(seq);
-
-        if ( it == block_map.end() )
-            it = block_map.begin();
-    }
+DataBlockList::const_iterator DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data) {
+    // Special check for the common case of appending to the end, which
+    // includes the empty list.
+    if ( Empty() || seq >= blocks.back().upper )
+        return blocks.begin() + InsertAt(blocks.size(), seq, upper, data);
 
-    while ( std::next(it) != block_map.end() && it->second.upper <= seq )
-        ++it;
+    // Find the first block that doesn't come completely before the new
+    // data. As blocks don't overlap, their upper ends are sorted as well.
+    auto it = std::partition_point(Begin(), End(), [seq](const DataBlock& b) { return b.upper <= seq; });
+    size_t idx = it - blocks.begin();
 
-    const auto& b = it->second;
+    constexpr size_t none = std::numeric_limits<size_t>::max();
+    size_t inserted = none;
+    size_t overlapped = none;
 
-    if ( b.upper <= seq )
-        // b is the last block, and it comes completely before the new block.
-        return Insert(seq, upper, data, block_map.end());
+    // Fill the holes before and between the blocks the new data overlaps.
+    // As we move from front to back, inserting doesn't shift the indices
+    // recorded already.
+    while ( seq < upper ) {
+        if ( idx == blocks.size() || upper <= blocks[idx].seq ) {
+            // The rest of the new data fits in before the next block.
+            auto r = InsertAt(idx, seq, upper, data);
 
-    if ( upper <= b.seq )
-        // The new block comes completely before b.
-        return Insert(seq, upper, data, it);
+            if ( inserted == none )
+                inserted = r;
 
-    DataBlockMap::const_iterator rval;
+            break;
+        }
 
-    // The blocks overlap.
-    if ( seq < b.seq ) {
-        // The new block has a prefix that comes before b.
-        uint64_t prefix_len = b.seq - seq;
+        if ( seq < blocks[idx].seq ) {
+            // The new data has a prefix that comes before the block.
+            uint64_t prefix_len = blocks[idx].seq - seq;
+            auto r = InsertAt(idx, seq, seq + prefix_len, data);
 
-        rval = Insert(seq, seq + prefix_len, data, it);
+            if ( inserted == none )
+                inserted = r;
 
-        data += prefix_len;
-        seq += prefix_len;
-    }
-    else
-        rval = it;
+            data += prefix_len;
+            seq += prefix_len;
+            idx = r + 1;
+        }
 
-    uint64_t overlap_start = seq;
-    uint64_t overlap_offset = overlap_start - b.seq;
-    uint64_t new_b_len = upper - seq;
-    uint64_t b_len = b.upper - overlap_start;
-    uint64_t overlap_len = min(new_b_len, b_len);
+        // Skip the part overlapping the block.
+        overlapped = idx;
+        uint64_t overlap_len = min(upper, blocks[idx].upper) - seq;
 
-    if ( overlap_len < new_b_len ) {
-        // Recurse to resolve remainder of the new data.
         data += overlap_len;
         seq += overlap_len;
-
-        auto r = Insert(seq, upper, data, &it);
-
-        if ( rval == it )
-            rval = r;
+        ++idx;
     }
 
-    return rval;
+    return blocks.begin() + (inserted != none ? inserted : overlapped);
 }
 
 uint64_t DataBlockList::Trim(uint64_t seq, uint64_t max_old, DataBlockList* old_list) {
@@ -182,8 +187,8 @@ uint64_t DataBlockList::Trim(uint64_t seq, uint64_t max_old, DataBlockList* old_
     // Do this accounting before looking for Undelivered data,
     // since that will alter last_reassem_seq.
 
-    if ( ! block_map.empty() ) {
-        const auto& first = block_map.begin()->second;
+    if ( ! Empty() ) {
+        const auto& first = FirstBlock();
 
         if ( first.seq > reassembler->LastReassemSeq() )
             // An initial hole.
@@ -200,18 +205,17 @@ uint64_t DataBlockList::Trim(uint64_t seq, uint64_t max_old, DataBlockList* old_
         reassembler->Undelivered(seq);
     }
 
-    while ( ! block_map.empty() ) {
-        auto first_it = block_map.begin();
-        const auto& first = first_it->second;
+    while ( ! Empty() ) {
+        const auto& first = FirstBlock();
 
         if ( first.upper > seq )
             break;
 
-        auto next = std::next(first_it);
+        auto next = std::next(Begin());
 
-        if ( next != block_map.end() && next->second.seq <= seq ) {
-            if ( first.upper != next->second.seq )
-                num_missing += next->second.seq - first.upper;
+        if ( next != End() && next->seq <= seq ) {
+            if ( first.upper != next->seq )
+                num_missing += next->seq - first.upper;
         }
         else {
             // No more blocks - did this one make it to seq?
@@ -222,20 +226,17 @@ uint64_t DataBlockList::Trim(uint64_t seq, uint64_t max_old, DataBlockList* old_
         }
 
         if ( max_old )
-            old_list->Append(Remove(first_it), max_old);
+            old_list->Append(RemoveFirst(), max_old);
         else
-            Delete(first_it);
+            DeleteFirst();
     }
 
-    if ( ! block_map.empty() ) {
-        auto first_it = block_map.begin();
-        const auto& first = first_it->second;
-
+    if ( ! Empty() ) {
         // If we skipped over some undeliverable data, then
         // it's possible that this block is now deliverable.
         // Give it a try.
-        if ( first.seq == reassembler->LastReassemSeq() )
-            reassembler->BlockInserted(first_it);
+        if ( FirstBlock().seq == reassembler->LastReassemSeq() )
+            reassembler->BlockInserted(Begin());
     }
 
     reassembler->SetTrimSeq(seq);
@@ -263,7 +264,7 @@ void Reassembler::CheckOverlap(const DataBlockList& list, uint64_t seq, uint64_t
         it = list.Begin();
 
     for ( ; it != list.End(); ++it ) {
-        const auto& b = it->second;
+        const auto& b = *it;
         uint64_t nseq = seq;
         uint64_t nupper = upper;
         const u_char* ndata = data;
@@ -322,7 +323,6 @@ void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* d
     }
 
     auto it = block_list.Insert(seq, upper_seq, data);
-    ;
     BlockInserted(it);
 }
 
@@ -343,4 +343,140 @@ void Reassembler::Undelivered(uint64_t up_to_seq) {
 
 uint64_t Reassembler::MemoryAllocation(ReassemblerType rtype) { return Reassembler::sizes[rtype]; }
 
+TEST_CASE("data block list") {
+    class TestReassembler : public Reassembler {
+    public:
+        TestReassembler() : Reassembler(0, REASSEM_UNKNOWN) {}
+
+        std::vector<uint64_t> inserted;
+        uint64_t overlapped = 0;
+
+        const DataBlockList& Blocks() const { return block_list; }
+        const DataBlockList& OldBlocks() const { return old_block_list; }
+
+    protected:
+        void BlockInserted(DataBlockList::const_iterator it) override { inserted.push_back(it->seq); }
+        void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override { overlapped += n; }
+    };
+
+    TestReassembler r;
+    u_char data[256];
+
+    for ( size_t i = 0; i < sizeof(data); ++i )
+        data[i] = static_cast<u_char>(i);
+
+    // Blocks must be sorted, must not overlap and must hold the data for
+    // their sequence range.
+    auto check = [&](const DataBlockList& list) {
+        uint64_t last_upper = 0;
+        uint64_t total = 0;
+
+        for ( auto it = list.Begin(); it != list.End(); ++it ) {
+            CHECK(it->seq < it->upper);
+            CHECK(it->seq >= last_upper);
+
+            for ( uint64_t s = it->seq; s < it->upper; ++s )
+                CHECK(it->block[s - it->seq] == static_cast<u_char>(s));
+
+            last_upper = it->upper;
+            total += it->Size();
+        }
+
+        CHECK(total == list.DataSize());
+    };
+
+    SUBCASE("in order") {
+        for ( uint64_t s = 0; s < 200; s += 10 )
+            r.NewBlock(0.0, s, 10, data + s);
+
+        check(r.Blocks());
+        CHECK(r.Blocks().NumBlocks() == 20);
+        CHECK(r.inserted.size() == 20);
+        CHECK(r.overlapped == 0);
+    }
+
+    SUBCASE("holes and overlaps") {
+        r.NewBlock(0.0, 100, 20, data + 100);
+        r.NewBlock(0.0, 40, 20, data + 40);
+        r.NewBlock(0.0, 70, 10, data + 70);
+        CHECK(r.Blocks().NumBlocks() == 3);
+
+        // Spans all three, filling the holes in between.
+        r.NewBlock(0.0, 30, 100, data + 30);
+        check(r.Blocks());
+        CHECK(r.Blocks().NumBlocks() == 7);
+        CHECK(r.Blocks().FirstBlock().seq == 30);
+        CHECK(r.Blocks().LastBlock().upper == 130);
+        CHECK(r.inserted.back() == 30);
+        CHECK(r.overlapped == 50);
+
+        // Entirely covered already.
+        r.NewBlock(0.0, 45, 10, data + 45);
+        CHECK(r.Blocks().NumBlocks() == 7);
+        CHECK(r.inserted.back() == 40);
+
+        // Starts inside a block and extends past the end.
+        r.NewBlock(0.0, 125, 20, data + 125);
+        check(r.Blocks());
+        CHECK(r.inserted.back() == 130);
+        CHECK(r.Blocks().LastBlock().upper == 145);
+
+        auto it = r.Blocks().FirstBlockAtOrBefore(72);
+        REQUIRE(it != r.Blocks().End());
+        CHECK(it->seq == 70);
+        CHECK(r.Blocks().FirstBlockAtOrBefore(29) == r.Blocks().End());
+    }
+
+    SUBCASE("trim") {
+        r.SetMaxOldBlocks(5);
+
+        for ( uint64_t s = 0; s < 250; s += 10 )
+            r.NewBlock(0.0, s, 5, data + s);
+
+        for ( uint64_t s = 57; s < 250; s += 40 ) {
+            r.TrimToSeq(s);
+            check(r.Blocks());
+            check(r.OldBlocks());
+            CHECK(r.Blocks().FirstBlock().seq == s + 3);
+            CHECK(r.OldBlocks().NumBlocks() == 5);
+
+            // Data before the trimmed sequence number gets dropped.
+            auto n = r.Blocks().NumBlocks();
+            r.NewBlock(0.0, s - 7, 5, data + s - 7);
+            CHECK(r.Blocks().NumBlocks() == n);
+
+            // Filling the hole at the front reuses space freed by trimming.
+            r.NewBlock(0.0, s, 3, data + s);
+            check(r.Blocks());
+            CHECK(r.Blocks().FirstBlock().seq == s);
+            CHECK(r.Blocks().NumBlocks() == n + 1);
+        }
+    }
+
+    SUBCASE("random") {
+        std::vector<bool> covered(sizeof(data));
+        uint64_t state = 42;
+
+        for ( int i = 0; i < 500; ++i ) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint64_t seq = (state >> 33) % 200;
+            uint64_t len = (state >> 20) % 40 + 1;
+
+            r.NewBlock(0.0, seq, len, data + seq);
+
+            for ( uint64_t s = seq; s < seq + len; ++s )
+                covered[s] = true;
+
+            if ( i % 100 == 99 ) {
+                check(r.Blocks());
+                CHECK(r.Blocks().DataSize() == static_cast<size_t>(std::count(covered.begin(), covered.end(), true)));
+            }
+        }
+    }
+
+    r.ClearBlocks();
+    r.ClearOldBlocks();
+    CHECK(Reassembler::MemoryAllocation(REASSEM_UNKNOWN) == 0);
+}
+
 } // namespace zeek
@@ -6,7 +6,7 @@
 #include <cassert>
 #include <cstdint>
 #include <cstring>
-#include <map>
+#include <vector>
 
 #include "zeek/Obj.h"
 
@@ -88,14 +88,18 @@ public:
     u_char* block;
 };
 
-using DataBlockMap = std::map<uint64_t, DataBlock>;
-
 /**
  * The data structure used for reassembling arbitrary sequences of data
- * blocks/segments.  It internally uses an ordered map (std::map).
+ * blocks/segments.  Blocks are kept sorted by sequence number and without
+ * overlap in a contiguous vector.  Reassembly mostly appends at the end and
+ * trims from the front, so blocks removed from the front only advance an
+ * offset into the vector, and the space gets reclaimed once it makes up
+ * half of the vector.
  */
 class DataBlockList {
 public:
+    using const_iterator = std::vector<DataBlock>::const_iterator;
+
     DataBlockList() {}
 
     DataBlockList(Reassembler* r) : reassembler(r) {}
@@ -105,20 +109,20 @@ public:
     /**
      * @return iterator to start of the block list.
      */
-    DataBlockMap::const_iterator Begin() const { return block_map.begin(); }
+    const_iterator Begin() const { return blocks.begin() + head; }
 
     /**
      * @return iterator to end of the block list (one past last element).
      */
-    DataBlockMap::const_iterator End() const { return block_map.end(); }
+    const_iterator End() const { return blocks.end(); }
 
     /**
      * @return reference to the first data block in the list.
      * Must not be called when the list is empty.
      */
     const DataBlock& FirstBlock() const {
-        assert(block_map.size());
-        return block_map.begin()->second;
+        assert(! Empty());
+        return blocks[head];
     }
 
     /**
@@ -126,19 +130,19 @@ public:
      * Must not be called when the list is empty.
      */
     const DataBlock& LastBlock() const {
-        assert(block_map.size());
-        return block_map.rbegin()->second;
+        assert(! Empty());
+        return blocks.back();
     }
 
     /**
      * @return whether the list is empty.
      */
-    bool Empty() const { return block_map.empty(); };
+    bool Empty() const { return head == blocks.size(); };
 
     /**
      * @return the number of blocks in the list.
      */
-    size_t NumBlocks() const { return block_map.size(); };
+    size_t NumBlocks() const { return blocks.size() - head; };
 
     /**
      * @return the total size, in bytes, of all blocks in the list.
@@ -162,16 +166,18 @@ public:
     void Clear();
 
     /**
-     * Insert a new data block into the list.
+     * Insert a new data block into the list.  Parts of the new data that
+     * overlap existing blocks are dropped, the remainder is inserted as one
+     * or more blocks filling the holes between existing ones.  Inserting
+     * invalidates all iterators into the list.
      * @param seq  lower sequence number of the data block
      * @param upper  highest sequence number of the data block
      * @param data  points to the data block contents
-     * @param hint  a suggestion of the node from which to start searching
-     * for an insertion point or null to search from the beginning of the list
-     * @return an iterator to the element that was inserted
+     * @return an iterator to the first element that was inserted, or, if
+     * the new data was entirely covered by existing blocks, to the last of
+     * those
      */
-    DataBlockMap::const_iterator Insert(uint64_t seq, uint64_t upper, const u_char* data,
-                                        DataBlockMap::const_iterator* hint = nullptr);
+    const_iterator Insert(uint64_t seq, uint64_t upper, const u_char* data);
 
     /**
      * Insert a new data block at the end of the list and remove blocks
@@ -199,39 +205,40 @@ public:
      * element exists, returns an iterator denoting one-past the end of the
      * list.
      */
-    DataBlockMap::const_iterator FirstBlockAtOrBefore(uint64_t seq) const;
+    const_iterator FirstBlockAtOrBefore(uint64_t seq) const;
 
 private:
     /**
-     * Insert a new data block into the list.
-     * @param seq  lower sequence number of the data block
-     * @param upper  highest sequence number of the data block
-     * @param data  points to the data block contents
-     * @param hint  a suggestion of the node from which to start searching
-     * for an insertion point
-     * @return an iterator to the element that was inserted
+     * Inserts a new data block at a given position of the vector and
+     * updates the size accounting.
+     * @param idx  the vector index before which to insert
+     * @return the vector index of the new block
      */
-    DataBlockMap::const_iterator Insert(uint64_t seq, uint64_t upper, const u_char* data,
-                                        DataBlockMap::const_iterator hint);
+    size_t InsertAt(size_t idx, uint64_t seq, uint64_t upper, const u_char* data);
 
     /**
-     * Removes a block from the list and updates other state which keeps
-     * track of total size of blocks.
-     * @param it  the element to remove
+     * Removes the first block from the list and updates other state which
+     * keeps track of total size of blocks.
      */
-    void Delete(DataBlockMap::const_iterator it);
+    void DeleteFirst();
 
     /**
-     * Removes a block from the list and returns it, assuming it will
-     * immediately be appended to another list.
-     * @param it  the element to remove
+     * Removes the first block from the list and returns it, assuming it
+     * will immediately be appended to another list.
      * @return the removed block
      */
-    DataBlock Remove(DataBlockMap::const_iterator it);
+    DataBlock RemoveFirst();
+
+    // Advances past the first block once it has been deleted or moved out.
+    void PopFirst();
 
     Reassembler* reassembler = nullptr;
     size_t total_data_size = 0;
-    DataBlockMap block_map;
+
+    // The list's blocks start at index "head"; the ones before are empty
+    // leftovers of removals from the front.
+    std::vector<DataBlock> blocks;
+    size_t head = 0;
 };
 
 class Reassembler : public Obj {
@@ -276,7 +283,7 @@ protected:
 
     virtual void Undelivered(uint64_t up_to_seq);
 
-    virtual void BlockInserted(DataBlockMap::const_iterator it) = 0;
+    virtual void BlockInserted(DataBlockList::const_iterator it) = 0;
     virtual void Overlap(const u_char* b1, const u_char* b2, uint64_t n) = 0;
 
     void CheckOverlap(const DataBlockList& list, uint64_t seq, uint64_t len, const u_char* data);
@@ -36,6 +36,7 @@ extern "C" {
 #include "zeek/iosource/PktSrc.h"
 #include "zeek/packet_analysis/Manager.h"
 #include "zeek/plugin/Manager.h"
+#include "zeek/script_opt/ScriptOpt.h"
 #include "zeek/session/Manager.h"
 
 static double last_watchdog_proc_time = 0.0; // value of above during last watchdog
@@ -316,6 +317,11 @@ void run_loop() {
 
         event_mgr.Drain();
 
+        // With no scripts executing, now's the time to switch hot
+        // bodies over to ZAM.
+        if ( zeek::detail::tiered_ZAM_active )
+            zeek::detail::compile_hot_ZAM_bodies();
+
         processing_start_time = 0.0; // = "we're not processing now"
         current_dispatched = 0;
         current_iosrc = nullptr;
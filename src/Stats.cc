@@ -36,6 +36,9 @@ uint64_t& tot_gap_events = zeek::detail::tot_gap_events;
 uint64_t zeek::detail::tot_gap_bytes = 0;
 uint64_t& tot_gap_bytes = zeek::detail::tot_gap_bytes;
 
+uint64_t zeek::detail::tot_tcp_unbuffered_bytes = 0;
+uint64_t zeek::detail::tot_tcp_buffered_bytes = 0;
+
 namespace zeek::detail {
 
 class ProfileTimer final : public Timer {
@@ -197,11 +200,13 @@ void ProfileLogger::Log() {
     const threading::Manager::msg_stats_list& thread_stats = thread_mgr->GetMsgThreadStats();
     for ( const auto& [name, s] : thread_stats ) {
         file->Write(util::fmt("%0.6f   %-25s in=%" PRIu64 " out=%" PRIu64 " pending=%" PRIu64 "/%" PRIu64
-                              " (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
+                              " (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64
+                              " full: in=%" PRIu64 " out=%" PRIu64 " max: in=%" PRIu64 " out=%" PRIu64 ")"
                               "\n",
                               run_state::network_time, name.c_str(), s.sent_in, s.sent_out, s.pending_in, s.pending_out,
                               s.queue_in_stats.num_reads, s.queue_in_stats.num_writes, s.queue_out_stats.num_reads,
-                              s.queue_out_stats.num_writes));
+                              s.queue_out_stats.num_writes, s.queue_in_stats.num_full, s.queue_out_stats.num_full,
+                              s.queue_in_stats.max_pending, s.queue_out_stats.max_pending));
     }
 
     auto cs = broker_mgr->GetStatistics();
@@ -39,6 +39,11 @@ extern uint64_t tot_ack_bytes;
 extern uint64_t tot_gap_events;
 extern uint64_t tot_gap_bytes;
 
+// TCP payload delivered directly from packets vs. through the reassembly
+// buffer.
+extern uint64_t tot_tcp_unbuffered_bytes;
+extern uint64_t tot_tcp_buffered_bytes;
+
 class PacketProfiler {
 public:
     PacketProfiler(unsigned int mode, double freq, File* arg_file);
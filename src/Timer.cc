@@ -98,6 +98,20 @@ void TimerMgr::InitPostScript() {
 
     dispatch_all_expired = zeek::detail::max_timer_expires == 0;
 
+    if ( BifConst::timer_wheel && ! wheel ) {
+        if ( BifConst::timer_wheel_resolution <= 0.0 )
+            reporter->FatalError("timer_wheel_resolution must be positive");
+
+        wheel = std::make_unique<TimerWheel>(BifConst::timer_wheel_resolution);
+
+        while ( auto* timer = q->Remove() )
+            wheel->Add(timer);
+
+        // Keep the statistics, and the counter reporting them, going.
+        wheel->InheritStats(q->PeakSize(), q->CumulativeNum());
+        q.reset();
+    }
+
     cumulative_num_metric =
         telemetry_mgr->CounterInstance("zeek", "timers", {}, "Cumulative number of timers", "",
                                        []() { return static_cast<double>(timer_mgr->CumulativeNum()); });
@@ -121,13 +135,16 @@ void TimerMgr::Add(Timer* timer) {
     // Add the timer even if it's already expired - that way, if
     // multiple already-added timers are added, they'll still
     // execute in sorted order.
-    if ( ! q->Add(timer) )
+    if ( ! (wheel ? wheel->Add(timer) : q->Add(timer)) )
         reporter->InternalError("out of memory");
 
     ++current_timers[timer->Type()];
 }
 
 void TimerMgr::Expire() {
+    if ( wheel )
+        wheel->Advance(HUGE_VAL);
+
     Timer* timer;
     while ( (timer = Remove()) ) {
         DBG_LOG(DBG_TM, "Dispatching timer %s (%p)", timer_type_to_string(timer->Type()), timer);
@@ -138,6 +155,9 @@ void TimerMgr::Expire() {
 }
 
 int TimerMgr::DoAdvance(double new_t, int max_expire) {
+    if ( wheel )
+        wheel->Advance(new_t);
+
     Timer* timer = Top();
     for ( num_expired = 0; (num_expired < max_expire || dispatch_all_expired) && timer && timer->Time() <= new_t;
           ++num_expired ) {
@@ -160,7 +180,7 @@ int TimerMgr::DoAdvance(double new_t, int max_expire) {
 }
 
 void TimerMgr::Remove(Timer* timer) {
-    if ( ! q->Remove(timer) )
+    if ( ! (wheel ? wheel->Remove(timer) : q->Remove(timer)) )
         reporter->InternalError("asked to remove a missing timer");
 
     --current_timers[timer->Type()];
@@ -168,6 +188,16 @@ void TimerMgr::Remove(Timer* timer) {
 }
 
 double TimerMgr::GetNextTimeout() {
+    if ( wheel ) {
+        // The wheel may only know a lower bound, which at worst
+        // advances a bit earlier than needed.
+        double next = wheel->NextTime();
+        if ( next >= 0 )
+            return std::max(0.0, next - run_state::network_time);
+
+        return -1;
+    }
+
     Timer* top = Top();
     if ( top )
         return std::max(0.0, top->Time() - run_state::network_time);
@@ -175,8 +205,8 @@ double TimerMgr::GetNextTimeout() {
     return -1;
 }
 
-Timer* TimerMgr::Remove() { return (Timer*)q->Remove(); }
+Timer* TimerMgr::Remove() { return (Timer*)(wheel ? wheel->Remove() : q->Remove()); }
 
-Timer* TimerMgr::Top() { return (Timer*)q->Top(); }
+Timer* TimerMgr::Top() { return (Timer*)(wheel ? wheel->Top() : q->Top()); }
 
 } // namespace zeek::detail
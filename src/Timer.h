@@ -6,6 +6,7 @@
 #include <memory>
 
 #include "zeek/PriorityQueue.h"
+#include "zeek/TimerWheel.h"
 #include "zeek/iosource/IOSource.h"
 
 namespace zeek {
@@ -122,9 +123,9 @@ public:
 
     double Time() const { return t ? t : 1; } // 1 > 0
 
-    size_t Size() const { return q->Size(); }
-    size_t PeakSize() const { return q->PeakSize(); }
-    size_t CumulativeNum() const { return q->CumulativeNum(); }
+    size_t Size() const { return wheel ? wheel->Size() : q->Size(); }
+    size_t PeakSize() const { return wheel ? wheel->PeakSize() : q->PeakSize(); }
+    size_t CumulativeNum() const { return wheel ? wheel->CumulativeNum() : q->CumulativeNum(); }
 
     double LastTimestamp() const { return last_timestamp; }
 
@@ -142,7 +143,9 @@ public:
 
     /**
      * Performs some extra initialization on a timer manager. This shouldn't
-     * need to be called for managers other than the global one.
+     * need to be called for managers other than the global one. This
+     * switches to a timing wheel if the timer_wheel option is set, taking
+     * over any timers added before.
      */
     void InitPostScript();
 
@@ -168,7 +171,9 @@ private:
     telemetry::GaugePtr lag_time_metric;
     telemetry::GaugePtr current_timer_metrics[NUM_TIMER_TYPES];
 
+    // Exactly one of these holds the pending timers.
     std::unique_ptr<PriorityQueue> q;
+    std::unique_ptr<TimerWheel> wheel;
 };
 
 extern TimerMgr* timer_mgr;
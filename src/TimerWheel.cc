@@ -0,0 +1,311 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/TimerWheel.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+TimerWheel::TimerWheel(double arg_resolution) : resolution(arg_resolution) {
+    for ( auto& h : heads )
+        h = -1;
+}
+
+TimerWheel::~TimerWheel() {
+    for ( const auto& n : nodes )
+        delete n.element;
+}
+
+uint64_t TimerWheel::Tick(double t) const {
+    if ( ! (t > 0.0) )
+        return 0;
+
+    double ticks = t / resolution;
+    if ( ticks >= static_cast<double>(std::numeric_limits<uint64_t>::max()) )
+        return std::numeric_limits<uint64_t>::max();
+
+    return static_cast<uint64_t>(ticks);
+}
+
+bool TimerWheel::Add(PQ_Element* e) {
+    int n;
+
+    if ( free_nodes >= 0 ) {
+        n = free_nodes;
+        free_nodes = nodes[n].next;
+    }
+    else {
+        n = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    nodes[n] = {e, Tick(e->Time()), -1, -1, -1};
+    ++num_pending;
+    ++cumulative_num;
+
+    Place(n);
+
+    if ( Size() > peak_size )
+        peak_size = Size();
+
+    return true;
+}
+
+void TimerWheel::Place(int n) {
+    Node& node = nodes[n];
+
+    if ( node.tick <= elapsed ) {
+        PQ_Element* e = node.element;
+        FreeNode(n);
+        --num_pending;
+        due.Add(e);
+        return;
+    }
+
+    // The level is determined by the highest bit in which the tick differs
+    // from the current one, so that a slot on a level gets reached only
+    // after all slots on lower levels.
+    uint64_t masked = (elapsed ^ node.tick) | (NUM_SLOTS - 1);
+    int level = (63 - std::countl_zero(masked)) / SLOT_BITS;
+    int slot = level * NUM_SLOTS + static_cast<int>((node.tick >> (level * SLOT_BITS)) & (NUM_SLOTS - 1));
+
+    node.slot = slot;
+    node.prev = -1;
+    node.next = heads[slot];
+
+    if ( node.next >= 0 )
+        nodes[node.next].prev = n;
+
+    heads[slot] = n;
+    occupied[level] |= uint64_t(1) << (slot % NUM_SLOTS);
+    node.element->SetOffset(n);
+}
+
+void TimerWheel::Unlink(int n) {
+    Node& node = nodes[n];
+
+    if ( node.prev >= 0 )
+        nodes[node.prev].next = node.next;
+    else {
+        heads[node.slot] = node.next;
+
+        if ( node.next < 0 )
+            occupied[node.slot / NUM_SLOTS] &= ~(uint64_t(1) << (node.slot % NUM_SLOTS));
+    }
+
+    if ( node.next >= 0 )
+        nodes[node.next].prev = node.prev;
+}
+
+void TimerWheel::FreeNode(int n) {
+    nodes[n].element = nullptr;
+    nodes[n].next = free_nodes;
+    free_nodes = n;
+}
+
+PQ_Element* TimerWheel::Remove() { return due.Remove(); }
+
+PQ_Element* TimerWheel::Remove(PQ_Element* e) {
+    int n = e->Offset();
+
+    if ( n >= 0 && n < static_cast<int>(nodes.size()) && nodes[n].element == e ) {
+        Unlink(n);
+        FreeNode(n);
+        --num_pending;
+        e->SetOffset(-1);
+        return e;
+    }
+
+    return due.Remove(e);
+}
+
+bool TimerWheel::NextExpiration(int* level, uint64_t* deadline) const {
+    for ( int l = 0; l < NUM_LEVELS; ++l ) {
+        if ( ! occupied[l] )
+            continue;
+
+        // Lower levels always hold earlier ticks, so the first occupied
+        // slot at or after the current position on the lowest non-empty
+        // level is the next one due.
+        int shift = l * SLOT_BITS;
+        int now_slot = static_cast<int>((elapsed >> shift) & (NUM_SLOTS - 1));
+        int slot = (std::countr_zero(std::rotr(occupied[l], now_slot)) + now_slot) & (NUM_SLOTS - 1);
+
+        uint64_t level_mask =
+            shift + SLOT_BITS >= 64 ? std::numeric_limits<uint64_t>::max() : (uint64_t(1) << (shift + SLOT_BITS)) - 1;
+        uint64_t d = (elapsed & ~level_mask) + (uint64_t(slot) << shift);
+
+        if ( d < elapsed )
+            d += level_mask + 1;
+
+        *level = l;
+        *deadline = d;
+        return true;
+    }
+
+    return false;
+}
+
+void TimerWheel::Advance(double t) {
+    uint64_t target = Tick(t);
+    int level;
+    uint64_t deadline;
+
+    while ( NextExpiration(&level, &deadline) && deadline <= target ) {
+        elapsed = deadline;
+
+        int slot = level * NUM_SLOTS + static_cast<int>((deadline >> (level * SLOT_BITS)) & (NUM_SLOTS - 1));
+        int n = heads[slot];
+
+        heads[slot] = -1;
+        occupied[level] &= ~(uint64_t(1) << (slot % NUM_SLOTS));
+
+        // Redistribute the slot's nodes, which moves them to lower levels
+        // or into the due queue.
+        while ( n >= 0 ) {
+            int next = nodes[n].next;
+            Place(n);
+            n = next;
+        }
+    }
+
+    if ( target > elapsed )
+        elapsed = target;
+}
+
+double TimerWheel::NextTime() const {
+    double next = -1;
+
+    if ( const auto* top = due.Top() )
+        next = top->Time();
+
+    int level;
+    uint64_t deadline;
+
+    if ( NextExpiration(&level, &deadline) ) {
+        double start = static_cast<double>(deadline) * resolution;
+        if ( next < 0 || start < next )
+            next = start;
+    }
+
+    return next;
+}
+
+TEST_CASE("timer wheel") {
+    TimerWheel wheel(0.001);
+    std::multimap<double, PQ_Element*> reference;
+    std::set<PQ_Element*> expired;
+
+    auto add = [&](double t) {
+        auto* e = new PQ_Element(t);
+        wheel.Add(e);
+        reference.emplace(t, e);
+        return e;
+    };
+
+    // Advances to t and checks that exactly the elements up to t come out,
+    // in order.
+    auto advance = [&](double t) {
+        wheel.Advance(t);
+
+        while ( auto* e = wheel.Top() ) {
+            if ( e->Time() > t )
+                break;
+
+            REQUIRE(! reference.empty());
+            CHECK(e->Time() == reference.begin()->first);
+            reference.erase(reference.find(e->Time()));
+            CHECK(wheel.Remove() == e);
+            expired.insert(e);
+            delete e;
+        }
+
+        CHECK(reference.empty() == (wheel.Size() == 0));
+
+        if ( ! reference.empty() ) {
+            CHECK(reference.begin()->first > t);
+            CHECK(wheel.NextTime() <= reference.begin()->first);
+        }
+    };
+
+    SUBCASE("inherited stats") {
+        add(10.0);
+        add(20.0);
+        wheel.InheritStats(5, 100);
+        CHECK(wheel.PeakSize() == 5);
+        CHECK(wheel.CumulativeNum() == 100);
+
+        add(30.0);
+        CHECK(wheel.CumulativeNum() == 101);
+
+        advance(std::numeric_limits<double>::infinity());
+        CHECK(wheel.PeakSize() == 5);
+    }
+
+    SUBCASE("empty") {
+        CHECK(wheel.Top() == nullptr);
+        CHECK(wheel.NextTime() == -1);
+        wheel.Advance(1e9);
+        CHECK(wheel.Size() == 0);
+    }
+
+    SUBCASE("ordering across levels") {
+        double now = 1.7e9;
+        wheel.Advance(now);
+
+        for ( double d : {0.0005, 0.01, 0.1, 5.0, 300.0, 3600.0, 86400.0, 1e7, -1.0, 0.0} )
+            add(now + d);
+
+        for ( double d : {0.0, 0.001, 1.0, 10.0, 1000.0, 1e5, 1e8} )
+            advance(now + d);
+
+        CHECK(wheel.Size() == 0);
+    }
+
+    SUBCASE("random with cancellation") {
+        std::mt19937_64 rng(42);
+        std::uniform_real_distribution<double> delay(0.0, 600.0);
+        std::vector<PQ_Element*> live;
+        double now = 1000.0;
+
+        for ( int round = 0; round < 200; ++round ) {
+            for ( int i = 0; i < 100; ++i )
+                live.push_back(add(now + delay(rng) * (i % 10 == 0 ? 100 : 1)));
+
+            // Cancel some, which may sit in the wheel or in the due queue.
+            for ( int i = 0; i < 30 && ! live.empty(); ++i ) {
+                size_t idx = rng() % live.size();
+                PQ_Element* e = live[idx];
+                live[idx] = live.back();
+                live.pop_back();
+
+                auto [first, last] = reference.equal_range(e->Time());
+                auto it = std::find_if(first, last, [e](const auto& entry) { return entry.second == e; });
+                REQUIRE(it != last);
+                reference.erase(it);
+
+                CHECK(wheel.Remove(e) == e);
+                delete e;
+            }
+
+            now += delay(rng) / 10;
+            advance(now);
+
+            std::erase_if(live, [&](PQ_Element* e) { return expired.count(e) > 0; });
+            expired.clear();
+        }
+
+        advance(std::numeric_limits<double>::infinity());
+        CHECK(wheel.Size() == 0);
+    }
+}
+
+} // namespace zeek::detail
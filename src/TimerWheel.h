@@ -0,0 +1,123 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "zeek/PriorityQueue.h"
+
+namespace zeek::detail {
+
+/**
+ * Hierarchical timing wheel holding PQ_Elements, as an alternative to a
+ * plain PriorityQueue for large numbers of pending timers.
+ *
+ * Time is divided into ticks of a fixed resolution. Elements are kept in
+ * unsorted per-slot lists on a number of levels, each level having 64
+ * slots that span 64 times the range of the level below. Adding and
+ * removing elements is O(1). Advancing moves whole slots at once: slots
+ * of higher levels get redistributed to lower ones as time approaches
+ * them, and elements whose tick has been reached go into a small
+ * PriorityQueue from which they are handed out in exact time order.
+ *
+ * Elements reuse their offset for indexing the wheel's bookkeeping.
+ */
+class TimerWheel {
+public:
+    /**
+     * Constructor.
+     *
+     * @param resolution The length of a tick in seconds.
+     */
+    explicit TimerWheel(double resolution);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /**
+     * Makes all elements with a time in a tick up to the one of t
+     * available through Top() and Remove().
+     */
+    void Advance(double t);
+
+    // Returns the element due next among those up to the last tick
+    // advanced to, or nil if there's none.
+    PQ_Element* Top() const { return due.Top(); }
+
+    // Removes (and returns) the element Top() returns.
+    PQ_Element* Remove();
+
+    // Removes element e.  Returns e, or nullptr if e wasn't in the wheel.
+    PQ_Element* Remove(PQ_Element* e);
+
+    // Add a new element to the wheel.
+    bool Add(PQ_Element* e);
+
+    /**
+     * Returns a lower bound on the time of the next element, or -1 if
+     * the wheel is empty. Elements that haven't been advanced to yet are
+     * only known by the start of their slot.
+     */
+    double NextTime() const;
+
+    int Size() const { return num_pending + due.Size(); }
+    int PeakSize() const { return peak_size; }
+    uint64_t CumulativeNum() const { return cumulative_num; }
+
+    /**
+     * Continues the statistics of a queue whose elements have been moved
+     * into the wheel, which already counted them.
+     */
+    void InheritStats(int arg_peak_size, uint64_t arg_cumulative_num) {
+        peak_size = std::max(peak_size, arg_peak_size);
+        cumulative_num = arg_cumulative_num;
+    }
+
+private:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int NUM_SLOTS = 1 << SLOT_BITS;
+
+    // Enough levels to cover all 64-bit ticks.
+    static constexpr int NUM_LEVELS = (64 + SLOT_BITS - 1) / SLOT_BITS;
+
+    struct Node {
+        PQ_Element* element;
+        uint64_t tick;
+        int prev;
+        int next;
+        int slot; // level * NUM_SLOTS + slot index
+    };
+
+    uint64_t Tick(double t) const;
+
+    // Files a node into the slot for its tick, or into the due queue if
+    // its tick has been reached already.
+    void Place(int n);
+
+    void Unlink(int n);
+    void FreeNode(int n);
+
+    // Finds the next slot to process, returning false if the wheel is
+    // empty.
+    bool NextExpiration(int* level, uint64_t* deadline) const;
+
+    double resolution;
+    uint64_t elapsed = 0;
+
+    int heads[NUM_LEVELS * NUM_SLOTS];
+    uint64_t occupied[NUM_LEVELS] = {};
+
+    std::vector<Node> nodes;
+    int free_nodes = -1;
+
+    PriorityQueue due;
+
+    int num_pending = 0;
+    int peak_size = 0;
+    uint64_t cumulative_num = 0;
+};
+
+} // namespace zeek::detail
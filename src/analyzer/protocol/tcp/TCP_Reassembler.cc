@@ -2,6 +2,8 @@
 
 #include "zeek/analyzer/protocol/tcp/TCP_Reassembler.h"
 
+#include <algorithm>
+
 #include "zeek/File.h"
 #include "zeek/Reporter.h"
 #include "zeek/RuleMatcher.h"
@@ -92,7 +94,7 @@ void TCP_Reassembler::SetContentsFile(FilePtr f) {
     }
     else {
         if ( ! block_list.Empty() )
-            RecordToSeq(block_list.Begin()->second.seq, last_reassem_seq, f);
+            RecordToSeq(block_list.Begin()->seq, last_reassem_seq, f);
     }
 
     record_contents_file = std::move(f);
@@ -203,7 +205,7 @@ void TCP_Reassembler::Undelivered(uint64_t up_to_seq) {
             auto it = block_list.Begin();
 
             while ( it != block_list.End() ) {
-                const auto& b = it->second;
+                const auto& b = *it;
 
                 if ( b.seq < last_reassem_seq ) {
                     // Already delivered this block.
@@ -269,7 +271,7 @@ void TCP_Reassembler::MatchUndelivered(uint64_t up_to_seq, bool use_last_upper)
     // block?
 
     for ( auto it = block_list.Begin(); it != block_list.End(); ++it ) {
-        const auto& b = it->second;
+        const auto& b = *it;
 
         if ( b.upper > last_reassem_seq )
             break;
@@ -287,7 +289,7 @@ void TCP_Reassembler::RecordToSeq(uint64_t start_seq, uint64_t stop_seq, const F
     auto it = block_list.Begin();
 
     // Skip over blocks up to the start seq.
-    while ( it != block_list.End() && it->second.upper <= start_seq )
+    while ( it != block_list.End() && it->upper <= start_seq )
         ++it;
 
     if ( it == block_list.End() )
@@ -295,8 +297,8 @@ void TCP_Reassembler::RecordToSeq(uint64_t start_seq, uint64_t stop_seq, const F
 
     uint64_t last_seq = start_seq;
 
-    while ( it != block_list.End() && it->second.upper <= stop_seq ) {
-        const auto& b = it->second;
+    while ( it != block_list.End() && it->upper <= stop_seq ) {
+        const auto& b = *it;
 
         if ( b.seq > last_seq )
             RecordGap(last_seq, b.seq, f);
@@ -336,8 +338,8 @@ void TCP_Reassembler::RecordGap(uint64_t start_seq, uint64_t upper_seq, const Fi
                                        make_intrusive<StringVal>("TCP reassembler gap write failure"));
 }
 
-void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it) {
-    const auto& start_block = it->second;
+void TCP_Reassembler::BlockInserted(DataBlockList::const_iterator it) {
+    const auto& start_block = *it;
 
     assert(start_block.seq < start_block.upper);
     if ( start_block.seq > last_reassem_seq || start_block.upper <= last_reassem_seq )
@@ -350,7 +352,7 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it) {
     // loop we have to take care not to deliver already-delivered
     // data.
     while ( it != block_list.End() ) {
-        const auto& b = it->second;
+        const auto& b = *it;
 
         if ( b.seq > last_reassem_seq )
             break;
@@ -363,12 +365,59 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it) {
             if ( record_contents_file )
                 RecordBlock(b, record_contents_file);
 
+            zeek::detail::tot_tcp_buffered_bytes += len;
             DeliverBlock(seq, len, b.block);
         }
 
         ++it;
     }
 
+    TrimDelivered();
+}
+
+bool TCP_Reassembler::DeliverUnbuffered(uint64_t seq, int len, const u_char* data) {
+    // Data needs to be kept around for checking retransmissions against
+    // it, for recording it, and for going after data already buffered.
+    if ( len <= 0 || ! block_list.Empty() || record_contents_file || max_old_blocks || rexmit_inconsistency )
+        return false;
+
+    uint64_t upper_seq = seq + len;
+
+    if ( seq != last_reassem_seq ) {
+        // A retransmission of data that took this path before just needs
+        // its new part delivered.
+        if ( unbuffered_upper != last_reassem_seq || seq < unbuffered_seq || seq > last_reassem_seq )
+            return false;
+
+        if ( upper_seq <= last_reassem_seq )
+            return true;
+
+        data += last_reassem_seq - seq;
+        len -= last_reassem_seq - seq;
+        seq = last_reassem_seq;
+    }
+    else if ( unbuffered_upper != seq )
+        unbuffered_seq = seq;
+
+    last_reassem_seq = upper_seq;
+    unbuffered_upper = upper_seq;
+
+    zeek::detail::tot_tcp_unbuffered_bytes += len;
+    DeliverBlock(seq, len, data);
+
+    TrimDelivered();
+    return true;
+}
+
+uint64_t TCP_Reassembler::UnackedUnbufferedBytes() const {
+    if ( skip_deliveries )
+        return 0;
+
+    uint64_t lower = std::max(unbuffered_seq, trim_seq);
+    return unbuffered_upper > lower ? unbuffered_upper - lower : 0;
+}
+
+void TCP_Reassembler::TrimDelivered() {
     TCP_Endpoint* e = endp;
 
     if ( ! e->peer->HasContents() )
@@ -445,7 +494,10 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len, const u_char* da
     }
 
     flags = arg_flags;
-    NewBlock(t, seq, len, data);
+
+    if ( ! DeliverUnbuffered(seq, len, data) )
+        NewBlock(t, seq, len, data);
+
     flags = TCP_Flags();
 
     if ( Endpoint()->NoDataAcked() && zeek::detail::tcp_max_above_hole_without_any_acks &&
@@ -456,7 +508,8 @@ bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len, const u_char* da
     }
 
     if ( zeek::detail::tcp_excessive_data_without_further_acks &&
-         block_list.DataSize() > static_cast<uint64_t>(zeek::detail::tcp_excessive_data_without_further_acks) ) {
+         block_list.DataSize() + UnackedUnbufferedBytes() >
+             static_cast<uint64_t>(zeek::detail::tcp_excessive_data_without_further_acks) ) {
         tcp_analyzer->Weird("excessive_data_without_further_acks");
         ClearBlocks();
         skip_deliveries = true;
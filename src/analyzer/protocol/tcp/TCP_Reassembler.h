@@ -72,7 +72,7 @@ public:
     // when so.
     void CheckEOF();
 
-    bool HasUndeliveredData() const { return HasBlocks(); }
+    bool HasUndeliveredData() const { return HasBlocks() || UnackedUnbufferedBytes() > 0; }
     bool HadGap() const { return had_gap; }
     bool DataPending() const;
     uint64_t DataSeq() const { return LastReassemSeq(); }
@@ -95,9 +95,26 @@ private:
     void RecordBlock(const DataBlock& b, const FilePtr& f);
     void RecordGap(uint64_t start_seq, uint64_t upper_seq, const FilePtr& f);
 
-    void BlockInserted(DataBlockMap::const_iterator it) override;
+    void BlockInserted(DataBlockList::const_iterator it) override;
     void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
 
+    // Delivers in-order data directly from the packet without copying it
+    // into a block, if nothing needs the data retained.  Returns false if
+    // the data needs to go through the block list instead.
+    //
+    // Retransmissions can only be compared against retained data, so
+    // data delivered this way can't raise rexmit_inconsistency.  We
+    // hence only take this path when there's no handler for that event.
+    bool DeliverUnbuffered(uint64_t seq, int len, const u_char* data);
+
+    // Returns the amount of data delivered by DeliverUnbuffered() that
+    // hasn't been acked yet, i.e., what the block list would otherwise
+    // still hold on to.
+    uint64_t UnackedUnbufferedBytes() const;
+
+    // Trims delivered data if we can't expect to see acks for it.
+    void TrimDelivered();
+
     TCP_Endpoint* endp;
 
     bool deliver_tcp_contents;
@@ -110,6 +127,10 @@ private:
 
     uint64_t seq_to_skip;
 
+    // The range most recently delivered by DeliverUnbuffered().
+    uint64_t unbuffered_seq = 0;
+    uint64_t unbuffered_upper = 0;
+
     FilePtr record_contents_file; // file on which to reassemble contents
 
     analyzer::Analyzer* dst_analyzer;
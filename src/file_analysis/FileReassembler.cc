@@ -40,14 +40,14 @@ uint64_t FileReassembler::FlushTo(uint64_t sequence) {
     return rval;
 }
 
-void FileReassembler::BlockInserted(DataBlockMap::const_iterator it) {
-    const auto& start_block = it->second;
+void FileReassembler::BlockInserted(DataBlockList::const_iterator it) {
+    const auto& start_block = *it;
     assert(start_block.seq < start_block.upper);
     if ( start_block.seq > last_reassem_seq || start_block.upper <= last_reassem_seq )
         return;
 
     while ( it != block_list.End() ) {
-        const auto& b = it->second;
+        const auto& b = *it;
 
         if ( b.seq > last_reassem_seq )
             break;
@@ -70,7 +70,7 @@ void FileReassembler::Undelivered(uint64_t up_to_seq) {
     auto it = block_list.Begin();
 
     while ( it != block_list.End() ) {
-        const auto& b = it->second;
+        const auto& b = *it;
 
         if ( b.seq < last_reassem_seq ) {
             // Already delivered this block.
@@ -48,7 +48,7 @@ public:
 
 protected:
     void Undelivered(uint64_t up_to_seq) override;
-    void BlockInserted(DataBlockMap::const_iterator it) override;
+    void BlockInserted(DataBlockList::const_iterator it) override;
     void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
 
     File* the_file = nullptr;
@@ -3,6 +3,7 @@
 #include "zeek/file_analysis/analyzer/extract/Extract.h"
 
 #include <fcntl.h>
+#include <unistd.h>
 #include <string>
 
 #include "zeek/file_analysis/Manager.h"
@@ -17,30 +18,39 @@ Extract::Extract(RecordValPtr args, file_analysis::File* file, std::string arg_f
       filename(std::move(arg_filename)),
       limit(arg_limit),
       limit_includes_missing(arg_limit_includes_missing) {
-    char buf[128];
-    file_stream = fopen(filename.data(), "wb");
-
-    if ( file_stream ) {
-        // Try to ensure full buffering.
-        if ( util::detail::setvbuf(file_stream, nullptr, _IOFBF, BUFSIZ) ) {
-            util::zeek_strerror_r(errno, buf, sizeof(buf));
-            reporter->Warning("cannot set buffering mode for %s: %s", filename.data(), buf);
-        }
-    }
+    fd = open(filename.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+    if ( fd >= 0 )
+        // Writes happen in the background, so that extracting a burst of
+        // data doesn't hold up analysis while the disk is busy.
+        output = std::make_unique<zeek::detail::AsyncFileWriter>(fd);
     else {
+        char buf[128];
         util::zeek_strerror_r(errno, buf, sizeof(buf));
         reporter->Error("cannot open %s: %s", filename.c_str(), buf);
     }
 }
 
 Extract::~Extract() {
-    if ( file_stream && fclose(file_stream) ) {
+    if ( output && ! Close() ) {
         char buf[128];
         util::zeek_strerror_r(errno, buf, sizeof(buf));
         reporter->Error("cannot close %s: %s", filename.data(), buf);
     }
 }
 
+bool Extract::Close() {
+    // Both leave errno set on failure.
+    bool ok = output->Sync();
+    output = nullptr;
+
+    if ( close(fd) != 0 )
+        ok = false;
+
+    fd = -1;
+    return ok;
+}
+
 static ValPtr get_extract_field_val(const RecordValPtr& args, const char* name) {
     const auto& rval = args->GetField(name);
 
@@ -92,7 +102,7 @@ static bool check_limit_exceeded(uint64_t lim, uint64_t written, uint64_t len, u
 }
 
 bool Extract::DeliverStream(const u_char* data, uint64_t len) {
-    if ( ! file_stream )
+    if ( ! output )
         return false;
 
     uint64_t towrite = 0;
@@ -106,14 +116,10 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len) {
         limit_exceeded = check_limit_exceeded(limit, written, len, &towrite);
     }
 
-    char buf[128];
-
     if ( towrite > 0 ) {
-        if ( fwrite(data, towrite, 1, file_stream) != 1 ) {
-            util::zeek_strerror_r(errno, buf, sizeof(buf));
-            reporter->Error("failed to write to extracted file %s: %s", filename.data(), buf);
-            fclose(file_stream);
-            file_stream = nullptr;
+        if ( ! output->Write(reinterpret_cast<const char*>(data), towrite) ) {
+            reporter->Error("failed to write to extracted file %s: %s", filename.data(), output->Error().c_str());
+            Close();
             return false;
         }
 
@@ -124,16 +130,14 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len) {
     // the extraction limit and the file analysis File still proceeding to
     // do other analysis without destructing/closing this one until the very end,
     // so flush anything currently buffered.
-    if ( limit_exceeded && fflush(file_stream) ) {
-        util::zeek_strerror_r(errno, buf, sizeof(buf));
-        reporter->Warning("cannot fflush extracted file %s: %s", filename.data(), buf);
-    }
+    if ( limit_exceeded && ! output->Flush() )
+        reporter->Warning("cannot flush extracted file %s: %s", filename.data(), output->Error().c_str());
 
     return (! limit_exceeded);
 }
 
 bool Extract::Undelivered(uint64_t offset, uint64_t len) {
-    if ( ! file_stream )
+    if ( ! output )
         return false;
 
     if ( limit_includes_missing ) {
@@ -156,12 +160,9 @@ bool Extract::Undelivered(uint64_t offset, uint64_t len) {
         written += len;
     }
 
-    if ( fseek(file_stream, len + offset, SEEK_SET) != 0 ) {
-        char buf[128];
-        util::zeek_strerror_r(errno, buf, sizeof(buf));
-        reporter->Error("failed to seek in extracted file %s: %s", filename.data(), buf);
-        fclose(file_stream);
-        file_stream = nullptr;
+    if ( ! output->Seek(len + offset) ) {
+        reporter->Error("failed to seek in extracted file %s: %s", filename.data(), output->Error().c_str());
+        Close();
         return false;
     }
 
@@ -2,9 +2,10 @@
 
 #pragma once
 
-#include <cstdio>
+#include <memory>
 #include <string>
 
+#include "zeek/AsyncFileWriter.h"
 #include "zeek/Val.h"
 #include "zeek/file_analysis/Analyzer.h"
 #include "zeek/file_analysis/File.h"
@@ -68,8 +69,12 @@ protected:
             bool arg_limit_includes_missing);
 
 private:
+    // Waits for outstanding writes and closes the file.
+    bool Close();
+
     std::string filename;
-    FILE* file_stream = nullptr;
+    int fd = -1;
+    std::unique_ptr<zeek::detail::AsyncFileWriter> output; // Writes in the background; null once closed.
     uint64_t limit = 0;                  // the file extraction limit
     uint64_t written = 0;                // how many bytes we have written so far
     bool limit_includes_missing = false; // do count missing bytes against limit if true
@@ -47,6 +47,7 @@ extern bool parse_only;
 extern std::vector<std::string> zeek_script_prefixes; // -p flag
 extern const char* command_line_policy;               // -e flag
 extern std::vector<std::string> params;
+extern std::string command_line_scripts; // what we parsed from the above two
 
 extern Stmt* stmts; // global statements
 
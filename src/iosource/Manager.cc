@@ -2,15 +2,11 @@
 
 #include "zeek/iosource/Manager.h"
 
-#include <cassert>
-// These two files have to remain in the same order or FreeBSD builds
-// stop working.
-// clang-format off
-#include <sys/types.h>
-#include <sys/event.h>
-// clang-format on
 #include <sys/time.h>
 #include <unistd.h>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
 
 #include "zeek/RunState.h"
 #include "zeek/iosource/Component.h"
@@ -42,9 +38,12 @@ void Manager::WakeupHandler::Ping(std::string_view where) {
 }
 
 Manager::Manager() {
-    event_queue = kqueue();
-    if ( event_queue == -1 )
-        reporter->FatalError("Failed to initialize kqueue: %s", strerror(errno));
+    std::string errmsg;
+    poller = detail::Poller::Create(&errmsg);
+    if ( ! poller )
+        reporter->FatalError("%s", errmsg.c_str());
+
+    DBG_LOG(DBG_MAINLOOP, "Using %s to poll IO sources", poller->Name());
 }
 
 Manager::~Manager() {
@@ -73,18 +72,6 @@ Manager::~Manager() {
 
     // Was registered without lifetime management.
     delete pkt_src;
-
-#ifndef _MSC_VER
-    // There's a bug here with builds on Windows that causes an assertion with debug builds
-    // related to libkqueue returning a zero for the file descriptor. The assert happens
-    // because something else has already closed FD zero by the time we get here, and Windows
-    // doesn't like that very much. We only do this close when shutting down, so it should
-    // be fine to just skip it.
-    //
-    // See https://github.com/mheily/libkqueue/issues/151 for more details.
-    if ( event_queue != -1 )
-        close(event_queue);
-#endif
 }
 
 void Manager::InitPostScript() {
@@ -186,15 +173,15 @@ void Manager::FindReadySources(ReadySources* ready) {
 }
 
 void Manager::Poll(ReadySources* ready, double timeout, IOSource* timeout_src) {
-    struct timespec kqueue_timeout;
-    ConvertTimeout(timeout, kqueue_timeout);
+    struct timespec poll_timeout;
+    ConvertTimeout(timeout, poll_timeout);
 
-    int ret = kevent(event_queue, nullptr, 0, events.data(), events.size(), &kqueue_timeout);
+    int ret = poller->Wait(&events, poll_timeout);
     if ( ret == -1 ) {
         // Ignore interrupts since we may catch one during shutdown and we don't want the
         // error to get printed.
         if ( errno != EINTR )
-            reporter->InternalWarning("Error calling kevent: %s", strerror(errno));
+            reporter->InternalWarning("Error polling IO sources with %s: %s", poller->Name(), strerror(errno));
     }
     else if ( ret == 0 ) {
         // If a timeout_src was provided and nothing else was ready, we timed out
@@ -203,19 +190,19 @@ void Manager::Poll(ReadySources* ready, double timeout, IOSource* timeout_src) {
             ready->push_back({timeout_src, -1, 0});
     }
     else {
-        // kevent returns the number of events that are ready, so we only need to loop
+        // The poller returns the number of events that are ready, so we only need to loop
         // over that many of them.
         bool timeout_src_added = false;
         for ( int i = 0; i < ret; i++ ) {
-            if ( events[i].filter == EVFILT_READ ) {
-                std::map<int, IOSource*>::const_iterator it = fd_map.find(events[i].ident);
+            if ( events[i].flags == IOSource::ProcessFlags::READ ) {
+                std::map<int, IOSource*>::const_iterator it = fd_map.find(events[i].fd);
                 if ( it != fd_map.end() )
-                    ready->push_back({it->second, static_cast<int>(events[i].ident), IOSource::ProcessFlags::READ});
+                    ready->push_back({it->second, events[i].fd, IOSource::ProcessFlags::READ});
             }
-            else if ( events[i].filter == EVFILT_WRITE ) {
-                std::map<int, IOSource*>::const_iterator it = write_fd_map.find(events[i].ident);
+            else if ( events[i].flags == IOSource::ProcessFlags::WRITE ) {
+                std::map<int, IOSource*>::const_iterator it = write_fd_map.find(events[i].fd);
                 if ( it != write_fd_map.end() )
-                    ready->push_back({it->second, static_cast<int>(events[i].ident), IOSource::ProcessFlags::WRITE});
+                    ready->push_back({it->second, events[i].fd, IOSource::ProcessFlags::WRITE});
             }
 
             // If we added a source that is the same as the passed timeout_src, take
@@ -243,28 +230,24 @@ void Manager::ConvertTimeout(double timeout, struct timespec& spec) {
     }
 }
 
-bool Manager::RegisterFd(int fd, IOSource* src, int flags) {
-    std::vector<struct kevent> new_events;
+int Manager::RegisteredFlags(int fd) const {
+    int flags = 0;
 
-    if ( (flags & IOSource::READ) != 0 ) {
-        if ( fd_map.count(fd) == 0 ) {
-            new_events.push_back({});
-            EV_SET(&(new_events.back()), fd, EVFILT_READ, EV_ADD, 0, 0, nullptr);
-        }
-    }
-    if ( (flags & IOSource::WRITE) != 0 ) {
-        if ( write_fd_map.count(fd) == 0 ) {
-            new_events.push_back({});
-            EV_SET(&(new_events.back()), fd, EVFILT_WRITE, EV_ADD, 0, 0, nullptr);
-        }
-    }
+    if ( fd_map.count(fd) != 0 )
+        flags |= IOSource::READ;
+    if ( write_fd_map.count(fd) != 0 )
+        flags |= IOSource::WRITE;
 
-    if ( ! new_events.empty() ) {
-        int ret = kevent(event_queue, new_events.data(), new_events.size(), nullptr, 0, nullptr);
-        if ( ret != -1 ) {
+    return flags;
+}
+
+bool Manager::RegisterFd(int fd, IOSource* src, int flags) {
+    int old_flags = RegisteredFlags(fd);
+    int new_flags = old_flags | (flags & (IOSource::READ | IOSource::WRITE));
+
+    if ( new_flags != old_flags ) {
+        if ( poller->Update(fd, old_flags, new_flags) ) {
             DBG_LOG(DBG_MAINLOOP, "Registered fd %d from %s", fd, src->Tag());
-            for ( const auto& a : new_events )
-                events.push_back({});
 
             if ( (flags & IOSource::READ) != 0 )
                 fd_map[fd] = src;
@@ -284,27 +267,12 @@ bool Manager::RegisterFd(int fd, IOSource* src, int flags) {
 }
 
 bool Manager::UnregisterFd(int fd, IOSource* src, int flags) {
-    std::vector<struct kevent> new_events;
-
-    if ( (flags & IOSource::READ) != 0 ) {
-        if ( fd_map.count(fd) != 0 ) {
-            new_events.push_back({});
-            EV_SET(&(new_events.back()), fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
-        }
-    }
-    if ( (flags & IOSource::WRITE) != 0 ) {
-        if ( write_fd_map.count(fd) != 0 ) {
-            new_events.push_back({});
-            EV_SET(&(new_events.back()), fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
-        }
-    }
+    int old_flags = RegisteredFlags(fd);
+    int new_flags = old_flags & ~flags;
 
-    if ( ! new_events.empty() ) {
-        int ret = kevent(event_queue, new_events.data(), new_events.size(), nullptr, 0, nullptr);
-        if ( ret != -1 ) {
+    if ( new_flags != old_flags ) {
+        if ( poller->Update(fd, old_flags, new_flags) ) {
             DBG_LOG(DBG_MAINLOOP, "Unregistered fd %d from %s", fd, src->Tag());
-            for ( const auto& a : new_events )
-                events.pop_back();
 
             if ( (flags & IOSource::READ) != 0 )
                 fd_map.erase(fd);
@@ -316,8 +284,8 @@ bool Manager::UnregisterFd(int fd, IOSource* src, int flags) {
         }
 
         // We don't care about failure here. If it failed to unregister, it's likely because
-        // the file descriptor was already closed, and kqueue already automatically removed
-        // it.
+        // the file descriptor was already closed, and the poller already automatically
+        // removed it.
     }
     else {
         reporter->Error("Attempted to unregister an unknown file descriptor %d from %s", fd, src->Tag());
@@ -3,14 +3,15 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "zeek/Flare.h"
 #include "zeek/iosource/IOSource.h"
+#include "zeek/iosource/Poller.h"
 
 struct timespec;
-struct kevent;
 
 namespace zeek {
 namespace iosource {
@@ -166,7 +167,7 @@ private:
 
     /**
      * Converts a double timeout value into a timespec struct used for calls
-     * to kevent().
+     * to the poller.
      */
     void ConvertTimeout(double timeout, struct timespec& spec);
 
@@ -226,13 +227,17 @@ private:
     int poll_counter = 0;
     int poll_interval = 0; // Set in InitPostScript() based on const value.
 
-    int event_queue = -1;
+    /**
+     * Returns the flags an fd is currently registered for.
+     */
+    int RegisteredFlags(int fd) const;
+
+    std::unique_ptr<detail::Poller> poller;
     std::map<int, IOSource*> fd_map;
     std::map<int, IOSource*> write_fd_map;
 
-    // This is only used for the output of the call to kqueue in FindReadySources().
-    // The actual events are stored as part of the queue.
-    std::vector<struct kevent> events;
+    // This is only used for the output of the poller in FindReadySources().
+    std::vector<detail::Poller::Event> events;
 };
 
 } // namespace iosource
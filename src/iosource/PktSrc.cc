@@ -3,6 +3,7 @@
 #include "zeek/iosource/PktSrc.h"
 
 #include <sys/stat.h>
+#include <algorithm>
 
 #include "zeek/DebugLogger.h"
 #include "zeek/RunState.h"
@@ -110,54 +111,82 @@ void PktSrc::Process() {
     if ( ! IsOpen() )
         return;
 
-    if ( ! ExtractNextPacketInternal() )
-        return;
+    // Work through the current batch. In pseudo-realtime mode every packet
+    // has to wait for its turn via GetNextTimeout(), so we dispatch only a
+    // single one per call.
+    do {
+        if ( ! ExtractNextPacketInternal() )
+            return;
 
-    run_state::detail::dispatch_packet(&current_packet, this);
+        run_state::detail::dispatch_packet(current_packet, this);
+        have_packet = false;
+    } while ( batch_pos < batch_len && run_state::pseudo_realtime == 0.0 && IsOpen() );
 
-    have_packet = false;
-    DoneWithPacket();
+    if ( batch_pos == batch_len )
+        ReleaseBatch();
 }
 
 const char* PktSrc::Tag() { return "PktSrc"; }
 
+size_t PktSrc::ExtractNextPackets(Packet* pkts, size_t max) { return ExtractNextPacket(&pkts[0]) ? 1 : 0; }
+
+void PktSrc::DoneWithPackets(size_t n) { DoneWithPacket(); }
+
+void PktSrc::ReleaseBatch() {
+    if ( batch_len == 0 )
+        return;
+
+    DoneWithPackets(batch_len);
+    batch_len = 0;
+    batch_pos = 0;
+}
+
 bool PktSrc::ExtractNextPacketInternal() {
     if ( have_packet )
         return true;
 
-    have_packet = false;
-
     // Don't return any packets if processing is suspended.
     if ( run_state::is_processing_suspended() )
         return false;
 
-    if ( ExtractNextPacket(&current_packet) ) {
-        had_packet = true;
+    while ( true ) {
+        if ( batch_pos == batch_len ) {
+            ReleaseBatch();
+
+            if ( batch.empty() )
+                batch = std::vector<Packet>(std::max(BifConst::Pcap::batch_size, static_cast<zeek_uint_t>(1)));
 
-        if ( current_packet.time < 0 ) {
-            Weird("negative_packet_timestamp", &current_packet);
-            return false;
+            batch_len = ExtractNextPackets(batch.data(), batch.size());
+
+            if ( batch_len == 0 ) {
+                // Update the idle_at timestamp the first time we've failed
+                // to extract a packet. This assumes ExtractNextPackets() is
+                // called regularly which is true for non-selectable PktSrc
+                // instances, but even for selectable ones with an FD the
+                // main-loop will call Process() on the interface regularly
+                // and detect it as idle.
+                if ( had_packet ) {
+                    DBG_LOG(DBG_PKTIO, "source %s is idle now", props.path.c_str());
+                    idle_at_wallclock = zeek::util::current_time(true);
+                }
+
+                had_packet = false;
+                return false;
+            }
+
+            had_packet = true;
         }
 
-        have_packet = true;
-        return true;
-    }
-    else {
-        // Update the idle_at timestamp the first time we've failed
-        // to extract a packet. This assumes ExtractNextPacket() is
-        // called regularly which is true for non-selectable PktSrc
-        // instances, but even for selectable ones with an FD the
-        // main-loop will call Process() on the interface regularly
-        // and detect it as idle.
-        if ( had_packet ) {
-            DBG_LOG(DBG_PKTIO, "source %s is idle now", props.path.c_str());
-            idle_at_wallclock = zeek::util::current_time(true);
+        current_packet = &batch[batch_pos++];
+
+        if ( current_packet->time < 0 ) {
+            Weird("negative_packet_timestamp", current_packet);
+            continue;
         }
 
-        had_packet = false;
+        have_packet = true;
+        return true;
     }
-
-    return false;
 }
 
 detail::BPF_Program* PktSrc::CompileFilter(const std::string& filter) {
@@ -222,7 +251,7 @@ bool PktSrc::GetCurrentPacket(const Packet** pkt) {
     if ( ! have_packet )
         return false;
 
-    *pkt = &current_packet;
+    *pkt = current_packet;
     return true;
 }
 
@@ -232,11 +261,9 @@ double PktSrc::GetNextTimeout() {
 
     // If we're in pseudo-realtime mode, find the next time that a packet is ready
     // and have poll block until then.
-    if ( run_state::pseudo_realtime ) {
-        ExtractNextPacketInternal();
-
+    if ( run_state::pseudo_realtime && ExtractNextPacketInternal() ) {
         // This duplicates the calculation used in run_state::check_pseudo_time().
-        double pseudo_time = current_packet.time - run_state::detail::first_timestamp;
+        double pseudo_time = current_packet->time - run_state::detail::first_timestamp;
         double ct = (util::current_time(true) - run_state::detail::first_wallclock) * run_state::pseudo_realtime;
         return std::max(0.0, pseudo_time - ct);
     }
@@ -350,6 +350,40 @@ protected:
      */
     virtual void DoneWithPacket() = 0;
 
+    /**
+     * Provides a batch of packets from the source at once. Sources that
+     * can hand out several packets without invalidating earlier ones
+     * should override this together with \a DoneWithPackets() to
+     * amortize per-packet overhead.
+     *
+     * The default implementation calls \a ExtractNextPacket() once and
+     * thus never returns more than a single packet.
+     *
+     * @param pkts An array of at least *max* packet structures to fill
+     * in. As with \a ExtractNextPacket(), the callee keeps ownership of
+     * the data but must guarantee that it stays available until \a
+     * DoneWithPackets() is called. It is guaranteed that no two calls
+     * to this method will happen without \a DoneWithPackets() in
+     * between.
+     *
+     * @param max The maximum number of packets to extract, at least 1.
+     *
+     * @return The number of packets filled in at the start of *pkts*.
+     * Zero if no packet is available or an error occurred (which must
+     * be flagged via Error()).
+     */
+    virtual size_t ExtractNextPackets(Packet* pkts, size_t max);
+
+    /**
+     * Signals that the data of all packets returned by the previous
+     * call to \a ExtractNextPackets() will no longer be needed.
+     *
+     * The default implementation calls \a DoneWithPacket().
+     *
+     * @param n The number of packets the previous call returned.
+     */
+    virtual void DoneWithPackets(size_t n);
+
     /**
      * Performs the actual filter compilation. This can be overridden to
      * provide a different implementation of the compilation called by
@@ -363,9 +397,14 @@ protected:
     virtual detail::BPF_Program* CompileFilter(const std::string& filter);
 
 private:
-    // Internal helper for ExtractNextPacket().
+    // Internal helper for ExtractNextPacket(). Moves on to the next
+    // packet of the current batch, fetching a new batch once the current
+    // one is exhausted.
     bool ExtractNextPacketInternal();
 
+    // Hands the current batch back to the source.
+    void ReleaseBatch();
+
     // IOSource interface implementation.
     void InitSource() override;
     void Done() override;
@@ -375,7 +414,14 @@ private:
     Properties props;
 
     bool have_packet;
-    Packet current_packet;
+    Packet* current_packet = nullptr;
+
+    // Packets of the most recent ExtractNextPackets() call. batch_pos
+    // indexes the next packet to hand out.
+    std::vector<Packet> batch;
+    size_t batch_len = 0;
+    size_t batch_pos = 0;
+
     // Did the previous call to ExtractNextPacket() yield a packet.
     bool had_packet;
 
@@ -0,0 +1,248 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/Poller.h"
+
+// These two files have to remain in the same order or FreeBSD builds
+// stop working.
+// clang-format off
+#include <sys/types.h>
+#include <sys/event.h>
+// clang-format on
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "zeek/zeek-config.h"
+
+#ifdef HAVE_LINUX
+#include <sys/epoll.h>
+#endif
+
+#include "zeek/iosource/IOSource.h"
+#include "zeek/util.h"
+
+namespace zeek::iosource::detail {
+
+namespace {
+
+class KqueuePoller final : public Poller {
+public:
+    ~KqueuePoller() override;
+
+    bool Init(std::string* errmsg);
+
+    const char* Name() const override { return "kqueue"; }
+    bool Update(int fd, int old_flags, int new_flags) override;
+    int Wait(std::vector<Event>* events, const struct timespec& timeout) override;
+
+private:
+    int event_queue = -1;
+    int num_filters = 0;
+
+    // Output buffer for kevent(), sized to the number of registered filters.
+    std::vector<struct kevent> kevents;
+};
+
+KqueuePoller::~KqueuePoller() {
+#ifndef _MSC_VER
+    // There's a bug here with builds on Windows that causes an assertion with debug builds
+    // related to libkqueue returning a zero for the file descriptor. The assert happens
+    // because something else has already closed FD zero by the time we get here, and Windows
+    // doesn't like that very much. We only do this close when shutting down, so it should
+    // be fine to just skip it.
+    //
+    // See https://github.com/mheily/libkqueue/issues/151 for more details.
+    if ( event_queue != -1 )
+        close(event_queue);
+#endif
+}
+
+bool KqueuePoller::Init(std::string* errmsg) {
+    event_queue = kqueue();
+
+    if ( event_queue == -1 ) {
+        *errmsg = util::fmt("Failed to initialize kqueue: %s", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool KqueuePoller::Update(int fd, int old_flags, int new_flags) {
+    struct kevent changes[2];
+    int n = 0;
+
+    int added = new_flags & ~old_flags;
+    int removed = old_flags & ~new_flags;
+
+    if ( added & IOSource::READ )
+        EV_SET(&changes[n++], fd, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+    if ( added & IOSource::WRITE )
+        EV_SET(&changes[n++], fd, EVFILT_WRITE, EV_ADD, 0, 0, nullptr);
+    if ( removed & IOSource::READ )
+        EV_SET(&changes[n++], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    if ( removed & IOSource::WRITE )
+        EV_SET(&changes[n++], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+
+    if ( n == 0 )
+        return true;
+
+    if ( kevent(event_queue, changes, n, nullptr, 0, nullptr) == -1 )
+        return false;
+
+    for ( int i = 0; i < n; ++i )
+        num_filters += (changes[i].flags & EV_ADD) ? 1 : -1;
+
+    kevents.resize(num_filters);
+    return true;
+}
+
+int KqueuePoller::Wait(std::vector<Event>* events, const struct timespec& timeout) {
+    int ret = kevent(event_queue, nullptr, 0, kevents.data(), kevents.size(), &timeout);
+
+    if ( ret <= 0 )
+        return ret;
+
+    events->clear();
+
+    for ( int i = 0; i < ret; i++ ) {
+        if ( kevents[i].filter == EVFILT_READ )
+            events->push_back({static_cast<int>(kevents[i].ident), IOSource::READ});
+        else if ( kevents[i].filter == EVFILT_WRITE )
+            events->push_back({static_cast<int>(kevents[i].ident), IOSource::WRITE});
+    }
+
+    return static_cast<int>(events->size());
+}
+
+#ifdef HAVE_LINUX
+
+/**
+ * Native epoll backend, avoiding libkqueue's translation of each kevent()
+ * call into epoll operations. Descriptors are registered level-triggered
+ * as IO sources aren't required to drain their descriptors in Process().
+ */
+class EpollPoller final : public Poller {
+public:
+    ~EpollPoller() override;
+
+    bool Init(std::string* errmsg);
+
+    const char* Name() const override { return "epoll"; }
+    bool Update(int fd, int old_flags, int new_flags) override;
+    int Wait(std::vector<Event>* events, const struct timespec& timeout) override;
+
+private:
+    int epoll_fd = -1;
+    int num_fds = 0;
+
+    std::vector<struct epoll_event> epoll_events;
+};
+
+EpollPoller::~EpollPoller() {
+    if ( epoll_fd != -1 )
+        close(epoll_fd);
+}
+
+bool EpollPoller::Init(std::string* errmsg) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    if ( epoll_fd == -1 ) {
+        *errmsg = util::fmt("Failed to initialize epoll: %s", strerror(errno));
+        return false;
+    }
+
+    epoll_events.resize(1);
+    return true;
+}
+
+bool EpollPoller::Update(int fd, int old_flags, int new_flags) {
+    if ( old_flags == new_flags )
+        return true;
+
+    struct epoll_event ev = {};
+    ev.data.fd = fd;
+
+    if ( new_flags & IOSource::READ )
+        ev.events |= EPOLLIN;
+    if ( new_flags & IOSource::WRITE )
+        ev.events |= EPOLLOUT;
+
+    int op = EPOLL_CTL_MOD;
+
+    if ( old_flags == 0 )
+        op = EPOLL_CTL_ADD;
+    else if ( new_flags == 0 )
+        op = EPOLL_CTL_DEL;
+
+    if ( epoll_ctl(epoll_fd, op, fd, &ev) == -1 ) {
+        // Closing a descriptor already removed it from the epoll set.
+        if ( op != EPOLL_CTL_DEL || (errno != EBADF && errno != ENOENT) )
+            return false;
+    }
+
+    if ( op == EPOLL_CTL_ADD )
+        ++num_fds;
+    else if ( op == EPOLL_CTL_DEL )
+        --num_fds;
+
+    epoll_events.resize(std::max(num_fds, 1));
+    return true;
+}
+
+int EpollPoller::Wait(std::vector<Event>* events, const struct timespec& timeout) {
+#ifdef HAVE_EPOLL_PWAIT2
+    int ret = epoll_pwait2(epoll_fd, epoll_events.data(), epoll_events.size(), &timeout, nullptr);
+#else
+    // Millisecond resolution only, truncating like libkqueue does.
+    int timeout_ms = static_cast<int>(timeout.tv_sec * 1000 + timeout.tv_nsec / 1000000);
+    int ret = epoll_wait(epoll_fd, epoll_events.data(), epoll_events.size(), timeout_ms);
+#endif
+
+    if ( ret <= 0 )
+        return ret;
+
+    events->clear();
+
+    for ( int i = 0; i < ret; i++ ) {
+        const auto& ev = epoll_events[i];
+
+        // Errors and hangups are reported as readiness for whatever the
+        // descriptor is registered for, so that its source notices.
+        if ( ev.events & (EPOLLIN | EPOLLERR | EPOLLHUP) )
+            events->push_back({ev.data.fd, IOSource::READ});
+        if ( ev.events & (EPOLLOUT | EPOLLERR | EPOLLHUP) )
+            events->push_back({ev.data.fd, IOSource::WRITE});
+    }
+
+    return static_cast<int>(events->size());
+}
+
+#endif
+
+} // namespace
+
+std::unique_ptr<Poller> Poller::Create(std::string* errmsg) {
+#ifdef HAVE_LINUX
+    const char* backend = getenv("ZEEK_IOSOURCE_POLLER");
+
+    if ( ! backend || strcmp(backend, "kqueue") != 0 ) {
+        auto poller = std::make_unique<EpollPoller>();
+        if ( ! poller->Init(errmsg) )
+            return nullptr;
+
+        return poller;
+    }
+#endif
+
+    auto poller = std::make_unique<KqueuePoller>();
+    if ( ! poller->Init(errmsg) )
+        return nullptr;
+
+    return poller;
+}
+
+} // namespace zeek::iosource::detail
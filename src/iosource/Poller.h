@@ -0,0 +1,72 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct timespec;
+
+namespace zeek::iosource::detail {
+
+/**
+ * Interface of the OS facilities the IO manager uses to wait for file
+ * descriptors to become ready. Flags are combinations of
+ * IOSource::ProcessFlags.
+ */
+class Poller {
+public:
+    struct Event {
+        int fd = -1;
+        int flags = 0;
+    };
+
+    virtual ~Poller() = default;
+
+    /**
+     * Returns the name of the backend for log and debug output.
+     */
+    virtual const char* Name() const = 0;
+
+    /**
+     * Changes the set of events a file descriptor is watched for.
+     *
+     * @param fd The file descriptor.
+     *
+     * @param old_flags The flags *fd* is currently registered for, zero
+     * if it isn't registered.
+     *
+     * @param new_flags The flags *fd* should be registered for, zero to
+     * unregister it.
+     *
+     * @return True on success. On failure, errno is set.
+     */
+    virtual bool Update(int fd, int old_flags, int new_flags) = 0;
+
+    /**
+     * Waits for registered file descriptors to become ready.
+     *
+     * @param events Receives the ready file descriptors. A descriptor
+     * ready for both reading and writing may be reported twice.
+     *
+     * @param timeout The maximum time to wait.
+     *
+     * @return The number of entries stored in *events*, or -1 on error
+     * with errno set.
+     */
+    virtual int Wait(std::vector<Event>* events, const struct timespec& timeout) = 0;
+
+    /**
+     * Instantiates the backend to use. On Linux this is epoll, unless the
+     * ZEEK_IOSOURCE_POLLER environment variable is set to "kqueue".
+     * Elsewhere it's kqueue, natively or through libkqueue.
+     *
+     * @param errmsg Receives a description of the problem on failure.
+     *
+     * @return The poller, or null on failure.
+     */
+    static std::unique_ptr<Poller> Create(std::string* errmsg);
+};
+
+} // namespace zeek::iosource::detail
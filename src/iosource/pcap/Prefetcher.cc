@@ -0,0 +1,568 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/pcap/Prefetcher.h"
+
+#include <fcntl.h>
+#include <zlib.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include "zeek/zeek-config.h"
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/util.h"
+
+namespace zeek::iosource::pcap {
+
+static constexpr size_t RECORD_ALIGNMENT = 8;
+
+PacketRing::PacketRing(size_t arg_capacity) {
+    capacity = arg_capacity & ~(RECORD_ALIGNMENT - 1);
+    buffer.reset(new u_char[capacity]);
+}
+
+size_t PacketRing::RecordSize(uint32_t caplen) {
+    size_t size = sizeof(Header) + caplen;
+    return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+size_t PacketRing::MaxCaplen() const {
+    // Limiting records to half the ring guarantees that a record plus the
+    // padding skipped at the end of the buffer always fits into an empty
+    // ring.
+    size_t max_record = (capacity / 2) & ~(RECORD_ALIGNMENT - 1);
+    return max_record > sizeof(Header) ? max_record - sizeof(Header) : 0;
+}
+
+bool PacketRing::Write(const struct pcap_pkthdr* hdr, const u_char* data) {
+    uint32_t caplen = hdr->caplen;
+
+    if ( caplen > MaxCaplen() )
+        return false;
+
+    size_t size = RecordSize(caplen);
+    size_t offset = tail % capacity;
+    size_t padding = capacity - offset < size ? capacity - offset : 0;
+
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+
+        while ( ! shutdown && capacity - (tail - head) < padding + size ) {
+            writer_waiting = true;
+            space_available.wait(lock);
+            writer_waiting = false;
+        }
+
+        if ( shutdown )
+            return false;
+    }
+
+    // The space between tail and head belongs to us now, so we can write
+    // without holding the lock.
+    if ( padding > 0 ) {
+        if ( padding >= sizeof(Header) ) {
+            Header marker = {};
+            marker.caplen = WRAP_MARKER;
+            memcpy(buffer.get() + offset, &marker, sizeof(marker));
+        }
+
+        offset = 0;
+    }
+
+    Header h = {hdr->ts, caplen, hdr->len};
+    memcpy(buffer.get() + offset, &h, sizeof(h));
+    memcpy(buffer.get() + offset + sizeof(h), data, caplen);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    tail += padding + size;
+
+    if ( reader_waiting )
+        data_available.notify_one();
+
+    return true;
+}
+
+void PacketRing::CloseWriter() {
+    std::lock_guard<std::mutex> lock(mtx);
+    writer_closed = true;
+    data_available.notify_one();
+}
+
+size_t PacketRing::Read(Record* recs, size_t max) {
+    uint64_t available_tail;
+
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+
+        // Only wait if we don't hold any records ourselves; otherwise the
+        // producer may be waiting for us to release them.
+        while ( read_pos == tail && read_pos == head && ! writer_closed && ! shutdown ) {
+            reader_waiting = true;
+            data_available.wait(lock);
+            reader_waiting = false;
+        }
+
+        if ( shutdown )
+            return 0;
+
+        available_tail = tail;
+    }
+
+    size_t n = 0;
+
+    while ( n < max && read_pos < available_tail ) {
+        size_t offset = read_pos % capacity;
+
+        if ( capacity - offset < sizeof(Header) ) {
+            read_pos += capacity - offset;
+            continue;
+        }
+
+        Header h;
+        memcpy(&h, buffer.get() + offset, sizeof(h));
+
+        if ( h.caplen == WRAP_MARKER ) {
+            read_pos += capacity - offset;
+            continue;
+        }
+
+        Record& r = recs[n++];
+        r.ts = h.ts;
+        r.caplen = h.caplen;
+        r.len = h.len;
+        r.data = buffer.get() + offset + sizeof(Header);
+
+        read_pos += RecordSize(h.caplen);
+    }
+
+    return n;
+}
+
+void PacketRing::Release() {
+    std::lock_guard<std::mutex> lock(mtx);
+    head = read_pos;
+
+    if ( writer_waiting )
+        space_available.notify_one();
+}
+
+bool PacketRing::Exhausted() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return shutdown || (writer_closed && read_pos == tail);
+}
+
+void PacketRing::Shutdown() {
+    std::lock_guard<std::mutex> lock(mtx);
+    shutdown = true;
+    space_available.notify_all();
+    data_available.notify_all();
+}
+
+// Blocks signals in helper threads so that they are only delivered to the
+// main thread, like threading::BasicThread does.
+static void block_signals() {
+    sigset_t mask_set;
+    sigfillset(&mask_set);
+    sigdelset(&mask_set, SIGFPE);
+    sigdelset(&mask_set, SIGILL);
+    sigdelset(&mask_set, SIGSEGV);
+    sigdelset(&mask_set, SIGBUS);
+    pthread_sigmask(SIG_BLOCK, &mask_set, nullptr);
+}
+
+// Writes all of buf, returning false if the reading end went away.
+static bool write_all(int fd, const void* buf, size_t len) {
+    const char* p = static_cast<const char*>(buf);
+
+    while ( len > 0 ) {
+        ssize_t n = write(fd, p, len);
+
+        if ( n < 0 ) {
+            if ( errno == EINTR )
+                continue;
+
+            return false;
+        }
+
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+Prefetcher::Prefetcher(size_t buffer_size) : ring(buffer_size) {}
+
+Prefetcher::~Prefetcher() { Stop(); }
+
+Prefetcher::Compression Prefetcher::DetectCompression(int fd) {
+    unsigned char magic[4];
+
+    if ( pread(fd, magic, sizeof(magic), 0) != sizeof(magic) )
+        return Compression::NONE;
+
+    if ( magic[0] == 0x1f && magic[1] == 0x8b )
+        return Compression::GZIP;
+
+    if ( magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd )
+        return Compression::ZSTD;
+
+    return Compression::NONE;
+}
+
+bool Prefetcher::IsCompressed(const std::string& path) {
+    if ( path == "-" )
+        return false;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if ( fd < 0 )
+        return false;
+
+    bool compressed = DetectCompression(fd) != Compression::NONE;
+    close(fd);
+    return compressed;
+}
+
+bool Prefetcher::Open(const std::string& path, std::string* errmsg) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    FILE* f = nullptr;
+
+    if ( path == "-" ) {
+        f = stdin;
+    }
+    else {
+        int fd = open(path.c_str(), O_RDONLY);
+
+        if ( fd < 0 ) {
+            *errmsg = util::fmt("unable to open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+
+        auto compression = DetectCompression(fd);
+
+#ifndef USE_ZSTD
+        if ( compression == Compression::ZSTD ) {
+            *errmsg = util::fmt("unable to read %s: Zeek was built without zstd support", path.c_str());
+            close(fd);
+            return false;
+        }
+#endif
+
+        if ( compression == Compression::NONE ) {
+            if ( f = fdopen(fd, "rb"); ! f )
+                close(fd);
+        }
+        else {
+            // libpcap reads the decompressed trace from a pipe that a
+            // separate thread fills.
+            int pipe_fds[2];
+
+            if ( pipe(pipe_fds) < 0 ) {
+                *errmsg = util::fmt("unable to create pipe: %s", strerror(errno));
+                close(fd);
+                return false;
+            }
+
+            decompressor = std::thread([this, fd, out_fd = pipe_fds[1], compression]() {
+                block_signals();
+                DecompressLoop(fd, out_fd, compression);
+            });
+
+            util::detail::set_thread_name("zk.decompress", decompressor.native_handle());
+
+            if ( f = fdopen(pipe_fds[0], "rb"); ! f )
+                close(pipe_fds[0]);
+        }
+
+        if ( ! f ) {
+            *errmsg = util::fmt("unable to open %s: %s", path.c_str(), strerror(errno));
+            Stop();
+            return false;
+        }
+    }
+
+    // pcap_fopen_offline() takes ownership of f on success and
+    // pcap_close() closes it.
+    pd = pcap_fopen_offline(f, errbuf);
+
+    if ( ! pd ) {
+        if ( f != stdin )
+            fclose(f);
+
+        Stop();
+
+        std::lock_guard<std::mutex> lock(error_mtx);
+        *errmsg = decompress_error.empty() ? errbuf : decompress_error;
+        return false;
+    }
+
+    link_type = pcap_datalink(pd);
+    snapshot = pcap_snapshot(pd);
+
+    if ( snapshot > 0 && static_cast<size_t>(snapshot) > ring.MaxCaplen() ) {
+        *errmsg = util::fmt("Pcap::prefetch_buffer_size too small for snapshot length %d of %s", snapshot,
+                            path.c_str());
+        Stop();
+        return false;
+    }
+
+    return true;
+}
+
+void Prefetcher::Start() {
+    if ( ! pd || reader.joinable() )
+        return;
+
+    reader = std::thread([this]() {
+        block_signals();
+        ReadLoop();
+    });
+
+    util::detail::set_thread_name("zk.pcap-reader", reader.native_handle());
+}
+
+void Prefetcher::Stop() {
+    stopping = true;
+    ring.Shutdown();
+
+    if ( reader.joinable() )
+        reader.join();
+
+    // Closing our end of the pipe lets a decompressor blocked in write()
+    // fail with EPIPE.
+    if ( pd ) {
+        pcap_close(pd);
+        pd = nullptr;
+    }
+
+    if ( decompressor.joinable() )
+        decompressor.join();
+}
+
+void Prefetcher::ReadLoop() {
+    const u_char* data;
+    pcap_pkthdr* header;
+
+    while ( ! stopping ) {
+        int res = pcap_next_ex(pd, &header, &data);
+
+        if ( res == PCAP_ERROR_BREAK )
+            break;
+
+        if ( res == PCAP_ERROR ) {
+            read_error = pcap_geterr(pd);
+            break;
+        }
+
+        if ( res != 1 || ! data )
+            continue;
+
+        if ( ! ring.Write(header, data) ) {
+            if ( ! stopping && header->caplen > ring.MaxCaplen() )
+                read_error = util::fmt("packet of %u bytes exceeds Pcap::prefetch_buffer_size", header->caplen);
+
+            break;
+        }
+    }
+
+    // libpcap reports a trace cut short by a failing decompressor as
+    // truncated; the decompressor's error is more useful.
+    {
+        std::lock_guard<std::mutex> lock(error_mtx);
+        if ( ! decompress_error.empty() && ! stopping )
+            read_error = decompress_error;
+    }
+
+    ring.CloseWriter();
+}
+
+void Prefetcher::DecompressLoop(int in_fd, int out_fd, Compression compression) {
+    constexpr size_t chunk_size = 128 * 1024;
+    std::unique_ptr<char[]> out(new char[chunk_size]);
+    std::string error;
+
+    if ( compression == Compression::GZIP ) {
+        gzFile gz = gzdopen(in_fd, "rb");
+
+        if ( ! gz ) {
+            error = "unable to initialize gzip decompression";
+            close(in_fd);
+        }
+        else {
+            gzbuffer(gz, chunk_size);
+
+            while ( ! stopping ) {
+                int n = gzread(gz, out.get(), chunk_size);
+                int errnum = Z_OK;
+                const char* msg = gzerror(gz, &errnum);
+
+                // A truncated stream reports Z_BUF_ERROR at its end.
+                if ( n < 0 || errnum != Z_OK ) {
+                    error = util::fmt("gzip decompression failed: %s",
+                                      errnum == Z_BUF_ERROR ? "truncated input" : msg);
+                    break;
+                }
+
+                if ( n == 0 || ! write_all(out_fd, out.get(), n) )
+                    break;
+            }
+
+            gzclose(gz);
+        }
+    }
+
+#ifdef USE_ZSTD
+    else if ( compression == Compression::ZSTD ) {
+        ZSTD_DStream* zds = ZSTD_createDStream();
+        ZSTD_initDStream(zds);
+        std::unique_ptr<char[]> in(new char[ZSTD_DStreamInSize()]);
+        size_t last_ret = 0;
+        bool reader_gone = false;
+
+        while ( ! stopping && ! reader_gone && error.empty() ) {
+            ssize_t n = read(in_fd, in.get(), ZSTD_DStreamInSize());
+
+            if ( n < 0 ) {
+                if ( errno == EINTR )
+                    continue;
+
+                error = util::fmt("read failed: %s", strerror(errno));
+                break;
+            }
+
+            if ( n == 0 ) {
+                // A non-zero last return means a frame wasn't complete.
+                if ( last_ret != 0 )
+                    error = "zstd decompression failed: truncated input";
+
+                break;
+            }
+
+            ZSTD_inBuffer input = {in.get(), static_cast<size_t>(n), 0};
+
+            while ( input.pos < input.size ) {
+                ZSTD_outBuffer output = {out.get(), chunk_size, 0};
+                last_ret = ZSTD_decompressStream(zds, &output, &input);
+
+                if ( ZSTD_isError(last_ret) ) {
+                    error = util::fmt("zstd decompression failed: %s", ZSTD_getErrorName(last_ret));
+                    break;
+                }
+
+                if ( ! write_all(out_fd, out.get(), output.pos) ) {
+                    reader_gone = true;
+                    break;
+                }
+            }
+        }
+
+        ZSTD_freeDStream(zds);
+        close(in_fd);
+    }
+#endif
+
+    if ( ! error.empty() ) {
+        std::lock_guard<std::mutex> lock(error_mtx);
+        decompress_error = std::move(error);
+    }
+
+    close(out_fd);
+}
+
+TEST_CASE("pcap prefetch ring") {
+    PacketRing ring(1024);
+    struct pcap_pkthdr hdr = {};
+    u_char data[256];
+
+    for ( size_t i = 0; i < sizeof(data); ++i )
+        data[i] = static_cast<u_char>(i);
+
+    PacketRing::Record recs[16];
+
+    SUBCASE("read what was written") {
+        hdr.caplen = 100;
+        hdr.len = 1500;
+        hdr.ts.tv_sec = 42;
+        CHECK(ring.Write(&hdr, data));
+        ring.CloseWriter();
+
+        CHECK(ring.Read(recs, 16) == 1);
+        CHECK(recs[0].caplen == 100);
+        CHECK(recs[0].len == 1500);
+        CHECK(recs[0].ts.tv_sec == 42);
+        CHECK(memcmp(recs[0].data, data, 100) == 0);
+        CHECK(ring.Exhausted());
+        CHECK(ring.Read(recs, 16) == 0);
+    }
+
+    SUBCASE("wrap around") {
+        // Records of 24 + 200 bytes, so a 1024 byte ring holds four of them.
+        hdr.caplen = 200;
+        hdr.len = 200;
+
+        for ( int round = 0; round < 10; ++round ) {
+            data[0] = static_cast<u_char>(round);
+            CHECK(ring.Write(&hdr, data));
+            CHECK(ring.Read(recs, 16) == 1);
+            CHECK(recs[0].data[0] == round);
+            CHECK(memcmp(recs[0].data + 1, data + 1, 199) == 0);
+            ring.Release();
+        }
+    }
+
+    SUBCASE("oversized packets are rejected") {
+        u_char big[1000] = {};
+        CHECK(PacketRing::RecordSize(ring.MaxCaplen()) == 512);
+        CHECK(PacketRing::RecordSize(ring.MaxCaplen() + 1) > 512);
+
+        hdr.caplen = hdr.len = ring.MaxCaplen();
+        CHECK(ring.Write(&hdr, big));
+
+        hdr.caplen = hdr.len = ring.MaxCaplen() + 1;
+        CHECK_FALSE(ring.Write(&hdr, big));
+
+        ring.CloseWriter();
+        CHECK(ring.Read(recs, 16) == 1);
+        CHECK(recs[0].caplen == ring.MaxCaplen());
+    }
+
+    SUBCASE("producer thread") {
+        std::thread producer([&]() {
+            struct pcap_pkthdr h = {};
+            u_char d[100];
+            h.caplen = h.len = sizeof(d);
+
+            for ( int i = 0; i < 1000; ++i ) {
+                d[0] = static_cast<u_char>(i);
+                h.ts.tv_sec = i;
+                ring.Write(&h, d);
+            }
+
+            ring.CloseWriter();
+        });
+
+        int expected = 0;
+        size_t n;
+
+        while ( (n = ring.Read(recs, 16)) > 0 ) {
+            for ( size_t i = 0; i < n; ++i, ++expected ) {
+                CHECK(recs[i].ts.tv_sec == expected);
+                CHECK(recs[i].data[0] == static_cast<u_char>(expected));
+            }
+
+            ring.Release();
+        }
+
+        producer.join();
+        CHECK(expected == 1000);
+        CHECK(ring.Exhausted());
+    }
+}
+
+} // namespace zeek::iosource::pcap
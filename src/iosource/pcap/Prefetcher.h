@@ -0,0 +1,217 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <pcap.h>
+}
+
+namespace zeek::iosource::pcap {
+
+/**
+ * A bounded single-producer/single-consumer ring of variable-sized packet
+ * records. The producer blocks while the ring is full; the consumer reads
+ * batches of records in place and releases them all at once.
+ */
+class PacketRing {
+public:
+    /**
+     * A packet record as stored in the ring.
+     */
+    struct Record {
+        decltype(pcap_pkthdr::ts) ts;
+        uint32_t caplen;
+        uint32_t len;
+        const u_char* data;
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param capacity The size of the ring in bytes.
+     */
+    explicit PacketRing(size_t capacity);
+
+    /**
+     * Copies a packet into the ring, blocking until there is space for
+     * it. Called by the producer only.
+     *
+     * @return False if the ring has been shut down by the consumer or the
+     * packet's capture length exceeds MaxCaplen().
+     */
+    bool Write(const struct pcap_pkthdr* hdr, const u_char* data);
+
+    /**
+     * Returns the largest capture length a packet may have to fit into
+     * the ring, which is bounded by half its capacity.
+     */
+    size_t MaxCaplen() const;
+
+    /**
+     * Signals that the producer won't write any further packets.
+     */
+    void CloseWriter();
+
+    /**
+     * Returns up to *max* records following the ones returned by previous
+     * calls. Records stay valid until Release(). If there are no records
+     * available and none are held by the consumer, blocks until the
+     * producer writes more or closes the ring. Called by the consumer only.
+     *
+     * @return The number of records stored in *recs*, zero once the ring
+     * is exhausted or shut down.
+     */
+    size_t Read(Record* recs, size_t max);
+
+    /**
+     * Releases all records read so far. Called by the consumer only.
+     */
+    void Release();
+
+    /**
+     * Returns true if the producer has closed the ring and all of its
+     * records have been read.
+     */
+    bool Exhausted();
+
+    /**
+     * Stops the ring, waking up a producer blocked in Write().
+     */
+    void Shutdown();
+
+    /**
+     * Returns the number of bytes a packet with the given capture length
+     * occupies in the ring.
+     */
+    static size_t RecordSize(uint32_t caplen);
+
+private:
+    struct Header {
+        decltype(pcap_pkthdr::ts) ts;
+        uint32_t caplen;
+        uint32_t len;
+    };
+
+    // Marks the rest of the buffer as unused, continuing at offset zero.
+    static constexpr uint32_t WRAP_MARKER = UINT32_MAX;
+
+    std::unique_ptr<u_char[]> buffer;
+    size_t capacity;
+
+    std::mutex mtx;
+    std::condition_variable space_available;
+    std::condition_variable data_available;
+    bool writer_waiting = false;
+    bool reader_waiting = false;
+
+    // Monotonically increasing byte positions. The producer owns tail,
+    // the consumer owns head and read_pos; tail and head are shared
+    // under the mutex.
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    uint64_t read_pos = 0;
+
+    bool writer_closed = false;
+    bool shutdown = false;
+};
+
+/**
+ * Reads a trace file on a background thread into a PacketRing. Traces
+ * compressed with gzip (or zstd, if available) are decompressed on an
+ * additional thread feeding libpcap through a pipe.
+ */
+class Prefetcher {
+public:
+    /**
+     * Constructor.
+     *
+     * @param buffer_size Size of the packet ring in bytes.
+     */
+    explicit Prefetcher(size_t buffer_size);
+
+    /**
+     * Destructor. Stops all threads.
+     */
+    ~Prefetcher();
+
+    /**
+     * Opens the trace and reads its file header. Starts decompression
+     * for compressed traces, but doesn't read any packets yet.
+     *
+     * @param path The trace's path, or "-" for stdin.
+     *
+     * @param errmsg Receives a description of the problem on failure.
+     *
+     * @return True on success.
+     */
+    bool Open(const std::string& path, std::string* errmsg);
+
+    /**
+     * Starts the background thread reading packets into the ring.
+     */
+    void Start();
+
+    /**
+     * Stops all threads and closes the trace.
+     */
+    void Stop();
+
+    /**
+     * Returns the trace's link type. Only valid after Open().
+     */
+    int LinkType() const { return link_type; }
+
+    /**
+     * Returns the trace's snapshot length. Only valid after Open().
+     */
+    int Snapshot() const { return snapshot; }
+
+    /**
+     * Returns the packet ring the background thread reads into.
+     */
+    PacketRing& Ring() { return ring; }
+
+    /**
+     * Returns the error that ended reading, or an empty string if the
+     * trace was read completely. Only valid once the ring is exhausted.
+     */
+    const std::string& ReadError() const { return read_error; }
+
+    /**
+     * Returns true if the file starts with the magic of a compression
+     * format we know how to decompress.
+     */
+    static bool IsCompressed(const std::string& path);
+
+private:
+    enum class Compression { NONE, GZIP, ZSTD };
+
+    static Compression DetectCompression(int fd);
+
+    void ReadLoop();
+    void DecompressLoop(int in_fd, int out_fd, Compression compression);
+
+    PacketRing ring;
+    pcap_t* pd = nullptr;
+    int link_type = -1;
+    int snapshot = 0;
+    std::string read_error;
+
+    std::thread reader;
+    std::thread decompressor;
+    std::atomic<bool> stopping = false;
+
+    std::mutex error_mtx;
+    std::string decompress_error;
+};
+
+} // namespace zeek::iosource::pcap
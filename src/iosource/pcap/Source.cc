@@ -8,7 +8,9 @@
 #include <pcap-int.h>
 #endif
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 
 #include "zeek/Event.h"
 #include "zeek/iosource/BPF_Program.h"
@@ -33,11 +35,19 @@ void PcapSource::Open() {
 }
 
 void PcapSource::Close() {
-    if ( ! pd )
+    if ( ! pd && ! prefetcher )
         return;
 
-    pcap_close(pd);
-    pd = nullptr;
+    if ( prefetcher ) {
+        prefetcher->Stop();
+        prefetcher.reset();
+        active_filter = -1;
+    }
+
+    if ( pd ) {
+        pcap_close(pd);
+        pd = nullptr;
+    }
 
     Closed();
 
@@ -152,6 +162,11 @@ void PcapSource::OpenLive() {
 }
 
 void PcapSource::OpenOffline() {
+    if ( BifConst::Pcap::prefetch_offline || Prefetcher::IsCompressed(props.path) ) {
+        OpenPrefetched();
+        return;
+    }
+
     char errbuf[PCAP_ERRBUF_SIZE];
 
     FILE* f = nullptr;
@@ -200,7 +215,29 @@ void PcapSource::OpenOffline() {
     Opened(props);
 }
 
+void PcapSource::OpenPrefetched() {
+    auto p = std::make_unique<Prefetcher>(BifConst::Pcap::prefetch_buffer_size);
+    std::string errmsg;
+
+    if ( ! p->Open(props.path, &errmsg) ) {
+        Error(errmsg);
+        return;
+    }
+
+    p->Start();
+    prefetcher = std::move(p);
+
+    props.selectable_fd = -1;
+    props.link_type = prefetcher->LinkType();
+    props.is_live = false;
+
+    Opened(props);
+}
+
 bool PcapSource::ExtractNextPacket(Packet* pkt) {
+    if ( prefetcher )
+        return ExtractPrefetched(pkt, 1) == 1;
+
     if ( ! pd )
         return false;
 
@@ -260,10 +297,154 @@ bool PcapSource::ExtractNextPacket(Packet* pkt) {
 }
 
 void PcapSource::DoneWithPacket() {
-    // Nothing to do.
+    if ( prefetcher )
+        prefetcher->Ring().Release();
+}
+
+void PcapSource::DispatchCallback(u_char* user, const struct pcap_pkthdr* hdr, const u_char* data) {
+    auto* state = reinterpret_cast<BatchState*>(user);
+    auto* src = state->src;
+    Packet* pkt = &state->pkts[state->n];
+
+    u_char* slot = src->batch_buffer.get() + state->n * state->slot_size;
+    uint32_t caplen = std::min(hdr->caplen, static_cast<uint32_t>(state->slot_size));
+    memcpy(slot, data, caplen);
+
+    pkt_timeval ts = hdr->ts;
+    pkt->Init(src->props.link_type, &ts, caplen, hdr->len, slot);
+
+    if ( hdr->len == 0 || hdr->caplen == 0 ) {
+        src->Weird("empty_pcap_header", pkt);
+        return;
+    }
+
+    ++src->stats.received;
+    src->stats.bytes_received += hdr->len;
+    ++state->n;
+}
+
+size_t PcapSource::ExtractNextPackets(Packet* pkts, size_t max) {
+    if ( prefetcher )
+        return ExtractPrefetched(pkts, max);
+
+    if ( ! pd )
+        return 0;
+
+    // Without batching, pcap_next_ex() avoids copying the packet.
+    if ( max == 1 )
+        return ExtractNextPacket(&pkts[0]) ? 1 : 0;
+
+    size_t slot_size = pcap_snapshot(pd);
+
+    if ( slot_size == 0 )
+        slot_size = BifConst::Pcap::snaplen;
+
+    if ( batch_buffer_size < max * slot_size ) {
+        batch_buffer_size = max * slot_size;
+        batch_buffer.reset(new u_char[batch_buffer_size]);
+    }
+
+    BatchState state = {this, pkts, 0, slot_size};
+    int res = pcap_dispatch(pd, static_cast<int>(max), DispatchCallback, reinterpret_cast<u_char*>(&state));
+
+    if ( res == PCAP_ERROR ) {
+        if ( props.is_live )
+            reporter->Error("failed to read packets from %s: %s", props.path.data(), pcap_geterr(pd));
+        else
+            reporter->FatalError("failed to read packets from %s: %s", props.path.data(), pcap_geterr(pd));
+
+        return 0;
+    }
+
+    if ( res == PCAP_ERROR_BREAK || (res == 0 && ! props.is_live) ) {
+        // Exhausted pcap file, no more packets to read. Packets
+        // collected so far remain valid as they live in our buffer.
+        assert(! props.is_live);
+        Close();
+    }
+
+    return state.n;
+}
+
+void PcapSource::DoneWithPackets(size_t n) {
+    // Without prefetching, the batch buffer is reused for the next batch.
+    if ( prefetcher )
+        prefetcher->Ring().Release();
+}
+
+size_t PcapSource::ExtractPrefetched(Packet* pkts, size_t max) {
+    if ( records.size() < max )
+        records.resize(max);
+
+    // Check the filter up front: failing it closes the source, which
+    // frees the ring the records below point into.
+    if ( active_filter >= 0 && ! GetBPFFilter(active_filter) ) {
+        Error(util::fmt("BPF filter %d not compiled", active_filter));
+        Close();
+        return 0;
+    }
+
+    auto& ring = prefetcher->Ring();
+    size_t n = 0;
+
+    while ( n == 0 ) {
+        size_t got = ring.Read(records.data(), max);
+
+        if ( got == 0 ) {
+            if ( ! ring.Exhausted() )
+                return 0;
+
+            if ( const auto& err = prefetcher->ReadError(); ! err.empty() )
+                reporter->FatalError("failed to read a packet from %s: %s", props.path.data(), err.c_str());
+
+            // Exhausted pcap file, no more packets to read.
+            Close();
+            return 0;
+        }
+
+        for ( size_t i = 0; i < got; ++i ) {
+            if ( FillPrefetched(&pkts[n], records[i]) )
+                ++n;
+        }
+
+        // All packets got filtered out, give their space back right away.
+        if ( n == 0 )
+            ring.Release();
+    }
+
+    return n;
+}
+
+bool PcapSource::FillPrefetched(Packet* pkt, const PacketRing::Record& rec) {
+    if ( active_filter >= 0 ) {
+        struct pcap_pkthdr hdr = {};
+        hdr.ts = rec.ts;
+        hdr.caplen = rec.caplen;
+        hdr.len = rec.len;
+
+        if ( ! ApplyBPFFilter(active_filter, &hdr, rec.data) )
+            return false;
+    }
+
+    pkt_timeval ts = rec.ts;
+    pkt->Init(props.link_type, &ts, rec.caplen, rec.len, rec.data);
+
+    if ( rec.len == 0 || rec.caplen == 0 ) {
+        Weird("empty_pcap_header", pkt);
+        return false;
+    }
+
+    ++stats.received;
+    stats.bytes_received += rec.len;
+
+    return true;
 }
 
 detail::BPF_Program* PcapSource::CompileFilter(const std::string& filter) {
+    // There's no pcap handle to compile against while prefetching.
+    if ( prefetcher )
+        return PktSrc::CompileFilter(filter);
+
     auto code = std::make_unique<detail::BPF_Program>();
 
     if ( ! code->Compile(pd, filter.c_str(), Netmask()) ) {
@@ -280,7 +461,7 @@ detail::BPF_Program* PcapSource::CompileFilter(const std::string& filter) {
 }
 
 bool PcapSource::SetFilter(int index) {
-    if ( ! pd )
+    if ( ! pd && ! prefetcher )
         return true; // Prevent error message
 
     char errbuf[PCAP_ERRBUF_SIZE];
@@ -299,6 +480,12 @@ bool PcapSource::SetFilter(int index) {
         // since the default scripts will always attempt to compile
         // and install a default filter
     }
+    else if ( prefetcher ) {
+        if ( code->GetState() == FilterState::FATAL )
+            return false;
+
+        active_filter = code->MatchesAnything() ? -1 : index;
+    }
     else if ( auto program = code->GetProgram() ) {
         if ( pcap_setfilter(pd, program) < 0 ) {
             PcapError();
@@ -4,6 +4,7 @@
 
 #include <sys/types.h> // for u_char
 #include <unistd.h>
+#include <memory>
 #include <vector>
 
 extern "C" {
@@ -11,6 +12,7 @@ extern "C" {
 }
 
 #include "zeek/iosource/PktSrc.h"
+#include "zeek/iosource/pcap/Prefetcher.h"
 
 namespace zeek::iosource::pcap {
 
@@ -27,6 +29,8 @@ protected:
     void Close() override;
     bool ExtractNextPacket(Packet* pkt) override;
     void DoneWithPacket() override;
+    size_t ExtractNextPackets(Packet* pkts, size_t max) override;
+    void DoneWithPackets(size_t n) override;
     bool SetFilter(int index) override;
     void Statistics(Stats* stats) override;
 
@@ -35,8 +39,22 @@ protected:
 private:
     void OpenLive();
     void OpenOffline();
+    void OpenPrefetched();
     void PcapError(const char* where = nullptr);
 
+    size_t ExtractPrefetched(Packet* pkts, size_t max);
+    bool FillPrefetched(Packet* pkt, const PacketRing::Record& rec);
+
+    // State shared with the pcap_dispatch() callback while filling a batch.
+    struct BatchState {
+        PcapSource* src;
+        Packet* pkts;
+        size_t n;
+        size_t slot_size;
+    };
+
+    static void DispatchCallback(u_char* user, const struct pcap_pkthdr* hdr, const u_char* data);
+
     Properties props;
     Stats stats;
 
@@ -45,6 +63,19 @@ private:
 
     // Buffer provided to setvbuf() when reading from a PCAP file.
     std::vector<char> iobuf;
+
+    // libpcap's buffer doesn't outlive pcap_dispatch(), so batched packets
+    // are copied into fixed-size slots of this buffer. It is left
+    // uninitialized so that only slots actually used get paged in.
+    std::unique_ptr<u_char[]> batch_buffer;
+    size_t batch_buffer_size = 0;
+
+    // Set instead of pd when reading a trace on a background thread. As
+    // libpcap doesn't see the packets, the active filter is applied when
+    // taking them out of the prefetch ring.
+    std::unique_ptr<Prefetcher> prefetcher;
+    std::vector<PacketRing::Record> records;
+    int active_filter = -1;
 };
 
 } // namespace zeek::iosource::pcap
@@ -0,0 +1,315 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/tpacket/RX_Ring.h"
+
+#ifdef HAVE_LINUX
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <initializer_list>
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/util.h"
+
+namespace zeek::iosource::tpacket {
+
+static uint64_t next_power_of_two(uint64_t x) {
+    uint64_t p = 1;
+    while ( p < x )
+        p <<= 1;
+
+    return p;
+}
+
+RingGeometry RingGeometry::Compute(uint64_t buffer_size, uint64_t block_size, uint32_t snaplen, uint32_t page_size) {
+    RingGeometry g;
+
+    if ( page_size == 0 || snaplen == 0 )
+        return g;
+
+    // With TPACKET_V3 frames are of variable size, but the kernel still
+    // validates the ring against a nominal frame size that has to fit the
+    // largest packet we want to capture.
+    uint64_t frame_size = TPACKET_ALIGN(TPACKET3_HDRLEN + snaplen);
+
+    block_size = std::max<uint64_t>(block_size, page_size);
+    block_size = std::max<uint64_t>(block_size, frame_size);
+    block_size = next_power_of_two(block_size);
+
+    if ( block_size > UINT32_MAX || buffer_size < block_size )
+        return g;
+
+    g.block_size = static_cast<uint32_t>(block_size);
+    g.block_nr = static_cast<uint32_t>(std::min<uint64_t>(buffer_size / block_size, UINT32_MAX));
+    g.frame_size = static_cast<uint32_t>(frame_size);
+    g.frame_nr = (g.block_size / g.frame_size) * g.block_nr;
+
+    return g;
+}
+
+RX_Ring::~RX_Ring() { Release(); }
+
+bool RX_Ring::Init(int sock, const RingGeometry& arg_geometry, uint32_t block_timeout_ms, std::string* errmsg) {
+    Release();
+
+    geometry = arg_geometry;
+
+    if ( geometry.block_nr == 0 ) {
+        *errmsg = "invalid ring geometry";
+        return false;
+    }
+
+    tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = geometry.block_size;
+    req.tp_block_nr = geometry.block_nr;
+    req.tp_frame_size = geometry.frame_size;
+    req.tp_frame_nr = geometry.frame_nr;
+    req.tp_retire_blk_tov = block_timeout_ms;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+    if ( setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 ) {
+        *errmsg = util::fmt("failed to set PACKET_RX_RING: %s", strerror(errno));
+        return false;
+    }
+
+    void* mem = mmap(nullptr, geometry.Size(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, sock, 0);
+
+    if ( mem == MAP_FAILED ) {
+        *errmsg = util::fmt("failed to map RX ring: %s", strerror(errno));
+        return false;
+    }
+
+    Attach(static_cast<uint8_t*>(mem), geometry);
+    return true;
+}
+
+void RX_Ring::Attach(uint8_t* mem, const RingGeometry& arg_geometry) {
+    Release();
+
+    ring = mem;
+    geometry = arg_geometry;
+    current_block = 0;
+    packets_left = 0;
+    current_packet = nullptr;
+    release_block = 0;
+    consumed_blocks = 0;
+}
+
+void RX_Ring::Release() {
+    if ( ! ring )
+        return;
+
+    munmap(ring, geometry.Size());
+    ring = nullptr;
+    current_packet = nullptr;
+    packets_left = 0;
+    consumed_blocks = 0;
+}
+
+const tpacket3_hdr* RX_Ring::NextPacket() {
+    if ( ! ring )
+        return nullptr;
+
+    if ( current_packet )
+        return current_packet;
+
+    while ( consumed_blocks < geometry.block_nr ) {
+        auto* block = Block(current_block);
+
+        // Pairs with the kernel's release store of the block status. Without
+        // the acquire we could observe the status flip before the packet data.
+        if ( (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0 )
+            return nullptr;
+
+        packets_left = block->hdr.bh1.num_pkts;
+
+        if ( packets_left == 0 ) {
+            // Retired by timeout without any packets in it.
+            FinishBlock();
+            continue;
+        }
+
+        current_packet = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(block) +
+                                                         block->hdr.bh1.offset_to_first_pkt);
+        return current_packet;
+    }
+
+    // Everything has been read, but nothing released yet.
+    return nullptr;
+}
+
+void RX_Ring::Advance() {
+    if ( ! current_packet )
+        return;
+
+    if ( --packets_left > 0 ) {
+        current_packet = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<uint8_t*>(current_packet) +
+                                                         current_packet->tp_next_offset);
+        return;
+    }
+
+    current_packet = nullptr;
+    FinishBlock();
+}
+
+void RX_Ring::FinishBlock() {
+    current_block = (current_block + 1) % geometry.block_nr;
+    ++consumed_blocks;
+}
+
+void RX_Ring::ReleaseConsumed() {
+    for ( ; consumed_blocks > 0; --consumed_blocks ) {
+        auto* block = Block(release_block);
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        release_block = (release_block + 1) % geometry.block_nr;
+    }
+}
+
+TEST_CASE("tpacket ring geometry") {
+    SUBCASE("defaults") {
+        auto g = RingGeometry::Compute(128 * 1024 * 1024, 4 * 1024 * 1024, 9216, 4096);
+        CHECK(g.block_size == 4 * 1024 * 1024);
+        CHECK(g.block_nr == 32);
+        CHECK(g.frame_size % TPACKET_ALIGNMENT == 0);
+        CHECK(g.frame_size >= 9216);
+        CHECK(g.frame_nr == (g.block_size / g.frame_size) * g.block_nr);
+        CHECK(g.Size() == 128 * 1024 * 1024);
+    }
+
+    SUBCASE("block size rounded up") {
+        auto g = RingGeometry::Compute(1024 * 1024, 5000, 1500, 4096);
+        CHECK(g.block_size == 8192);
+        CHECK(g.block_nr == 128);
+    }
+
+    SUBCASE("block fits snaplen") {
+        auto g = RingGeometry::Compute(1024 * 1024, 4096, 9216, 4096);
+        CHECK(g.block_size == 16384);
+        CHECK(g.frame_nr == g.block_nr);
+    }
+
+    SUBCASE("buffer too small") {
+        auto g = RingGeometry::Compute(1024, 4096, 1500, 4096);
+        CHECK(g.block_nr == 0);
+    }
+}
+
+namespace {
+
+// Lays out a block the way the kernel retires it, holding packets with
+// the given payload lengths whose first byte is their index within the
+// block.
+void fill_block(tpacket_block_desc* block, std::initializer_list<uint32_t> lens) {
+    auto* base = reinterpret_cast<uint8_t*>(block);
+    uint32_t offset = TPACKET_ALIGN(sizeof(tpacket_block_desc));
+    tpacket3_hdr* prev = nullptr;
+    uint8_t idx = 0;
+
+    block->version = TPACKET_V3;
+    block->hdr.bh1.num_pkts = lens.size();
+    block->hdr.bh1.offset_to_first_pkt = offset;
+
+    for ( auto len : lens ) {
+        auto* pkt = reinterpret_cast<tpacket3_hdr*>(base + offset);
+
+        if ( prev )
+            prev->tp_next_offset = reinterpret_cast<uint8_t*>(pkt) - reinterpret_cast<uint8_t*>(prev);
+
+        pkt->tp_snaplen = pkt->tp_len = len;
+        pkt->tp_mac = TPACKET_ALIGN(sizeof(tpacket3_hdr));
+        pkt->tp_next_offset = 0;
+        base[offset + pkt->tp_mac] = idx++;
+
+        offset += TPACKET_ALIGN(pkt->tp_mac + len);
+        prev = pkt;
+    }
+
+    block->hdr.bh1.block_status = TP_STATUS_USER;
+}
+
+uint8_t first_byte(const tpacket3_hdr* pkt) { return reinterpret_cast<const uint8_t*>(pkt)[pkt->tp_mac]; }
+
+} // namespace
+
+TEST_CASE("tpacket ring walk") {
+    auto g = RingGeometry::Compute(3 * 4096, 4096, 1500, 4096);
+    REQUIRE(g.block_nr == 3);
+
+    void* mem = mmap(nullptr, g.Size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    REQUIRE(mem != MAP_FAILED);
+
+    auto* base = static_cast<uint8_t*>(mem);
+    auto block = [&](uint32_t i) { return reinterpret_cast<tpacket_block_desc*>(base + i * g.block_size); };
+
+    RX_Ring ring;
+    ring.Attach(base, g);
+
+    SUBCASE("nothing retired yet") { CHECK(ring.NextPacket() == nullptr); }
+
+    SUBCASE("packets across blocks") {
+        fill_block(block(0), {60, 1500});
+        fill_block(block(1), {100});
+
+        auto* p = ring.NextPacket();
+        REQUIRE(p != nullptr);
+        CHECK(p->tp_len == 60);
+        CHECK(first_byte(p) == 0);
+        CHECK(ring.NextPacket() == p);
+
+        ring.Advance();
+        p = ring.NextPacket();
+        REQUIRE(p != nullptr);
+        CHECK(p->tp_len == 1500);
+        CHECK(first_byte(p) == 1);
+
+        // Moving to the next block doesn't return the previous one yet.
+        ring.Advance();
+        p = ring.NextPacket();
+        REQUIRE(p != nullptr);
+        CHECK(p->tp_len == 100);
+        CHECK(first_byte(p) == 0);
+        CHECK(block(0)->hdr.bh1.block_status == TP_STATUS_USER);
+
+        ring.ReleaseConsumed();
+        CHECK(block(0)->hdr.bh1.block_status == TP_STATUS_KERNEL);
+        CHECK(block(1)->hdr.bh1.block_status == TP_STATUS_USER);
+
+        ring.ReleasePacket();
+        CHECK(block(1)->hdr.bh1.block_status == TP_STATUS_KERNEL);
+        CHECK(ring.NextPacket() == nullptr);
+    }
+
+    SUBCASE("empty blocks are skipped") {
+        fill_block(block(0), {});
+        fill_block(block(1), {42});
+
+        auto* p = ring.NextPacket();
+        REQUIRE(p != nullptr);
+        CHECK(p->tp_len == 42);
+
+        ring.ReleasePacket();
+        CHECK(block(0)->hdr.bh1.block_status == TP_STATUS_KERNEL);
+        CHECK(block(1)->hdr.bh1.block_status == TP_STATUS_KERNEL);
+    }
+
+    SUBCASE("wrap around") {
+        for ( uint32_t round = 0; round < 2 * g.block_nr; ++round ) {
+            fill_block(block(round % g.block_nr), {static_cast<uint32_t>(64 + round)});
+
+            auto* p = ring.NextPacket();
+            REQUIRE(p != nullptr);
+            CHECK(p->tp_len == 64 + round);
+
+            ring.ReleasePacket();
+            CHECK(ring.NextPacket() == nullptr);
+        }
+    }
+}
+
+} // namespace zeek::iosource::tpacket
+
+#endif
@@ -0,0 +1,162 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "zeek/zeek-config.h"
+
+#ifdef HAVE_LINUX
+#include <linux/if_packet.h>
+#endif
+
+namespace zeek::iosource::tpacket {
+
+#ifdef HAVE_LINUX
+
+/**
+ * Geometry of a TPACKET_V3 receive ring. Block sizes have to be a power
+ * of two multiple of the page size, and the total size is rounded down
+ * to an integral number of blocks.
+ */
+struct RingGeometry {
+    uint32_t block_size = 0;
+    uint32_t block_nr = 0;
+    uint32_t frame_size = 0;
+    uint32_t frame_nr = 0;
+
+    /**
+     * Computes the ring geometry for the given parameters.
+     *
+     * @param buffer_size The requested total size of the ring in bytes.
+     *
+     * @param block_size The requested size of a single block in bytes.
+     *
+     * @param snaplen The maximum number of bytes captured per packet.
+     *
+     * @param page_size The system's page size.
+     *
+     * @return A geometry with *block_nr* set to zero if the parameters
+     * can't be satisfied.
+     */
+    static RingGeometry Compute(uint64_t buffer_size, uint64_t block_size, uint32_t snaplen, uint32_t page_size);
+
+    /**
+     * Returns the total number of bytes occupied by the ring.
+     */
+    size_t Size() const { return static_cast<size_t>(block_size) * block_nr; }
+};
+
+/**
+ * A memory-mapped TPACKET_V3 receive ring attached to an AF_PACKET socket.
+ *
+ * The kernel fills whole blocks with packets and flips a block's status to
+ * TP_STATUS_USER once it retires it. Packets within a ready block are
+ * handed out in place without copying. A block is given back to the
+ * kernel once its last packet has been moved past and the consumer
+ * releases what it has read, which allows handing out batches of packets
+ * that span several blocks.
+ */
+class RX_Ring {
+public:
+    RX_Ring() = default;
+    ~RX_Ring();
+
+    RX_Ring(const RX_Ring&) = delete;
+    RX_Ring& operator=(const RX_Ring&) = delete;
+
+    /**
+     * Configures the PACKET_RX_RING option on the socket and maps the
+     * ring into memory.
+     *
+     * @param sock An AF_PACKET socket already set to TPACKET_V3.
+     *
+     * @param geometry The ring's layout as returned by RingGeometry::Compute().
+     *
+     * @param block_timeout_ms Timeout after which the kernel retires a
+     * partially filled block.
+     *
+     * @param errmsg Receives a description of the problem on failure.
+     *
+     * @return True on success.
+     */
+    bool Init(int sock, const RingGeometry& geometry, uint32_t block_timeout_ms, std::string* errmsg);
+
+    /**
+     * Starts reading from a ring that has already been mapped, taking
+     * over the mapping. Init() uses this once the socket is set up; on
+     * its own, it allows running the ring on blocks not filled in by
+     * the kernel.
+     *
+     * @param mem The ring's memory, as returned by mmap().
+     *
+     * @param geometry The ring's layout.
+     */
+    void Attach(uint8_t* mem, const RingGeometry& geometry);
+
+    /**
+     * Unmaps the ring. Safe to call on an uninitialized ring.
+     */
+    void Release();
+
+    /**
+     * Returns the next packet header from the ring, or null if the
+     * kernel hasn't retired a block yet. Consecutive calls without an
+     * intermediate Advance() return the same packet.
+     */
+    const tpacket3_hdr* NextPacket();
+
+    /**
+     * Moves past the packet most recently returned by NextPacket(). The
+     * packet's data remains valid until the next ReleaseConsumed().
+     */
+    void Advance();
+
+    /**
+     * Hands all blocks whose packets have been moved past back to the
+     * kernel.
+     */
+    void ReleaseConsumed();
+
+    /**
+     * Releases the packet most recently returned by NextPacket(). Once
+     * the last packet of a block has been released, the whole block is
+     * handed back to the kernel.
+     */
+    void ReleasePacket() {
+        Advance();
+        ReleaseConsumed();
+    }
+
+    /**
+     * Returns true if the ring is mapped.
+     */
+    bool IsMapped() const { return ring != nullptr; }
+
+private:
+    tpacket_block_desc* Block(uint32_t idx) const {
+        return reinterpret_cast<tpacket_block_desc*>(ring + static_cast<size_t>(idx) * geometry.block_size);
+    }
+
+    void FinishBlock();
+
+    uint8_t* ring = nullptr;
+    RingGeometry geometry;
+
+    // Block currently read from and the state of the iteration over its
+    // packets.
+    uint32_t current_block = 0;
+    uint32_t packets_left = 0;
+    tpacket3_hdr* current_packet = nullptr;
+
+    // Blocks that have been read completely but not yet returned to the
+    // kernel, starting at release_block.
+    uint32_t release_block = 0;
+    uint32_t consumed_blocks = 0;
+};
+
+#endif
+
+} // namespace zeek::iosource::tpacket
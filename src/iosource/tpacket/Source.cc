@@ -0,0 +1,314 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/tpacket/Source.h"
+
+#ifdef HAVE_LINUX
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+#include "zeek/3rdparty/doctest.h"
+#include "zeek/iosource/BPF_Program.h"
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/pcap/pcap.bif.h"
+#include "zeek/iosource/tpacket/tpacket.bif.h"
+#include "zeek/iosource/tpacket/types.bif.h"
+
+namespace zeek::iosource::tpacket {
+
+uint32_t fanout_arg(uint32_t group_id, uint32_t mode, bool defrag) {
+    uint32_t arg = (group_id & 0xffff) | (mode << 16);
+
+#ifdef PACKET_FANOUT_FLAG_DEFRAG
+    if ( defrag )
+        arg |= (PACKET_FANOUT_FLAG_DEFRAG << 16);
+#endif
+
+    return arg;
+}
+
+TPacketSource::TPacketSource(const std::string& path, bool is_live) {
+    props.path = path;
+    props.is_live = is_live;
+}
+
+TPacketSource::~TPacketSource() { Close(); }
+
+#ifdef HAVE_LINUX
+
+void TPacketSource::Open() {
+    if ( props.path.empty() ) {
+        Error("no interface given");
+        return;
+    }
+
+    ifindex = if_nametoindex(props.path.c_str());
+
+    if ( ifindex == 0 ) {
+        Error(util::fmt("unknown interface %s", props.path.c_str()));
+        return;
+    }
+
+    // Open the socket without a protocol so that nothing is queued up
+    // before the ring is in place. BindInterface() enables reception.
+    socket_fd = socket(AF_PACKET, SOCK_RAW, 0);
+
+    if ( socket_fd < 0 ) {
+        SocketError("socket");
+        return;
+    }
+
+    int version = TPACKET_V3;
+    if ( setsockopt(socket_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ) {
+        SocketError("PACKET_VERSION");
+        return;
+    }
+
+    auto geometry = RingGeometry::Compute(BifConst::TPacket::buffer_size, BifConst::TPacket::block_size,
+                                          BifConst::Pcap::snaplen, sysconf(_SC_PAGESIZE));
+
+    std::string errmsg;
+    uint32_t block_timeout_ms = static_cast<uint32_t>(BifConst::TPacket::block_timeout * 1000);
+
+    if ( ! rx_ring.Init(socket_fd, geometry, block_timeout_ms, &errmsg) ) {
+        Error(errmsg);
+        Close();
+        return;
+    }
+
+    if ( ! BindInterface() || ! EnablePromiscMode() || ! ConfigureFanout() )
+        return;
+
+    props.selectable_fd = socket_fd;
+    props.link_type = BifConst::TPacket::link_type;
+    props.netmask = NETMASK_UNKNOWN;
+    props.is_live = true;
+
+    Info(util::fmt("tpacket ring of %u blocks of %u bytes on %s", geometry.block_nr, geometry.block_size,
+                   props.path.c_str()));
+
+    Opened(props);
+}
+
+void TPacketSource::Close() {
+    if ( socket_fd < 0 )
+        return;
+
+    rx_ring.Release();
+    close(socket_fd);
+    socket_fd = -1;
+
+    Closed();
+}
+
+bool TPacketSource::BindInterface() {
+    struct sockaddr_ll saddr;
+    memset(&saddr, 0, sizeof(saddr));
+    saddr.sll_family = AF_PACKET;
+    saddr.sll_protocol = htons(ETH_P_ALL);
+    saddr.sll_ifindex = ifindex;
+
+    if ( bind(socket_fd, reinterpret_cast<struct sockaddr*>(&saddr), sizeof(saddr)) < 0 ) {
+        SocketError("bind");
+        return false;
+    }
+
+    return true;
+}
+
+bool TPacketSource::EnablePromiscMode() {
+    struct packet_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+
+    if ( setsockopt(socket_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 ) {
+        SocketError("PACKET_ADD_MEMBERSHIP");
+        return false;
+    }
+
+    return true;
+}
+
+bool TPacketSource::ConfigureFanout() {
+    if ( ! BifConst::TPacket::enable_fanout )
+        return true;
+
+    uint32_t mode = PACKET_FANOUT_HASH;
+
+    switch ( BifConst::TPacket::fanout_mode->AsInt() ) {
+        case BifEnum::TPacket::FANOUT_HASH: mode = PACKET_FANOUT_HASH; break;
+        case BifEnum::TPacket::FANOUT_LB: mode = PACKET_FANOUT_LB; break;
+        case BifEnum::TPacket::FANOUT_CPU: mode = PACKET_FANOUT_CPU; break;
+        case BifEnum::TPacket::FANOUT_QM: mode = PACKET_FANOUT_QM; break;
+        default: reporter->InternalError("unknown TPacket::fanout_mode"); break;
+    }
+
+    uint32_t arg = fanout_arg(BifConst::TPacket::fanout_id, mode,
+                              mode == PACKET_FANOUT_HASH && BifConst::TPacket::enable_defrag);
+
+    if ( setsockopt(socket_fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0 ) {
+        SocketError("PACKET_FANOUT");
+        return false;
+    }
+
+    return true;
+}
+
+void TPacketSource::FillPacket(Packet* pkt, const tpacket3_hdr* hdr) {
+    pkt_timeval ts = {static_cast<time_t>(hdr->tp_sec), static_cast<suseconds_t>(hdr->tp_nsec / 1000)};
+    const u_char* data = reinterpret_cast<const u_char*>(hdr) + hdr->tp_mac;
+
+    pkt->Init(props.link_type, &ts, hdr->tp_snaplen, hdr->tp_len, data);
+
+    // The kernel strips VLAN tags it has offloaded and reports them
+    // out-of-band instead.
+    if ( hdr->tp_status & TP_STATUS_VLAN_VALID )
+        pkt->vlan = hdr->hv1.tp_vlan_tci & 0x0fff;
+
+    if ( BifConst::TPacket::checksum_offloading )
+        pkt->l4_checksummed = (hdr->tp_status & (TP_STATUS_CSUMNOTREADY | TP_STATUS_CSUM_VALID)) != 0;
+
+    ++stats.received;
+    stats.bytes_received += hdr->tp_len;
+}
+
+bool TPacketSource::ExtractNextPacket(Packet* pkt) {
+    if ( socket_fd < 0 )
+        return false;
+
+    const tpacket3_hdr* hdr = rx_ring.NextPacket();
+    if ( ! hdr )
+        return false;
+
+    FillPacket(pkt, hdr);
+    return true;
+}
+
+void TPacketSource::DoneWithPacket() { rx_ring.ReleasePacket(); }
+
+size_t TPacketSource::ExtractNextPackets(Packet* pkts, size_t max) {
+    if ( socket_fd < 0 )
+        return 0;
+
+    size_t n = 0;
+
+    while ( n < max ) {
+        const tpacket3_hdr* hdr = rx_ring.NextPacket();
+        if ( ! hdr )
+            break;
+
+        FillPacket(&pkts[n++], hdr);
+
+        // Keeps the block in user space until DoneWithPackets().
+        rx_ring.Advance();
+    }
+
+    return n;
+}
+
+void TPacketSource::DoneWithPackets(size_t n) { rx_ring.ReleaseConsumed(); }
+
+bool TPacketSource::SetFilter(int index) {
+    if ( socket_fd < 0 )
+        return true; // Prevent error message
+
+    iosource::detail::BPF_Program* code = GetBPFFilter(index);
+
+    if ( ! code ) {
+        Error(util::fmt("No precompiled filter for index %d", index));
+        return false;
+    }
+
+    if ( code->GetState() == FilterState::FATAL )
+        return false;
+
+    if ( code->MatchesAnything() ) {
+        // ENOENT just means there wasn't a filter attached.
+        if ( setsockopt(socket_fd, SOL_SOCKET, SO_DETACH_FILTER, nullptr, 0) < 0 && errno != ENOENT ) {
+            SocketError("SO_DETACH_FILTER");
+            return false;
+        }
+
+        return true;
+    }
+
+    bpf_program* program = code->GetProgram();
+
+    if ( ! program )
+        return code->GetState() == FilterState::OK;
+
+    // struct bpf_insn from libpcap and struct sock_filter share a layout.
+    struct sock_fprog fprog;
+    fprog.len = program->bf_len;
+    fprog.filter = reinterpret_cast<struct sock_filter*>(program->bf_insns);
+
+    if ( setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 ) {
+        SocketError("SO_ATTACH_FILTER");
+        return false;
+    }
+
+    return true;
+}
+
+void TPacketSource::Statistics(Stats* s) {
+    if ( socket_fd >= 0 ) {
+        // Reading the statistics resets the kernel's counters.
+        struct tpacket_stats_v3 tp_stats;
+        socklen_t len = sizeof(tp_stats);
+
+        if ( getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &len) == 0 ) {
+            stats.link += tp_stats.tp_packets;
+            stats.dropped += tp_stats.tp_drops;
+        }
+    }
+
+    *s = stats;
+}
+
+void TPacketSource::SocketError(const char* where) {
+    Error(util::fmt("%s: %s", where, strerror(errno)));
+    Close();
+}
+
+#else
+
+void TPacketSource::Open() { Error("TPACKET_V3 packet sources are only supported on Linux"); }
+
+void TPacketSource::Close() {}
+
+bool TPacketSource::ExtractNextPacket(Packet* pkt) { return false; }
+
+void TPacketSource::DoneWithPacket() {}
+
+size_t TPacketSource::ExtractNextPackets(Packet* pkts, size_t max) { return 0; }
+
+void TPacketSource::DoneWithPackets(size_t n) {}
+
+bool TPacketSource::SetFilter(int index) { return false; }
+
+void TPacketSource::Statistics(Stats* s) { *s = stats; }
+
+#endif
+
+iosource::PktSrc* TPacketSource::Instantiate(const std::string& path, bool is_live) {
+    return new TPacketSource(path, is_live);
+}
+
+TEST_CASE("tpacket fanout_arg") {
+    CHECK(fanout_arg(42, 0, false) == 42);
+    CHECK(fanout_arg(0x12345, 0, false) == 0x2345);
+    CHECK(fanout_arg(7, 2, false) == ((2 << 16) | 7));
+
+#ifdef PACKET_FANOUT_FLAG_DEFRAG
+    CHECK(fanout_arg(7, 0, true) == ((PACKET_FANOUT_FLAG_DEFRAG << 16) | 7u));
+#endif
+}
+
+} // namespace zeek::iosource::tpacket
@@ -0,0 +1,71 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "zeek/iosource/PktSrc.h"
+#include "zeek/iosource/tpacket/RX_Ring.h"
+
+namespace zeek::iosource::tpacket {
+
+/**
+ * Returns the argument for the PACKET_FANOUT socket option.
+ *
+ * @param group_id The fanout group shared by all sockets that should
+ * split the traffic between them.
+ *
+ * @param mode One of the kernel's PACKET_FANOUT_* modes.
+ *
+ * @param defrag True to have the kernel defragment IP packets before
+ * hashing them into the group.
+ */
+uint32_t fanout_arg(uint32_t group_id, uint32_t mode, bool defrag);
+
+/**
+ * Live packet source reading from an AF_PACKET socket through a memory
+ * mapped TPACKET_V3 ring. Packets are passed on without copying them out
+ * of the ring; a ring block is returned to the kernel once all of its
+ * packets have been processed.
+ */
+class TPacketSource : public PktSrc {
+public:
+    TPacketSource(const std::string& path, bool is_live);
+    ~TPacketSource() override;
+
+    static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+    // PktSrc interface.
+    void Open() override;
+    void Close() override;
+    bool ExtractNextPacket(Packet* pkt) override;
+    void DoneWithPacket() override;
+    size_t ExtractNextPackets(Packet* pkts, size_t max) override;
+    void DoneWithPackets(size_t n) override;
+    bool SetFilter(int index) override;
+    void Statistics(Stats* stats) override;
+
+private:
+    bool BindInterface();
+    bool EnablePromiscMode();
+    bool ConfigureFanout();
+    void SocketError(const char* where);
+
+#ifdef HAVE_LINUX
+    void FillPacket(Packet* pkt, const tpacket3_hdr* hdr);
+#endif
+
+    Properties props;
+    Stats stats;
+
+    int socket_fd = -1;
+    int ifindex = 0;
+
+#ifdef HAVE_LINUX
+    RX_Ring rx_ring;
+#endif
+};
+
+} // namespace zeek::iosource::tpacket
@@ -0,0 +1,313 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/ColumnarBatch.h"
+
+#include <cstring>
+
+#include "zeek/Reporter.h"
+#include "zeek/util.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::logging {
+
+Column::Column(TypeTag arg_type, TypeTag arg_subtype) : type(arg_type), subtype(arg_subtype) {
+    switch ( type ) {
+        case TYPE_STRING:
+        case TYPE_ENUM:
+        case TYPE_FILE:
+        case TYPE_FUNC:
+        case TYPE_PATTERN: offsets.push_back(0); break;
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR:
+            offsets.push_back(0);
+            elements = std::make_unique<Column>(subtype);
+            break;
+
+        default: break;
+    }
+}
+
+void Column::AppendValid(bool valid) {
+    if ( size % 64 == 0 )
+        validity.push_back(0);
+
+    if ( valid )
+        validity.back() |= uint64_t(1) << (size % 64);
+    else
+        ++null_count;
+
+    ++size;
+}
+
+void Column::AppendNull() {
+    AppendValid(false);
+
+    switch ( type ) {
+        case TYPE_BOOL:
+        case TYPE_INT: ints.push_back(0); break;
+
+        case TYPE_COUNT: counts.push_back(0); break;
+
+        case TYPE_PORT:
+            counts.push_back(0);
+            protos.push_back(TRANSPORT_UNKNOWN);
+            break;
+
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: doubles.push_back(0.0); break;
+
+        case TYPE_ADDR: addrs.push_back({}); break;
+
+        case TYPE_SUBNET: subnets.push_back({}); break;
+
+        default:
+            // Strings and containers.
+            offsets.push_back(offsets.back());
+            break;
+    }
+}
+
+void Column::Append(const threading::Value& v) {
+    if ( ! v.present ) {
+        AppendNull();
+        return;
+    }
+
+    AppendValid(true);
+
+    switch ( type ) {
+        case TYPE_BOOL:
+        case TYPE_INT: ints.push_back(v.val.int_val); break;
+
+        case TYPE_COUNT: counts.push_back(v.val.uint_val); break;
+
+        case TYPE_PORT:
+            counts.push_back(v.val.port_val.port);
+            protos.push_back(v.val.port_val.proto);
+            break;
+
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: doubles.push_back(v.val.double_val); break;
+
+        case TYPE_ADDR: addrs.push_back(v.val.addr_val); break;
+
+        case TYPE_SUBNET: subnets.push_back(v.val.subnet_val); break;
+
+        case TYPE_STRING:
+        case TYPE_ENUM:
+        case TYPE_FILE:
+        case TYPE_FUNC:
+            data.append(v.val.string_val.data, v.val.string_val.length);
+            offsets.push_back(data.size());
+            break;
+
+        case TYPE_PATTERN:
+            data.append(v.val.pattern_text_val);
+            offsets.push_back(data.size());
+            break;
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR:
+            // Sets and vectors share their representation.
+            for ( zeek_int_t i = 0; i < v.val.set_val.size; ++i )
+                elements->Append(*v.val.set_val.vals[i]);
+
+            offsets.push_back(elements->Size());
+            break;
+
+        default: reporter->InternalError("unsupported type %s for columnar log batch", type_name(type));
+    }
+}
+
+void Column::Append(const Column& other) {
+    for ( size_t i = 0; i < other.size; ++i )
+        AppendValid(! other.IsNull(i));
+
+    ints.insert(ints.end(), other.ints.begin(), other.ints.end());
+    counts.insert(counts.end(), other.counts.begin(), other.counts.end());
+    protos.insert(protos.end(), other.protos.begin(), other.protos.end());
+    doubles.insert(doubles.end(), other.doubles.begin(), other.doubles.end());
+    addrs.insert(addrs.end(), other.addrs.begin(), other.addrs.end());
+    subnets.insert(subnets.end(), other.subnets.begin(), other.subnets.end());
+
+    if ( ! offsets.empty() ) {
+        // Rebase the other column's offsets onto our own data or elements.
+        uint64_t base = elements ? elements->Size() : data.size();
+
+        for ( size_t i = 1; i < other.offsets.size(); ++i )
+            offsets.push_back(base + other.offsets[i]);
+
+        data.append(other.data);
+
+        if ( elements )
+            elements->Append(*other.elements);
+    }
+}
+
+void Column::Clear() {
+    size = null_count = 0;
+    validity.clear();
+    ints.clear();
+    counts.clear();
+    protos.clear();
+    doubles.clear();
+    addrs.clear();
+    subnets.clear();
+    data.clear();
+
+    if ( ! offsets.empty() )
+        offsets.resize(1);
+
+    if ( elements )
+        elements->Clear();
+}
+
+ColumnarBatch::ColumnarBatch(int arg_num_fields, const threading::Field* const* arg_fields)
+    : num_fields(arg_num_fields), fields(arg_fields) {
+    columns.reserve(num_fields);
+
+    for ( int i = 0; i < num_fields; ++i )
+        columns.emplace_back(std::make_unique<Column>(fields[i]->type, fields[i]->subtype));
+}
+
+void ColumnarBatch::Append(const detail::LogRecord& record) {
+    for ( int i = 0; i < num_fields; ++i )
+        columns[i]->Append(record[i]);
+
+    ++num_rows;
+}
+
+void ColumnarBatch::Append(zeek::Span<detail::LogRecord> records) {
+    // Go column by column, which keeps each column's arrays in cache.
+    for ( int i = 0; i < num_fields; ++i ) {
+        auto& column = *columns[i];
+
+        for ( const auto& record : records )
+            column.Append(record[i]);
+    }
+
+    num_rows += records.size();
+}
+
+void ColumnarBatch::Append(const ColumnarBatch& other) {
+    for ( int i = 0; i < num_fields; ++i )
+        columns[i]->Append(*other.columns[i]);
+
+    num_rows += other.num_rows;
+}
+
+void ColumnarBatch::Clear() {
+    for ( auto& c : columns )
+        c->Clear();
+
+    num_rows = 0;
+}
+
+TEST_CASE("columnar log batch") {
+    threading::Field ts{"ts", nullptr, TYPE_TIME, TYPE_VOID, false};
+    threading::Field uid{"uid", nullptr, TYPE_STRING, TYPE_VOID, false};
+    threading::Field port{"port", nullptr, TYPE_PORT, TYPE_VOID, false};
+    threading::Field tags{"tags", nullptr, TYPE_TABLE, TYPE_STRING, true};
+    threading::Field count{"count", nullptr, TYPE_COUNT, TYPE_VOID, true};
+    const threading::Field* fields[] = {&ts, &uid, &port, &tags, &count};
+
+    auto string_value = [](const char* s) {
+        threading::Value v{TYPE_STRING};
+        v.val.string_val.data = util::copy_string(s);
+        v.val.string_val.length = static_cast<int>(strlen(s));
+        return v;
+    };
+
+    std::vector<detail::LogRecord> records;
+
+    for ( int i = 0; i < 100; ++i ) {
+        detail::LogRecord rec;
+        rec.emplace_back(TYPE_TIME);
+        rec.back().val.double_val = 1000.0 + i;
+        rec.emplace_back(string_value(i % 2 ? "odd" : "even"));
+        rec.emplace_back(TYPE_PORT);
+        rec.back().val.port_val = {static_cast<zeek_uint_t>(i), TRANSPORT_TCP};
+
+        if ( i % 3 == 0 ) {
+            threading::Value set{TYPE_TABLE, TYPE_STRING};
+            set.val.set_val.vals = new threading::Value*[2];
+            set.val.set_val.vals[0] = new threading::Value(string_value("a"));
+            set.val.set_val.vals[1] = new threading::Value(string_value("b"));
+            set.val.set_val.size = 2;
+            rec.emplace_back(std::move(set));
+        }
+        else
+            rec.emplace_back(TYPE_TABLE, TYPE_STRING, false);
+
+        rec.emplace_back(TYPE_COUNT, i % 10 != 0);
+        rec.back().val.uint_val = i;
+
+        records.emplace_back(std::move(rec));
+    }
+
+    ColumnarBatch batch(5, fields);
+
+    auto check = [&]() {
+        REQUIRE(batch.NumRows() == 100);
+
+        const auto& c_ts = batch.GetColumn(0);
+        const auto& c_uid = batch.GetColumn(1);
+        const auto& c_port = batch.GetColumn(2);
+        const auto& c_tags = batch.GetColumn(3);
+        const auto& c_count = batch.GetColumn(4);
+
+        CHECK(c_ts.Doubles()[42] == 1042.0);
+        CHECK(c_uid.String(42) == "even");
+        CHECK(c_uid.String(43) == "odd");
+        CHECK(c_uid.Data().size() == 50 * 4 + 50 * 3);
+        CHECK(c_port.Counts()[7] == 7);
+        CHECK(c_port.Protos()[7] == TRANSPORT_TCP);
+
+        CHECK(c_tags.NullCount() == 66);
+        CHECK_FALSE(c_tags.IsNull(3));
+        CHECK(c_tags.IsNull(4));
+        CHECK(c_tags.Offsets()[3] == 2);
+        CHECK(c_tags.Offsets()[4] == 4);
+        CHECK(c_tags.Offsets()[5] == 4);
+        CHECK(c_tags.Elements().Size() == 68);
+        CHECK(c_tags.Elements().String(5) == "b");
+
+        CHECK(c_count.NullCount() == 10);
+        CHECK(c_count.IsNull(70));
+        CHECK(c_count.Counts()[70] == 0);
+        CHECK(c_count.Counts()[71] == 71);
+    };
+
+    SUBCASE("row by row") {
+        for ( const auto& rec : records )
+            batch.Append(rec);
+
+        check();
+    }
+
+    SUBCASE("span, after clearing") {
+        batch.Append(zeek::Span{records});
+        batch.Clear();
+        CHECK(batch.NumRows() == 0);
+        CHECK(batch.GetColumn(3).Elements().Size() == 0);
+
+        batch.Append(zeek::Span{records});
+        check();
+    }
+
+    SUBCASE("concatenated batches") {
+        ColumnarBatch other(5, fields);
+        auto all = zeek::Span{records};
+
+        batch.Append(all.subspan(0, 42));
+        other.Append(all.subspan(42));
+        batch.Append(other);
+        check();
+    }
+}
+
+} // namespace zeek::logging
@@ -0,0 +1,227 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "zeek/Span.h"
+#include "zeek/logging/Types.h"
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::logging {
+
+/**
+ * The values of one log field across a batch of records, stored in
+ * contiguous typed arrays along with a bitmap of the rows that have a
+ * value. Rows without one (unset optional fields) hold a zero or empty
+ * entry in the typed arrays, so that row i is always at index i.
+ *
+ * The layout follows Apache Arrow's: variable-length values (strings, and
+ * the elements of sets and vectors) are concatenated, with an offsets
+ * array holding NumRows() + 1 entries delimiting each row's part.
+ */
+class Column {
+public:
+    /**
+     * Constructor.
+     *
+     * @param type The type of the field.
+     *
+     * @param subtype The type of the elements for sets and vectors.
+     */
+    explicit Column(TypeTag type, TypeTag subtype = TYPE_VOID);
+
+    Column(const Column&) = delete;
+    Column& operator=(const Column&) = delete;
+
+    TypeTag Type() const { return type; }
+    TypeTag SubType() const { return subtype; }
+
+    /**
+     * @return The number of rows.
+     */
+    size_t Size() const { return size; }
+
+    /**
+     * @return True if row i has no value.
+     */
+    bool IsNull(size_t i) const { return ! ((validity[i / 64] >> (i % 64)) & 1); }
+
+    /**
+     * @return The number of rows without a value.
+     */
+    size_t NullCount() const { return null_count; }
+
+    /**
+     * @return The validity bitmap, one bit per row, least significant bit
+     * first. A set bit means the row has a value.
+     */
+    const std::vector<uint64_t>& Validity() const { return validity; }
+
+    /**
+     * @return The values of TYPE_BOOL and TYPE_INT columns.
+     */
+    const std::vector<zeek_int_t>& Ints() const { return ints; }
+
+    /**
+     * @return The values of TYPE_COUNT columns, and the port numbers of
+     * TYPE_PORT columns.
+     */
+    const std::vector<zeek_uint_t>& Counts() const { return counts; }
+
+    /**
+     * @return The protocols of TYPE_PORT columns.
+     */
+    const std::vector<TransportProto>& Protos() const { return protos; }
+
+    /**
+     * @return The values of TYPE_DOUBLE, TYPE_TIME and TYPE_INTERVAL
+     * columns.
+     */
+    const std::vector<double>& Doubles() const { return doubles; }
+
+    /**
+     * @return The values of TYPE_ADDR columns.
+     */
+    const std::vector<threading::Value::addr_t>& Addrs() const { return addrs; }
+
+    /**
+     * @return The values of TYPE_SUBNET columns.
+     */
+    const std::vector<threading::Value::subnet_t>& Subnets() const { return subnets; }
+
+    /**
+     * Returns the value of row i of a column holding strings, which are
+     * columns of TYPE_STRING, TYPE_ENUM, TYPE_FILE, TYPE_FUNC and
+     * TYPE_PATTERN.
+     */
+    std::string_view String(size_t i) const { return {data.data() + offsets[i], offsets[i + 1] - offsets[i]}; }
+
+    /**
+     * @return The concatenated values of a column holding strings.
+     */
+    const std::string& Data() const { return data; }
+
+    /**
+     * @return For columns holding strings, the offsets of each row's value
+     * into Data(). For TYPE_TABLE and TYPE_VECTOR columns, the index of
+     * each row's first element in Elements().
+     */
+    const std::vector<uint64_t>& Offsets() const { return offsets; }
+
+    /**
+     * @return The elements of all rows of a TYPE_TABLE or TYPE_VECTOR
+     * column. Must not be called for other types.
+     */
+    const Column& Elements() const { return *elements; }
+
+    /**
+     * Adds a row.
+     */
+    void Append(const threading::Value& v);
+
+    /**
+     * Adds all rows of another column of the same type.
+     */
+    void Append(const Column& other);
+
+    /**
+     * Removes all rows, keeping the memory allocated for reuse.
+     */
+    void Clear();
+
+private:
+    void AppendNull();
+    void AppendValid(bool valid);
+
+    TypeTag type;
+    TypeTag subtype;
+    size_t size = 0;
+    size_t null_count = 0;
+
+    std::vector<uint64_t> validity;
+    std::vector<zeek_int_t> ints;
+    std::vector<zeek_uint_t> counts;
+    std::vector<TransportProto> protos;
+    std::vector<double> doubles;
+    std::vector<threading::Value::addr_t> addrs;
+    std::vector<threading::Value::subnet_t> subnets;
+    std::vector<uint64_t> offsets;
+    std::string data;
+    std::unique_ptr<Column> elements;
+};
+
+/**
+ * A batch of log records in columnar form, with one Column per log field.
+ *
+ * Writers can receive these instead of individual records by overriding
+ * WriterBackend::WantsColumnarBatches(). A batch is meant to be reused:
+ * clearing it keeps its memory around for the next one.
+ */
+class ColumnarBatch {
+public:
+    /**
+     * Constructor.
+     *
+     * @param num_fields The number of log fields.
+     *
+     * @param fields The log fields. The batch keeps a pointer to them.
+     */
+    ColumnarBatch(int num_fields, const threading::Field* const* fields);
+
+    ColumnarBatch(const ColumnarBatch&) = delete;
+    ColumnarBatch& operator=(const ColumnarBatch&) = delete;
+
+    /**
+     * @return The number of records in the batch.
+     */
+    size_t NumRows() const { return num_rows; }
+
+    /**
+     * @return The number of log fields.
+     */
+    int NumFields() const { return num_fields; }
+
+    /**
+     * @return The log fields as passed to the constructor.
+     */
+    const threading::Field* const* Fields() const { return fields; }
+
+    /**
+     * @return The column for log field i.
+     */
+    const Column& GetColumn(int i) const { return *columns[i]; }
+
+    /**
+     * Adds a record. Its values must match the fields passed to the
+     * constructor.
+     */
+    void Append(const detail::LogRecord& record);
+
+    /**
+     * Adds a span of records.
+     */
+    void Append(zeek::Span<detail::LogRecord> records);
+
+    /**
+     * Adds all records of another batch with the same fields.
+     */
+    void Append(const ColumnarBatch& other);
+
+    /**
+     * Removes all records, keeping the memory allocated for reuse.
+     */
+    void Clear();
+
+private:
+    int num_fields;
+    const threading::Field* const* fields;
+    std::vector<std::unique_ptr<Column>> columns;
+    size_t num_rows = 0;
+};
+
+} // namespace zeek::logging
@@ -4,6 +4,7 @@
 
 #include <broker/endpoint_info.hh>
 #include <functional>
+#include <new>
 #include <optional>
 #include <utility>
 
@@ -216,6 +217,9 @@ struct Manager::Filter {
     bool remote = false;
     double interval = 0.0;
     Func* postprocessor = nullptr;
+    zeek_uint_t max_queued_batches = 0;
+    zeek_int_t overload_policy = 0;
+    zeek_uint_t shards = 1;
 
     int num_fields = 0;
     threading::Field** fields = nullptr;
@@ -491,7 +495,20 @@ Manager::Manager()
       total_log_writer_discarded_writes_family(
           telemetry_mgr->CounterFamily("zeek", "log-writer-discarded-writes",
                                        {"writer", "module", "stream", "filter-name", "path"},
-                                       "Total number of log writes discarded due to size limitations.")) {
+                                       "Total number of log writes discarded due to size limitations.")),
+      total_log_writer_dropped_writes_family(
+          telemetry_mgr->CounterFamily("zeek", "log-writer-dropped-writes",
+                                       {"writer", "module", "stream", "filter-name", "path"},
+                                       "Total number of log writes dropped because the writer fell behind.")),
+      total_log_writer_spilled_writes_family(
+          telemetry_mgr->CounterFamily("zeek", "log-writer-spilled-writes",
+                                       {"writer", "module", "stream", "filter-name", "path"},
+                                       "Total number of log writes diverted to an overflow file because the "
+                                       "writer fell behind.")),
+      log_writer_queued_batches_family(
+          telemetry_mgr->GaugeFamily("zeek", "log-writer-queued-batches",
+                                     {"writer", "module", "stream", "filter-name", "path"},
+                                     "Number of batches of log writes queued for the writer thread.")) {
     rotations_pending = 0;
 }
 
@@ -504,6 +521,11 @@ void Manager::InitPostScript() {
     rotation_format_func = id::find_func("Log::rotation_format_func");
     log_stream_policy_hook = id::find_func("Log::log_stream_policy");
     max_log_record_size = id::find_val("Log::max_log_record_size")->AsCount();
+    default_max_queued_batches = id::find_val("Log::default_max_queued_batches")->AsCount();
+    default_overload_policy = id::find_val("Log::default_overload_policy")->AsEnum();
+    default_writer_shards = id::find_val("Log::default_writer_shards")->AsCount();
+    overload_block_timeout = id::find_val("Log::overload_block_timeout")->AsInterval();
+    overload_spill_dir = id::find_val("Log::overload_spill_dir")->AsStringVal()->ToStdString();
 }
 
 WriterBackend* Manager::CreateBackend(WriterFrontend* frontend, EnumVal* tag) {
@@ -871,6 +893,9 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval) {
     auto scope_sep = fval->GetFieldOrDefault("scope_sep");
     auto ext_prefix = fval->GetFieldOrDefault("ext_prefix");
     auto ext_func = fval->GetFieldOrDefault("ext_func");
+    auto max_queued_batches = fval->GetFieldOrDefault("max_queued_batches");
+    auto overload_policy = fval->GetFieldOrDefault("overload_policy");
+    auto shards = fval->GetFieldOrDefault("shards");
 
     Filter* filter = new Filter;
     filter->fval = fval->Ref();
@@ -889,6 +914,9 @@ bool Manager::AddFilter(EnumVal* id, RecordVal* fval) {
     filter->scope_sep = scope_sep->AsString()->CheckString();
     filter->ext_prefix = ext_prefix->AsString()->CheckString();
     filter->ext_func = ext_func ? ext_func->AsFunc() : nullptr;
+    filter->max_queued_batches = max_queued_batches->AsCount();
+    filter->overload_policy = overload_policy->AsEnum();
+    filter->shards = shards->AsCount();
 
     // Build the list of fields that the filter wants included, including
     // potentially rolling out fields.
@@ -1147,9 +1175,12 @@ bool Manager::WriteToFilters(const Manager::Stream* stream, zeek::RecordValPtr c
         assert(writer);
         assert(info);
 
-        // Alright, can do the write now.
+        // Alright, can do the write now. Plugins hooking into writes may
+        // replace values, so they get records that own their data.
+        bool have_write_hook = zeek::plugin_mgr->HavePluginForHook(zeek::plugin::HOOK_LOG_WRITE);
+
         size_t total_size = 0;
-        auto rec = RecordToLogRecord(stream, filter, columns.get(), total_size);
+        auto rec = RecordToLogRecord(stream, filter, columns.get(), total_size, have_write_hook ? nullptr : writer);
 
         if ( total_size > max_log_record_size ) {
             reporter->Weird("log_record_too_large", util::fmt("%s", stream->name.c_str()));
@@ -1157,7 +1188,7 @@ bool Manager::WriteToFilters(const Manager::Stream* stream, zeek::RecordValPtr c
             continue;
         }
 
-        if ( zeek::plugin_mgr->HavePluginForHook(zeek::plugin::HOOK_LOG_WRITE) ) {
+        if ( have_write_hook ) {
             // The current HookLogWrite API takes a threading::Value**.
             // Fabricate the pointer array on the fly. Mutation is allowed.
             std::vector<threading::Value*> vals;
@@ -1388,11 +1419,38 @@ bool Manager::SetMaxDelayQueueSize(const EnumValPtr& id, zeek_uint_t queue_size)
     return true;
 }
 
-threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t& total_size) {
+// Allocates nested values of sets and vectors from an arena if given, and
+// from the heap otherwise.
+static threading::Value** NewValueArray(zeek_int_t n, detail::RecordArena* arena) {
+    if ( arena ) {
+        void* p = arena->Allocate(n * sizeof(threading::Value*), alignof(threading::Value*));
+        return static_cast<threading::Value**>(p);
+    }
+
+    return new threading::Value*[n];
+}
+
+static threading::Value* NewValue(threading::Value&& v, detail::RecordArena* arena) {
+    if ( arena )
+        return new (arena->Allocate(sizeof(threading::Value), alignof(threading::Value)))
+            threading::Value(std::move(v));
+
+    return new threading::Value(std::move(v));
+}
+
+threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t& total_size,
+                                      detail::RecordArena* arena) {
     if ( ! val )
         return {ty->Tag(), false};
 
     threading::Value lval{ty->Tag()};
+    lval.in_arena = arena != nullptr;
+
+    // Copies string data into the arena if there's one, and to the heap
+    // otherwise.
+    auto copy_string = [arena](const char* s, size_t len) {
+        return arena ? arena->CopyString(s, len) : util::copy_string(s, len);
+    };
 
     switch ( lval.type ) {
         case TYPE_BOOL:
@@ -1406,14 +1464,14 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t
 
             if ( s ) {
                 auto len = strlen(s);
-                lval.val.string_val.data = util::copy_string(s, len);
+                lval.val.string_val.data = copy_string(s, len);
                 lval.val.string_val.length = len;
             }
 
             else {
                 auto err_msg = "enum type does not contain value:" + std::to_string(val->AsInt());
                 ty->Error(err_msg.c_str());
-                lval.val.string_val.data = util::copy_string("", 0);
+                lval.val.string_val.data = copy_string("", 0);
                 lval.val.string_val.length = 0;
             }
 
@@ -1464,7 +1522,7 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t
 
         case TYPE_STRING: {
             const String* s = val->AsString()->AsString();
-            char* buf = new char[s->Len()];
+            char* buf = arena ? static_cast<char*>(arena->Allocate(s->Len(), 1)) : new char[s->Len()];
             memcpy(buf, s->Bytes(), s->Len());
 
             lval.val.string_val.data = buf;
@@ -1477,7 +1535,7 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t
             const File* f = val->AsFile();
             const char* s = f->Name();
             auto len = strlen(s);
-            lval.val.string_val.data = util::copy_string(s, len);
+            lval.val.string_val.data = copy_string(s, len);
             lval.val.string_val.length = len;
             total_size += lval.val.string_val.length;
             break;
@@ -1489,7 +1547,7 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t
             f->Describe(&d);
             const char* s = d.Description();
             auto len = strlen(s);
-            lval.val.string_val.data = util::copy_string(s, len);
+            lval.val.string_val.data = copy_string(s, len);
             lval.val.string_val.length = len;
             total_size += lval.val.string_val.length;
             break;
@@ -1509,11 +1567,11 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t
             bool is_managed = ZVal::IsManagedType(set_t);
 
             zeek_int_t set_length = set->Length();
-            lval.val.set_val.vals = new threading::Value*[set_length];
+            lval.val.set_val.vals = NewValueArray(set_length, arena);
 
             for ( zeek_int_t i = 0; i < set_length && total_size < max_log_record_size; i++ ) {
                 std::optional<ZVal> s_i = ZVal(set->Idx(i), set_t);
-                lval.val.set_val.vals[i] = new threading::Value(ValToLogVal(s_i, set_t.get(), total_size));
+                lval.val.set_val.vals[i] = NewValue(ValToLogVal(s_i, set_t.get(), total_size, arena), arena);
                 if ( is_managed )
                     ZVal::DeleteManagedType(*s_i);
                 lval.val.set_val.size++;
@@ -1525,13 +1583,13 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t
         case TYPE_VECTOR: {
             VectorVal* vec = val->AsVector();
             zeek_int_t vec_length = vec->Size();
-            lval.val.vector_val.vals = new threading::Value*[vec_length];
+            lval.val.vector_val.vals = NewValueArray(vec_length, arena);
 
             auto& vv = vec->RawVec();
             auto& vt = vec->GetType()->Yield();
 
             for ( zeek_int_t i = 0; i < vec_length && total_size < max_log_record_size; i++ ) {
-                lval.val.vector_val.vals[i] = new threading::Value(ValToLogVal(vv[i], vt.get(), total_size));
+                lval.val.vector_val.vals[i] = NewValue(ValToLogVal(vv[i], vt.get(), total_size, arena), arena);
                 lval.val.vector_val.size++;
             }
 
@@ -1545,7 +1603,7 @@ threading::Value Manager::ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t
 }
 
 detail::LogRecord Manager::RecordToLogRecord(const Stream* stream, Filter* filter, RecordVal* columns,
-                                             size_t& total_size) {
+                                             size_t& total_size, WriterFrontend* writer) {
     RecordValPtr ext_rec;
 
     if ( filter->num_ext_fields > 0 ) {
@@ -1555,8 +1613,13 @@ detail::LogRecord Manager::RecordToLogRecord(const Stream* stream, Filter* filte
             ext_rec = {AdoptRef{}, res.release()->AsRecordVal()};
     }
 
+    // Only now get the arena, as the function above may have flushed the
+    // writer's buffer.
+    auto* arena = writer ? writer->Arena() : nullptr;
+    auto arena_mark = arena ? arena->GetMark() : detail::RecordArena::Mark{};
+
     // Allocate storage for all vals.
-    detail::LogRecord vals;
+    detail::LogRecord vals{detail::RecordArenaAllocator<threading::Value>(arena)};
     vals.reserve(filter->num_fields);
 
     for ( int i = 0; i < filter->num_fields; ++i ) {
@@ -1595,9 +1658,16 @@ detail::LogRecord Manager::RecordToLogRecord(const Stream* stream, Filter* filte
         }
 
         if ( val )
-            vals.emplace_back(ValToLogVal(val, vt, total_size));
+            vals.emplace_back(ValToLogVal(val, vt, total_size, arena));
 
         if ( total_size > max_log_record_size ) {
+            // The record gets discarded, so hand its memory back to the
+            // batch. The values need to go first.
+            vals.clear();
+
+            if ( arena )
+                arena->Rewind(arena_mark);
+
             return {};
         }
     }
@@ -1666,6 +1736,9 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
     // looking up the logging framework's default rotation interval.
     bool found_filter_match = false;
     list<Filter*>::const_iterator it;
+    zeek_uint_t max_queued_batches = default_max_queued_batches;
+    zeek_int_t overload_policy = default_overload_policy;
+    zeek_uint_t shards = default_writer_shards;
 
     for ( it = stream->filters.begin(); it != stream->filters.end(); ++it ) {
         Filter* f = *it;
@@ -1673,6 +1746,9 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
             found_filter_match = true;
             winfo->interval = f->interval;
             winfo->postprocessor = f->postprocessor;
+            max_queued_batches = f->max_queued_batches;
+            overload_policy = f->overload_policy;
+            shards = f->shards;
 
             if ( f->postprocessor ) {
                 delete[] winfo->info->post_proc_func;
@@ -1708,7 +1784,8 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
     winfo->info->rotation_interval = winfo->interval;
     winfo->info->rotation_base = util::detail::parse_rotate_base_time(base_time);
 
-    winfo->writer = new WriterFrontend(*winfo->info, id, writer, local, remote);
+    winfo->writer = new WriterFrontend(*winfo->info, id, writer, local, remote, shards);
+    ConfigureOverload(winfo->writer, max_queued_batches, overload_policy, Span{labels.begin(), labels.size()});
     winfo->writer->Init(num_fields, fields);
 
     if ( ! from_remote ) {
@@ -1722,6 +1799,32 @@ WriterFrontend* Manager::CreateWriter(EnumVal* id, EnumVal* writer, WriterBacken
     return winfo->writer;
 }
 
+void Manager::ConfigureOverload(WriterFrontend* writer, zeek_uint_t max_queued_batches, zeek_int_t overload_policy,
+                                Span<const telemetry::LabelView> labels) {
+    WriterFrontend::OverloadSettings settings;
+    settings.max_queued_batches = max_queued_batches;
+    settings.block_timeout = overload_block_timeout;
+    settings.queued_batches = log_writer_queued_batches_family->GetOrAdd(labels);
+    settings.dropped_records = total_log_writer_dropped_writes_family->GetOrAdd(labels);
+    settings.spilled_records = total_log_writer_spilled_writes_family->GetOrAdd(labels);
+
+    switch ( static_cast<BifEnum::Log::OverloadPolicy>(overload_policy) ) {
+        case BifEnum::Log::OVERLOAD_BLOCK: settings.policy = WriterFrontend::OverloadSettings::Policy::BLOCK; break;
+        case BifEnum::Log::OVERLOAD_DROP_OLDEST:
+            settings.policy = WriterFrontend::OverloadSettings::Policy::DROP_OLDEST;
+            break;
+        case BifEnum::Log::OVERLOAD_SPILL: settings.policy = WriterFrontend::OverloadSettings::Policy::SPILL; break;
+        default: reporter->InternalError("unknown Log::OverloadPolicy value: %" PRId64, overload_policy); break;
+    }
+
+    settings.spill_path = util::fmt("%s.overflow.log", writer->Info().path);
+
+    if ( ! overload_spill_dir.empty() )
+        settings.spill_path = overload_spill_dir + "/" + settings.spill_path;
+
+    writer->SetOverloadSettings(std::move(settings));
+}
+
 WriterFrontend* Manager::CreateWriterForFilter(Filter* filter, const std::string& path, WriterOrigin from) {
     // Copy the fields for WriterFrontend::Init() as it
     // will take ownership.
@@ -2142,7 +2245,8 @@ void Manager::Rotate(WriterInfo* winfo) {
 
     winfo->writer->Rotate(rotation_path.data(), winfo->open_time, run_state::network_time, run_state::terminating);
 
-    ++rotations_pending;
+    // Each of the writer's shards finishes separately.
+    rotations_pending += static_cast<int>(winfo->writer->NumShards());
 }
 
 bool Manager::FinishedRotation(WriterFrontend* writer, const char* new_name, const char* old_name, double open,
@@ -419,11 +419,26 @@ private:
      */
     WriterFrontend* CreateWriterForFilter(Filter* filter, const std::string& path, WriterOrigin origin);
 
+    /**
+     * Helper to set up a new writer's queue limit and its telemetry.
+     *
+     * @param writer the writer to configure.
+     * @param max_queued_batches the queue limit, zero for none.
+     * @param overload_policy the Log::OverloadPolicy value applying once the limit is reached.
+     * @param labels the writer's telemetry labels.
+     */
+    void ConfigureOverload(WriterFrontend* writer, zeek_uint_t max_queued_batches, zeek_int_t overload_policy,
+                           Span<const telemetry::LabelView> labels);
+
     bool TraverseRecord(Stream* stream, Filter* filter, RecordType* rt, TableVal* include, TableVal* exclude,
                         const std::string& path, const std::list<int>& indices);
 
-    detail::LogRecord RecordToLogRecord(const Stream* stream, Filter* filter, RecordVal* columns, size_t& total_size);
-    threading::Value ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t& total_size);
+    // Converts a record for writing. If a writer is given, the record's
+    // data goes into the arena of the writer's current batch.
+    detail::LogRecord RecordToLogRecord(const Stream* stream, Filter* filter, RecordVal* columns, size_t& total_size,
+                                        WriterFrontend* writer = nullptr);
+    threading::Value ValToLogVal(std::optional<ZVal>& val, Type* ty, size_t& total_size,
+                                 detail::RecordArena* arena = nullptr);
 
     Stream* FindStream(EnumVal* id);
     void RemoveDisabledWriters(Stream* stream);
@@ -453,6 +468,16 @@ private:
     std::shared_ptr<telemetry::CounterFamily> total_log_stream_writes_family;
     std::shared_ptr<telemetry::CounterFamily> total_log_writer_writes_family;
     std::shared_ptr<telemetry::CounterFamily> total_log_writer_discarded_writes_family;
+    std::shared_ptr<telemetry::CounterFamily> total_log_writer_dropped_writes_family;
+    std::shared_ptr<telemetry::CounterFamily> total_log_writer_spilled_writes_family;
+    std::shared_ptr<telemetry::GaugeFamily> log_writer_queued_batches_family;
+
+    // Overload handling for writers not instantiated by a filter.
+    zeek_uint_t default_max_queued_batches = 0;
+    zeek_int_t default_overload_policy = 0;
+    zeek_uint_t default_writer_shards = 1;
+    double overload_block_timeout = 0.0;
+    std::string overload_spill_dir;
 
     zeek_uint_t last_delay_token = 0;
     std::vector<detail::WriteContext> active_writes;
@@ -2,12 +2,70 @@
 
 #include "zeek/logging/Types.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "zeek/Desc.h"
 #include "zeek/Type.h"
 #include "zeek/Val.h"
 
+#include "zeek/3rdparty/doctest.h"
+
 namespace zeek::logging::detail {
 
+// Chunks grow along with the arena, up to this size.
+constexpr size_t MIN_CHUNK_SIZE = 4 * 1024;
+constexpr size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+struct RecordArena::Chunk {
+    Chunk* next;
+    size_t size;
+};
+
+RecordArena::~RecordArena() {
+    while ( chunks ) {
+        auto* next = chunks->next;
+        ::operator delete(chunks);
+        chunks = next;
+    }
+}
+
+void* RecordArena::AllocateSlow(size_t size, size_t align) {
+    size_t header = (sizeof(Chunk) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    size_t chunk_size = std::clamp(capacity, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+    chunk_size = std::max(chunk_size, header + size + align);
+
+    auto* chunk = static_cast<Chunk*>(::operator new(chunk_size));
+    chunk->next = chunks;
+    chunk->size = chunk_size;
+    chunks = chunk;
+    capacity += chunk_size;
+
+    pos = reinterpret_cast<char*>(chunk) + header;
+    end = reinterpret_cast<char*>(chunk) + chunk_size;
+
+    return Allocate(size, align);
+}
+
+void RecordArena::Rewind(const Mark& mark) {
+    while ( chunks != mark.chunks ) {
+        auto* next = chunks->next;
+        capacity -= chunks->size;
+        ::operator delete(chunks);
+        chunks = next;
+    }
+
+    pos = mark.pos;
+    end = mark.end;
+}
+
+char* RecordArena::CopyString(const char* s, size_t len) {
+    auto* buf = static_cast<char*>(Allocate(len + 1, 1));
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    return buf;
+}
+
 LogWriteHeader::LogWriteHeader(EnumValPtr arg_stream_id, EnumValPtr arg_writer_id, std::string arg_filter_name,
                                std::string arg_path)
     : stream_id(std::move(arg_stream_id)),
@@ -39,4 +97,87 @@ bool LogWriteHeader::PopulateEnumVals() {
     return true;
 }
 
+TEST_CASE("record arena") {
+    RecordArena arena;
+
+    SUBCASE("allocation") {
+        auto* a = static_cast<char*>(arena.Allocate(3, 1));
+        auto* b = arena.Allocate(sizeof(double), alignof(double));
+        CHECK(reinterpret_cast<uintptr_t>(b) % alignof(double) == 0);
+        CHECK(static_cast<char*>(b) >= a + 3);
+
+        // Larger than a chunk.
+        auto* c = static_cast<char*>(arena.Allocate(4 * 1024 * 1024));
+        memset(c, 0, 4 * 1024 * 1024);
+        CHECK(arena.Capacity() >= 4 * 1024 * 1024);
+
+        char* s = arena.CopyString("hello", 5);
+        CHECK(strcmp(s, "hello") == 0);
+    }
+
+    SUBCASE("rewind") {
+        arena.Allocate(16);
+        auto mark = arena.GetMark();
+        auto capacity = arena.Capacity();
+
+        // Within the current chunk.
+        auto* a = arena.Allocate(16);
+        arena.Rewind(mark);
+        CHECK(arena.Allocate(16) == a);
+        arena.Rewind(mark);
+
+        // Across new chunks.
+        arena.Allocate(64 * 1024);
+        arena.Allocate(2 * 1024 * 1024);
+        CHECK(arena.Capacity() > capacity);
+        arena.Rewind(mark);
+        CHECK(arena.Capacity() == capacity);
+        CHECK(arena.Allocate(16) == a);
+
+        // On an empty arena.
+        RecordArena empty;
+        auto empty_mark = empty.GetMark();
+        empty.Allocate(16);
+        empty.Rewind(empty_mark);
+        CHECK(empty.Capacity() == 0);
+    }
+
+    SUBCASE("records") {
+        std::vector<LogRecord> records;
+
+        for ( int i = 0; i < 1000; ++i ) {
+            LogRecord rec{RecordArenaAllocator<threading::Value>(&arena)};
+            rec.reserve(2);
+
+            threading::Value str{TYPE_STRING};
+            str.in_arena = true;
+            str.val.string_val.data = arena.CopyString("test", 4);
+            str.val.string_val.length = 4;
+            rec.emplace_back(std::move(str));
+
+            threading::Value vec{TYPE_VECTOR, TYPE_COUNT};
+            vec.in_arena = true;
+            vec.val.vector_val.vals = static_cast<threading::Value**>(arena.Allocate(sizeof(threading::Value*)));
+            vec.val.vector_val.vals[0] = new (arena.Allocate(sizeof(threading::Value))) threading::Value(TYPE_COUNT);
+            vec.val.vector_val.vals[0]->val.uint_val = i;
+            vec.val.vector_val.size = 1;
+            rec.emplace_back(std::move(vec));
+
+            records.emplace_back(std::move(rec));
+        }
+
+        CHECK(records[999][0].val.string_val.length == 4);
+        CHECK(records[999][1].val.vector_val.vals[0]->val.uint_val == 999);
+
+        // Copies own their data.
+        LogRecord copy{records[42].begin(), records[42].begin() + 1};
+        CHECK(copy.get_allocator().arena == nullptr);
+        CHECK_FALSE(copy[0].in_arena);
+        CHECK(memcmp(copy[0].val.string_val.data, "test", 4) == 0);
+
+        LogRecord copy2 = copy;
+        CHECK(copy2.get_allocator().arena == nullptr);
+    }
+}
+
 } // namespace zeek::logging::detail
@@ -7,7 +7,11 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "zeek/IntrusivePtr.h"
@@ -19,14 +23,143 @@ using EnumValPtr = IntrusivePtr<EnumVal>;
 
 namespace logging::detail {
 
+/**
+ * Memory for the log records of a batch.
+ *
+ * Log records buffered for a writer allocate their values and any string,
+ * set and vector payloads from an arena, which is handed to the writer
+ * thread along with the records and released in one step once it has
+ * written them. Memory is never returned to the arena individually.
+ *
+ * Not thread-safe: an arena is only used by one thread at a time.
+ */
+class RecordArena {
+public:
+    RecordArena() = default;
+    ~RecordArena();
+
+    RecordArena(const RecordArena&) = delete;
+    RecordArena& operator=(const RecordArena&) = delete;
+
+    /**
+     * Allocates memory from the arena.
+     *
+     * @param size The number of bytes.
+     * @param align The required alignment, a power of two.
+     */
+    void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        auto p = (reinterpret_cast<uintptr_t>(pos) + align - 1) & ~(uintptr_t(align) - 1);
+
+        if ( ! pos || p + size > reinterpret_cast<uintptr_t>(end) )
+            return AllocateSlow(size, align);
+
+        pos = reinterpret_cast<char*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+
+    /**
+     * Copies a string into the arena, adding a terminating NUL.
+     */
+    char* CopyString(const char* s, size_t len);
+
+    /**
+     * @return The number of bytes the arena has obtained from the heap.
+     */
+    size_t Capacity() const { return capacity; }
+
+    struct Chunk;
+
+    /**
+     * A position in the arena, see GetMark() and Rewind().
+     */
+    struct Mark {
+        Chunk* chunks = nullptr;
+        char* pos = nullptr;
+        char* end = nullptr;
+    };
+
+    /**
+     * @return The arena's current position.
+     */
+    Mark GetMark() const { return {chunks, pos, end}; }
+
+    /**
+     * Releases all memory allocated since the given mark was taken. Any
+     * objects living there must have been destroyed already.
+     */
+    void Rewind(const Mark& mark);
+
+private:
+    void* AllocateSlow(size_t size, size_t align);
+
+    Chunk* chunks = nullptr;
+    char* pos = nullptr;
+    char* end = nullptr;
+    size_t capacity = 0;
+};
+
+/**
+ * Allocator for containers that live in a RecordArena. A default
+ * constructed instance uses the heap instead, and copies of containers
+ * go to the heap as well.
+ */
+template<typename T>
+class RecordArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    RecordArenaAllocator() noexcept = default;
+
+    explicit RecordArenaAllocator(RecordArena* arena) noexcept : arena(arena) {}
+
+    template<typename U>
+    RecordArenaAllocator(const RecordArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if ( arena )
+            return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        if ( ! arena )
+            std::allocator<T>().deallocate(p, n);
+    }
+
+    RecordArenaAllocator select_on_container_copy_construction() const { return {}; }
+
+    template<typename U>
+    bool operator==(const RecordArenaAllocator<U>& other) const noexcept {
+        return arena == other.arena;
+    }
+
+    RecordArena* arena = nullptr;
+};
+
 /**
  * A single log record.
  *
  * This is what a Zeek record value passed into Log::write()
  * is converted into before passed to a local log writer or
  * send via the cluster to a remote node.
+ *
+ * Records created for local writers keep their values in the
+ * RecordArena of the batch they belong to.
+ */
+using LogRecord = std::vector<threading::Value, RecordArenaAllocator<threading::Value>>;
+
+/**
+ * A batch of log records for a local writer, together with the arena
+ * holding their data.
  */
-using LogRecord = std::vector<threading::Value>;
+struct LogRecordBatch {
+    // Declared first so that the records go away before their memory.
+    std::unique_ptr<RecordArena> arena;
+    std::vector<LogRecord> records;
+};
 
 /**
  * A struct holding all necessary information that relates to
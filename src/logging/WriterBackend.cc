@@ -110,10 +110,10 @@ WriterBackend::WriterBackend(WriterFrontend* arg_frontend) : MsgThread() {
     fields = nullptr;
     buffering = true;
     frontend = arg_frontend;
-    info = new WriterInfo(frontend->Info());
+    info = new WriterInfo(frontend->BackendInfo());
     rotation_counter = 0;
 
-    SetName(frontend->Name());
+    SetName(frontend->BackendName());
 }
 
 WriterBackend::~WriterBackend() {
@@ -201,7 +201,16 @@ bool WriterBackend::Write(int arg_num_fields, zeek::Span<detail::LogRecord> reco
 
     bool success = true;
 
-    if ( ! Failed() ) {
+    if ( ! Failed() && WantsColumnarBatches() ) {
+        if ( ! columnar_batch )
+            columnar_batch = std::make_unique<ColumnarBatch>(num_fields, fields);
+
+        columnar_batch->Clear();
+        columnar_batch->Append(records);
+        success = DoWriteBatch(*columnar_batch);
+    }
+
+    else if ( ! Failed() ) {
         // Populate a Value* array for backwards compat with plugin
         // provided WriterBackend implementations that expect to
         // receive a threading::Value**.
@@ -231,6 +240,11 @@ bool WriterBackend::Write(int arg_num_fields, zeek::Span<detail::LogRecord> reco
     return success;
 }
 
+bool WriterBackend::DoWriteBatch(const ColumnarBatch& batch) {
+    Error("writer does not implement columnar batch output");
+    return false;
+}
+
 bool WriterBackend::SetBuf(bool enabled) {
     if ( enabled == buffering )
         // No change.
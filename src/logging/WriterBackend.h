@@ -4,7 +4,12 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
 #include "zeek/Span.h"
+#include "zeek/logging/ColumnarBatch.h"
 #include "zeek/logging/Component.h"
 #include "zeek/logging/Types.h"
 #include "zeek/threading/MsgThread.h"
@@ -258,6 +263,22 @@ public:
     // info function in the base.
     using MsgThread::Info;
 
+    /**
+     * Bookkeeping that the frontend and the backend share to bound the
+     * number of write batches queued for the writer thread. Unlike the
+     * rest of this class, it's safe to access from any thread.
+     */
+    struct WriteQueueState {
+        std::atomic<uint64_t> queued_batches = 0;  //! Batches sent, but not yet processed.
+        std::atomic<uint64_t> shed_batches = 0;    //! Number of oldest batches to skip.
+        std::atomic<uint64_t> dropped_records = 0; //! Records in batches skipped so far.
+    };
+
+    /**
+     * Returns the write queue state shared with the frontend.
+     */
+    WriteQueueState& WriteQueue() { return write_queue; }
+
 protected:
     friend class FinishMessage;
 
@@ -284,6 +305,31 @@ protected:
      */
     virtual bool DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) = 0;
 
+    /**
+     * Returns true if the writer wants to receive its log entries in
+     * columnar form through DoWriteBatch() instead of one at a time
+     * through DoWrite(). The backend then converts each batch of records
+     * it receives into a ColumnarBatch. The default returns false.
+     */
+    virtual bool WantsColumnarBatches() const { return false; }
+
+    /**
+     * Writer-specific output method implementing recording of a batch of
+     * log entries in columnar form. Called instead of DoWrite() for
+     * writers whose WantsColumnarBatches() returns true, which must
+     * override it.
+     *
+     * The batch is reused for subsequent calls, so the writer must copy
+     * anything it wants to keep beyond returning.
+     *
+     * If the method returns false, it will be assumed that a fatal error
+     * has occurred that prevents the writer from further operation; it
+     * will then be disabled and eventually deleted. When returning
+     * false, an implementation should also call Error() to indicate what
+     * happened.
+     */
+    virtual bool DoWriteBatch(const ColumnarBatch& batch);
+
     /**
      * Writer-specific method implementing a change of the buffering
      * state.  If buffering is disabled, the writer should attempt to
@@ -387,7 +433,11 @@ private:
     const threading::Field* const* fields; // Log fields.
     bool buffering;                        // True if buffering is enabled.
 
+    std::unique_ptr<ColumnarBatch> columnar_batch; // Reused for DoWriteBatch().
+
     int rotation_counter; // Tracks FinishedRotation() calls.
+
+    WriteQueueState write_queue; // Shared with the frontend.
 };
 
 } // namespace zeek::logging
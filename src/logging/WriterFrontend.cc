@@ -2,13 +2,27 @@
 
 #include "zeek/logging/WriterFrontend.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "zeek/AsyncFileWriter.h"
+#include "zeek/Desc.h"
 #include "zeek/RunState.h"
 #include "zeek/Span.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/cluster/Backend.h"
 #include "zeek/logging/Manager.h"
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/telemetry/Counter.h"
+#include "zeek/telemetry/Gauge.h"
 #include "zeek/threading/SerialTypes.h"
+#include "zeek/threading/formatters/JSON.h"
 
 using zeek::threading::Field;
 using zeek::threading::Value;
@@ -54,16 +68,28 @@ private:
 
 class WriteMessage final : public threading::InputMessage<WriterBackend> {
 public:
-    WriteMessage(WriterBackend* backend, int num_fields, std::vector<detail::LogRecord>&& records)
-        : threading::InputMessage<WriterBackend>("Write", backend),
-          num_fields(num_fields),
-          records(std::move(records)) {}
+    WriteMessage(WriterBackend* backend, int num_fields, detail::LogRecordBatch&& batch)
+        : threading::InputMessage<WriterBackend>("Write", backend), num_fields(num_fields), batch(std::move(batch)) {}
+
+    bool Process() override {
+        auto& queue = Object()->WriteQueue();
+        queue.queued_batches.fetch_sub(1);
+
+        // The frontend asks us to skip the oldest batches when it
+        // enforces its queue limit by dropping those. We're it. Only
+        // this thread decrements the count.
+        if ( queue.shed_batches.load() > 0 ) {
+            queue.shed_batches.fetch_sub(1);
+            queue.dropped_records.fetch_add(batch.records.size());
+            return true;
+        }
 
-    bool Process() override { return Object()->Write(num_fields, zeek::Span{records}); }
+        return Object()->Write(num_fields, zeek::Span{batch.records});
+    }
 
 private:
     int num_fields;
-    std::vector<detail::LogRecord> records;
+    detail::LogRecordBatch batch;
 };
 
 class SetBufMessage final : public threading::InputMessage<WriterBackend> {
@@ -91,7 +117,7 @@ private:
 // Frontend methods.
 
 WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVal* arg_stream, EnumVal* arg_writer,
-                               bool arg_local, bool arg_remote)
+                               bool arg_local, bool arg_remote, size_t arg_shards)
     : write_buffer(detail::WriteBuffer(BifConst::Log::write_buffer_size)) {
     // The header's fields are initialized in Init()
     header = detail::LogWriteHeader{{zeek::NewRef{}, arg_stream},
@@ -112,14 +138,28 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
     name = util::copy_string(util::fmt("%s/%s", arg_info.path, w));
 
     if ( local ) {
-        backend = log_mgr->CreateBackend(this, header.writer_id.get());
+        for ( size_t i = 0; i < std::max<size_t>(arg_shards, 1); ++i ) {
+            // Each shard writes to its own path, which the backend picks
+            // up from BackendInfo() when it gets instantiated.
+            WriterBackend::WriterInfo shard_info(*info);
+
+            if ( arg_shards > 1 ) {
+                delete[] shard_info.path;
+                shard_info.path = util::copy_string(util::fmt("%s.%zu", info->path, i));
+                backend_name = util::fmt("%s/%s", shard_info.path, w);
+                backend_info = &shard_info;
+            }
+
+            auto* backend = log_mgr->CreateBackend(this, header.writer_id.get());
+            backend_info = nullptr;
+
+            if ( ! backend )
+                break;
 
-        if ( backend )
             backend->Start();
+            backends.push_back(backend);
+        }
     }
-
-    else
-        backend = nullptr;
 }
 
 WriterFrontend::~WriterFrontend() {
@@ -128,6 +168,8 @@ WriterFrontend::~WriterFrontend() {
 
     delete[] fields;
 
+    CloseSpill();
+
     delete info;
     delete[] name;
 }
@@ -138,11 +180,17 @@ void WriterFrontend::Stop() {
     }
 
     FlushWriteBuffer();
+    CloseSpill();
     SetDisable();
 
-    if ( backend ) {
-        backend->SignalStop();
-        backend = nullptr; // Thread manager will clean it up once it finishes.
+    if ( ! backends.empty() ) {
+        if ( overload.queued_batches )
+            overload.queued_batches->Set(0);
+
+        for ( auto* backend : backends )
+            backend->SignalStop();
+
+        backends.clear(); // Thread manager will clean them up once they finish.
     }
 }
 
@@ -158,7 +206,7 @@ void WriterFrontend::Init(int arg_num_fields, const Field* const* arg_fields) {
 
     initialized = true;
 
-    if ( backend ) {
+    for ( auto* backend : backends ) {
         auto fs = new Field*[num_fields];
 
         for ( auto i = 0; i < num_fields; ++i )
@@ -177,7 +225,7 @@ void WriterFrontend::Init(int arg_num_fields, const Field* const* arg_fields) {
 }
 
 void WriterFrontend::Write(detail::LogRecord&& arg_vals) {
-    std::vector<threading::Value> vals = std::move(arg_vals);
+    detail::LogRecord vals = std::move(arg_vals);
 
     if ( disabled )
         return;
@@ -200,18 +248,18 @@ void WriterFrontend::Write(detail::LogRecord&& arg_vals) {
         if ( broker_is_cluster_backend ) {
             zeek::broker_mgr->PublishLogWrite(header.stream_id.get(), header.writer_id.get(), info->path, vals);
 
-            if ( ! backend ) // nothing left do do if we do not log locally
+            if ( backends.empty() ) // nothing left do do if we do not log locally
                 return;
         }
     }
-    else if ( ! backend ) {
+    else if ( backends.empty() ) {
         assert(! remote);
         // Not remote and no backend, we're done.
         return;
     }
 
     // Either non-broker remote or local logging.
-    assert(backend || (remote && ! broker_is_cluster_backend));
+    assert(! backends.empty() || (remote && ! broker_is_cluster_backend));
 
     write_buffer.WriteRecord(std::move(vals));
 
@@ -220,24 +268,221 @@ void WriterFrontend::Write(detail::LogRecord&& arg_vals) {
         FlushWriteBuffer();
 }
 
+detail::RecordArena* WriterFrontend::Arena() {
+    // Records written without a local backend or a cluster backend other
+    // than broker don't get buffered.
+    if ( disabled || (backends.empty() && ! (remote && zeek::cluster::backend != zeek::broker_mgr)) )
+        return nullptr;
+
+    return write_buffer.Arena();
+}
+
 void WriterFrontend::FlushWriteBuffer() {
     if ( disabled )
         return;
 
-    if ( write_buffer.Empty() )
-        // Nothing to do.
+    // The backend's heartbeats trigger this regularly, even while there
+    // aren't any writes.
+    UpdateQueueTelemetry();
+
+    if ( write_buffer.Empty() ) {
+        // Nothing to do, except for dropping what records that didn't
+        // make it into the buffer left behind.
+        write_buffer.ReleaseArena();
         return;
+    }
 
-    auto records = std::move(write_buffer).TakeRecords();
+    auto batch = std::move(write_buffer).TakeRecords();
 
     // We've already pushed to broker during Write(). If another backend
     // is used, push all the buffered log records to it now.
     const bool broker_is_cluster_backend = zeek::cluster::backend == zeek::broker_mgr;
     if ( remote && ! broker_is_cluster_backend )
-        zeek::cluster::backend->PublishLogWrites(header, Span{records});
+        zeek::cluster::backend->PublishLogWrites(header, Span{batch.records});
+
+    if ( backends.empty() )
+        return;
+
+    auto* backend = NextBackend();
+
+    if ( AdmitBatch(backend, batch) ) {
+        backend->WriteQueue().queued_batches.fetch_add(1);
+        backend->SendIn(new WriteMessage(backend, num_fields, std::move(batch)));
+    }
+}
+
+WriterBackend* WriterFrontend::NextBackend() {
+    if ( backends.size() == 1 )
+        return backends[0];
+
+    // Take turns, but skip ahead to whichever shard has the fewest
+    // batches queued.
+    size_t best = next_shard;
+    uint64_t best_queued = backends[best]->WriteQueue().queued_batches.load(std::memory_order_relaxed);
+
+    for ( size_t i = 1; i < backends.size() && best_queued > 0; ++i ) {
+        size_t idx = (next_shard + i) % backends.size();
+        uint64_t queued = backends[idx]->WriteQueue().queued_batches.load(std::memory_order_relaxed);
+
+        if ( queued < best_queued ) {
+            best = idx;
+            best_queued = queued;
+        }
+    }
+
+    next_shard = (best + 1) % backends.size();
+    return backends[best];
+}
+
+bool WriterFrontend::AdmitBatch(WriterBackend* backend, detail::LogRecordBatch& batch) {
+    const uint64_t limit = overload.max_queued_batches;
+
+    if ( limit == 0 )
+        return true;
+
+    auto& queue = backend->WriteQueue();
+
+    switch ( overload.policy ) {
+        case OverloadSettings::Policy::BLOCK: {
+            if ( queue.queued_batches.load() < limit )
+                return true;
+
+            // Give the backend a moment to catch up, stalling the main
+            // loop meanwhile.
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(overload.block_timeout);
+
+            while ( queue.queued_batches.load() >= limit ) {
+                if ( std::chrono::steady_clock::now() >= deadline || backend->Killed() ) {
+                    CountDropped(batch.records.size());
+                    return false;
+                }
+
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+
+            return true;
+        }
+
+        case OverloadSettings::Policy::DROP_OLDEST: {
+            uint64_t queued = queue.queued_batches.load();
+            uint64_t shed = std::min(queue.shed_batches.load(), queued);
+
+            if ( queued - shed < limit )
+                return true;
+
+            // A backend that's stuck altogether never gets to skipping
+            // anything, so at some point, drop the new batch instead.
+            if ( queued >= 2 * limit ) {
+                CountDropped(batch.records.size());
+                return false;
+            }
 
-    if ( backend )
-        backend->SendIn(new WriteMessage(backend, num_fields, std::move(records)));
+            queue.shed_batches.fetch_add(1);
+            return true;
+        }
+
+        case OverloadSettings::Policy::SPILL:
+            if ( queue.queued_batches.load() < limit )
+                return true;
+
+            SpillBatch(batch);
+            return false;
+    }
+
+    return true;
+}
+
+void WriterFrontend::SpillBatch(detail::LogRecordBatch& batch) {
+    if ( ! spill_writer && ! spill_failed ) {
+        // No O_APPEND, the writer needs positional access. It starts
+        // at the current end of the file instead.
+        spill_fd = open(overload.spill_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+
+        if ( spill_fd < 0 || lseek(spill_fd, 0, SEEK_END) < 0 ) {
+            reporter->Error("cannot open log overflow file %s for %s: %s", overload.spill_path.c_str(), name,
+                            strerror(errno));
+            CloseSpill();
+            spill_failed = true;
+        }
+        else
+            spill_writer = std::make_unique<zeek::detail::AsyncFileWriter>(spill_fd);
+    }
+
+    if ( ! spill_writer ) {
+        CountDropped(batch.records.size());
+        return;
+    }
+
+    // The formatter runs on the main thread, so without a thread of its
+    // own it reports errors through the reporter.
+    if ( ! spill_formatter )
+        spill_formatter = std::make_unique<threading::formatter::JSON>(nullptr, threading::formatter::JSON::TS_EPOCH);
+
+    ODesc desc;
+    std::vector<Value*> vals(num_fields);
+
+    for ( auto& record : batch.records ) {
+        for ( int i = 0; i < num_fields; ++i )
+            vals[i] = &record[i];
+
+        spill_formatter->Describe(&desc, num_fields, fields, vals.data());
+        desc.AddRaw("\n", 1);
+    }
+
+    // The writer only queues the data, the helper writes it out.
+    if ( ! spill_writer->Write(reinterpret_cast<const char*>(desc.Bytes()), desc.Len()) ) {
+        reporter->Error("cannot write log overflow file %s for %s: %s", overload.spill_path.c_str(), name,
+                        spill_writer->Error().c_str());
+        CloseSpill();
+        spill_failed = true;
+        CountDropped(batch.records.size());
+        return;
+    }
+
+    if ( overload.spilled_records )
+        overload.spilled_records->Inc(batch.records.size());
+}
+
+void WriterFrontend::CloseSpill() {
+    if ( spill_writer ) {
+        if ( ! spill_writer->Sync() )
+            reporter->Error("cannot write log overflow file %s for %s: %s", overload.spill_path.c_str(), name,
+                            spill_writer->Error().c_str());
+
+        spill_writer.reset();
+    }
+
+    if ( spill_fd >= 0 ) {
+        close(spill_fd);
+        spill_fd = -1;
+    }
+}
+
+void WriterFrontend::CountDropped(uint64_t n) {
+    if ( overload.dropped_records )
+        overload.dropped_records->Inc(n);
+}
+
+void WriterFrontend::UpdateQueueTelemetry() {
+    if ( backends.empty() )
+        return;
+
+    uint64_t queued = 0;
+    uint64_t drops = 0;
+
+    for ( auto* backend : backends ) {
+        auto& queue = backend->WriteQueue();
+        queued += queue.queued_batches.load(std::memory_order_relaxed);
+        drops += queue.dropped_records.load(std::memory_order_relaxed);
+    }
+
+    if ( overload.queued_batches )
+        overload.queued_batches->Set(queued);
+
+    if ( drops > reported_backend_drops ) {
+        CountDropped(drops - reported_backend_drops);
+        reported_backend_drops = drops;
+    }
 }
 
 void WriterFrontend::SetBuf(bool enabled) {
@@ -246,7 +491,7 @@ void WriterFrontend::SetBuf(bool enabled) {
 
     buf = enabled;
 
-    if ( backend )
+    for ( auto* backend : backends )
         backend->SendIn(new SetBufMessage(backend, enabled));
 
     if ( ! buf )
@@ -260,7 +505,10 @@ void WriterFrontend::Flush(double network_time) {
 
     FlushWriteBuffer();
 
-    if ( backend )
+    if ( spill_writer )
+        spill_writer->Flush();
+
+    for ( auto* backend : backends )
         backend->SendIn(new FlushMessage(backend, network_time));
 }
 
@@ -270,8 +518,16 @@ void WriterFrontend::Rotate(const char* rotated_path, double open, double close,
 
     FlushWriteBuffer();
 
-    if ( backend )
-        backend->SendIn(new RotateMessage(backend, this, rotated_path, open, close, terminating));
+    if ( backends.size() == 1 )
+        backends[0]->SendIn(new RotateMessage(backends[0], this, rotated_path, open, close, terminating));
+
+    else if ( ! backends.empty() ) {
+        // Each shard reports back separately.
+        for ( size_t i = 0; i < backends.size(); ++i )
+            backends[i]->SendIn(new RotateMessage(backends[i], this, util::fmt("%s.%zu", rotated_path, i), open,
+                                                  close, terminating));
+    }
+
     else
         // Still signal log manager that we're done.
         log_mgr->FinishedRotation(this, nullptr, nullptr, 0, 0, false, terminating);
@@ -2,9 +2,29 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "zeek/logging/Types.h"
 #include "zeek/logging/WriterBackend.h"
 
+namespace zeek::detail {
+class AsyncFileWriter;
+}
+
+namespace zeek::telemetry {
+class Counter;
+class Gauge;
+} // namespace zeek::telemetry
+
+namespace zeek::threading {
+class Formatter;
+}
+
 namespace zeek::logging {
 
 class Manager;
@@ -25,6 +45,25 @@ public:
      */
     explicit WriteBuffer(size_t buffer_size) : buffer_size(buffer_size) {}
 
+    /**
+     * Returns the arena for the records of the current batch, creating it
+     * if needed. Records written to the buffer may keep their data in it.
+     */
+    RecordArena* Arena() {
+        if ( ! arena )
+            arena = std::make_unique<RecordArena>();
+
+        return arena.get();
+    }
+
+    /**
+     * Releases the arena. Must only be called while the buffer is empty.
+     */
+    void ReleaseArena() {
+        assert(records.empty());
+        arena.reset();
+    }
+
     /**
      * Push a record to the buffer.
      *
@@ -37,14 +76,14 @@ public:
      *
      * @return The currently buffered log records.
      */
-    std::vector<LogRecord> TakeRecords() && {
-        auto tmp = std::move(records);
+    LogRecordBatch TakeRecords() && {
+        LogRecordBatch batch{std::move(arena), std::move(records)};
 
         // Re-initialize the buffer.
         records.clear();
         records.reserve(buffer_size);
 
-        return tmp;
+        return batch;
     }
 
     /**
@@ -64,6 +103,7 @@ public:
 
 private:
     size_t buffer_size;
+    std::unique_ptr<RecordArena> arena;
     std::vector<LogRecord> records;
 };
 
@@ -97,9 +137,14 @@ public:
      * remote: If true, the writer will forward logs to remote
      * clients.
      *
+     * shards: The number of backends to spread local writes across. With
+     * more than one, each backend writes to the path with its index
+     * appended, like \c conn.0, and gets a share of the write batches.
+     *
      * Frontends must only be instantiated by the main thread.
      */
-    WriterFrontend(const WriterBackend::WriterInfo& info, EnumVal* stream, EnumVal* writer, bool local, bool remote);
+    WriterFrontend(const WriterBackend::WriterInfo& info, EnumVal* stream, EnumVal* writer, bool local, bool remote,
+                   size_t shards = 1);
 
     /**
      * Destructor.
@@ -154,6 +199,17 @@ public:
      */
     void Write(detail::LogRecord&& rec);
 
+    /**
+     * Returns the arena that records passed to the next Write() can
+     * allocate their data from. The arena changes when the write buffer
+     * gets flushed.
+     *
+     * Returns null if records won't be buffered.
+     *
+     * This method must only be called from the main thread.
+     */
+    detail::RecordArena* Arena();
+
     /**
      * Sets the buffering state.
      *
@@ -202,6 +258,35 @@ public:
      */
     void FlushWriteBuffer();
 
+    /**
+     * Settings for dealing with a backend that can't keep up with the
+     * writes sent to it.
+     */
+    struct OverloadSettings {
+        enum class Policy {
+            BLOCK,       //! Wait for the backend, then drop the new batch.
+            DROP_OLDEST, //! Have the backend skip the oldest queued batch.
+            SPILL,       //! Append the new batch to a local overflow file.
+        };
+
+        uint64_t max_queued_batches = 0; //! Limit of batches queued for the backend, zero for none.
+        Policy policy = Policy::BLOCK;   //! What to do with batches beyond the limit.
+        double block_timeout = 0.0;      //! For BLOCK, the longest time to wait, in seconds.
+        std::string spill_path;          //! For SPILL, the overflow file.
+
+        std::shared_ptr<telemetry::Gauge> queued_batches;    //! Tracks the queue depth, if set.
+        std::shared_ptr<telemetry::Counter> dropped_records; //! Counts dropped records, if set.
+        std::shared_ptr<telemetry::Counter> spilled_records; //! Counts spilled records, if set.
+    };
+
+    /**
+     * Sets how to deal with a backend falling behind. By default, there's
+     * no limit to the writes queued for it.
+     *
+     * This method must only be called from the main thread.
+     */
+    void SetOverloadSettings(OverloadSettings settings) { overload = std::move(settings); }
+
     /**
      * Disables the writer frontend. From now on, all method calls that
      * would normally send message over to the backend, turn into no-ops.
@@ -226,6 +311,26 @@ public:
      */
     const WriterBackend::WriterInfo& Info() const { return *info; }
 
+    /**
+     * Returns the writer information for the backend currently getting
+     * instantiated. With several shards, that differs from Info() in the
+     * path. This is for the WriterBackend constructor.
+     */
+    const WriterBackend::WriterInfo& BackendInfo() const { return backend_info ? *backend_info : *info; }
+
+    /**
+     * Returns the descriptive name for the backend currently getting
+     * instantiated. This is for the WriterBackend constructor.
+     */
+    const char* BackendName() const { return backend_info ? backend_name.c_str() : name; }
+
+    /**
+     * Returns the number of local backends writes get spread across, or
+     * one without local logging. Each of them reports back separately
+     * when rotating.
+     */
+    size_t NumShards() const { return std::max<size_t>(backends.size(), 1); }
+
     /**
      * Returns the number of log fields as passed into the constructor.
      */
@@ -263,12 +368,12 @@ public:
 protected:
     friend class Manager;
 
-    WriterBackend* backend; // The backend we have instantiated.
-    bool disabled;          // True if disabled.
-    bool initialized;       // True if initialized.
-    bool buf;               // True if buffering is enabled (default).
-    bool local;             // True if logging locally.
-    bool remote;            // True if logging remotely.
+    std::vector<WriterBackend*> backends; // The backends we have instantiated, one per shard.
+    bool disabled;                        // True if disabled.
+    bool initialized;                     // True if initialized.
+    bool buf;                             // True if buffering is enabled (default).
+    bool local;                           // True if logging locally.
+    bool remote;                          // True if logging remotely.
 
     const char* name;                      // Descriptive name of the
     WriterBackend::WriterInfo* info;       // The writer information.
@@ -277,6 +382,39 @@ protected:
 
     detail::LogWriteHeader header;    // Collected information about the WriterFrontend.
     detail::WriteBuffer write_buffer; // Buffer for bulk writes.
+
+private:
+    // Picks the backend to send the next batch to.
+    WriterBackend* NextBackend();
+
+    // Applies the overload policy to a batch about to be sent to the
+    // backend. Returns false if it must not be sent after all.
+    bool AdmitBatch(WriterBackend* backend, detail::LogRecordBatch& batch);
+
+    // Appends a batch to the overflow file as JSON lines.
+    void SpillBatch(detail::LogRecordBatch& batch);
+
+    // Writes out anything still pending for the spill file and closes it.
+    void CloseSpill();
+
+    // Counts records we gave up on.
+    void CountDropped(uint64_t n);
+
+    // Brings queue depth and drop telemetry up to date.
+    void UpdateQueueTelemetry();
+
+    size_t next_shard = 0; // Where NextBackend() starts looking.
+
+    // Set while instantiating a shard's backend.
+    const WriterBackend::WriterInfo* backend_info = nullptr;
+    std::string backend_name;
+
+    OverloadSettings overload;
+    uint64_t reported_backend_drops = 0; // Backend drops already counted.
+    int spill_fd = -1;
+    std::unique_ptr<zeek::detail::AsyncFileWriter> spill_writer; // Writes the spill file in the background.
+    bool spill_failed = false;
+    std::unique_ptr<threading::Formatter> spill_formatter;
 };
 
 } // namespace zeek::logging
@@ -0,0 +1,191 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/arrow/Arrow.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include "zeek/Val.h"
+#include "zeek/logging/writers/arrow/arrow.bif.h"
+
+using namespace std;
+
+namespace zeek::logging::writer::detail {
+
+Arrow::Arrow(WriterFrontend* frontend) : WriterBackend(frontend) {
+    options.compression_level = static_cast<int>(BifConst::LogArrow::compression_level);
+    options.dictionary_encoding = BifConst::LogArrow::dictionary_encoding;
+    batch_size = BifConst::LogArrow::batch_size;
+    logdir = zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString();
+}
+
+Arrow::~Arrow() {
+    // In case of errors aborting the logging altogether, DoFinish() may
+    // not have been called. Closing writes out the footer, so that what's
+    // been written so far remains readable.
+    if ( file )
+        file->Close();
+}
+
+bool Arrow::InitFilterOptions(const WriterInfo& info) {
+    // Set per-filter configuration options.
+    for ( const auto& [key, value] : info.config ) {
+        if ( strcmp(key, "compression_level") == 0 ) {
+            options.compression_level = atoi(value);
+
+            if ( options.compression_level < 0 || options.compression_level > 22 ) {
+                Error("invalid value for 'compression_level', must be a number between 0 and 22.");
+                return false;
+            }
+        }
+
+        else if ( strcmp(key, "dictionary_encoding") == 0 ) {
+            if ( strcmp(value, "T") == 0 )
+                options.dictionary_encoding = true;
+            else if ( strcmp(value, "F") == 0 )
+                options.dictionary_encoding = false;
+            else {
+                Error("invalid value for 'dictionary_encoding', must be a string and either \"T\" or \"F\"");
+                return false;
+            }
+        }
+
+        else if ( strcmp(key, "batch_size") == 0 ) {
+            batch_size = strtoull(value, nullptr, 10);
+
+            if ( batch_size == 0 ) {
+                Error("invalid value for 'batch_size', must be a positive number.");
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Arrow::DoInit(const WriterInfo& info, int num_fields, const threading::Field* const* fields) {
+    if ( ! InitFilterOptions(info) )
+        return false;
+
+    if ( options.compression_level > 0 && ! ArrowFile::HaveCompression() )
+        Warning(Fmt("zstd support not available, writing %s uncompressed", info.path));
+
+    fname = info.path;
+
+    if ( fname.front() != '/' && ! logdir.empty() )
+        fname = (std::filesystem::path(logdir) / fname).string();
+
+    fname += "." + LogExt();
+
+    file = std::make_unique<ArrowFile>(num_fields, fields, options);
+    pending = std::make_unique<ColumnarBatch>(num_fields, fields);
+
+    return OpenFile();
+}
+
+bool Arrow::OpenFile() {
+    if ( ! file->Open(fname) ) {
+        Error(file->Error().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool Arrow::WritePending() {
+    if ( pending->NumRows() == 0 )
+        return true;
+
+    bool ok = file->Write(*pending);
+    pending->Clear();
+
+    if ( ! ok )
+        Error(file->Error().c_str());
+
+    return ok;
+}
+
+bool Arrow::CloseFile() {
+    if ( ! file || ! file->IsOpen() )
+        return true;
+
+    bool ok = WritePending();
+
+    if ( ! file->Close() ) {
+        Error(file->Error().c_str());
+        ok = false;
+    }
+
+    return ok;
+}
+
+bool Arrow::DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) {
+    // Not reached, as we receive all records through DoWriteBatch().
+    Error("Arrow writer does not support writing individual records");
+    return false;
+}
+
+bool Arrow::DoWriteBatch(const ColumnarBatch& batch) {
+    if ( ! file->IsOpen() && ! OpenFile() )
+        return false;
+
+    // Collect records into record batches of the configured size, as
+    // larger ones compress better and are cheaper for readers to scan.
+    pending->Append(batch);
+
+    if ( pending->NumRows() >= batch_size || ! IsBuf() )
+        return WritePending();
+
+    return true;
+}
+
+bool Arrow::DoSetBuf(bool enabled) {
+    if ( ! enabled && file && file->IsOpen() )
+        return WritePending();
+
+    return true;
+}
+
+bool Arrow::DoFlush(double network_time) {
+    if ( ! file || ! file->IsOpen() )
+        return true;
+
+    return WritePending();
+}
+
+bool Arrow::DoRotate(const char* rotated_path, double open, double close, bool terminating) {
+    // Don't rotate if there's no file currently open.
+    if ( ! file || ! file->IsOpen() ) {
+        FinishedRotation();
+        return true;
+    }
+
+    if ( ! CloseFile() ) {
+        FinishedRotation();
+        return false;
+    }
+
+    string nname = string(rotated_path) + "." + LogExt();
+
+    if ( rename(fname.c_str(), nname.c_str()) != 0 ) {
+        Error(Fmt("failed to rename %s to %s: %s", fname.c_str(), nname.c_str(), Strerror(errno)));
+        FinishedRotation();
+        return false;
+    }
+
+    // The next write opens a new file.
+    if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) ) {
+        Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+        return false;
+    }
+
+    return true;
+}
+
+bool Arrow::DoFinish(double network_time) { return CloseFile(); }
+
+} // namespace zeek::logging::writer::detail
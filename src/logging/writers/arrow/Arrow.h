@@ -0,0 +1,52 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for Apache Arrow IPC files.
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "zeek/logging/ColumnarBatch.h"
+#include "zeek/logging/WriterBackend.h"
+#include "zeek/logging/writers/arrow/ArrowFile.h"
+
+namespace zeek::logging::writer::detail {
+
+class Arrow : public WriterBackend {
+public:
+    explicit Arrow(WriterFrontend* frontend);
+    ~Arrow() override;
+
+    static std::string LogExt() { return "arrow"; }
+
+    static WriterBackend* Instantiate(WriterFrontend* frontend) { return new Arrow(frontend); }
+
+protected:
+    bool DoInit(const WriterInfo& info, int num_fields, const threading::Field* const* fields) override;
+    bool DoWrite(int num_fields, const threading::Field* const* fields, threading::Value** vals) override;
+    bool WantsColumnarBatches() const override { return true; }
+    bool DoWriteBatch(const ColumnarBatch& batch) override;
+    bool DoSetBuf(bool enabled) override;
+    bool DoRotate(const char* rotated_path, double open, double close, bool terminating) override;
+    bool DoFlush(double network_time) override;
+    bool DoFinish(double network_time) override;
+    bool DoHeartbeat(double network_time, double current_time) override { return true; }
+
+private:
+    bool InitFilterOptions(const WriterInfo& info);
+    bool OpenFile();
+    bool WritePending();
+    bool CloseFile();
+
+    std::string fname;
+    std::unique_ptr<ArrowFile> file;
+    std::unique_ptr<ColumnarBatch> pending; // Records not yet written to the file.
+
+    // Options set from the script-level.
+    ArrowFile::Options options;
+    zeek_uint_t batch_size;
+    std::string logdir;
+};
+
+} // namespace zeek::logging::writer::detail
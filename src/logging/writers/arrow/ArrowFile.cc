@@ -0,0 +1,764 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/arrow/ArrowFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+#include "zeek/zeek-config.h"
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "zeek/threading/Formatter.h"
+#include "zeek/util.h"
+
+namespace zeek::logging::writer::detail {
+
+namespace {
+
+// Constants from the flatbuffers schemas of the Arrow format (Schema.fbs,
+// Message.fbs and File.fbs).
+constexpr int16_t METADATA_V5 = 4;
+
+constexpr uint8_t HEADER_SCHEMA = 1;
+constexpr uint8_t HEADER_DICTIONARY_BATCH = 2;
+constexpr uint8_t HEADER_RECORD_BATCH = 3;
+
+constexpr uint8_t ARROW_INT = 2;
+constexpr uint8_t ARROW_FLOATING_POINT = 3;
+constexpr uint8_t ARROW_UTF8 = 5;
+constexpr uint8_t ARROW_BOOL = 6;
+constexpr uint8_t ARROW_TIMESTAMP = 10;
+constexpr uint8_t ARROW_LIST = 12;
+constexpr uint8_t ARROW_DURATION = 18;
+
+constexpr int16_t PRECISION_DOUBLE = 2;
+constexpr int16_t TIME_UNIT_MICROSECOND = 2;
+constexpr int8_t CODEC_ZSTD = 1;
+
+// Padded to 8 bytes at the start of the file.
+constexpr char MAGIC[8] = "ARROW1";
+constexpr size_t MAGIC_LEN = 6;
+
+template<typename T>
+void append_le(std::string& out, T value) {
+    auto v = static_cast<std::make_unsigned_t<T>>(value);
+
+    for ( size_t i = 0; i < sizeof(T); ++i )
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void pad_to_8(std::string& out) { out.append((8 - out.size() % 8) % 8, '\0'); }
+
+// Builds a flatbuffer. As objects may only refer to ones stored after
+// them, the buffer gets built back to front, with objects identified by
+// their distance from its end.
+class FlatBufferBuilder {
+public:
+    using Offset = uint32_t;
+
+    void StartTable() {
+        fields.clear();
+        table_start = Size();
+    }
+
+    template<typename T>
+    void AddScalar(int slot, T value) {
+        Align(sizeof(T));
+        Prepend(value);
+        fields.push_back({slot, Size()});
+    }
+
+    void AddOffset(int slot, Offset off) {
+        PrependOffset(off);
+        fields.push_back({slot, Size()});
+    }
+
+    Offset EndTable() {
+        // The table starts with the distance back to its vtable, which we
+        // patch in once we know it.
+        Align(4);
+        Prepend<int32_t>(0);
+        size_t table = Size();
+
+        int num_slots = 0;
+        for ( const auto& f : fields )
+            num_slots = std::max(num_slots, f.slot + 1);
+
+        std::vector<uint16_t> vtable(num_slots, 0);
+        for ( const auto& f : fields )
+            vtable[f.slot] = static_cast<uint16_t>(table - f.pos);
+
+        for ( auto it = vtable.rbegin(); it != vtable.rend(); ++it )
+            Prepend(*it);
+
+        Prepend(static_cast<uint16_t>(table - table_start));
+        Prepend(static_cast<uint16_t>(4 + 2 * num_slots));
+
+        auto vtable_offset = static_cast<uint32_t>(Size() - table);
+        for ( size_t i = 0; i < 4; ++i )
+            rev[table - 1 - i] = static_cast<char>((vtable_offset >> (8 * i)) & 0xff);
+
+        fields.clear();
+        return static_cast<Offset>(table);
+    }
+
+    Offset CreateString(std::string_view s) {
+        Align(4, s.size() + 1);
+        rev.push_back('\0');
+        PrependBytes(s.data(), s.size());
+        Prepend(static_cast<uint32_t>(s.size()));
+        return static_cast<Offset>(Size());
+    }
+
+    Offset CreateOffsetVector(const std::vector<Offset>& offsets) {
+        Align(4, 4 * offsets.size());
+
+        for ( auto it = offsets.rbegin(); it != offsets.rend(); ++it )
+            PrependOffset(*it);
+
+        Prepend(static_cast<uint32_t>(offsets.size()));
+        return static_cast<Offset>(Size());
+    }
+
+    // Creates a vector of structs given as their little-endian bytes.
+    Offset CreateStructVector(const std::string& structs, size_t num, size_t alignment) {
+        Align(std::max<size_t>(alignment, 4), structs.size());
+        PrependBytes(structs.data(), structs.size());
+        Prepend(static_cast<uint32_t>(num));
+        return static_cast<Offset>(Size());
+    }
+
+    std::string Finish(Offset root) {
+        Align(max_align, 4);
+        PrependOffset(root);
+        return {rev.rbegin(), rev.rend()};
+    }
+
+private:
+    size_t Size() const { return rev.size(); }
+
+    // Pads so that Size() + extra becomes a multiple of alignment.
+    void Align(size_t alignment, size_t extra = 0) {
+        max_align = std::max(max_align, alignment);
+        rev.append((alignment - (Size() + extra) % alignment) % alignment, '\0');
+    }
+
+    void PrependBytes(const void* data, size_t len) {
+        auto p = static_cast<const char*>(data);
+        rev.append(std::make_reverse_iterator(p + len), std::make_reverse_iterator(p));
+    }
+
+    template<typename T>
+    void Prepend(T value) {
+        auto v = static_cast<std::make_unsigned_t<T>>(value);
+
+        for ( size_t i = sizeof(T); i > 0; --i )
+            rev.push_back(static_cast<char>((v >> (8 * (i - 1))) & 0xff));
+    }
+
+    void PrependOffset(Offset off) {
+        Align(4);
+        Prepend(static_cast<uint32_t>(Size() + 4 - off));
+    }
+
+    struct FieldPos {
+        int slot;
+        size_t pos;
+    };
+
+    std::string rev; // The buffer, in reverse.
+    size_t max_align = 4;
+    std::vector<FieldPos> fields;
+    size_t table_start = 0;
+};
+
+using Offset = FlatBufferBuilder::Offset;
+
+std::string build_message(FlatBufferBuilder& fb, uint8_t header_type, Offset header, int64_t body_length) {
+    fb.StartTable();
+    fb.AddScalar<int64_t>(3, body_length);
+    fb.AddOffset(2, header);
+    fb.AddScalar<int16_t>(0, METADATA_V5);
+    fb.AddScalar<uint8_t>(1, header_type);
+    return fb.Finish(fb.EndTable());
+}
+
+std::pair<uint8_t, Offset> build_type(FlatBufferBuilder& fb, TypeTag type) {
+    switch ( type ) {
+        case TYPE_BOOL: fb.StartTable(); return {ARROW_BOOL, fb.EndTable()};
+
+        case TYPE_INT:
+        case TYPE_COUNT:
+        case TYPE_PORT:
+            fb.StartTable();
+            fb.AddScalar<int32_t>(0, 64);
+            fb.AddScalar<uint8_t>(1, type == TYPE_INT);
+            return {ARROW_INT, fb.EndTable()};
+
+        case TYPE_DOUBLE:
+            fb.StartTable();
+            fb.AddScalar<int16_t>(0, PRECISION_DOUBLE);
+            return {ARROW_FLOATING_POINT, fb.EndTable()};
+
+        case TYPE_TIME: {
+            auto tz = fb.CreateString("UTC");
+            fb.StartTable();
+            fb.AddOffset(1, tz);
+            fb.AddScalar<int16_t>(0, TIME_UNIT_MICROSECOND);
+            return {ARROW_TIMESTAMP, fb.EndTable()};
+        }
+
+        case TYPE_INTERVAL:
+            fb.StartTable();
+            fb.AddScalar<int16_t>(0, TIME_UNIT_MICROSECOND);
+            return {ARROW_DURATION, fb.EndTable()};
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR: fb.StartTable(); return {ARROW_LIST, fb.EndTable()};
+
+        default:
+            // Everything else gets rendered into strings.
+            fb.StartTable();
+            return {ARROW_UTF8, fb.EndTable()};
+    }
+}
+
+Offset build_field(FlatBufferBuilder& fb, const char* name, bool nullable, TypeTag type, TypeTag subtype,
+                   int64_t dictionary_id) {
+    std::vector<Offset> children;
+
+    if ( type == TYPE_TABLE || type == TYPE_VECTOR )
+        children.push_back(build_field(fb, "item", true, subtype, TYPE_VOID, -1));
+
+    auto children_vec = fb.CreateOffsetVector(children);
+    auto [type_type, type_table] = build_type(fb, type);
+    Offset dictionary = 0;
+
+    if ( dictionary_id >= 0 ) {
+        fb.StartTable();
+        fb.AddScalar<int32_t>(0, 32);
+        fb.AddScalar<uint8_t>(1, 1);
+        auto index_type = fb.EndTable();
+
+        fb.StartTable();
+        fb.AddScalar<int64_t>(0, dictionary_id);
+        fb.AddOffset(1, index_type);
+        dictionary = fb.EndTable();
+    }
+
+    auto name_str = fb.CreateString(name);
+
+    fb.StartTable();
+    fb.AddOffset(0, name_str);
+    fb.AddOffset(3, type_table);
+    fb.AddOffset(5, children_vec);
+
+    if ( dictionary )
+        fb.AddOffset(4, dictionary);
+
+    fb.AddScalar<uint8_t>(1, nullable);
+    fb.AddScalar<uint8_t>(2, type_type);
+    return fb.EndTable();
+}
+
+// Zeek strings are raw bytes, while Arrow requires UTF-8. Like the JSON
+// formatter does, escape the ones that aren't valid UTF-8.
+void append_utf8(std::string& out, std::string_view s) {
+    if ( std::all_of(s.begin(), s.end(), [](char c) { return static_cast<unsigned char>(c) < 0x80; }) )
+        out.append(s);
+    else
+        out.append(util::json_escape_utf8(s.data(), s.size()));
+}
+
+} // namespace
+
+class ArrowCompressor {
+public:
+    explicit ArrowCompressor(int arg_level) {
+#ifdef USE_ZSTD
+        level = arg_level;
+        ctx = ZSTD_createCCtx();
+#endif
+    }
+
+    ~ArrowCompressor() {
+#ifdef USE_ZSTD
+        ZSTD_freeCCtx(ctx);
+#endif
+    }
+
+    // Appends the compressed data to out, returning false if that wasn't
+    // possible or didn't make it smaller.
+    bool Compress(std::string& out, const void* data, size_t len) {
+#ifdef USE_ZSTD
+        size_t start = out.size();
+        size_t bound = ZSTD_compressBound(len);
+
+        out.resize(start + bound);
+        size_t n = ZSTD_compressCCtx(ctx, out.data() + start, bound, data, len, level);
+
+        if ( ! ZSTD_isError(n) && n < len ) {
+            out.resize(start + n);
+            return true;
+        }
+
+        out.resize(start);
+#endif
+        return false;
+    }
+
+private:
+#ifdef USE_ZSTD
+    int level = 0;
+    ZSTD_CCtx* ctx = nullptr;
+#endif
+};
+
+struct ArrowDictionary {
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+
+    explicit ArrowDictionary(int64_t arg_id) : id(arg_id) {}
+
+    int32_t Lookup(std::string_view value) {
+        if ( auto it = index.find(value); it != index.end() )
+            return it->second;
+
+        auto i = static_cast<int32_t>(offsets.size() - 1);
+        data.append(value);
+        offsets.push_back(static_cast<int32_t>(data.size()));
+        index.emplace(value, i);
+        return i;
+    }
+
+    int64_t id;
+    std::unordered_map<std::string, int32_t, Hash, std::equal_to<>> index;
+    std::vector<int32_t> offsets{0};
+    std::string data;
+};
+
+namespace {
+
+// The body of a record batch message, along with the metadata describing
+// its layout.
+class Body {
+public:
+    explicit Body(ArrowCompressor* arg_compressor) : compressor(arg_compressor) {}
+
+    void AddNode(size_t length, size_t null_count) {
+        append_le<int64_t>(nodes, length);
+        append_le<int64_t>(nodes, null_count);
+        ++num_nodes;
+    }
+
+    void AddBuffer(const void* buf, size_t len) {
+        size_t start = data.size();
+
+        if ( len > 0 && compressor ) {
+            // Compressed buffers start with their uncompressed length, or
+            // -1 if they are stored as they are.
+            append_le<int64_t>(data, len);
+
+            if ( ! compressor->Compress(data, buf, len) ) {
+                data.resize(start);
+                append_le<int64_t>(data, -1);
+                data.append(static_cast<const char*>(buf), len);
+            }
+        }
+        else
+            data.append(static_cast<const char*>(buf), len);
+
+        append_le<int64_t>(buffers, start);
+        append_le<int64_t>(buffers, data.size() - start);
+        ++num_buffers;
+        pad_to_8(data);
+    }
+
+    template<typename T>
+    void AddBuffer(const std::vector<T>& v) {
+        AddBuffer(v.data(), v.size() * sizeof(T));
+    }
+
+    void AddValidity(const Column& c) {
+        if ( c.NullCount() == 0 )
+            AddBuffer(nullptr, 0);
+        else
+            AddBuffer(c.Validity().data(), (c.Size() + 7) / 8);
+    }
+
+    // Adds the offsets and the data of a string array.
+    bool AddStrings(size_t num, const std::function<void(size_t, std::string&)>& get) {
+        std::vector<int32_t> offsets;
+        offsets.reserve(num + 1);
+        offsets.push_back(0);
+        scratch.clear();
+
+        for ( size_t i = 0; i < num; ++i ) {
+            get(i, scratch);
+
+            if ( scratch.size() > INT32_MAX )
+                return false;
+
+            offsets.push_back(static_cast<int32_t>(scratch.size()));
+        }
+
+        AddBuffer(offsets);
+        AddBuffer(scratch.data(), scratch.size());
+        return true;
+    }
+
+    Offset Build(FlatBufferBuilder& fb, size_t length) const {
+        auto nodes_vec = fb.CreateStructVector(nodes, num_nodes, 8);
+        auto buffers_vec = fb.CreateStructVector(buffers, num_buffers, 8);
+        Offset compression = 0;
+
+        if ( compressor ) {
+            fb.StartTable();
+            fb.AddScalar<int8_t>(0, CODEC_ZSTD);
+            compression = fb.EndTable();
+        }
+
+        fb.StartTable();
+        fb.AddScalar<int64_t>(0, length);
+        fb.AddOffset(1, nodes_vec);
+        fb.AddOffset(2, buffers_vec);
+
+        if ( compression )
+            fb.AddOffset(3, compression);
+
+        return fb.EndTable();
+    }
+
+    const std::string& Data() const { return data; }
+
+private:
+    ArrowCompressor* compressor;
+    std::string data;
+    std::string nodes;
+    std::string buffers;
+    size_t num_nodes = 0;
+    size_t num_buffers = 0;
+    std::string scratch;
+};
+
+bool encode_column(Body& body, const Column& c) {
+    size_t rows = c.Size();
+
+    body.AddNode(rows, c.NullCount());
+    body.AddValidity(c);
+
+    switch ( c.Type() ) {
+        case TYPE_BOOL: {
+            std::vector<uint8_t> bits((rows + 7) / 8);
+
+            for ( size_t i = 0; i < rows; ++i ) {
+                if ( c.Ints()[i] )
+                    bits[i / 8] |= 1 << (i % 8);
+            }
+
+            body.AddBuffer(bits);
+            return true;
+        }
+
+        case TYPE_INT: body.AddBuffer(c.Ints()); return true;
+
+        case TYPE_COUNT:
+        case TYPE_PORT: body.AddBuffer(c.Counts()); return true;
+
+        case TYPE_DOUBLE: body.AddBuffer(c.Doubles()); return true;
+
+        case TYPE_TIME:
+        case TYPE_INTERVAL: {
+            std::vector<int64_t> us(rows);
+
+            for ( size_t i = 0; i < rows; ++i ) {
+                double d = c.Doubles()[i] * 1e6;
+
+                if ( std::isfinite(d) && std::fabs(d) < 9e18 )
+                    us[i] = std::llround(d);
+            }
+
+            body.AddBuffer(us);
+            return true;
+        }
+
+        case TYPE_ADDR:
+            return body.AddStrings(rows, [&c](size_t i, std::string& out) {
+                if ( ! c.IsNull(i) )
+                    out.append(threading::Formatter::Render(c.Addrs()[i]));
+            });
+
+        case TYPE_SUBNET:
+            return body.AddStrings(rows, [&c](size_t i, std::string& out) {
+                if ( ! c.IsNull(i) )
+                    out.append(threading::Formatter::Render(c.Subnets()[i]));
+            });
+
+        case TYPE_TABLE:
+        case TYPE_VECTOR: {
+            if ( c.Offsets().back() > INT32_MAX )
+                return false;
+
+            std::vector<int32_t> offsets(c.Offsets().begin(), c.Offsets().end());
+            body.AddBuffer(offsets);
+            return encode_column(body, c.Elements());
+        }
+
+        default:
+            return body.AddStrings(rows, [&c](size_t i, std::string& out) { append_utf8(out, c.String(i)); });
+    }
+}
+
+void encode_dictionary_column(Body& body, const Column& c, ArrowDictionary& dict) {
+    std::vector<int32_t> indices(c.Size());
+    std::string value;
+
+    for ( size_t i = 0; i < c.Size(); ++i ) {
+        if ( c.IsNull(i) )
+            continue;
+
+        value.clear();
+        append_utf8(value, c.String(i));
+        indices[i] = dict.Lookup(value);
+    }
+
+    body.AddNode(c.Size(), c.NullCount());
+    body.AddValidity(c);
+    body.AddBuffer(indices);
+}
+
+Offset build_schema(FlatBufferBuilder& fb, int num_fields, const threading::Field* const* fields,
+                    const std::vector<std::unique_ptr<ArrowDictionary>>& dictionaries) {
+    std::vector<Offset> field_tables;
+
+    for ( int i = 0; i < num_fields; ++i ) {
+        const auto* f = fields[i];
+        int64_t dictionary_id = dictionaries[i] ? dictionaries[i]->id : -1;
+        field_tables.push_back(build_field(fb, f->name, f->optional, f->type, f->subtype, dictionary_id));
+    }
+
+    auto fields_vec = fb.CreateOffsetVector(field_tables);
+
+    fb.StartTable();
+    fb.AddOffset(1, fields_vec);
+    fb.AddScalar<int16_t>(0, 0); // Little-endian
+    return fb.EndTable();
+}
+
+} // namespace
+
+ArrowFile::ArrowFile(int arg_num_fields, const threading::Field* const* arg_fields, Options arg_options)
+    : num_fields(arg_num_fields), fields(arg_fields), options(arg_options) {
+    if ( options.compression_level > 0 && HaveCompression() )
+        compressor = std::make_unique<ArrowCompressor>(options.compression_level);
+}
+
+ArrowFile::~ArrowFile() {
+    if ( fd >= 0 )
+        close(fd);
+}
+
+bool ArrowFile::HaveCompression() {
+#ifdef USE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ArrowFile::Open(const std::string& arg_path) {
+    path = arg_path;
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+    if ( fd < 0 ) {
+        char buf[256];
+        util::zeek_strerror_r(errno, buf, sizeof(buf));
+        error = "cannot open " + path + ": " + buf;
+        return false;
+    }
+
+    offset = 0;
+    dictionary_blocks.clear();
+    record_batch_blocks.clear();
+
+    return WriteRaw(MAGIC, sizeof(MAGIC)) && WriteSchema();
+}
+
+bool ArrowFile::WriteRaw(const void* data, size_t len) {
+    auto p = static_cast<const char*>(data);
+
+    while ( len > 0 ) {
+        ssize_t n = write(fd, p, len);
+
+        if ( n < 0 ) {
+            if ( errno == EINTR )
+                continue;
+
+            char buf[256];
+            util::zeek_strerror_r(errno, buf, sizeof(buf));
+            error = "error writing to " + path + ": " + buf;
+            return false;
+        }
+
+        p += n;
+        len -= n;
+        offset += n;
+    }
+
+    return true;
+}
+
+bool ArrowFile::WriteMessage(const std::string& metadata, const std::string& body, std::vector<Block>* blocks) {
+    // The metadata gets padded so that the body starts 8-byte aligned.
+    std::string header;
+    append_le<uint32_t>(header, 0xffffffff);
+    append_le<int32_t>(header, (metadata.size() + 7) & ~size_t(7));
+    header.append(metadata);
+    pad_to_8(header);
+
+    int64_t start = offset;
+
+    if ( ! WriteRaw(header.data(), header.size()) || ! WriteRaw(body.data(), body.size()) )
+        return false;
+
+    if ( blocks )
+        blocks->push_back({start, static_cast<int32_t>(header.size()), static_cast<int64_t>(body.size())});
+
+    return true;
+}
+
+bool ArrowFile::WriteSchema() {
+    dictionaries.clear();
+    dictionaries.resize(num_fields);
+
+    // Only enums get dictionary-encoded. Their values come from a fixed
+    // set of names, which bounds the size of the dictionaries we need to
+    // hold on to until the file gets closed.
+    for ( int i = 0; options.dictionary_encoding && i < num_fields; ++i ) {
+        if ( fields[i]->type == TYPE_ENUM )
+            dictionaries[i] = std::make_unique<ArrowDictionary>(i);
+    }
+
+    FlatBufferBuilder fb;
+    auto schema = build_schema(fb, num_fields, fields, dictionaries);
+    return WriteMessage(build_message(fb, HEADER_SCHEMA, schema, 0), {}, nullptr);
+}
+
+bool ArrowFile::Write(const ColumnarBatch& batch) {
+    if ( batch.NumRows() == 0 )
+        return true;
+
+    Body body(compressor.get());
+
+    for ( int i = 0; i < num_fields; ++i ) {
+        if ( dictionaries[i] )
+            encode_dictionary_column(body, batch.GetColumn(i), *dictionaries[i]);
+
+        else if ( ! encode_column(body, batch.GetColumn(i)) ) {
+            error = std::string("too much data in field ") + fields[i]->name;
+            return false;
+        }
+    }
+
+    FlatBufferBuilder fb;
+    auto record_batch = body.Build(fb, batch.NumRows());
+    auto metadata = build_message(fb, HEADER_RECORD_BATCH, record_batch, body.Data().size());
+
+    return WriteMessage(metadata, body.Data(), &record_batch_blocks);
+}
+
+bool ArrowFile::Close() {
+    if ( fd < 0 )
+        return true;
+
+    bool ok = true;
+
+    // With all values known now, write out the dictionaries.
+    for ( const auto& dict : dictionaries ) {
+        if ( ! ok || ! dict )
+            continue;
+
+        Body body(compressor.get());
+        size_t num_values = dict->offsets.size() - 1;
+
+        body.AddNode(num_values, 0);
+        body.AddBuffer(nullptr, 0);
+        body.AddBuffer(dict->offsets);
+        body.AddBuffer(dict->data.data(), dict->data.size());
+
+        FlatBufferBuilder fb;
+        auto record_batch = body.Build(fb, num_values);
+
+        fb.StartTable();
+        fb.AddScalar<int64_t>(0, dict->id);
+        fb.AddOffset(1, record_batch);
+        auto dictionary_batch = fb.EndTable();
+
+        auto metadata = build_message(fb, HEADER_DICTIONARY_BATCH, dictionary_batch, body.Data().size());
+        ok = WriteMessage(metadata, body.Data(), &dictionary_blocks);
+    }
+
+    if ( ok ) {
+        std::string trailer;
+
+        // End-of-stream marker.
+        append_le<uint32_t>(trailer, 0xffffffff);
+        append_le<int32_t>(trailer, 0);
+
+        auto blocks = [](const std::vector<Block>& blocks) {
+            std::string s;
+
+            for ( const auto& b : blocks ) {
+                append_le<int64_t>(s, b.offset);
+                append_le<int32_t>(s, b.metadata_length);
+                append_le<int32_t>(s, 0);
+                append_le<int64_t>(s, b.body_length);
+            }
+
+            return s;
+        };
+
+        FlatBufferBuilder fb;
+        auto schema = build_schema(fb, num_fields, fields, dictionaries);
+        auto dictionaries_vec = fb.CreateStructVector(blocks(dictionary_blocks), dictionary_blocks.size(), 8);
+        auto record_batches_vec = fb.CreateStructVector(blocks(record_batch_blocks), record_batch_blocks.size(), 8);
+
+        fb.StartTable();
+        fb.AddOffset(1, schema);
+        fb.AddOffset(2, dictionaries_vec);
+        fb.AddOffset(3, record_batches_vec);
+        fb.AddScalar<int16_t>(0, METADATA_V5);
+        auto footer = fb.Finish(fb.EndTable());
+
+        trailer.append(footer);
+        append_le<int32_t>(trailer, footer.size());
+        trailer.append(MAGIC, MAGIC_LEN);
+
+        ok = WriteRaw(trailer.data(), trailer.size());
+    }
+
+    if ( close(fd) != 0 && ok ) {
+        char buf[256];
+        util::zeek_strerror_r(errno, buf, sizeof(buf));
+        error = "cannot close " + path + ": " + buf;
+        ok = false;
+    }
+
+    fd = -1;
+    dictionaries.clear();
+    return ok;
+}
+
+} // namespace zeek::logging::writer::detail
@@ -0,0 +1,122 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Encoder for the Apache Arrow IPC file format.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zeek/logging/ColumnarBatch.h"
+
+namespace zeek::logging::writer::detail {
+
+class ArrowCompressor;
+struct ArrowDictionary;
+
+/**
+ * Writes batches of log records into a file in the Arrow IPC file format
+ * (also known as Feather V2), without depending on the Arrow libraries.
+ *
+ * Each batch becomes one record batch. Enum columns can be
+ * dictionary-encoded. As the file format doesn't allow replacing
+ * dictionaries, their values accumulate until the file gets closed,
+ * which is when they are written out. With a compression level set, all
+ * buffers are compressed with zstd, if available.
+ *
+ * Until it's closed, a file can't be read as an Arrow file. Its contents
+ * after the initial 8 bytes can still be read as an Arrow IPC stream once
+ * the dictionaries are known, which makes recovering files that didn't
+ * get closed possible.
+ */
+class ArrowFile {
+public:
+    struct Options {
+        int compression_level = 0;
+        bool dictionary_encoding = true;
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param num_fields The number of log fields.
+     *
+     * @param fields The log fields. The file keeps a pointer to them.
+     *
+     * @param options The encoding options.
+     */
+    ArrowFile(int num_fields, const threading::Field* const* fields, Options options);
+    ~ArrowFile();
+
+    ArrowFile(const ArrowFile&) = delete;
+    ArrowFile& operator=(const ArrowFile&) = delete;
+
+    /**
+     * Creates the file, truncating any existing one, and writes the schema.
+     *
+     * @return False on error, with the reason available from Error().
+     */
+    bool Open(const std::string& path);
+
+    /**
+     * Writes a batch of records. Does nothing for an empty batch.
+     *
+     * @return False on error, with the reason available from Error().
+     */
+    bool Write(const ColumnarBatch& batch);
+
+    /**
+     * Writes out the dictionaries and the footer, and closes the file.
+     *
+     * @return False on error, with the reason available from Error().
+     */
+    bool Close();
+
+    /**
+     * @return True if the file is open.
+     */
+    bool IsOpen() const { return fd >= 0; }
+
+    /**
+     * @return A description of the last error.
+     */
+    const std::string& Error() const { return error; }
+
+    /**
+     * @return True if zstd compression is available.
+     */
+    static bool HaveCompression();
+
+private:
+    struct Block {
+        int64_t offset;
+        int32_t metadata_length;
+        int64_t body_length;
+    };
+
+    // Sets up the dictionaries and writes the schema.
+    bool WriteSchema();
+
+    // Writes an encapsulated IPC message, recording it in blocks if given.
+    bool WriteMessage(const std::string& metadata, const std::string& body, std::vector<Block>* blocks);
+
+    bool WriteRaw(const void* data, size_t len);
+
+    int num_fields;
+    const threading::Field* const* fields;
+    Options options;
+
+    std::string path;
+    int fd = -1;
+    int64_t offset = 0;
+    std::string error;
+
+    std::unique_ptr<ArrowCompressor> compressor;             // Null without compression.
+    std::vector<std::unique_ptr<ArrowDictionary>> dictionaries; // Per field, null if not encoded.
+    std::vector<Block> dictionary_blocks;
+    std::vector<Block> record_batch_blocks;
+};
+
+} // namespace zeek::logging::writer::detail
@@ -7,7 +7,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cerrno>
+#include <climits>
 #include <cstdio>
 #include <ctime>
 #include <filesystem>
@@ -123,6 +125,8 @@ static std::optional<LeftoverLog> parse_shadow_log(const std::string& fname) {
     string default_ext = "." + Ascii::LogExt();
     if ( BifConst::LogAscii::gzip_level > 0 )
         default_ext += ".gz";
+    else if ( BifConst::LogAscii::zstd_level > 0 )
+        default_ext += ".zst";
 
     LeftoverLog rval = {};
     rval.filename = fname;
@@ -216,7 +220,8 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend) {
     json_include_unset_fields = false;
     formatter = nullptr;
     gzip_level = 0;
-    gzfile = nullptr;
+    zstd_level = 0;
+    compression_threads = 0;
 
     InitConfigOptions();
     init_options = InitFilterOptions();
@@ -227,7 +232,10 @@ void Ascii::InitConfigOptions() {
     include_meta = BifConst::LogAscii::include_meta;
     use_json = BifConst::LogAscii::use_json;
     enable_utf_8 = BifConst::LogAscii::enable_utf_8;
-    gzip_level = BifConst::LogAscii::gzip_level;
+    // Capped, so that huge values don't wrap into the valid range.
+    gzip_level = static_cast<int>(std::min<zeek_uint_t>(BifConst::LogAscii::gzip_level, INT_MAX));
+    zstd_level = static_cast<int>(std::min<zeek_uint_t>(BifConst::LogAscii::zstd_level, INT_MAX));
+    compression_threads = BifConst::LogAscii::compression_threads;
 
     separator.assign((const char*)BifConst::LogAscii::separator->Bytes(), BifConst::LogAscii::separator->Len());
 
@@ -249,6 +257,9 @@ void Ascii::InitConfigOptions() {
     gzip_file_extension.assign((const char*)BifConst::LogAscii::gzip_file_extension->Bytes(),
                                BifConst::LogAscii::gzip_file_extension->Len());
 
+    zstd_file_extension.assign((const char*)BifConst::LogAscii::zstd_file_extension->Bytes(),
+                               BifConst::LogAscii::zstd_file_extension->Len());
+
     logdir = zeek::id::find_const<StringVal>("Log::default_logdir")->ToStdString();
 }
 
@@ -268,14 +279,12 @@ bool Ascii::InitFilterOptions() {
             }
         }
 
-        else if ( strcmp(key, "gzip_level") == 0 ) {
+        else if ( strcmp(key, "gzip_level") == 0 )
             gzip_level = atoi(value);
 
-            if ( gzip_level < 0 || gzip_level > 9 ) {
-                Error("invalid value for 'gzip_level', must be a number between 0 and 9.");
-                return false;
-            }
-        }
+        else if ( strcmp(key, "zstd_level") == 0 )
+            zstd_level = atoi(value);
+
         else if ( strcmp(key, "use_json") == 0 ) {
             if ( strcmp(value, "T") == 0 )
                 use_json = true;
@@ -344,6 +353,30 @@ bool Ascii::InitFilterOptions() {
 
         else if ( strcmp(key, "gzip_file_extension") == 0 )
             gzip_file_extension.assign(value);
+
+        else if ( strcmp(key, "zstd_file_extension") == 0 )
+            zstd_file_extension.assign(value);
+    }
+
+    // Checked here, so that the global defaults get validated as well.
+    if ( gzip_level < 0 || gzip_level > 9 ) {
+        Error("invalid value for 'gzip_level', must be a number between 0 and 9.");
+        return false;
+    }
+
+    if ( zstd_level < 0 || zstd_level > 22 ) {
+        Error("invalid value for 'zstd_level', must be a number between 0 and 22.");
+        return false;
+    }
+
+    if ( gzip_level > 0 && zstd_level > 0 ) {
+        Error("'gzip_level' and 'zstd_level' cannot both be enabled");
+        return false;
+    }
+
+    if ( zstd_level > 0 && ! BlockCompressor::HaveZstd() ) {
+        Error("cannot use 'zstd_level': Zeek was built without zstd support");
+        return false;
     }
 
     if ( ! InitFormatter() )
@@ -416,7 +449,16 @@ void Ascii::CloseFile(double t) {
 
     InternalClose(fd);
     fd = 0;
-    gzfile = nullptr;
+}
+
+string Ascii::CompressionExt() const {
+    if ( gzip_level > 0 )
+        return "." + (gzip_file_extension.empty() ? string("gz") : gzip_file_extension);
+
+    if ( zstd_level > 0 )
+        return "." + (zstd_file_extension.empty() ? string("zst") : zstd_file_extension);
+
+    return "";
 }
 
 bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Field* const* fields) {
@@ -425,6 +467,10 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
     if ( ! init_options )
         return false;
 
+    // The fields stay the same for the lifetime of the writer, so let the
+    // formatter work out once how to serialize each of them.
+    formatter->Prepare(num_fields, fields);
+
     string path = info.path;
 
     if ( output_to_stdout )
@@ -433,12 +479,7 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
     fname = path;
 
     if ( ! IsSpecial(fname) ) {
-        std::string ext = "." + LogExt();
-
-        if ( gzip_level > 0 ) {
-            ext += ".";
-            ext += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-        }
+        std::string ext = "." + LogExt() + CompressionExt();
 
         if ( fname.front() != '/' && ! logdir.empty() )
             fname = (std::filesystem::path(logdir) / fname).string();
@@ -487,25 +528,20 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
         return false;
     }
 
-    if ( gzip_level > 0 ) {
-        if ( gzip_level < 0 || gzip_level > 9 ) {
-            Error("invalid value for 'gzip_level', must be a number between 0 and 9.");
-            return false;
-        }
-
-        char mode[4];
-        snprintf(mode, sizeof(mode), "wb%d", gzip_level);
-        errno = 0; // errno will only be set under certain circumstances by gzdopen.
-        gzfile = gzdopen(fd, mode);
+    // Writes to disk happen in the background, so that a busy disk
+    // doesn't hold up this writer right away.
+    output = std::make_unique<zeek::detail::AsyncFileWriter>(fd);
 
-        if ( gzfile == nullptr ) {
-            Error(Fmt("cannot gzip %s: %s", fname.c_str(), Strerror(errno)));
-            return false;
-        }
-    }
-    else {
-        gzfile = nullptr;
-    }
+    // Blocks of the output get compressed on a pool of worker threads,
+    // so that higher levels don't hold up this writer.
+    if ( gzip_level > 0 )
+        compressor = std::make_unique<BlockCompressor>(output.get(), BlockCompressor::Format::GZIP, gzip_level,
+                                                       compression_threads);
+    else if ( zstd_level > 0 )
+        compressor = std::make_unique<BlockCompressor>(output.get(), BlockCompressor::Format::ZSTD, zstd_level,
+                                                       compression_threads);
+    else
+        compressor = nullptr;
 
     if ( ! WriteHeader(path) ) {
         Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
@@ -560,6 +596,14 @@ bool Ascii::WriteHeader(const string& path) {
 }
 
 bool Ascii::DoFlush(double network_time) {
+    // Compressed output gets out in complete blocks only, so close the
+    // current one.
+    if ( compressor && ! compressor->Flush(true) )
+        Error(Fmt("Ascii::DoFlush error: %s", compressor->Error().c_str()));
+
+    if ( output && ! output->Sync() )
+        Error(Fmt("error writing to %s: %s", fname.c_str(), output->Error().c_str()));
+
     fsync(fd);
     return true;
 }
@@ -608,8 +652,12 @@ bool Ascii::DoWrite(int num_fields, const threading::Field* const* fields, threa
     if ( ! InternalWrite(fd, bytes, len) )
         goto write_error;
 
-    if ( ! IsBuf() )
+    if ( ! IsBuf() ) {
+        if ( output && ! output->Sync() )
+            goto write_error;
+
         fsync(fd);
+    }
 
     return true;
 
@@ -627,12 +675,7 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 
     CloseFile(close);
 
-    string nname = string(rotated_path) + "." + LogExt();
-
-    if ( gzip_level > 0 ) {
-        nname += ".";
-        nname += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
-    }
+    string nname = string(rotated_path) + "." + LogExt() + CompressionExt();
 
     if ( rename(fname.c_str(), nname.c_str()) != 0 ) {
         char buf[256];
@@ -668,7 +711,13 @@ bool Ascii::DoSetBuf(bool enabled) {
 }
 
 bool Ascii::DoHeartbeat(double network_time, double current_time) {
-    // Nothing to do.
+    // Get what's buffered on its way to disk, without waiting for it.
+    if ( compressor && ! compressor->Flush() )
+        Error(Fmt("Ascii::DoHeartbeat error: %s", compressor->Error().c_str()));
+
+    if ( output && ! output->Flush() )
+        Error(Fmt("error writing to %s: %s", fname.c_str(), output->Error().c_str()));
+
     return true;
 }
 
@@ -823,48 +872,40 @@ string Ascii::Timestamp(double t) {
 }
 
 bool Ascii::InternalWrite(int fd, const char* data, int len) {
-    if ( ! gzfile )
-        return util::safe_write(fd, data, len);
-
-    while ( len > 0 ) {
-        int n = gzwrite(gzfile, data, len);
+    if ( ! compressor )
+        return output && output->Write(data, len);
 
-        if ( n <= 0 ) {
-            const char* err = gzerror(gzfile, &n);
-            Error(Fmt("Ascii::InternalWrite error: %s\n", err));
-            return false;
-        }
-
-        data += n;
-        len -= n;
+    if ( ! compressor->Write(data, len) ) {
+        Error(Fmt("Ascii::InternalWrite error: %s", compressor->Error().c_str()));
+        return false;
     }
 
     return true;
 }
 
 bool Ascii::InternalClose(int fd) {
-    if ( ! gzfile ) {
-        util::safe_close(fd);
-        return true;
-    }
+    bool ok = true;
 
-    int res = gzclose(gzfile);
+    if ( compressor ) {
+        if ( ! compressor->Finish() ) {
+            Error(Fmt("Ascii::InternalClose error: %s", compressor->Error().c_str()));
+            ok = false;
+        }
 
-    if ( res == Z_OK )
-        return true;
+        compressor = nullptr;
+    }
 
-    switch ( res ) {
-        case Z_STREAM_ERROR: Error("Ascii::InternalClose gzclose error: invalid file stream"); break;
-        case Z_BUF_ERROR:
-            Error(
-                "Ascii::InternalClose gzclose error: "
-                "no compression progress possible during buffer flush");
-            break;
-        case Z_ERRNO: Error(Fmt("Ascii::InternalClose gzclose error: %s\n", Strerror(errno))); break;
-        default: Error("Ascii::InternalClose invalid gzclose result"); break;
+    if ( output ) {
+        if ( ! output->Sync() ) {
+            Error(Fmt("Ascii::InternalClose error: %s", output->Error().c_str()));
+            ok = false;
+        }
+
+        output = nullptr;
     }
 
-    return false;
+    util::safe_close(fd);
+    return ok;
 }
 
 } // namespace zeek::logging::writer::detail
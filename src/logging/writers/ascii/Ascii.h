@@ -4,11 +4,13 @@
 
 #pragma once
 
-#include <zlib.h>
+#include <memory>
 #include <string>
 
+#include "zeek/AsyncFileWriter.h"
 #include "zeek/Desc.h"
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/logging/writers/ascii/BlockCompressor.h"
 #include "zeek/threading/Formatter.h"
 
 namespace zeek::plugin::detail::Zeek_AsciiWriter {
@@ -48,11 +50,13 @@ private:
     void InitConfigOptions();
     bool InitFilterOptions();
     bool InitFormatter();
+    std::string CompressionExt() const;
     bool InternalWrite(int fd, const char* data, int len);
     bool InternalClose(int fd);
 
     int fd;
-    gzFile gzfile;
+    std::unique_ptr<zeek::detail::AsyncFileWriter> output;
+    std::unique_ptr<BlockCompressor> compressor;
     std::string fname;
     ODesc desc;
     bool ascii_done;
@@ -70,6 +74,9 @@ private:
 
     int gzip_level; // level > 0 enables gzip compression
     std::string gzip_file_extension;
+    int zstd_level; // level > 0 enables zstd compression
+    std::string zstd_file_extension;
+    size_t compression_threads;
     bool use_json;
     bool enable_utf_8;
     std::string json_timestamps;
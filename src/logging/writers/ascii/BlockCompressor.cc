@@ -0,0 +1,374 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/ascii/BlockCompressor.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "zeek/zeek-config.h"
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "zeek/AsyncFileWriter.h"
+#include "zeek/util.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::logging::writer::detail {
+
+namespace {
+
+// Larger blocks compress better, smaller ones spread better across the
+// workers. At 1 MiB, the loss compared to compressing a whole file in one
+// go is a fraction of a percent.
+constexpr size_t BLOCK_SIZE = 1024 * 1024;
+
+// Runs tasks on a fixed set of threads, in the order they come in.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t num_threads) {
+        for ( size_t i = 0; i < num_threads; ++i ) {
+            threads.emplace_back([this] { Run(); });
+            util::detail::set_thread_name("zk.log-compress", threads.back().native_handle());
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+
+        cv.notify_all();
+
+        for ( auto& t : threads )
+            t.join();
+    }
+
+    std::future<void> Submit(std::function<void()> func) {
+        std::packaged_task<void()> task(std::move(func));
+        auto done = task.get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            tasks.push_back(std::move(task));
+        }
+
+        cv.notify_one();
+        return done;
+    }
+
+private:
+    void Run() {
+        while ( true ) {
+            std::packaged_task<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || ! tasks.empty(); });
+
+                if ( tasks.empty() )
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::packaged_task<void()>> tasks;
+    bool stopping = false;
+};
+
+// The pool shared by all compressors, started by the first one needing it.
+WorkerPool& worker_pool(size_t num_threads) {
+    static WorkerPool pool(num_threads);
+    return pool;
+}
+
+} // namespace
+
+BlockCompressor::BlockCompressor(zeek::detail::AsyncFileWriter* arg_out, Format arg_format, int arg_level,
+                                 size_t arg_threads)
+    : out(arg_out), format(arg_format), level(arg_level), threads(arg_threads) {
+    // Bounds both the memory a busy writer ties up and how far its output
+    // lags behind.
+    max_pending = std::max<size_t>(2 * threads, 1);
+}
+
+BlockCompressor::~BlockCompressor() {
+    // The workers may still reference our blocks.
+    for ( auto& p : pending ) {
+        if ( p.done.valid() )
+            p.done.wait();
+    }
+}
+
+bool BlockCompressor::HaveZstd() {
+#ifdef USE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool BlockCompressor::Write(const char* data, size_t len) {
+    while ( len > 0 ) {
+        if ( ! current ) {
+            current = std::make_unique<Block>();
+            current->data.reserve(BLOCK_SIZE);
+        }
+
+        size_t n = std::min(len, BLOCK_SIZE - current->data.size());
+        current->data.insert(current->data.end(), data, data + n);
+        data += n;
+        len -= n;
+
+        if ( current->data.size() == BLOCK_SIZE && ! Submit() )
+            return false;
+    }
+
+    return true;
+}
+
+bool BlockCompressor::Finish() {
+    // Without any input, still produce a valid (empty) compressed file.
+    if ( ! current && pending.empty() && ! wrote_block )
+        current = std::make_unique<Block>();
+
+    if ( current && ! Submit() )
+        return false;
+
+    while ( ! pending.empty() ) {
+        if ( ! WriteOldest() )
+            return false;
+    }
+
+    return true;
+}
+
+bool BlockCompressor::Flush(bool wait) {
+    if ( current && ! current->data.empty() && ! Submit() )
+        return false;
+
+    while ( wait && ! pending.empty() ) {
+        if ( ! WriteOldest() )
+            return false;
+    }
+
+    return WriteReady();
+}
+
+bool BlockCompressor::Submit() {
+    Pending p;
+    p.block = std::move(current);
+
+    if ( threads > 0 ) {
+        Block* block = p.block.get();
+        p.done = worker_pool(threads).Submit([this, block] { Compress(block); });
+    }
+    else
+        Compress(p.block.get());
+
+    pending.push_back(std::move(p));
+
+    while ( pending.size() > max_pending ) {
+        if ( ! WriteOldest() )
+            return false;
+    }
+
+    // Write out whatever else is ready by now, without waiting for it.
+    return WriteReady();
+}
+
+bool BlockCompressor::WriteReady() {
+    while ( ! pending.empty() && (! pending.front().done.valid() ||
+                                  pending.front().done.wait_for(std::chrono::seconds(0)) == std::future_status::ready) ) {
+        if ( ! WriteOldest() )
+            return false;
+    }
+
+    return true;
+}
+
+bool BlockCompressor::WriteOldest() {
+    Pending p = std::move(pending.front());
+    pending.pop_front();
+
+    if ( p.done.valid() )
+        p.done.get();
+
+    if ( ! p.block->error.empty() ) {
+        error = p.block->error;
+        return false;
+    }
+
+    if ( ! out->Write(p.block->compressed.data(), p.block->compressed.size()) ) {
+        error = out->Error();
+        return false;
+    }
+
+    wrote_block = true;
+    return true;
+}
+
+void BlockCompressor::Compress(Block* block) const {
+    switch ( format ) {
+        case Format::GZIP: CompressGzip(block); break;
+        case Format::ZSTD: CompressZstd(block); break;
+    }
+}
+
+void BlockCompressor::CompressGzip(Block* block) const {
+    z_stream zs = {};
+
+    // A window size of 15 plus 16 selects the gzip wrapper.
+    if ( deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK ) {
+        block->error = "cannot initialize zlib";
+        return;
+    }
+
+    block->compressed.resize(deflateBound(&zs, block->data.size()));
+
+    zs.next_in = reinterpret_cast<Bytef*>(block->data.data());
+    zs.avail_in = block->data.size();
+    zs.next_out = reinterpret_cast<Bytef*>(block->compressed.data());
+    zs.avail_out = block->compressed.size();
+
+    if ( deflate(&zs, Z_FINISH) == Z_STREAM_END )
+        block->compressed.resize(zs.total_out);
+    else
+        block->error = std::string("zlib compression failed: ") + (zs.msg ? zs.msg : "unknown error");
+
+    deflateEnd(&zs);
+}
+
+void BlockCompressor::CompressZstd(Block* block) const {
+#ifdef USE_ZSTD
+    block->compressed.resize(ZSTD_compressBound(block->data.size()));
+
+    size_t n = ZSTD_compress(block->compressed.data(), block->compressed.size(), block->data.data(),
+                             block->data.size(), level);
+
+    if ( ZSTD_isError(n) )
+        block->error = std::string("zstd compression failed: ") + ZSTD_getErrorName(n);
+    else
+        block->compressed.resize(n);
+#else
+    block->error = "Zeek was built without zstd support";
+#endif
+}
+
+namespace {
+
+// Reads back what's been written to f and decompresses each of the gzip
+// members in it.
+std::string gunzip_members(FILE* f) {
+    std::string in;
+    char buf[4096];
+    size_t n;
+
+    rewind(f);
+
+    while ( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+        in.append(buf, n);
+
+    std::string out;
+    z_stream zs = {};
+    inflateInit2(&zs, 15 + 16);
+    zs.next_in = reinterpret_cast<Bytef*>(in.data());
+    zs.avail_in = in.size();
+
+    while ( zs.avail_in > 0 ) {
+        zs.next_out = reinterpret_cast<Bytef*>(buf);
+        zs.avail_out = sizeof(buf);
+        int res = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+
+        if ( res == Z_STREAM_END )
+            inflateReset(&zs);
+        else if ( res != Z_OK )
+            break;
+    }
+
+    inflateEnd(&zs);
+    return out;
+}
+
+} // namespace
+
+TEST_CASE("writers.ascii BlockCompressor gzip") {
+    auto round_trip = [](const std::string& data, size_t threads) {
+        FILE* f = tmpfile();
+        REQUIRE(f);
+
+        zeek::detail::AsyncFileWriter output(fileno(f));
+        BlockCompressor c(&output, BlockCompressor::Format::GZIP, 6, threads);
+
+        // Write in uneven pieces that straddle the block boundaries.
+        for ( size_t i = 0; i < data.size(); i += 1000 )
+            CHECK(c.Write(data.data() + i, std::min<size_t>(1000, data.size() - i)));
+
+        CHECK(c.Finish());
+        CHECK(output.Sync());
+
+        auto out = gunzip_members(f);
+        fclose(f);
+        return out;
+    };
+
+    std::string lines;
+
+    for ( int i = 0; lines.size() < 3 * BLOCK_SIZE + 100; ++i )
+        lines += "line " + std::to_string(i) + "\tsome\tlog\tfields\n";
+
+    for ( size_t threads : {0, 2} ) {
+        CHECK(round_trip("", threads).empty());
+        CHECK(round_trip("one line\n", threads) == "one line\n");
+        CHECK(round_trip(lines, threads) == lines);
+    }
+}
+
+TEST_CASE("writers.ascii BlockCompressor flush") {
+    for ( size_t threads : {0, 2} ) {
+        FILE* f = tmpfile();
+        REQUIRE(f);
+
+        zeek::detail::AsyncFileWriter output(fileno(f));
+        BlockCompressor c(&output, BlockCompressor::Format::GZIP, 6, threads);
+
+        // A flushed partial block decompresses before the end.
+        CHECK(c.Write("one\n", 4));
+        CHECK(c.Flush(true));
+        CHECK(output.Sync());
+        CHECK(gunzip_members(f) == "one\n");
+
+        // Flushing without anything new doesn't add an empty member.
+        CHECK(c.Flush(true));
+        CHECK(output.Sync());
+        CHECK(gunzip_members(f) == "one\n");
+
+        CHECK(c.Write("two\n", 4));
+        CHECK(c.Finish());
+        CHECK(output.Sync());
+        CHECK(gunzip_members(f) == "one\ntwo\n");
+
+        fclose(f);
+    }
+}
+
+} // namespace zeek::logging::writer::detail
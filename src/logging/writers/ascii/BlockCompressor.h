@@ -0,0 +1,126 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Compresses a log file's output in independent blocks on a pool of
+// worker threads.
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace zeek::detail {
+class AsyncFileWriter;
+}
+
+namespace zeek::logging::writer::detail {
+
+/**
+ * Compresses data written to a file in blocks, each of which
+ * becomes a self-contained gzip member or zstd frame. Both formats allow
+ * concatenating these, so the result decompresses with the standard tools
+ * like a file compressed in one go. Blocks get compressed on a small
+ * process-wide pool of worker threads shared by all instances, and written
+ * out in order as they complete.
+ */
+class BlockCompressor {
+public:
+    enum class Format { GZIP, ZSTD };
+
+    /**
+     * Constructor.
+     *
+     * @param out The file output to pass the compressed data to. It must
+     * outlive the compressor.
+     *
+     * @param format The compression format to use.
+     *
+     * @param level The compression level, 1-9 for gzip and 1-22 for zstd.
+     *
+     * @param threads The number of worker threads the process-wide pool
+     * gets started with on first use. With zero, blocks get compressed on
+     * the calling thread instead.
+     */
+    BlockCompressor(zeek::detail::AsyncFileWriter* out, Format format, int level, size_t threads);
+
+    /**
+     * Destructor. Waits for blocks still being compressed, but doesn't
+     * write them out: call Finish() for that.
+     */
+    ~BlockCompressor();
+
+    /**
+     * Returns true if Zeek has been built with zstd support.
+     */
+    static bool HaveZstd();
+
+    /**
+     * Adds data to the output. Returns false on errors, see Error().
+     */
+    bool Write(const char* data, size_t len);
+
+    /**
+     * Starts compressing the block filled so far, even if it's not full,
+     * and passes on the blocks that are done. As each block is complete on
+     * its own, the output remains decompressible. Returns false on errors,
+     * see Error().
+     *
+     * @param wait If true, waits for all blocks to be passed to the
+     * output. Otherwise, stops at the first one still being compressed.
+     */
+    bool Flush(bool wait = false);
+
+    /**
+     * Compresses any data still buffered and waits for all blocks to be
+     * passed to the output. Returns false on errors, see Error().
+     */
+    bool Finish();
+
+    /**
+     * Returns a description of the last error.
+     */
+    const std::string& Error() const { return error; }
+
+private:
+    // A block of input, and its compressed version once done.
+    struct Block {
+        std::vector<char> data;
+        std::vector<char> compressed;
+        std::string error;
+    };
+
+    struct Pending {
+        std::unique_ptr<Block> block;
+        std::future<void> done;
+    };
+
+    // Hands the current block to the pool, or compresses it right away
+    // without one.
+    bool Submit();
+
+    // Writes out the oldest pending block, waiting for it if needed.
+    bool WriteOldest();
+
+    // Writes out pending blocks up to the first one not done yet.
+    bool WriteReady();
+
+    void Compress(Block* block) const;
+    void CompressGzip(Block* block) const;
+    void CompressZstd(Block* block) const;
+
+    zeek::detail::AsyncFileWriter* out;
+    Format format;
+    int level;
+    size_t threads;
+    size_t max_pending;
+    bool wrote_block = false;
+
+    std::unique_ptr<Block> current;
+    std::deque<Pending> pending;
+    std::string error;
+};
+
+} // namespace zeek::logging::writer::detail
@@ -49,11 +49,15 @@ bool IPBasedAnalyzer::AnalyzePacket(size_t len, const uint8_t* data, Packet* pkt
 
     key->Init(*pkt);
 
+    // Get the session table's memory for this connection on its way into
+    // the caches before doing the remaining setup.
+    size_t hash = session_mgr->PrefetchConnection(*key);
+
     const std::shared_ptr<IP_Hdr>& ip_hdr = pkt->ip_hdr;
     auto src_addr = key->SrcAddr();
     auto src_port = key->SrcPort();
 
-    Connection* conn = session_mgr->FindConnection(*key);
+    Connection* conn = session_mgr->FindConnection(*key, hash);
 
     if ( ! conn ) {
         conn = NewConn(std::move(key), pkt);
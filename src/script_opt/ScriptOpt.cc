@@ -2,6 +2,8 @@
 
 #include "zeek/script_opt/ScriptOpt.h"
 
+#include <deque>
+
 #include "zeek/Desc.h"
 #include "zeek/EventHandler.h"
 #include "zeek/EventRegistry.h"
@@ -15,6 +17,7 @@
 #include "zeek/script_opt/Reduce.h"
 #include "zeek/script_opt/UsageAnalyzer.h"
 #include "zeek/script_opt/UseDefs.h"
+#include "zeek/script_opt/ZAM/Cache.h"
 #include "zeek/script_opt/ZAM/Compile.h"
 #include "zeek/script_opt/ZAM/Profile.h"
 
@@ -37,6 +40,25 @@ static std::unordered_set<const ScriptFunc*> when_lambdas;
 static ScriptFuncPtr global_stmts;
 static size_t global_stmts_ind; // index into Funcs corresponding to global_stmts
 
+// For tiered ZAM execution, the bodies we're still interpreting.
+struct TieredBody {
+    size_t func_ind; // index into funcs
+    std::string cache_key;
+    int num_calls = 0;
+};
+
+bool tiered_ZAM_active = false;
+
+static std::unordered_map<const Stmt*, TieredBody> tiered_bodies;
+static std::deque<const Stmt*> hot_bodies;
+
+// What compiling the bodies later requires.
+static std::shared_ptr<ProfileFuncs> tiered_pfs;
+static std::unique_ptr<ZAMCache> tiered_cache;
+
+// Whether clear_script_analysis() was put off due to tiered execution.
+static bool deferred_clear = false;
+
 void analyze_func(ScriptFuncPtr f) {
     // Even if we're analyzing only a subset of the scripts, we still
     // track all functions here because the inliner will need the full list.
@@ -295,6 +317,9 @@ static void init_options() {
     check_env_opt("ZEEK_DUMP_ZAM", analysis_options.dump_ZAM);
     check_env_opt("ZEEK_DUMP_FINAL_ZAM", analysis_options.dump_final_ZAM);
     check_env_opt("ZEEK_PROFILE", analysis_options.profile_ZAM);
+    check_env_opt("ZEEK_ZAM_TIERED", analysis_options.tiered_ZAM);
+    check_env_opt("ZEEK_REPORT_ZAM_CACHE", analysis_options.report_ZAM_cache);
+    check_env_opt("ZEEK_REPORT_TIERED_ZAM", analysis_options.report_tiered_ZAM);
 
     // Compile-to-C++-related options.
     check_env_opt("ZEEK_GEN_CPP", analysis_options.gen_CPP);
@@ -337,6 +362,24 @@ static void init_options() {
             add_file_analysis_pattern(analysis_options, zo);
     }
 
+    auto zcd = getenv("ZEEK_ZAM_CACHE_DIR");
+    if ( zcd )
+        analysis_options.ZAM_cache_dir = zcd;
+
+    if ( analysis_options.tiered_ZAM ) {
+        auto zthresh = getenv("ZEEK_ZAM_TIER_THRESHOLD");
+        if ( zthresh ) {
+            analysis_options.tiered_ZAM_threshold = atoi(zthresh);
+            if ( analysis_options.tiered_ZAM_threshold <= 0 ) {
+                fprintf(stderr, "bad ZAM tier threshold from $ZEEK_ZAM_TIER_THRESHOLD: %s\n", zthresh);
+                analysis_options.tiered_ZAM = false;
+            }
+        }
+
+        if ( analysis_options.tiered_ZAM )
+            analysis_options.gen_ZAM = true;
+    }
+
     if ( analysis_options.profile_ZAM ) {
         auto zsamp = getenv("ZEEK_ZAM_PROF_SAMPLING_RATE");
         if ( zsamp ) {
@@ -473,6 +516,19 @@ static void generate_CPP(std::shared_ptr<ProfileFuncs> pfs) {
     CPPCompile cpp(funcs, std::move(pfs), gen_name, standalone, report);
 }
 
+// Whether tiered execution can put off compiling the given body.  Bodies
+// with "when" statements or lambdas can leave behind frames and ASTs that
+// outlive a call, which would then be affected by transforming the body.
+static bool can_tier(const FuncInfo& f) {
+    if ( f.Body()->Tag() == STMT_CPP )
+        return false;
+
+    // We can't use the function's existing profile, as inlining might
+    // have changed the body.
+    ProfileFunc pf(f.Func(), f.Body(), true);
+    return pf.NumWhenStmts() == 0 && pf.NumLambdas() == 0;
+}
+
 static void analyze_scripts_for_ZAM(std::shared_ptr<ProfileFuncs> pfs) {
     if ( analysis_options.usage_issues > 0 && analysis_options.optimize_AST ) {
         fprintf(stderr,
@@ -494,6 +550,16 @@ static void analyze_scripts_for_ZAM(std::shared_ptr<ProfileFuncs> pfs) {
 #endif
     }
 
+    // The cache needs to see the types prior to inlining and compiling.
+    // Profiling and dumping need the full compilation.
+    std::unique_ptr<ZAMCache> cache;
+    if ( ! analysis_options.ZAM_cache_dir.empty() && analysis_options.gen_ZAM_code && ! analysis_options.profile_ZAM &&
+         ! analysis_options.dump_ZAM && ! analysis_options.dump_final_ZAM ) {
+        cache = std::make_unique<ZAMCache>(analysis_options.ZAM_cache_dir, pfs);
+        if ( ! cache->IsActive() )
+            cache.reset();
+    }
+
     bool report_recursive = analysis_options.report_recursive;
     std::unique_ptr<Inliner> inl;
     if ( analysis_options.inliner )
@@ -525,6 +591,7 @@ static void analyze_scripts_for_ZAM(std::shared_ptr<ProfileFuncs> pfs) {
     }
 
     bool did_one = false;
+    int num_compiled = 0;
 
     for ( auto& f : funcs ) {
         if ( ! f.ShouldAnalyze() )
@@ -545,19 +612,56 @@ static void analyze_scripts_for_ZAM(std::shared_ptr<ProfileFuncs> pfs) {
             continue;
         }
 
+        std::string cache_key;
+
+        if ( cache && ! is_lambda ) {
+            cache_key = cache->BodyKey(f);
+
+            if ( auto zb = cache->Lookup(cache_key, f) ) {
+                func->ReplaceBody(f.Body(), zb);
+                f.SetBody(zb);
+                did_one = true;
+                continue;
+            }
+        }
+
+        if ( analysis_options.tiered_ZAM && ! is_lambda && can_tier(f) ) {
+            // Leave it to the interpreter until it proves to be hot.
+            tiered_bodies[f.Body().get()] = TieredBody{static_cast<size_t>(&f - funcs.data()), std::move(cache_key)};
+            did_one = true;
+            continue;
+        }
+
         auto new_body = f.Body();
         optimize_func(func, f.ProfilePtr(), pfs, f.Scope(), new_body);
         f.SetBody(new_body);
+        ++num_compiled;
 
         if ( is_lambda )
             l->second->ReplaceBody(new_body);
 
+        if ( ! cache_key.empty() && new_body->Tag() == STMT_ZAM )
+            cache->Add(cache_key, f, static_cast<const ZBody*>(new_body.get()));
+
         did_one = true;
     }
 
     if ( ! did_one )
         reporter->FatalError("no matching functions/files for -O ZAM");
 
+    if ( cache ) {
+        cache->Save();
+
+        if ( analysis_options.report_ZAM_cache )
+            fprintf(stderr, "ZAM cache: loaded %d bodies, compiled %d\n", cache->NumLoaded(), num_compiled);
+    }
+
+    if ( ! tiered_bodies.empty() ) {
+        tiered_ZAM_active = true;
+        tiered_pfs = std::move(pfs);
+        tiered_cache = std::move(cache);
+    }
+
     finalize_functions(funcs);
 }
 
@@ -565,6 +669,13 @@ void clear_script_analysis() {
     if ( analysis_options.gen_CPP )
         return;
 
+    if ( tiered_ZAM_active ) {
+        // We still need the analysis for compiling the remaining
+        // bodies.  If they all get compiled, we clear it then.
+        deferred_clear = true;
+        return;
+    }
+
     IDOptInfo::ClearGlobalInitExprs();
 
     // We need to explicitly clear out the optimization information
@@ -665,6 +776,57 @@ void analyze_scripts(bool no_unused_warnings) {
         reporter->FatalError("Optimized script execution aborted due to errors");
 }
 
+void note_tiered_ZAM_call(const Stmt* body) {
+    auto tb = tiered_bodies.find(body);
+    if ( tb != tiered_bodies.end() && ++tb->second.num_calls == analysis_options.tiered_ZAM_threshold )
+        hot_bodies.push_back(body);
+}
+
+void compile_hot_ZAM_bodies() {
+    if ( hot_bodies.empty() )
+        return;
+
+    // Compiling a body can take a few milliseconds.  Rather than stalling
+    // processing when lots of bodies become hot at once, we spread the
+    // work across main loop iterations.
+    constexpr double time_slice = 0.01;
+    auto start = util::current_time(true);
+
+    while ( ! hot_bodies.empty() && util::current_time(true) - start < time_slice ) {
+        auto tb = tiered_bodies.find(hot_bodies.front());
+        hot_bodies.pop_front();
+
+        auto& f = funcs[tb->second.func_ind];
+        auto cache_key = std::move(tb->second.cache_key);
+        tiered_bodies.erase(tb);
+
+        // No scripts are executing, so there's no call in progress
+        // that could observe the switch to the new body.
+        auto new_body = f.Body();
+        optimize_func(f.FuncPtr(), f.ProfilePtr(), tiered_pfs, f.Scope(), new_body);
+        f.SetBody(new_body);
+
+        if ( analysis_options.report_tiered_ZAM )
+            fprintf(stderr, "Tiered ZAM compiled %s (%s)\n", f.Func()->GetName().c_str(),
+                    new_body->Tag() == STMT_ZAM ? "ZAM" : "not compilable");
+
+        if ( tiered_cache && ! cache_key.empty() && new_body->Tag() == STMT_ZAM )
+            tiered_cache->Add(cache_key, f, static_cast<const ZBody*>(new_body.get()));
+    }
+
+    if ( tiered_cache )
+        tiered_cache->Save();
+
+    if ( tiered_bodies.empty() ) {
+        tiered_ZAM_active = false;
+        tiered_pfs.reset();
+        tiered_cache.reset();
+
+        if ( deferred_clear )
+            clear_script_analysis();
+    }
+}
+
 void profile_script_execution() {
     if ( analysis_options.profile_ZAM ) {
         report_ZOP_profile();
@@ -96,6 +96,26 @@ struct AnalyOpt {
     // An associated file to which to write the profile.
     FILE* profile_file = nullptr;
 
+    // Directory in which to keep compiled ZAM bodies across runs, if
+    // any.  Set via ZEEK_ZAM_CACHE_DIR.
+    std::string ZAM_cache_dir;
+
+    // If true, report how many bodies came from the cache at startup,
+    // and how many we compiled instead.  Set via ZEEK_REPORT_ZAM_CACHE.
+    bool report_ZAM_cache = false;
+
+    // If true, start out interpreting function bodies, and only compile
+    // those to ZAM that are called frequently.  Implies "gen_ZAM".
+    bool tiered_ZAM = false;
+
+    // The number of calls after which tiered execution compiles a body.
+    // Set via ZEEK_ZAM_TIER_THRESHOLD.
+    int tiered_ZAM_threshold = 1000;
+
+    // If true, report each body that tiered execution compiles.  Set via
+    // ZEEK_REPORT_TIERED_ZAM.
+    bool report_tiered_ZAM = false;
+
     // If true, dump out transformed code: the results of reducing
     // interpreted scripts, and, if optimize is set, of then optimizing
     // them.
@@ -274,6 +294,16 @@ extern void validate_ZAM_insts();
 // unused ASTs and associated state.
 extern void clear_script_analysis();
 
+// True if tiered ZAM execution has bodies left that it's interpreting.
+extern bool tiered_ZAM_active;
+
+// Notes a call to the given function body, for tiered ZAM execution.
+extern void note_tiered_ZAM_call(const Stmt* body);
+
+// Compiles the bodies that tiered ZAM execution has found to be hot, and
+// swaps them in.  Must only be called while no scripts are executing.
+extern void compile_hot_ZAM_bodies();
+
 // Called when Zeek is terminating.
 extern void finish_script_execution();
 
@@ -120,6 +120,17 @@ void ZAMCompiler::OptimizeInsts() {
         }
     } while ( something_changed );
 
+    // Fusing moves assignments and uses of slots between instructions,
+    // so we then need fresh lifetimes.
+    if ( FuseInsts() ) {
+        if ( dump_intermediaries ) {
+            printf("Fused some instructions:\n");
+            DumpInsts1(nullptr);
+        }
+
+        ComputeFrameLifetimes();
+    }
+
     ReMapFrame();
     ReMapInterpreterFrame();
 }
@@ -324,6 +335,73 @@ bool ZAMCompiler::PruneUnused() {
     return did_prune;
 }
 
+bool ZAMCompiler::FuseInsts() {
+    bool did_fuse = false;
+
+    for ( unsigned int i = 0; i < insts1.size(); ++i ) {
+        auto i0 = insts1[i];
+
+        if ( ! i0->live )
+            continue;
+
+        auto i1 = NextLiveInst(i0);
+
+        // The second instruction must only be reachable by way of the
+        // first.
+        if ( ! i1 || i1->num_labels > 0 )
+            continue;
+
+        if ( FuseTableLookup(i0, i1) ) {
+            KillInst(i1);
+            did_fuse = true;
+        }
+    }
+
+    return did_fuse;
+}
+
+bool ZAMCompiler::FuseTableLookup(ZInstI* i0, ZInstI* i1) {
+    if ( i0->op != OP_VAL_IS_IN_TABLE_COND_VVb || i0->aux )
+        return false;
+
+    // The assignment comes in flavors for the different types of lhs.
+    static std::unordered_set<ZOp> table_index_ops;
+
+    if ( table_index_ops.empty() ) {
+        // Primes assignment_flavor.
+        (void)AssignmentFlavor(OP_NOP, TYPE_VOID, false);
+
+        for ( auto& [tag, op] : assignment_flavor[OP_TABLE_INDEX1_VVV] )
+            table_index_ops.insert(op);
+    }
+
+    if ( table_index_ops.count(i1->op) == 0 )
+        return false;
+
+    // The conditional has the index in v1 and the table in v2, the
+    // assignment the table in v2 and the index in v3.
+    if ( i1->v2 != i0->v2 || i1->v3 != i0->v1 )
+        return false;
+
+    auto index_type = i0->GetType();
+
+    i0->op = OP_VAL_IS_IN_TABLE_ASSIGN_COND_VVVb;
+    i0->op_type = OP_VVVV_I4;
+    i0->v4 = i0->v3;
+    i0->v3 = i0->v2;
+    i0->v2 = i0->v1;
+    i0->v1 = i1->v1;
+    i0->target_slot = 4;
+    i0->SetType(frame_denizens[i1->v1]->GetType());
+    i0->SetType2(index_type);
+
+    // Retain whether the lookup can change non-locals.
+    i0->aux = i1->aux;
+    i1->aux = nullptr;
+
+    return true;
+}
+
 void ZAMCompiler::ComputeFrameLifetimes() {
     // Start analysis from scratch, since we might do this repeatedly.
     inst_beginnings.clear();
@@ -22,6 +22,16 @@ bool CollapseGoTos();
 // pruned.
 bool PruneUnused();
 
+// Replace common sequences of instructions with superinstructions
+// that do the same in one go.  True if something got fused.
+bool FuseInsts();
+
+// Fuses "if ( index in tbl ) lhs = tbl[index]", given the conditional
+// i0 and the assignment i1 following it, into a single table lookup.
+// Rewrites i0 in place and returns true if successful; the caller then
+// kills i1.
+bool FuseTableLookup(ZInstI* i0, ZInstI* i1);
+
 // For the current state of insts1, compute lifetimes of frame
 // denizens (variable(s) using a given frame slot) in terms of
 // first-instruction-to-last-instruction during which they're
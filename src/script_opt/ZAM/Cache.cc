@@ -0,0 +1,1198 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/script_opt/ZAM/Cache.h"
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+#include "zeek/Desc.h"
+#include "zeek/EventRegistry.h"
+#include "zeek/RE.h"
+#include "zeek/Reporter.h"
+#include "zeek/ScannedFile.h"
+#include "zeek/Scope.h"
+#include "zeek/input.h"
+#include "zeek/script_opt/ScriptOpt.h"
+#include "zeek/script_opt/ZAM/Compile.h"
+#include "zeek/script_opt/ZAM/ZBody.h"
+
+extern "C" const char zeek_build_info[];
+
+namespace zeek {
+extern const char* zeek_version();
+}
+
+namespace zeek::detail {
+
+namespace {
+
+// Bump this whenever the layout of the cache files changes.
+constexpr int CACHE_FORMAT_VERSION = 1;
+
+constexpr const char* CACHE_MAGIC = "zeek-ZAM-cache";
+
+// Thrown when we can't save a body, or can't load a saved one.
+class CacheFailure {
+public:
+    explicit CacheFailure(const char* arg_reason) : reason(arg_reason) {}
+
+    const char* reason;
+};
+
+// Cache files consist of space-terminated tokens.  Strings are prefixed
+// with their length so they can contain anything.
+class CacheWriter {
+public:
+    void Int(int64_t i) { Token(std::to_string(i)); }
+    void UInt(uint64_t u) { Token(std::to_string(u)); }
+
+    void Double(double d) {
+        // Hex floats round-trip exactly.
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%a", d);
+        Token(buf);
+    }
+
+    void Str(std::string_view s) {
+        text += std::to_string(s.size());
+        text += ':';
+        text.append(s);
+        text += ' ';
+    }
+
+    const std::string& Text() const { return text; }
+
+private:
+    void Token(std::string_view t) {
+        text.append(t);
+        text += ' ';
+    }
+
+    std::string text;
+};
+
+class CacheReader {
+public:
+    explicit CacheReader(std::string_view arg_text) : text(arg_text) {}
+
+    int64_t Int() { return ParseInt(Token()); }
+
+    uint64_t UInt() {
+        auto t = Token();
+        char* end;
+        errno = 0;
+        auto u = strtoull(t.c_str(), &end, 10);
+
+        if ( t.empty() || *end || errno || t[0] == '-' )
+            throw CacheFailure("bad count");
+
+        return u;
+    }
+
+    double Double() {
+        auto t = Token();
+        char* end;
+        auto d = strtod(t.c_str(), &end);
+
+        if ( t.empty() || *end )
+            throw CacheFailure("bad double");
+
+        return d;
+    }
+
+    std::string_view Str() {
+        auto colon = text.find(':', pos);
+        if ( colon == std::string_view::npos )
+            throw CacheFailure("truncated string");
+
+        auto len = ParseInt(std::string(text.substr(pos, colon - pos)));
+        auto start = colon + 1;
+
+        // We need room for the string plus its terminating space.
+        if ( len < 0 || static_cast<uint64_t>(len) >= text.size() - start )
+            throw CacheFailure("bad string length");
+
+        pos = start + len;
+
+        if ( text[pos] != ' ' )
+            throw CacheFailure("unterminated string");
+
+        ++pos;
+        return text.substr(start, len);
+    }
+
+    // Reads the number of elements that follow, each of which takes up at
+    // least two bytes.  Checking that bound keeps bogus counts from
+    // triggering huge allocations.
+    size_t Count() {
+        auto n = Int();
+
+        if ( n < 0 || static_cast<uint64_t>(n) > (text.size() - pos) / 2 )
+            throw CacheFailure("bad count");
+
+        return n;
+    }
+
+    // Reads an index into a table of the given size, with -1 meaning none.
+    int Index(size_t size) {
+        auto i = Int();
+
+        if ( i < -1 || i >= static_cast<int64_t>(size) )
+            throw CacheFailure("bad index");
+
+        return static_cast<int>(i);
+    }
+
+    bool AtEnd() const { return pos == text.size(); }
+
+private:
+    std::string Token() {
+        auto end = text.find(' ', pos);
+        if ( end == std::string_view::npos )
+            throw CacheFailure("truncated");
+
+        std::string t(text.substr(pos, end - pos));
+        pos = end + 1;
+
+        return t;
+    }
+
+    static int64_t ParseInt(const std::string& t) {
+        char* end;
+        errno = 0;
+        auto i = strtoll(t.c_str(), &end, 10);
+
+        if ( t.empty() || *end || errno )
+            throw CacheFailure("bad integer");
+
+        return i;
+    }
+
+    std::string_view text;
+    size_t pos = 0;
+};
+
+// Bodies refer to file and identifier names via raw pointers, so the
+// names we load need to stay around for good.
+const char* intern(std::string_view s) {
+    static std::unordered_set<std::string> strings;
+    return strings.emplace(s).first->c_str();
+}
+
+// Returns the name under which we can find the given global again.
+std::string global_name(const ID* id) {
+    if ( ! id->IsGlobal() || lookup_ID(id->Name(), GLOBAL_MODULE_NAME, false, false, false).get() != id )
+        throw CacheFailure("identifier not reachable by name");
+
+    return id->Name();
+}
+
+IDPtr find_global(std::string_view name) {
+    std::string n(name);
+    auto id = lookup_ID(n.c_str(), GLOBAL_MODULE_NAME, false, false, false);
+
+    if ( ! id || ! id->IsGlobal() )
+        throw CacheFailure("unknown global");
+
+    return id;
+}
+
+Func* global_func(const IDPtr& id) {
+    const auto& v = id->GetVal();
+
+    if ( ! v || v->GetType()->Tag() != TYPE_FUNC )
+        throw CacheFailure("global is not a function");
+
+    return v->AsFunc();
+}
+
+void save_ints(CacheWriter& w, const std::vector<int>& v) {
+    w.Int(v.size());
+    for ( auto i : v )
+        w.Int(i);
+}
+
+std::vector<int> load_ints(CacheReader& r) {
+    std::vector<int> v(r.Count());
+    for ( auto& i : v )
+        i = r.Int();
+
+    return v;
+}
+
+template<typename T, typename F>
+void save_cases(CacheWriter& w, const CaseMaps<T>& cases, F save_key) {
+    w.Int(cases.size());
+
+    for ( const auto& cm : cases ) {
+        w.Int(cm.size());
+
+        for ( const auto& [k, inst] : cm ) {
+            save_key(k);
+            w.Int(inst);
+        }
+    }
+}
+
+template<typename T, typename F>
+CaseMaps<T> load_cases(CacheReader& r, F load_key) {
+    CaseMaps<T> cases(r.Count());
+
+    for ( auto& cm : cases ) {
+        auto n = r.Count();
+
+        for ( size_t i = 0; i < n; ++i ) {
+            auto k = load_key();
+            cm[k] = r.Int();
+        }
+    }
+
+    return cases;
+}
+
+template<typename T>
+void check_case_targets(const CaseMaps<T>& cases, size_t ninsts) {
+    for ( const auto& cm : cases )
+        for ( const auto& [k, inst] : cm )
+            if ( inst < 0 || static_cast<size_t>(inst) > ninsts )
+                throw CacheFailure("bad case target");
+}
+
+// What the integer operands of a loaded body's instructions can index.
+struct OperandLimits {
+    int frame_size;
+    int64_t interp_frame_size;
+    int num_globals;
+    size_t num_table_iters;
+    int num_step_iters;
+    size_t num_insts;
+};
+
+// Range-checks the integer operands of a loaded instruction that index
+// into the frame, the body's tables or its instructions.  A branch may
+// target the end of the body, so those go up to (and include) num_insts.
+void check_operands(const ZInstI& z, const OperandLimits& l) {
+    int v[4] = {z.v1, z.v2, z.v3, z.v4};
+
+    auto check = [](int vi, int64_t limit, const char* what) {
+        if ( vi < 0 || vi >= limit )
+            throw CacheFailure(what);
+    };
+
+    // Global loads and stores use an index into the globals rather
+    // than a frame slot; see ZAMCompiler::ReMapFrame().
+    if ( z.IsGlobalStore() ) {
+        check(z.v1, l.num_globals, "bad global index");
+        return;
+    }
+
+    int nslots = z.NumFrameSlots();
+
+    if ( z.IsGlobalLoad() ) {
+        check(z.v2, l.num_globals, "bad global index");
+        nslots = 1;
+    }
+    else if ( z.op_type == OP_VV_FRAME )
+        check(z.v2, l.interp_frame_size, "bad interpreter frame slot");
+
+    // Instructions that manipulate their first slot internally don't
+    // necessarily use it as a frame slot.
+    int first = op1_flavor[z.op] == OP1_INTERNAL ? 1 : 0;
+
+    for ( int i = first; i < nslots; ++i )
+        check(v[i], l.frame_size, "bad frame slot");
+
+    // The remaining operands only have a known meaning if the operation
+    // comes with a description.
+    auto d = zam_inst_desc.find(z.op);
+    if ( d == zam_inst_desc.end() )
+        return;
+
+    const auto& oc = d->second.op_class;
+    if ( oc.find_first_not_of("VRbfgsiCX") != std::string::npos )
+        return;
+
+    int n = 0;
+    for ( auto oc_i : oc ) {
+        if ( oc_i == 'C' || oc_i == 'X' )
+            continue;
+
+        if ( n >= 4 )
+            throw CacheFailure("bad operand class");
+
+        auto vi = v[n++];
+
+        switch ( oc_i ) {
+            case 'b': check(vi, static_cast<int64_t>(l.num_insts) + 1, "bad branch target"); break;
+            case 'f': check(vi, l.num_table_iters, "bad table iteration"); break;
+            case 'g': check(vi, l.num_globals, "bad global index"); break;
+            case 's': check(vi, l.num_step_iters, "bad step iteration"); break;
+            default: break;
+        }
+    }
+}
+
+// Gathers the types and locations that a body's instructions refer to.
+// We write each of these out once per body, with the instructions then
+// referring to them by index.
+class BodySaver {
+public:
+    BodySaver(ProfileFuncs* arg_pfs, const std::unordered_map<p_hash_type, TypePtr>& arg_known_types)
+        : pfs(arg_pfs), known_types(arg_known_types) {}
+
+    void Inst(CacheWriter& w, const ZInst& z);
+    void Tables(CacheWriter& w) const;
+
+private:
+    void Aux(CacheWriter& w, const ZInst& z);
+    void Val(CacheWriter& w, const ValPtr& v);
+
+    int TypeIndex(const TypePtr& t);
+    int LocIndex(const std::shared_ptr<ZAMLocInfo>& loc);
+
+    ProfileFuncs* pfs;
+    const std::unordered_map<p_hash_type, TypePtr>& known_types;
+
+    std::vector<p_hash_type> types;
+    std::unordered_map<p_hash_type, int> type_indices;
+
+    std::vector<std::shared_ptr<ZAMLocInfo>> locs;
+    std::unordered_map<const ZAMLocInfo*, int> loc_indices;
+};
+
+void BodySaver::Inst(CacheWriter& w, const ZInst& z) {
+    w.Int(z.op);
+    w.Int(z.op_type);
+    w.Int(z.v1);
+    w.Int(z.v2);
+    w.Int(z.v3);
+    w.Int(z.v4);
+    w.Int(TypeIndex(z.GetType()));
+    w.Int(TypeIndex(z.GetType2()));
+    w.Int(z.is_managed ? int(*z.is_managed) : -1);
+    w.Int(LocIndex(z.loc));
+
+    // A few instructions stash values in the constant despite not having
+    // a constant operand.  We can't tell how to interpret those.
+    auto c = z.ConstVal();
+    if ( ! c && z.c.AsInt() != 0 )
+        throw CacheFailure("non-operand constant");
+
+    Val(w, c);
+    Aux(w, z);
+}
+
+void BodySaver::Aux(CacheWriter& w, const ZInst& z) {
+    auto aux = z.aux;
+
+    if ( ! aux ) {
+        w.Int(-1);
+        return;
+    }
+
+    if ( aux->lambda || aux->wi || aux->cat_args || aux->attrs || aux->field_inits )
+        throw CacheFailure("unsupported auxiliary information");
+
+    if ( aux->call_expr &&
+         (z.op == OP_WHENCALLN_V || z.op == OP_WHEN_ID_INDCALLN_V || z.op == OP_WHENINDCALLN_VV) )
+        throw CacheFailure("call in \"when\" condition");
+
+    w.Int(aux->n);
+    w.Int(aux->elems_has_slots);
+
+    for ( int i = 0; i < aux->n; ++i ) {
+        auto& e = aux->elems[i];
+        w.Int(e.IntVal());
+        w.Int(TypeIndex(e.GetType()));
+        Val(w, e.Constant());
+    }
+
+    w.Str(aux->id_val ? global_name(aux->id_val.get()) : "");
+
+    if ( aux->func && (! aux->id_val || global_func(aux->id_val) != aux->func) )
+        throw CacheFailure("function not reachable by name");
+
+    w.Int(aux->func != nullptr);
+    w.Int(aux->is_BiF_call);
+
+    w.Int(aux->cft.size());
+    for ( auto [cft, n] : aux->cft ) {
+        w.Int(cft);
+        w.Int(n);
+    }
+
+    w.Str(aux->event_handler ? aux->event_handler->Name() : "");
+    w.Int(aux->can_change_non_locals);
+
+    save_ints(w, aux->map);
+    save_ints(w, aux->rhs_map);
+    save_ints(w, aux->lhs_map);
+
+    w.Int(aux->types.size());
+    for ( const auto& t : aux->types )
+        w.Int(TypeIndex(t));
+
+    w.Int(aux->is_managed.size());
+    for ( auto m : aux->is_managed )
+        w.Int(m);
+
+    save_ints(w, aux->loop_vars);
+    w.Int(TypeIndex(aux->value_var_type));
+    w.Int(aux->zvec.size());
+}
+
+void BodySaver::Val(CacheWriter& w, const ValPtr& v) {
+    if ( ! v ) {
+        w.Int(-1);
+        return;
+    }
+
+    const auto& t = v->GetType();
+    auto tag = t->Tag();
+
+    w.Int(tag);
+
+    switch ( tag ) {
+        case TYPE_BOOL:
+        case TYPE_INT: w.Int(v->AsInt()); break;
+
+        case TYPE_COUNT:
+        case TYPE_PORT: w.UInt(v->AsCount()); break;
+
+        case TYPE_DOUBLE:
+        case TYPE_TIME:
+        case TYPE_INTERVAL: w.Double(v->AsDouble()); break;
+
+        case TYPE_ENUM:
+            w.Int(TypeIndex(t));
+            w.Int(v->AsEnum());
+            break;
+
+        case TYPE_STRING: {
+            auto s = v->AsString();
+            w.Str({reinterpret_cast<const char*>(s->Bytes()), static_cast<size_t>(s->Len())});
+            break;
+        }
+
+        case TYPE_ADDR: w.Str(v->AsAddr().AsString()); break;
+
+        case TYPE_SUBNET:
+            w.Str(v->AsSubNetVal()->Prefix().AsString());
+            w.Int(v->AsSubNetVal()->Width());
+            break;
+
+        case TYPE_PATTERN: {
+            auto re = v->AsPattern();
+            w.Str(re->PatternText());
+            w.Str(re->AnywherePatternText());
+            break;
+        }
+
+        case TYPE_FUNC: {
+            auto f = v->AsFunc();
+            auto id = find_global(f->GetName());
+
+            if ( global_func(id) != f )
+                throw CacheFailure("function not reachable by name");
+
+            w.Str(f->GetName());
+            break;
+        }
+
+        case TYPE_TYPE: w.Int(TypeIndex(t->AsTypeType()->GetType())); break;
+
+        default: throw CacheFailure("unsupported constant");
+    }
+}
+
+int BodySaver::TypeIndex(const TypePtr& t) {
+    if ( ! t )
+        return -1;
+
+    auto h = pfs->HashType(t);
+
+    if ( known_types.count(h) == 0 )
+        throw CacheFailure("type unknown prior to compilation");
+
+    auto ti = type_indices.find(h);
+    if ( ti != type_indices.end() )
+        return ti->second;
+
+    types.push_back(h);
+    return type_indices[h] = types.size() - 1;
+}
+
+int BodySaver::LocIndex(const std::shared_ptr<ZAMLocInfo>& loc) {
+    if ( ! loc )
+        return -1;
+
+    auto li = loc_indices.find(loc.get());
+    if ( li != loc_indices.end() )
+        return li->second;
+
+    // Parents come first, so that loading can resolve them right away.
+    LocIndex(loc->Parent());
+
+    locs.push_back(loc);
+    return loc_indices[loc.get()] = locs.size() - 1;
+}
+
+void BodySaver::Tables(CacheWriter& w) const {
+    w.Int(types.size());
+    for ( auto h : types )
+        w.UInt(h);
+
+    w.Int(locs.size());
+    for ( const auto& l : locs ) {
+        auto loc = l->Loc();
+        w.Str(l->FuncName());
+        w.Str(loc->FileName() ? loc->FileName() : "");
+        w.Int(loc->FirstLine());
+        w.Int(loc->LastLine());
+
+        auto p = l->Parent();
+        w.Int(p ? loc_indices.at(p.get()) : -1);
+    }
+}
+
+// The reverse of BodySaver.
+class BodyLoader {
+public:
+    explicit BodyLoader(const std::unordered_map<p_hash_type, TypePtr>& arg_known_types) : known_types(arg_known_types) {}
+
+    void Tables(CacheReader& r);
+    std::unique_ptr<ZInstI> Inst(CacheReader& r);
+
+    // Hands the auxiliary information over to the body's instructions.
+    void ReleaseAux() {
+        for ( auto& a : auxes )
+            a.release();
+    }
+
+private:
+    ZInstAux* Aux(CacheReader& r);
+    ValPtr Val(CacheReader& r);
+    TypePtr Type(CacheReader& r);
+
+    const std::unordered_map<p_hash_type, TypePtr>& known_types;
+
+    std::vector<TypePtr> types;
+    std::vector<std::shared_ptr<ZAMLocInfo>> locs;
+    std::vector<std::unique_ptr<ZInstAux>> auxes;
+};
+
+void BodyLoader::Tables(CacheReader& r) {
+    auto ntypes = r.Count();
+    for ( size_t i = 0; i < ntypes; ++i ) {
+        auto t = known_types.find(r.UInt());
+        if ( t == known_types.end() )
+            throw CacheFailure("unknown type");
+
+        types.push_back(t->second);
+    }
+
+    auto nlocs = r.Count();
+    for ( size_t i = 0; i < nlocs; ++i ) {
+        auto func_name = r.Str();
+        auto file = r.Str();
+        auto first = r.Int();
+        auto last = r.Int();
+        auto parent = r.Index(locs.size());
+
+        auto loc = std::make_shared<Location>(file.empty() ? nullptr : intern(file), first, last);
+        locs.push_back(std::make_shared<ZAMLocInfo>(std::string(func_name), std::move(loc),
+                                                    parent >= 0 ? locs[parent] : nullptr));
+    }
+}
+
+std::unique_ptr<ZInstI> BodyLoader::Inst(CacheReader& r) {
+    auto op = r.Int();
+    if ( op < 0 || op > OP_NOP )
+        throw CacheFailure("bad operation");
+
+    auto op_type = r.Int();
+    if ( op_type < 0 || op_type > OP_VVVV_I2_I3_I4 )
+        throw CacheFailure("bad operand type");
+
+    int v[4];
+    for ( auto& vi : v )
+        vi = r.Int();
+
+    auto t = Type(r);
+    auto t2 = Type(r);
+    auto is_managed = r.Int();
+
+    auto li = r.Index(locs.size());
+    if ( li < 0 )
+        throw CacheFailure("missing location");
+
+    auto c = Val(r);
+    if ( c && ! t )
+        throw CacheFailure("constant without type");
+
+    // Instructions pick up their location when constructed.
+    ZAM::curr_loc = locs[li];
+
+    auto z = std::make_unique<ZInstI>();
+    z->op = static_cast<ZOp>(op);
+    z->op_type = static_cast<ZAMOpType>(op_type);
+    z->v1 = v[0];
+    z->v2 = v[1];
+    z->v3 = v[2];
+    z->v4 = v[3];
+
+    if ( t )
+        z->SetType(t);
+    if ( t2 )
+        z->SetType2(t2);
+
+    if ( is_managed >= 0 )
+        z->is_managed = is_managed != 0;
+    else
+        z->is_managed = std::nullopt;
+
+    if ( c )
+        z->c = ZVal(c, t);
+
+    z->aux = Aux(r);
+
+    return z;
+}
+
+ZInstAux* BodyLoader::Aux(CacheReader& r) {
+    auto n = r.Int();
+    if ( n < 0 )
+        return nullptr;
+
+    if ( static_cast<uint64_t>(n) > 1000000 )
+        throw CacheFailure("bad auxiliary size");
+
+    auxes.push_back(std::make_unique<ZInstAux>(n));
+    auto aux = auxes.back().get();
+
+    aux->elems_has_slots = r.Int() != 0;
+
+    for ( int i = 0; i < n; ++i ) {
+        auto e_i = r.Int();
+        auto t = Type(r);
+        auto c = Val(r);
+
+        if ( t )
+            aux->elems[i].SetInt(e_i, t);
+        else
+            aux->elems[i].SetInt(e_i);
+
+        if ( c )
+            aux->elems[i].SetConstant(c);
+    }
+
+    if ( auto id_name = r.Str(); ! id_name.empty() )
+        aux->id_val = find_global(id_name);
+
+    if ( r.Int() ) {
+        if ( ! aux->id_val )
+            throw CacheFailure("function without identifier");
+
+        aux->func = global_func(aux->id_val);
+    }
+
+    aux->is_BiF_call = r.Int() != 0;
+
+    auto ncft = r.Count();
+    for ( size_t i = 0; i < ncft; ++i ) {
+        auto cft = r.Int();
+        if ( cft < 0 || cft > CFT_NONE )
+            throw CacheFailure("bad control flow type");
+
+        aux->cft[static_cast<ControlFlowType>(cft)] = r.Int();
+    }
+
+    if ( auto eh_name = r.Str(); ! eh_name.empty() ) {
+        aux->event_handler = event_registry->Lookup(eh_name);
+        if ( ! aux->event_handler )
+            throw CacheFailure("unknown event handler");
+    }
+
+    aux->can_change_non_locals = r.Int() != 0;
+
+    aux->map = load_ints(r);
+    aux->rhs_map = load_ints(r);
+    aux->lhs_map = load_ints(r);
+
+    auto ntypes = r.Count();
+    for ( size_t i = 0; i < ntypes; ++i )
+        aux->types.push_back(Type(r));
+
+    auto nmanaged = r.Count();
+    for ( size_t i = 0; i < nmanaged; ++i )
+        aux->is_managed.push_back(r.Int() != 0);
+
+    aux->loop_vars = load_ints(r);
+    aux->value_var_type = Type(r);
+
+    auto nzvec = r.Int();
+    if ( nzvec < 0 || nzvec > 1000000 )
+        throw CacheFailure("bad value vector size");
+
+    aux->zvec.resize(nzvec);
+
+    return aux;
+}
+
+ValPtr BodyLoader::Val(CacheReader& r) {
+    auto tag = r.Int();
+    if ( tag < 0 )
+        return nullptr;
+
+    switch ( tag ) {
+        case TYPE_BOOL: return val_mgr->Bool(r.Int() != 0);
+        case TYPE_INT: return val_mgr->Int(r.Int());
+        case TYPE_COUNT: return val_mgr->Count(r.UInt());
+        case TYPE_PORT: return val_mgr->Port(static_cast<uint32_t>(r.UInt()));
+        case TYPE_DOUBLE: return make_intrusive<DoubleVal>(r.Double());
+        case TYPE_TIME: return make_intrusive<TimeVal>(r.Double());
+        case TYPE_INTERVAL: return make_intrusive<IntervalVal>(r.Double());
+
+        case TYPE_ENUM: {
+            auto t = Type(r);
+            if ( ! t || t->Tag() != TYPE_ENUM )
+                throw CacheFailure("bad enum type");
+
+            return t->AsEnumType()->GetEnumVal(r.Int());
+        }
+
+        case TYPE_STRING: {
+            auto s = r.Str();
+            return make_intrusive<StringVal>(s.size(), s.data());
+        }
+
+        case TYPE_ADDR: return make_intrusive<AddrVal>(std::string(r.Str()));
+
+        case TYPE_SUBNET: {
+            std::string prefix(r.Str());
+            auto width = r.Int();
+            return make_intrusive<SubNetVal>(IPAddr(prefix), width);
+        }
+
+        case TYPE_PATTERN: {
+            std::string exact(r.Str());
+            std::string anywhere(r.Str());
+
+            auto re = new RE_Matcher(exact.c_str(), anywhere.c_str());
+            if ( ! re->Compile() ) {
+                delete re;
+                throw CacheFailure("bad pattern");
+            }
+
+            return make_intrusive<PatternVal>(re);
+        }
+
+        case TYPE_FUNC: {
+            auto id = find_global(r.Str());
+            global_func(id);
+            return id->GetVal();
+        }
+
+        case TYPE_TYPE: {
+            auto t = Type(r);
+            if ( ! t )
+                throw CacheFailure("missing type value");
+
+            return make_intrusive<TypeVal>(t, true);
+        }
+
+        default: throw CacheFailure("bad constant");
+    }
+}
+
+TypePtr BodyLoader::Type(CacheReader& r) {
+    auto i = r.Index(types.size());
+    return i >= 0 ? types[i] : nullptr;
+}
+
+} // namespace
+
+ZAMCache::ZAMCache(const std::string& dir, std::shared_ptr<ProfileFuncs> _pfs) : pfs(std::move(_pfs)) {
+    file_name = CacheFileName(dir);
+    if ( file_name.empty() )
+        return;
+
+    if ( ! util::detail::ensure_intermediate_dirs(dir.c_str()) ) {
+        reporter->Warning("cannot create ZAM cache directory %s", dir.c_str());
+        return;
+    }
+
+    // Later, compiling adds further types to the profile, which a new
+    // run wouldn't know about until compiling as well.
+    for ( auto t : pfs->RepTypes() )
+        known_types.emplace(pfs->HashType(t), TypePtr{NewRef{}, const_cast<Type*>(t)});
+
+    active = true;
+    Load();
+}
+
+std::string ZAMCache::BodyKey(const FuncInfo& f) const {
+    auto loc = f.Body()->GetLocationInfo();
+    auto pf = f.Profile();
+    p_hash_type h = pf && pf->HasHashVal() ? pf->HashVal() : 0;
+
+    return util::fmt("%s@%s:%d-%d#%llu", f.Func()->GetName().c_str(), loc->FileName() ? loc->FileName() : "<none>",
+                     loc->FirstLine(), loc->LastLine(), h);
+}
+
+StmtPtr ZAMCache::Lookup(const std::string& key, const FuncInfo& f) {
+    if ( ! active || f.Body()->Tag() == STMT_CPP )
+        return nullptr;
+
+    auto e = entries.find(key);
+    if ( e == entries.end() )
+        return nullptr;
+
+    try {
+        auto body = LoadBody(f, e->second);
+        ++num_loaded;
+        return body;
+    } catch ( const CacheFailure& ) {
+        // Compiling the body anew replaces the entry.
+        entries.erase(e);
+        return nullptr;
+    }
+}
+
+void ZAMCache::Add(const std::string& key, const FuncInfo& f, const ZBody* zb) {
+    if ( ! active )
+        return;
+
+    try {
+        entries[key] = SaveBody(f, zb);
+        modified = true;
+    } catch ( const CacheFailure& ) {
+        // Not cacheable, we'll compile it again next time.
+    }
+}
+
+void ZAMCache::Save() {
+    if ( ! active || ! modified )
+        return;
+
+    CacheWriter w;
+    w.Int(entries.size());
+
+    for ( const auto& [key, body] : entries ) {
+        w.Str(key);
+        w.Str(body);
+    }
+
+    const auto& payload = w.Text();
+
+    // Writing to a temporary file and then renaming it means that other
+    // Zeek processes starting up concurrently, such as cluster workers,
+    // never see a partial file.
+    std::string tmp_name = util::fmt("%s.%d.tmp", file_name.c_str(), getpid());
+
+    auto f = fopen(tmp_name.c_str(), "w");
+    if ( ! f ) {
+        reporter->Warning("cannot write ZAM cache file %s: %s", tmp_name.c_str(), strerror(errno));
+        return;
+    }
+
+    fprintf(f, "%s %d %llu\n", CACHE_MAGIC, CACHE_FORMAT_VERSION, p_hash(payload));
+    bool ok = fwrite(payload.data(), 1, payload.size(), f) == payload.size();
+    ok = fclose(f) == 0 && ok;
+
+    if ( ! ok || rename(tmp_name.c_str(), file_name.c_str()) != 0 ) {
+        reporter->Warning("cannot write ZAM cache file %s: %s", file_name.c_str(), strerror(errno));
+        unlink(tmp_name.c_str());
+        return;
+    }
+
+    modified = false;
+}
+
+std::string ZAMCache::CacheFileName(const std::string& dir) const {
+    // The build, including the set of ZAM operations it provides.
+    auto h = merge_p_hashes(p_hash(zeek_version()), p_hash(zeek_build_info));
+
+    for ( int i = 0; i <= OP_NOP; ++i ) {
+        auto op = static_cast<ZOp>(i);
+        h = merge_p_hashes(h, p_hash(ZOP_name(op)));
+
+        if ( auto d = zam_inst_desc.find(op); d != zam_inst_desc.end() )
+            h = merge_p_hashes(h, p_hash(d->second.op_eval));
+    }
+
+    // The scripts, and everything else that affects how we compile them.
+    for ( const auto& sf : files_scanned ) {
+        if ( sf.skipped )
+            continue;
+
+        if ( sf.canonical_path == ScannedFile::canonical_stdin_path )
+            return "";
+
+        std::ifstream in(sf.canonical_path, std::ios::binary);
+        if ( ! in )
+            return "";
+
+        std::stringstream contents;
+        contents << in.rdbuf();
+
+        h = merge_p_hashes(h, p_hash(sf.canonical_path));
+        h = merge_p_hashes(h, p_hash(contents.str()));
+    }
+
+    // Code from -e and redefs from var=val parameters.
+    h = merge_p_hashes(h, p_hash(command_line_scripts));
+
+    // The function bodies, which reflect @if's that depend on the
+    // environment, such as the cluster node type.  The profiles are
+    // keyed by pointer, so combine them independent of their order.
+    p_hash_type bodies_h = 0;
+    for ( const auto& [f, pf] : pfs->FuncProfs() )
+        if ( pf->HasHashVal() )
+            bodies_h += pf->HashVal();
+
+    h = merge_p_hashes(h, bodies_h);
+
+    // Values of constants, which the optimizer can propagate into the
+    // bodies.  Only atomic ones, since we don't cache bodies that have
+    // aggregate constants.
+    for ( const auto& id : global_scope()->OrderedVars() ) {
+        if ( ! id->IsConst() || ! id->GetVal() || IsAggr(id->GetType()) )
+            continue;
+
+        ODesc d;
+        id->GetVal()->Describe(&d);
+        h = merge_p_hashes(h, p_hash(id->Name()));
+        h = merge_p_hashes(h, p_hash(d.Description()));
+    }
+
+    const auto& ao = analysis_options;
+    for ( bool opt : {ao.inliner, ao.no_inliner, ao.no_eh_coalescence, ao.optimize_AST, ao.keep_asserts,
+                      ao.compile_all, ao.no_ZAM_opt, ao.no_ZAM_control_flow_opt} )
+        h = merge_p_hashes(h, p_hash(opt));
+
+    for ( auto env : {"ZEEK_OPT_FUNCS", "ZEEK_OPT_FILES"} )
+        if ( auto val = getenv(env) )
+            h = merge_p_hashes(h, p_hash(val));
+
+    return util::fmt("%s/zam-%016llx.cache", dir.c_str(), h);
+}
+
+void ZAMCache::Load() {
+    std::ifstream in(file_name, std::ios::binary);
+    if ( ! in )
+        // Nothing cached yet.
+        return;
+
+    std::stringstream contents;
+    contents << in.rdbuf();
+    auto text = contents.str();
+
+    auto nl = text.find('\n');
+    std::string_view payload(text);
+    payload.remove_prefix(nl == std::string::npos ? text.size() : nl + 1);
+
+    char magic[32];
+    int version;
+    unsigned long long checksum;
+
+    if ( nl == std::string::npos ||
+         sscanf(text.substr(0, nl).c_str(), "%31s %d %llu", magic, &version, &checksum) != 3 ||
+         strcmp(magic, CACHE_MAGIC) != 0 || version != CACHE_FORMAT_VERSION || checksum != p_hash(payload) ) {
+        reporter->Warning("ignoring corrupt ZAM cache file %s", file_name.c_str());
+        return;
+    }
+
+    try {
+        CacheReader r(payload);
+        auto n = r.Count();
+
+        for ( size_t i = 0; i < n; ++i ) {
+            std::string key(r.Str());
+            entries[key] = r.Str();
+        }
+    } catch ( const CacheFailure& ) {
+        reporter->Warning("ignoring corrupt ZAM cache file %s", file_name.c_str());
+        entries.clear();
+    }
+}
+
+std::string ZAMCache::SaveBody(const FuncInfo& f, const ZBody* zb) {
+    BodySaver saver(pfs.get(), known_types);
+
+    // The instructions determine the tables of types and locations,
+    // which need to come first.
+    CacheWriter insts;
+    insts.Int(zb->end_pc);
+
+    for ( auto i = 0U; i < zb->end_pc; ++i )
+        saver.Inst(insts, zb->insts[i]);
+
+    CacheWriter w;
+    w.Str(zb->func_name);
+
+    auto loc = zb->GetLocationInfo();
+    w.Str(loc->FileName() ? loc->FileName() : "");
+    w.Int(loc->FirstLine());
+    w.Int(loc->LastLine());
+
+    w.Int(zb->fixed_frame != nullptr);
+    w.Int(f.Func()->FrameSize());
+
+    w.Int(zb->frame_denizens.size());
+    for ( const auto& fd : zb->frame_denizens ) {
+        w.Int(fd.names.size());
+        for ( auto n : fd.names )
+            w.Str(n);
+
+        w.Int(fd.id_start.size());
+        for ( auto s : fd.id_start )
+            w.UInt(s);
+
+        w.Int(fd.scope_end);
+        w.Int(fd.is_managed);
+    }
+
+    save_ints(w, zb->managed_slots);
+
+    w.Int(zb->globals.size());
+    for ( const auto& g : zb->globals ) {
+        w.Str(global_name(g.id.get()));
+        w.Int(g.slot);
+    }
+
+    save_cases(w, zb->int_cases, [&w](zeek_int_t k) { w.Int(k); });
+    save_cases(w, zb->uint_cases, [&w](zeek_uint_t k) { w.UInt(k); });
+    save_cases(w, zb->double_cases, [&w](double k) { w.Double(k); });
+    save_cases(w, zb->str_cases, [&w](const std::string& k) { w.Str(k); });
+
+    w.Int(zb->table_iters.size());
+    w.Int(zb->num_step_iters);
+
+    saver.Tables(w);
+    w.Str(insts.Text());
+
+    return w.Text();
+}
+
+StmtPtr ZAMCache::LoadBody(const FuncInfo& f, std::string_view data) {
+    CacheReader r(data);
+
+    auto zb = IntrusivePtr<ZBody>{AdoptRef{}, new ZBody(std::string(r.Str()))};
+
+    auto file = r.Str();
+    auto first_line = r.Int();
+    auto last_line = r.Int();
+    Location body_loc(file.empty() ? nullptr : intern(file), first_line, last_line);
+
+    bool non_recursive = r.Int() != 0;
+    auto interp_frame_size = r.Int();
+
+    auto nfd = r.Count();
+    for ( size_t i = 0; i < nfd; ++i ) {
+        FrameSharingInfo fd;
+
+        auto nnames = r.Count();
+        for ( size_t j = 0; j < nnames; ++j )
+            fd.names.push_back(intern(r.Str()));
+
+        auto nstarts = r.Count();
+        for ( size_t j = 0; j < nstarts; ++j )
+            fd.id_start.push_back(r.UInt());
+
+        fd.scope_end = r.Int();
+        fd.is_managed = r.Int() != 0;
+
+        zb->frame_denizens.push_back(std::move(fd));
+    }
+
+    zb->frame_size = zb->frame_denizens.size();
+
+    zb->managed_slots = load_ints(r);
+    for ( auto ms : zb->managed_slots )
+        if ( ms < 0 || ms >= zb->frame_size )
+            throw CacheFailure("bad managed slot");
+
+    auto nglobals = r.Count();
+    for ( size_t i = 0; i < nglobals; ++i ) {
+        auto id = find_global(r.Str());
+        zb->globals.push_back(GlobalInfo{std::move(id), static_cast<int>(r.Int())});
+    }
+
+    zb->num_globals = zb->globals.size();
+
+    for ( const auto& g : zb->globals )
+        if ( g.slot < 0 || g.slot >= zb->frame_size )
+            throw CacheFailure("bad global slot");
+
+    zb->int_cases = load_cases<zeek_int_t>(r, [&r] { return r.Int(); });
+    zb->uint_cases = load_cases<zeek_uint_t>(r, [&r] { return r.UInt(); });
+    zb->double_cases = load_cases<double>(r, [&r] { return r.Double(); });
+    zb->str_cases = load_cases<std::string>(r, [&r] { return std::string(r.Str()); });
+
+    zb->table_iters.resize(r.Count());
+    zb->num_step_iters = r.Int();
+
+    BodyLoader loader(known_types);
+    loader.Tables(r);
+
+    CacheReader ir(r.Str());
+
+    if ( ! r.AtEnd() )
+        throw CacheFailure("trailing data");
+
+    std::vector<std::unique_ptr<ZInstI>> insts;
+    auto ninsts = ir.Count();
+
+    for ( size_t i = 0; i < ninsts; ++i )
+        insts.push_back(loader.Inst(ir));
+
+    if ( ! ir.AtEnd() )
+        throw CacheFailure("trailing instruction data");
+
+    OperandLimits limits{zb->frame_size, interp_frame_size, zb->num_globals, zb->table_iters.size(),
+                         zb->num_step_iters, ninsts};
+
+    for ( const auto& z : insts )
+        check_operands(*z, limits);
+
+    check_case_targets(zb->int_cases, ninsts);
+    check_case_targets(zb->uint_cases, ninsts);
+    check_case_targets(zb->double_cases, ninsts);
+    check_case_targets(zb->str_cases, ninsts);
+
+    // From here on, nothing can fail.
+    loader.ReleaseAux();
+
+    std::vector<ZInstI*> instsI;
+    for ( auto& z : insts )
+        instsI.push_back(z.get());
+
+    zb->SetInsts(instsI);
+    zb->SetLocationInfo(&body_loc);
+    zb->Init(non_recursive);
+
+    // Adjust the frames as optimize_func() would have.
+    auto func = f.Func();
+
+    if ( interp_frame_size > func->FrameSize() )
+        func->SetFrameSize(interp_frame_size);
+
+    if ( ! analysis_options.no_ZAM_opt ) {
+        int nparams = func->GetType()->Params()->NumFields();
+        auto rf = remapped_intrp_frame_sizes.find(func);
+
+        if ( rf == remapped_intrp_frame_sizes.end() || rf->second < nparams )
+            remapped_intrp_frame_sizes[func] = nparams;
+    }
+
+    return zb;
+}
+
+} // namespace zeek::detail
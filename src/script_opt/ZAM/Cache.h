@@ -0,0 +1,99 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Persistent cache of compiled ZAM function bodies.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "zeek/script_opt/ProfileFunc.h"
+
+namespace zeek::detail {
+
+class ZBody;
+
+// Saves compiled ZAM bodies to a file in a cache directory, so that later
+// runs can reconstitute them instead of reducing, optimizing and compiling
+// the scripts again.
+//
+// A cache file holds the bodies for one combination of Zeek build, loaded
+// scripts (including code and redefs from the command line), resulting
+// function bodies, constants and optimization options, which together
+// determine its name.  Other options, such as the trace to read, don't
+// matter, so runs on different inputs share the file.  Within the file,
+// bodies are keyed by their function's name and location along with the
+// hash of the function's profile.  Inlining and constant propagation mean
+// that a body's code can depend on more than its own script, so any change
+// to the loaded scripts starts a new file rather than reusing bodies from
+// the old one.
+//
+// Only bodies are cached whose instructions refer to things that we can find
+// again by name or hash: globals, functions, events, types and atomic
+// constants.  Bodies with lambdas, "when" conditions, attributes or
+// aggregate constants always get compiled.
+class ZAMCache {
+public:
+    // Looks for an existing cache file in the given directory.  The
+    // profile of all of the functions provides the hashes with which
+    // we identify types.
+    ZAMCache(const std::string& dir, std::shared_ptr<ProfileFuncs> pfs);
+
+    // False if we can't cache bodies for this run, for example because
+    // a script came from stdin.
+    bool IsActive() const { return active; }
+
+    // Returns the key identifying the given function body.  Needs to
+    // be called prior to compiling the body.
+    std::string BodyKey(const FuncInfo& f) const;
+
+    // Returns the cached body for the given key, or nil if there isn't
+    // one (or it can't be used).  Updates the function's frame size the
+    // same way compiling it would.
+    StmtPtr Lookup(const std::string& key, const FuncInfo& f);
+
+    // Adds a freshly compiled body.  Quietly skips bodies we can't cache.
+    void Add(const std::string& key, const FuncInfo& f, const ZBody* zb);
+
+    // Writes the cache file back out if we added bodies to it since
+    // loading or last saving it.
+    void Save();
+
+    // The number of bodies that Lookup() has returned.
+    int NumLoaded() const { return num_loaded; }
+
+private:
+    // Computes the file name from the fingerprints of the build and of
+    // the scripts.  Returns an empty string if the latter isn't possible.
+    std::string CacheFileName(const std::string& dir) const;
+
+    void Load();
+
+    std::string SaveBody(const FuncInfo& f, const ZBody* zb);
+    StmtPtr LoadBody(const FuncInfo& f, std::string_view data);
+
+    std::shared_ptr<ProfileFuncs> pfs;
+
+    // Maps the hashes of the types known prior to compilation to the
+    // corresponding representative types.  Bodies using other types
+    // can't be cached, since we wouldn't be able to find those types
+    // again in a later run.
+    std::unordered_map<p_hash_type, TypePtr> known_types;
+
+    std::string file_name;
+    bool active = false;
+
+    // Maps body keys to their serialized bodies.  Ordered so that the
+    // same bodies always lead to the same file.
+    std::map<std::string, std::string> entries;
+
+    // Whether we've added entries since loading or saving the file.
+    bool modified = false;
+
+    int num_loaded = 0;
+};
+
+} // namespace zeek::detail
@@ -243,4 +243,7 @@ private:
 class FuncInfo;
 extern void finalize_functions(const std::vector<FuncInfo>& funcs);
 
+// Per function, its maximum remapped interpreter frame size.
+extern std::unordered_map<const Func*, int> remapped_intrp_frame_sizes;
+
 } // namespace zeek::detail
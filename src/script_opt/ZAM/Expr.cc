@@ -242,7 +242,17 @@ const ZAMStmt ZAMCompiler::CompileAssignExpr(const AssignExpr* e) {
 
     if ( rhs->Tag() == EXPR_ANY_INDEX ) {
         auto rhs_as_any = static_cast<const AnyIndexExpr*>(rhs);
-        return AnyIndexVVi(lhs, r1->AsNameExpr(), rhs_as_any->Index());
+        auto first_inst = insts1.size();
+        auto z = AnyIndexVVi(lhs, r1->AsNameExpr(), rhs_as_any->Index());
+
+        // Provides the instruction's cache of record types. We can't
+        // simply use the last instruction, as for globals and captures
+        // a store follows it.
+        for ( auto i = first_inst; i < insts1.size(); ++i )
+            if ( insts1[i]->op == OP_ANYINDEX_VVi && ! insts1[i]->aux )
+                insts1[i]->aux = new ZInstAux(0);
+
+        return z;
     }
 
     if ( rhs->Tag() == EXPR_LAMBDA )
@@ -1634,6 +1644,7 @@ const ZAMStmt ZAMCompiler::Is(const NameExpr* n, const Expr* e) {
     ZInstI z(OP_IS_VV, Frame1Slot(n, OP_IS_VV), op_slot);
     z.SetType(is->TestType());
     z.SetType2(op->GetType());
+    z.aux = new ZInstAux(0); // for its cache of record types
 
     return AddInst(z);
 }
@@ -2,11 +2,37 @@
 
 #include "zeek/script_opt/ZAM/Profile.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 #include "zeek/Obj.h"
 #include "zeek/script_opt/ProfileFunc.h"
+#include "zeek/script_opt/ZAM/ZInst.h"
 
 namespace zeek::detail {
 
+// How many of the most frequent pairs we report.
+static constexpr size_t MAX_REPORTED_ZOP_PAIRS = 50;
+
+// Counts of consecutively executed pairs of operations, indexed by the
+// first op in the upper and the second in the lower 16 bits.
+static std::unordered_map<uint32_t, int> ZOP_pair_count;
+
+void note_ZOP_pair(ZOp prev, ZOp op) { ++ZOP_pair_count[(uint32_t(prev) << 16) | op]; }
+
+void report_ZOP_pair_profile(FILE* f) {
+    std::vector<std::pair<uint32_t, int>> pairs(ZOP_pair_count.begin(), ZOP_pair_count.end());
+    auto n = std::min(pairs.size(), MAX_REPORTED_ZOP_PAIRS);
+
+    std::partial_sort(pairs.begin(), pairs.begin() + n, pairs.end(),
+                      [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    for ( size_t i = 0; i < n; ++i )
+        fprintf(f, "pair\t%s\t%s\t%d\n", ZOP_name(ZOp(pairs[i].first >> 16)), ZOP_name(ZOp(pairs[i].first & 0xffff)),
+                pairs[i].second);
+}
+
 ZAMLocInfo::ZAMLocInfo(std::string _func_name, std::shared_ptr<Location> _loc, std::shared_ptr<ZAMLocInfo> _parent)
     : loc(std::move(_loc)), parent(std::move(_parent)) {
     func_name = func_name_at_loc(_func_name, loc.get());
@@ -4,10 +4,13 @@
 
 #pragma once
 
+#include <cstdio>
 #include <memory>
 #include <set>
 #include <string>
 
+#include "zeek/script_opt/ZAM/ZOp.h"
+
 namespace zeek::detail {
 
 class Location;
@@ -45,4 +48,12 @@ extern void estimate_ZAM_profiling_overhead();
 // that executed.
 extern void report_ZOP_profile();
 
+// Notes that an instruction with the given op executed right after one
+// with the op "prev".
+extern void note_ZOP_pair(ZOp prev, ZOp op);
+
+// Reports the most frequent pairs of consecutively executed operations,
+// which are candidates for fusing into superinstructions.
+extern void report_ZOP_pair_profile(FILE* f);
+
 } // namespace zeek::detail
@@ -10,12 +10,14 @@
 #include "zeek/ZeekString.h"
 #include "zeek/analyzer/Manager.h"
 #include "zeek/analyzer/protocol/conn-size/ConnSize.h"
+#include "zeek/broker/Data.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/file_analysis/Manager.h"
 #include "zeek/file_analysis/file_analysis.bif.h"
 #include "zeek/logging/Manager.h"
 #include "zeek/packet_analysis/Manager.h"
 #include "zeek/script_opt/ProfileFunc.h"
+#include "zeek/script_opt/ZAM/ZInstAux.h"
 #include "zeek/session/Manager.h"
 
 namespace zeek::detail {
@@ -162,6 +164,44 @@ bool CheckAnyType(const TypePtr& any_type, const TypePtr& expected_type, const s
     return true;
 }
 
+bool CheckAnyType(const TypePtr& any_type, const TypePtr& expected_type, const std::shared_ptr<ZAMLocInfo>& loc,
+                  RecordTypeCache& cache) {
+    if ( any_type->Tag() != TYPE_RECORD )
+        return CheckAnyType(any_type, expected_type, loc);
+
+    if ( cache.Lookup(any_type.get()) )
+        return true;
+
+    // Only successes get cached, as failures are errors anyway.
+    if ( ! CheckAnyType(any_type, expected_type, loc) )
+        return false;
+
+    cache.Insert(any_type, true);
+    return true;
+}
+
+bool IsCacheableCastType(const TypePtr& t) {
+    // Whether Broker data can be cast depends on what it holds.
+    return t->Tag() == TYPE_RECORD && ! same_type(t, Broker::detail::DataVal::ScriptDataType());
+}
+
+bool ZAM_can_cast_value_to_type(const Val* v, Type* t, RecordTypeCache& cache) {
+    if ( ! v )
+        return false;
+
+    const auto& vt = v->GetType();
+
+    if ( auto outcome = cache.Lookup(vt.get()) )
+        return *outcome;
+
+    bool outcome = can_cast_value_to_type(v, t);
+
+    if ( IsCacheableCastType(vt) )
+        cache.Insert(vt, outcome);
+
+    return outcome;
+}
+
 StringVal* ZAM_to_lower(const StringVal* sv) {
     auto bs = sv->AsString();
     const u_char* s = bs->Bytes();
@@ -37,6 +37,7 @@ class Component;
 namespace detail {
 
 class Expr;
+class RecordTypeCache;
 class Stmt;
 
 using ValVec = std::vector<ValPtr>;
@@ -108,6 +109,20 @@ inline bool IsAny(const TypePtr& t) { return IsAny(t.get()); }
 // expected typed.  Returns true if the type match is okay.
 extern bool CheckAnyType(const TypePtr& any_type, const TypePtr& expected_type, const std::shared_ptr<ZAMLocInfo>& loc);
 
+// The same, but remembering record types that passed in the given
+// per-instruction cache.
+extern bool CheckAnyType(const TypePtr& any_type, const TypePtr& expected_type, const std::shared_ptr<ZAMLocInfo>& loc,
+                         RecordTypeCache& cache);
+
+// True if whether a value of the given type can be cast to another type
+// depends only on the types, and is worth caching per instruction. That's
+// the case for records, other than Broker's opaque data wrapper.
+extern bool IsCacheableCastType(const TypePtr& t);
+
+// can_cast_value_to_type(), remembering the outcomes for record types in
+// the given per-instruction cache.
+extern bool ZAM_can_cast_value_to_type(const Val* v, Type* t, RecordTypeCache& cache);
+
 extern void ZAM_run_time_error(const char* msg);
 extern void ZAM_run_time_error(std::shared_ptr<ZAMLocInfo> loc, const char* msg);
 extern void ZAM_run_time_error(std::shared_ptr<ZAMLocInfo> loc, const char* msg, const Obj* o);
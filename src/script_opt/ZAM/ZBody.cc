@@ -119,6 +119,35 @@ static bool profile_all = false;
 
 #endif
 
+// With direct-threaded dispatch, each instruction handler jumps straight to
+// the handler of the next instruction through a table of label addresses,
+// rather than going back to the switch. That gives every handler its own
+// indirect branch, which CPUs predict much better than the switch's single
+// one. It relies on the "labels as values" extension of GCC and Clang.
+// Profiling needs to hook into every instruction, so it keeps using the
+// switch.
+#if defined(ENABLE_ZAM_THREADED_DISPATCH) && ! defined(ENABLE_ZAM_PROFILE)
+
+#define ZAM_THREADED_DISPATCH
+
+#define ZAM_OP_LABEL(op) zam_op_##op
+
+// These next three macros appear in ZAM-EvalDefsThreaded.h, which wraps
+// each handler in them.
+#define ZAM_OP_BEGIN(op)                                                                                               \
+    ZAM_OP_LABEL(op) : {                                                                                               \
+        [[maybe_unused]] auto& z = insts[pc];
+
+#define ZAM_OP_END                                                                                                     \
+    }                                                                                                                  \
+    if ( ++pc >= end_pc || ZAM_error )                                                                                 \
+        goto zam_done;                                                                                                 \
+    goto* op_labels[insts[pc].op];
+
+#define ZAM_OP_CLOSE }
+
+#endif
+
 using std::vector;
 
 // Thrown when a call inside a "when" delays.
@@ -148,6 +177,8 @@ void report_ZOP_profile() {
             auto CPU = std::max(ZOP_CPU[i] - ZOP_count[i] * CPU_prof_overhead, 0.0);
             fprintf(analysis_options.profile_file, "%s\t%d\t%.06f\n", ZOP_name(ZOp(i)), ZOP_count[i], CPU);
         }
+
+    report_ZOP_pair_profile(analysis_options.profile_file);
 }
 
 // Sets the given element to a copy of an existing (not newly constructed)
@@ -246,17 +277,23 @@ ZBody::ZBody(std::string _func_name, const ZAMCompiler* zc) : Stmt(STMT_ZAM) {
     double_cases = zc->GetCases<double>();
     str_cases = zc->GetCases<std::string>();
 
-    if ( zc->NonRecursive() ) {
+    table_iters = zc->GetTableIters();
+    num_step_iters = zc->NumStepIters();
+
+    Init(zc->NonRecursive());
+}
+
+ZBody::ZBody(std::string _func_name) : Stmt(STMT_ZAM) { func_name = std::move(_func_name); }
+
+void ZBody::Init(bool non_recursive) {
+    if ( non_recursive ) {
         fixed_frame = new ZVal[frame_size];
 
         for ( auto& ms : managed_slots )
             fixed_frame[ms].ClearManagedVal();
     }
 
-    table_iters = zc->GetTableIters();
-    num_step_iters = zc->NumStepIters();
-
-    // It's a little weird doing this in the constructor, but unless
+    // It's a little weird doing this when constructing a body, but unless
     // we add a general "initialize for ZAM" function, this is as good
     // a place as any.
     if ( ! did_init ) {
@@ -384,6 +421,10 @@ ValPtr ZBody::Exec(Frame* f, StmtFlowType& flow) {
     double start_CPU_time = 0.0;
     uint64_t start_mem = 0;
 
+    // The op of the previously executed instruction, for profiling
+    // which ops execute consecutively.
+    ZOp prev_op = OP_NOP;
+
     if ( profiling_active ) {
         ++ncall;
         start_CPU_time = util::curr_CPU_time();
@@ -424,6 +465,16 @@ ValPtr ZBody::Exec(Frame* f, StmtFlowType& flow) {
     // Clear any leftover error state.
     ZAM_error = false;
 
+#ifdef ZAM_THREADED_DISPATCH
+    // Handler addresses, indexed by opcode.
+    static const void* const op_labels[] = {
+#include "ZAM-OpLabels.h"
+        &&ZAM_OP_LABEL(OP_NOP),
+    };
+
+    static_assert(sizeof(op_labels) / sizeof(op_labels[0]) == OP_NOP + 1);
+#endif
+
     while ( pc < end_pc && ! ZAM_error ) {
         auto& z = insts[pc];
 
@@ -441,20 +492,38 @@ ValPtr ZBody::Exec(Frame* f, StmtFlowType& flow) {
                 ++ZOP_count[z.op];
                 ++ninst;
 
+                if ( prev_op != OP_NOP )
+                    note_ZOP_pair(prev_op, z.op);
+
                 profile_pc = pc;
                 profile_CPU = util::curr_CPU_time();
             }
+
+            prev_op = z.op;
         }
 #endif
 
+#ifdef ZAM_THREADED_DISPATCH
+        // Only the first instruction, and those reached through branches,
+        // get dispatched from here.
+        goto* op_labels[z.op];
+#endif
+
         switch ( z.op ) {
             case OP_NOP:
+#ifdef ZAM_THREADED_DISPATCH
+            ZAM_OP_LABEL(OP_NOP):
+#endif
                 break;
 
                 // These must stay in this order or the build fails.
                 // clang-format off
 #include "ZAM-EvalMacros.h"
+#ifdef ZAM_THREADED_DISPATCH
+#include "ZAM-EvalDefsThreaded.h"
+#else
 #include "ZAM-EvalDefs.h"
+#endif
                 // clang-format on
 
             default: reporter->InternalError("bad ZAM opcode");
@@ -465,6 +534,10 @@ ValPtr ZBody::Exec(Frame* f, StmtFlowType& flow) {
         ++pc;
     }
 
+#ifdef ZAM_THREADED_DISPATCH
+zam_done:
+#endif
+
 #ifdef ENABLE_ZAM_PROFILE
     if ( profiling_active ) {
         tot_CPU_time += util::curr_CPU_time() - start_CPU_time;
@@ -64,6 +64,14 @@ public:
 
 private:
     friend class CPPCompile;
+    friend class ZAMCache;
+
+    // Used by ZAMCache, which fills in the remaining members itself
+    // before calling Init().
+    ZBody(std::string _func_name);
+
+    // Completes construction once the frame layout is known.
+    void Init(bool non_recursive);
 
     auto Instructions() const { return insts; }
     auto NumInsts() const { return end_pc; }
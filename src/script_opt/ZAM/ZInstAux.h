@@ -93,6 +93,39 @@ private:
     bool is_managed = false;
 };
 
+// A per-instruction inline cache for instructions that check the dynamic
+// type of "any" values against a type known at compile time. It remembers
+// the outcome for the record types that the instruction has encountered, so
+// that hot polymorphic code compares type pointers rather than comparing the
+// record types field-by-field (or, for record promotion, name-by-name).
+//
+// The cache holds references to its types so that their addresses can't be
+// reused for different types.
+class RecordTypeCache {
+public:
+    // Returns the outcome cached for the given type, if any.
+    std::optional<int> Lookup(const Type* t) const {
+        for ( int i = 0; i < num_entries; ++i )
+            if ( entries[i].first.get() == t )
+                return entries[i].second;
+
+        return std::nullopt;
+    }
+
+    // Caches the outcome for the given record type. Once the cache is
+    // full, the instruction is megamorphic and we stop adding to it.
+    void Insert(TypePtr t, int outcome) {
+        if ( num_entries < MAX_ENTRIES )
+            entries[num_entries++] = {std::move(t), outcome};
+    }
+
+private:
+    static constexpr int MAX_ENTRIES = 4;
+
+    std::pair<TypePtr, int> entries[MAX_ENTRIES];
+    int num_entries = 0;
+};
+
 enum ControlFlowType : uint8_t {
     CFT_IF,
     CFT_BLOCK_END,
@@ -282,6 +315,9 @@ public:
     // If non-nil, used for constructing records. Each pair gives the index
     // into the final record and the associated field initializer.
     std::unique_ptr<std::vector<std::pair<int, std::shared_ptr<detail::FieldInit>>>> field_inits;
+
+    // For instructions that check the type of "any" values at run-time.
+    RecordTypeCache type_cache;
 };
 
 } // namespace zeek::detail
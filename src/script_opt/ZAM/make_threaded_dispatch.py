@@ -0,0 +1,78 @@
+# Derives the headers for direct-threaded ZAM dispatch from what Gen-ZAM
+# produces for the switch-based interpreter loop:
+#
+#     ZAM-OpLabels.h          The addresses of the handler labels, in
+#                             opcode order, to initialize the dispatch
+#                             table in ZBody::Exec() with.
+#
+#     ZAM-EvalDefsThreaded.h  ZAM-EvalDefs.h with each handler wrapped in
+#                             ZAM_OP_BEGIN()/ZAM_OP_END, which ZBody.cc
+#                             defines to label the handler and have it jump
+#                             straight to the handler of the next
+#                             instruction rather than back to the switch.
+#
+# Usage: make_threaded_dispatch.py <ZAM-OpsDefs.h> <ZAM-EvalDefs.h> <output-dir>
+
+import os
+import re
+import sys
+
+ops_file, eval_file, out_dir = sys.argv[1:4]
+
+header = """//
+// This file was automatically generated from {}
+// DO NOT EDIT.
+//
+"""
+
+case_re = re.compile(r"^[ \t]*case (OP_\w+):", re.MULTILINE)
+final_break_re = re.compile(r"\bbreak;\s*$")
+
+
+def gen_labels():
+    with open(ops_file) as f:
+        ops = re.findall(r"^\s*(OP_\w+)\s*,", f.read(), re.MULTILINE)
+
+    if not ops:
+        sys.exit(f"{ops_file}: no opcodes found")
+
+    with open(os.path.join(out_dir, "ZAM-OpLabels.h"), "w") as f:
+        f.write(header.format(ops_file))
+
+        for op in ops:
+            f.write(f"&&ZAM_OP_LABEL({op}),\n")
+
+
+def gen_eval_defs():
+    with open(eval_file) as f:
+        text = f.read()
+
+    cases = list(case_re.finditer(text))
+
+    if not cases:
+        sys.exit(f"{eval_file}: no instruction handlers found")
+
+    out = [header.format(eval_file), text[: cases[0].start()]]
+
+    for i, case in enumerate(cases):
+        end = cases[i + 1].start() if i + 1 < len(cases) else len(text)
+        body = text[case.end() : end]
+
+        out.append(f"{case.group(0)} ZAM_OP_BEGIN({case.group(1)})")
+
+        # A handler normally finishes with a break out of the switch,
+        # which now becomes the jump to the next handler. Anything else
+        # keeps its original meaning.
+        m = final_break_re.search(body)
+
+        if m:
+            out.append(body[: m.start()] + "ZAM_OP_END\n\n")
+        else:
+            out.append(body.rstrip() + "\nZAM_OP_CLOSE\n\n")
+
+    with open(os.path.join(out_dir, "ZAM-EvalDefsThreaded.h"), "w") as f:
+        f.write("".join(out))
+
+
+gen_labels()
+gen_eval_defs()
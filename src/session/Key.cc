@@ -4,6 +4,8 @@
 
 #include <cstring>
 
+#include "zeek/session/KeyPool.h"
+
 namespace zeek::session::detail {
 
 Key::Key(const void* session, size_t size, size_t type, bool copy) : size(size), type(type) {
@@ -28,6 +30,9 @@ Key::Key(Key&& rhs) noexcept {
 
 Key& Key::operator=(Key&& rhs) noexcept {
     if ( this != &rhs ) {
+        if ( copied )
+            key_pool().Release(const_cast<uint8_t*>(data), size);
+
         data = rhs.data;
         size = rhs.size;
         copied = rhs.copied;
@@ -43,7 +48,7 @@ Key& Key::operator=(Key&& rhs) noexcept {
 
 Key::~Key() {
     if ( copied )
-        delete[] data;
+        key_pool().Release(const_cast<uint8_t*>(data), size);
 }
 
 void Key::CopyData() {
@@ -52,7 +57,7 @@ void Key::CopyData() {
 
     copied = true;
 
-    uint8_t* temp = new uint8_t[size];
+    auto* temp = static_cast<uint8_t*>(key_pool().Allocate(size));
     memcpy(temp, data, size);
     data = temp;
 }
@@ -19,7 +19,9 @@ struct KeyHash;
  * the lifetime of the data pointed to by the Key. It only holds a
  * pointer. When a Key object is inserted into the SessionManager's map,
  * the data is copied into the object so the lifetime of the key data is
- * guaranteed over the lifetime of the map entry.
+ * guaranteed over the lifetime of the map entry. Copied data lives in the
+ * KeyPool, so inserting sessions doesn't go through the general heap and
+ * looking up existing ones doesn't allocate at all.
  */
 class Key final {
 public:
@@ -0,0 +1,140 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/session/KeyPool.h"
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "zeek/3rdparty/doctest.h"
+
+// Pooling would hide use-after-free errors on keys from AddressSanitizer,
+// so sanitizer builds go straight to the heap.
+#if defined(__SANITIZE_ADDRESS__)
+#define ZEEK_KEY_POOL_BYPASS 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ZEEK_KEY_POOL_BYPASS 1
+#endif
+#endif
+
+namespace zeek::session::detail {
+
+KeyPool::~KeyPool() {
+    while ( slabs ) {
+        Slab* next = slabs->next;
+        ::operator delete(slabs);
+        slabs = next;
+    }
+}
+
+void* KeyPool::Allocate(size_t size) {
+#ifndef ZEEK_KEY_POOL_BYPASS
+    if ( size <= MAX_POOLED_SIZE ) {
+        size_t cls = SizeClass(size);
+
+        if ( ! free_lists[cls] )
+            Refill(cls);
+
+        FreeBlock* block = free_lists[cls];
+        free_lists[cls] = block->next;
+        return block;
+    }
+#endif
+
+    return ::operator new(size);
+}
+
+void KeyPool::Release(void* block, size_t size) {
+    if ( ! block )
+        return;
+
+#ifndef ZEEK_KEY_POOL_BYPASS
+    if ( size <= MAX_POOLED_SIZE ) {
+        size_t cls = SizeClass(size);
+        auto* b = static_cast<FreeBlock*>(block);
+        b->next = free_lists[cls];
+        free_lists[cls] = b;
+        return;
+    }
+#endif
+
+    ::operator delete(block);
+}
+
+void KeyPool::Refill(size_t cls) {
+    auto* mem = static_cast<char*>(::operator new(SLAB_SIZE));
+    auto* slab = reinterpret_cast<Slab*>(mem);
+    slab->next = slabs;
+    slabs = slab;
+    slab_bytes += SLAB_SIZE;
+
+    // The slab header takes up the first granule, keeping all blocks
+    // aligned to the granularity.
+    size_t block_size = (cls + 1) * GRANULARITY;
+
+    for ( size_t off = GRANULARITY; off + block_size <= SLAB_SIZE; off += block_size ) {
+        auto* b = reinterpret_cast<FreeBlock*>(mem + off);
+        b->next = free_lists[cls];
+        free_lists[cls] = b;
+    }
+}
+
+KeyPool& key_pool() {
+    static KeyPool* pool = new KeyPool();
+    return *pool;
+}
+
+TEST_CASE("session key pool") {
+    KeyPool pool;
+
+    SUBCASE("reuse") {
+        void* a = pool.Allocate(40);
+        pool.Release(a, 40);
+
+        // Sizes of the same class share their free list.
+        void* b = pool.Allocate(48);
+#ifndef ZEEK_KEY_POOL_BYPASS
+        CHECK(a == b);
+#endif
+        pool.Release(b, 48);
+    }
+
+    SUBCASE("distinct and aligned") {
+        std::vector<std::pair<void*, size_t>> blocks;
+        std::set<void*> seen;
+
+        for ( size_t i = 0; i < 10000; ++i ) {
+            size_t size = 1 + (i * 37) % (KeyPool::MAX_POOLED_SIZE + 64);
+            void* p = pool.Allocate(size);
+            CHECK(reinterpret_cast<uintptr_t>(p) % KeyPool::GRANULARITY == 0);
+            CHECK(seen.insert(p).second);
+            memset(p, 0xab, size);
+            blocks.emplace_back(p, size);
+        }
+
+        for ( auto [p, size] : blocks )
+            pool.Release(p, size);
+
+#ifndef ZEEK_KEY_POOL_BYPASS
+        // Allocating the same blocks again doesn't need more slabs.
+        size_t slab_bytes = pool.SlabBytes();
+        blocks.clear();
+
+        for ( size_t i = 0; i < 10000; ++i ) {
+            size_t size = 1 + (i * 37) % (KeyPool::MAX_POOLED_SIZE + 64);
+            blocks.emplace_back(pool.Allocate(size), size);
+        }
+
+        CHECK(pool.SlabBytes() == slab_bytes);
+
+        for ( auto [p, size] : blocks )
+            pool.Release(p, size);
+#endif
+    }
+}
+
+} // namespace zeek::session::detail
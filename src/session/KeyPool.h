@@ -0,0 +1,81 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+
+namespace zeek::session::detail {
+
+/**
+ * Allocator for the small, uniformly sized objects that make up session
+ * keys: the key data copied into the session table and the ConnKey
+ * instances owned by connections.
+ *
+ * Memory is carved out of larger slabs into blocks of a few size classes
+ * and released blocks go onto a free list for their class, so that a
+ * steady stream of connections coming and going doesn't hit the general
+ * purpose heap. Slabs are only returned when the pool gets destroyed.
+ * Requests larger than the biggest size class are forwarded to operator
+ * new.
+ *
+ * The pool isn't thread-safe. Sessions only live on the main thread.
+ */
+class KeyPool {
+public:
+    // Blocks are multiples of this size, which also is their alignment.
+    static constexpr size_t GRANULARITY = 16;
+
+    // The largest request served from the pool.
+    static constexpr size_t MAX_POOLED_SIZE = 256;
+
+    KeyPool() = default;
+    ~KeyPool();
+
+    KeyPool(const KeyPool&) = delete;
+    KeyPool& operator=(const KeyPool&) = delete;
+
+    /**
+     * Returns a block of at least the given size.
+     */
+    void* Allocate(size_t size);
+
+    /**
+     * Returns a block to the pool. The size must match the one passed to
+     * Allocate().
+     */
+    void Release(void* block, size_t size);
+
+    /**
+     * Returns the number of slab bytes the pool has allocated.
+     */
+    size_t SlabBytes() const { return slab_bytes; }
+
+private:
+    static constexpr size_t NUM_CLASSES = MAX_POOLED_SIZE / GRANULARITY;
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct Slab {
+        Slab* next;
+    };
+
+    static size_t SizeClass(size_t size) { return size > GRANULARITY ? (size - 1) / GRANULARITY : 0; }
+
+    // Carves a new slab into blocks of the given class.
+    void Refill(size_t cls);
+
+    FreeBlock* free_lists[NUM_CLASSES] = {};
+    Slab* slabs = nullptr;
+    size_t slab_bytes = 0;
+};
+
+/**
+ * Returns the pool shared by all session keys. It's never destroyed, so
+ * keys held by static objects remain safe to release during shutdown.
+ */
+KeyPool& key_pool();
+
+} // namespace zeek::session::detail
@@ -107,12 +107,19 @@ Connection* Manager::FindConnection(Val* v) {
 
 Connection* Manager::FindConnection(const zeek::ConnKey& conn_key) {
     auto key = conn_key.SessionKey();
+    return static_cast<Connection*>(session_map.Find(key));
+}
 
-    auto it = session_map.find(key);
-    if ( it != session_map.end() )
-        return static_cast<Connection*>(it->second);
+Connection* Manager::FindConnection(const zeek::ConnKey& conn_key, size_t hash) {
+    auto key = conn_key.SessionKey();
+    return static_cast<Connection*>(session_map.Find(key, hash));
+}
 
-    return nullptr;
+size_t Manager::PrefetchConnection(const zeek::ConnKey& conn_key) {
+    auto key = conn_key.SessionKey();
+    size_t hash = detail::SessionTable::HashOf(key);
+    session_map.Prefetch(hash);
+    return hash;
 }
 
 void Manager::Remove(Session* s) {
@@ -123,7 +130,7 @@ void Manager::Remove(Session* s) {
 
         detail::Key key = s->SessionKey(false);
 
-        if ( session_map.erase(key) == 0 )
+        if ( session_map.Erase(key) == 0 )
             reporter->InternalWarning("connection missing");
         else {
             Connection* c = static_cast<Connection*>(s);
@@ -145,11 +152,8 @@ void Manager::Insert(Session* s, bool remove_existing) {
     detail::Key key = s->SessionKey(true);
 
     if ( remove_existing ) {
-        auto it = session_map.find(key);
-        if ( it != session_map.end() )
-            old = it->second;
-
-        session_map.erase(key);
+        old = session_map.Find(key);
+        session_map.Erase(key);
     }
 
     InsertSession(std::move(key), s);
@@ -169,21 +173,21 @@ void Manager::Drain() {
     // every run.
     if ( zeek::util::detail::have_random_seed() ) {
         std::vector<const detail::Key*> keys;
-        keys.reserve(session_map.size());
+        keys.reserve(session_map.Size());
 
         for ( auto& entry : session_map )
-            keys.push_back(&(entry.first));
+            keys.push_back(&(entry.key));
         std::sort(keys.begin(), keys.end(), [](const detail::Key* a, const detail::Key* b) { return *a < *b; });
 
         for ( const auto* k : keys ) {
-            Session* tc = session_map.at(*k);
+            Session* tc = session_map.Find(*k);
             tc->Done();
             tc->RemovalEvent();
         }
     }
     else {
         for ( const auto& entry : session_map ) {
-            Session* tc = entry.second;
+            Session* tc = entry.session;
             tc->Done();
             tc->RemovalEvent();
         }
@@ -192,9 +196,9 @@ void Manager::Drain() {
 
 void Manager::Clear() {
     for ( const auto& entry : session_map )
-        Unref(entry.second);
+        Unref(entry.session);
 
-    session_map.clear();
+    session_map.Clear();
 
     zeek::detail::fragment_mgr->Clear();
 }
@@ -245,7 +249,7 @@ void Manager::Weird(const char* name, const IP_Hdr* ip, const char* addl) {
 void Manager::InsertSession(detail::Key key, Session* session) {
     session->SetInSessionTable(true);
     key.CopyData();
-    session_map.insert_or_assign(std::move(key), session);
+    session_map.InsertOrAssign(std::move(key), session);
 
     std::string protocol = session->TransportIdentifier();
 
@@ -3,11 +3,11 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
-#include <unordered_map>
 
 #include "zeek/ConnKey.h"
 #include "zeek/Frag.h"
 #include "zeek/session/Session.h"
+#include "zeek/session/SessionTable.h"
 
 namespace zeek {
 
@@ -73,6 +73,26 @@ public:
      */
     Connection* FindConnection(const zeek::ConnKey& conn_key);
 
+    /**
+     * Looks up the connection referred to by a given key, using the hash
+     * returned by an earlier call to PrefetchConnection().
+     *
+     * @param conn_key The key for the connection to search for.
+     * @param hash The key's hash as returned by PrefetchConnection().
+     * @return The connection, or nullptr if one doesn't exist.
+     */
+    Connection* FindConnection(const zeek::ConnKey& conn_key, size_t hash);
+
+    /**
+     * Starts loading the part of the session table that a lookup of the
+     * given key will access into the CPU's caches, so that the memory
+     * access can overlap with other work before the actual lookup.
+     *
+     * @param conn_key The key for the connection to look up later.
+     * @return The key's hash, for passing to FindConnection().
+     */
+    size_t PrefetchConnection(const zeek::ConnKey& conn_key);
+
     void Remove(Session* s);
     void Insert(Session* c, bool remove_existing = true);
 
@@ -88,11 +108,9 @@ public:
     void Weird(const char* name, const Packet* pkt, const char* addl = "", const char* source = "");
     void Weird(const char* name, const IP_Hdr* ip, const char* addl = "");
 
-    size_t CurrentSessions() { return session_map.size(); }
+    size_t CurrentSessions() { return session_map.Size(); }
 
 private:
-    using SessionMap = std::unordered_map<detail::Key, Session*, detail::KeyHash>;
-
     // Inserts a new connection into the sessions map. If a connection with
     // the same key already exists in the map, it will be overwritten by
     // the new one.  Connection count stats get updated either way (so most
@@ -100,7 +118,7 @@ private:
     // avoid unnecessary incrementing of connecting counts).
     void InsertSession(detail::Key key, Session* session);
 
-    SessionMap session_map;
+    detail::SessionTable session_map;
     detail::ProtocolStats* stats;
     telemetry::CounterFamilyPtr ended_sessions_metric_family;
     telemetry::CounterPtr ended_by_inactivity_metric;
@@ -2,6 +2,9 @@
 
 #include "zeek/session/Session.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "zeek/Desc.h"
 #include "zeek/Event.h"
 #include "zeek/Reporter.h"
@@ -91,17 +94,8 @@ void Session::SetInactivityTimeout(double timeout) {
     if ( timeout == inactivity_timeout )
         return;
 
-    // First cancel and remove any existing inactivity timer.
-    for ( const auto& timer : timers )
-        if ( timer->Type() == zeek::detail::TIMER_CONN_INACTIVITY ) {
-            zeek::detail::timer_mgr->Cancel(timer);
-            break;
-        }
-
-    if ( timeout )
-        ADD_TIMER(&Session::InactivityTimer, last_time + timeout, 0, zeek::detail::TIMER_CONN_INACTIVITY);
-
     inactivity_timeout = timeout;
+    ArmDeadlineTimer();
 }
 
 void Session::EnableStatusUpdateTimer() {
@@ -109,9 +103,9 @@ void Session::EnableStatusUpdateTimer() {
         return;
 
     if ( session_status_update_event && session_status_update_interval ) {
-        ADD_TIMER(&Session::StatusUpdateTimer, run_state::network_time + session_status_update_interval, 0,
-                  zeek::detail::TIMER_CONN_STATUS_UPDATE);
+        next_status_update = run_state::network_time + session_status_update_interval;
         installed_status_timer = 1;
+        ArmDeadlineTimer();
     }
 }
 
@@ -137,37 +131,79 @@ void Session::DeleteTimer(double /* t */) {
     session_mgr->Remove(this);
 }
 
-void Session::AddTimer(timer_func timer, double t, bool do_expire, zeek::detail::TimerType type) {
+zeek::detail::Timer* Session::AddTimer(timer_func timer, double t, bool do_expire, zeek::detail::TimerType type) {
     if ( timers_canceled )
-        return;
+        return nullptr;
 
     // If the key is cleared, the session isn't stored in the session table
     // anymore and will soon be deleted. We're not installed new timers
     // anymore then.
     if ( ! IsInSessionTable() )
-        return;
+        return nullptr;
 
     zeek::detail::Timer* conn_timer = new detail::Timer(this, timer, t, do_expire, type);
     zeek::detail::timer_mgr->Add(conn_timer);
     timers.push_back(conn_timer);
+    return conn_timer;
 }
 
-void Session::RemoveTimer(zeek::detail::Timer* t) { timers.remove(t); }
+void Session::RemoveTimer(zeek::detail::Timer* t) {
+    timers.remove(t);
 
-void Session::InactivityTimer(double t) {
-    if ( last_time + inactivity_timeout <= t ) {
-        Event(session_timeout_event, nullptr);
-        session_mgr->Remove(this);
-        ++zeek::detail::killed_by_inactivity;
+    if ( t == deadline_timer )
+        deadline_timer = nullptr;
+}
+
+void Session::ArmDeadlineTimer() {
+    double inactivity_at = inactivity_timeout ? last_time + inactivity_timeout : HUGE_VAL;
+    double status_at = next_status_update ? next_status_update : HUGE_VAL;
+    double next = std::min(inactivity_at, status_at);
+
+    if ( next == HUGE_VAL )
+        return;
+
+    // Activity only ever moves the inactivity deadline further out, so a
+    // timer that's already armed usually is early enough. Only an earlier
+    // deadline needs rescheduling.
+    if ( deadline_timer ) {
+        if ( deadline_timer->Time() <= next )
+            return;
+
+        zeek::detail::timer_mgr->Cancel(deadline_timer);
     }
-    else
-        ADD_TIMER(&Session::InactivityTimer, last_time + inactivity_timeout, 0, zeek::detail::TIMER_CONN_INACTIVITY);
+
+    auto type =
+        inactivity_at <= status_at ? zeek::detail::TIMER_CONN_INACTIVITY : zeek::detail::TIMER_CONN_STATUS_UPDATE;
+    deadline_timer = ADD_TIMER(&Session::DeadlineTimer, next, 0, type);
+}
+
+void Session::DeadlineTimer(double t) {
+    double inactivity_at = inactivity_timeout ? last_time + inactivity_timeout : HUGE_VAL;
+    double status_at = next_status_update ? next_status_update : HUGE_VAL;
+
+    // Handle only the earlier of the two. If the other one is due as
+    // well, the re-armed timer takes care of it in order with the timers
+    // of other sessions.
+    if ( status_at <= t && status_at <= inactivity_at )
+        StatusUpdateTimer(t);
+
+    else if ( inactivity_at <= t ) {
+        InactivityTimer(t);
+        return;
+    }
+
+    ArmDeadlineTimer();
+}
+
+void Session::InactivityTimer(double t) {
+    Event(session_timeout_event, nullptr);
+    session_mgr->Remove(this);
+    ++zeek::detail::killed_by_inactivity;
 }
 
 void Session::StatusUpdateTimer(double t) {
     EnqueueEvent(session_status_update_event, nullptr, GetVal());
-    ADD_TIMER(&Session::StatusUpdateTimer, run_state::network_time + session_status_update_interval, 0,
-              zeek::detail::TIMER_CONN_STATUS_UPDATE);
+    next_status_update = run_state::network_time + session_status_update_interval;
 }
 
 void Session::RemoveConnectionTimer(double t) {
@@ -259,8 +259,10 @@ protected:
      * @param do_expire If set to true, the timer is also evaluated when Zeek
      * terminates.
      * @param type The type of timer being added.
+     * @return The new timer, or nullptr if the session doesn't take timers
+     * anymore.
      */
-    void AddTimer(timer_func timer, double t, bool do_expire, zeek::detail::TimerType type);
+    zeek::detail::Timer* AddTimer(timer_func timer, double t, bool do_expire, zeek::detail::TimerType type);
 
     /**
      * Remove a specific timer from firing.
@@ -268,12 +270,26 @@ protected:
     void RemoveTimer(zeek::detail::Timer* t);
 
     /**
-     * The handler method for inactivity timers.
+     * Makes sure the deadline timer fires no later than the earliest of the
+     * inactivity timeout and the next status update. An armed timer that
+     * fires earlier than needed is left alone; it re-arms itself when it
+     * finds nothing due.
+     */
+    void ArmDeadlineTimer();
+
+    /**
+     * The handler method for the deadline timer, which the inactivity
+     * timeout and status updates share.
+     */
+    void DeadlineTimer(double t);
+
+    /**
+     * Times out the session once its inactivity deadline has passed.
      */
     void InactivityTimer(double t);
 
     /**
-     * The handler method for status update timers.
+     * Handles the status update deadline.
      */
     void StatusUpdateTimer(double t);
 
@@ -284,6 +300,11 @@ protected:
     TimerPList timers;
     double inactivity_timeout;
 
+    // The single timer covering inactivity and status updates, and when
+    // the next status update is due, or zero if none is.
+    zeek::detail::Timer* deadline_timer = nullptr;
+    double next_status_update = 0.0;
+
     EventHandlerPtr session_timeout_event;
     EventHandlerPtr session_status_update_event;
     double session_status_update_interval;
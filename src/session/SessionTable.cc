@@ -0,0 +1,331 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/session/SessionTable.h"
+
+#include <cstring>
+#include <map>
+#include <new>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::session::detail {
+
+namespace {
+
+#ifdef __SSE2__
+
+// A group of 16 control bytes, matched with SSE2.
+class Group {
+public:
+    static constexpr size_t WIDTH = 16;
+
+    explicit Group(const uint8_t* pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+    // Returns a bitmask of the bytes equal to h2.
+    uint32_t Match(uint8_t h2) const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(h2)), ctrl)));
+    }
+
+    // Returns a bitmask of the empty bytes, which are the ones with the
+    // high bit set.
+    uint32_t MatchEmpty() const { return static_cast<uint32_t>(_mm_movemask_epi8(ctrl)); }
+
+    static int LowestBit(uint32_t mask) { return __builtin_ctz(mask); }
+    static uint32_t ClearLowestBit(uint32_t mask) { return mask & (mask - 1); }
+
+private:
+    __m128i ctrl;
+};
+
+#else
+
+// A group of 8 control bytes, matched a 64-bit word at a time. Bitmasks
+// have the high bit of each matching byte set.
+class Group {
+public:
+    static constexpr size_t WIDTH = 8;
+
+    explicit Group(const uint8_t* pos) { memcpy(&ctrl, pos, sizeof(ctrl)); }
+
+    uint64_t Match(uint8_t h2) const {
+        constexpr uint64_t lsbs = 0x0101010101010101ULL;
+        constexpr uint64_t msbs = 0x8080808080808080ULL;
+        uint64_t x = ctrl ^ (lsbs * h2);
+
+        // Zero bytes of x are matches. This may report false positives
+        // for bytes following a match, which the key comparison weeds out.
+        return (x - lsbs) & ~x & msbs;
+    }
+
+    uint64_t MatchEmpty() const { return ctrl & 0x8080808080808080ULL; }
+
+    static int LowestBit(uint64_t mask) { return __builtin_ctzll(mask) >> 3; }
+    static uint64_t ClearLowestBit(uint64_t mask) { return mask & (mask - 1); }
+
+private:
+    uint64_t ctrl = 0;
+};
+
+#endif
+
+constexpr size_t MIN_CAPACITY = 2 * Group::WIDTH;
+
+// Maximum fill of the table. Linear probing degrades quickly beyond this.
+size_t max_load(size_t capacity) { return capacity - capacity / 4; }
+
+} // namespace
+
+SessionTable::~SessionTable() { Clear(); }
+
+Session* SessionTable::Find(const Key& key, size_t hash) const {
+    size_t idx = FindIndex(key, hash);
+    return idx < capacity ? slots[idx].session : nullptr;
+}
+
+size_t SessionTable::FindIndex(const Key& key, size_t hash) const {
+    if ( size == 0 )
+        return capacity;
+
+    size_t mask = capacity - 1;
+    size_t pos = hash & mask;
+    uint8_t h2 = H2(hash);
+
+    while ( true ) {
+        Group g(ctrl + pos);
+
+        for ( auto m = g.Match(h2); m; m = Group::ClearLowestBit(m) ) {
+            size_t idx = (pos + Group::LowestBit(m)) & mask;
+            const Slot& s = slots[idx];
+
+            if ( s.hash == hash && s.key == key )
+                return idx;
+        }
+
+        // With linear probing, an entry is never stored past the first
+        // empty slot following its home position.
+        if ( g.MatchEmpty() )
+            return capacity;
+
+        pos = (pos + Group::WIDTH) & mask;
+    }
+}
+
+size_t SessionTable::FindEmpty(size_t hash) const {
+    size_t mask = capacity - 1;
+    size_t pos = hash & mask;
+
+    while ( true ) {
+        Group g(ctrl + pos);
+
+        if ( auto m = g.MatchEmpty() )
+            return (pos + Group::LowestBit(m)) & mask;
+
+        pos = (pos + Group::WIDTH) & mask;
+    }
+}
+
+void SessionTable::SetCtrl(size_t idx, uint8_t c) {
+    ctrl[idx] = c;
+
+    if ( idx < Group::WIDTH - 1 )
+        ctrl[capacity + idx] = c;
+}
+
+void SessionTable::InsertOrAssign(Key key, Session* session) {
+    size_t hash = HashOf(key);
+
+    // Like std::unordered_map::insert_or_assign(), this keeps the
+    // existing key.
+    if ( size_t idx = FindIndex(key, hash); idx < capacity ) {
+        slots[idx].session = session;
+        return;
+    }
+
+    if ( growth_left == 0 )
+        Resize(capacity ? capacity * 2 : MIN_CAPACITY);
+
+    size_t idx = FindEmpty(hash);
+    new (&slots[idx]) Slot{std::move(key), session, hash};
+    SetCtrl(idx, H2(hash));
+
+    ++size;
+    --growth_left;
+}
+
+size_t SessionTable::Erase(const Key& key) {
+    size_t idx = FindIndex(key, HashOf(key));
+
+    if ( idx == capacity )
+        return 0;
+
+    EraseIndex(idx);
+    return 1;
+}
+
+void SessionTable::EraseIndex(size_t idx) {
+    size_t mask = capacity - 1;
+    size_t hole = idx;
+
+    slots[hole].~Slot();
+
+    // Move later entries of the same run back into the hole if that keeps
+    // them reachable from their home position, i.e. if the hole isn't
+    // before their home.
+    for ( size_t j = (hole + 1) & mask; ! IsEmpty(ctrl[j]); j = (j + 1) & mask ) {
+        size_t home = slots[j].hash & mask;
+
+        if ( ((j - home) & mask) >= ((j - hole) & mask) ) {
+            new (&slots[hole]) Slot(std::move(slots[j]));
+            slots[j].~Slot();
+            SetCtrl(hole, ctrl[j]);
+            hole = j;
+        }
+    }
+
+    SetCtrl(hole, EMPTY);
+    --size;
+    ++growth_left;
+}
+
+void SessionTable::Prefetch(size_t hash) const {
+    if ( capacity == 0 )
+        return;
+
+    size_t pos = hash & (capacity - 1);
+    __builtin_prefetch(ctrl + pos);
+    __builtin_prefetch(slots + pos);
+}
+
+void SessionTable::Resize(size_t new_capacity) {
+    uint8_t* old_ctrl = ctrl;
+    Slot* old_slots = slots;
+    size_t old_capacity = capacity;
+
+    ctrl = new uint8_t[new_capacity + Group::WIDTH - 1];
+    memset(ctrl, EMPTY, new_capacity + Group::WIDTH - 1);
+    slots = static_cast<Slot*>(::operator new(new_capacity * sizeof(Slot), std::align_val_t{alignof(Slot)}));
+    capacity = new_capacity;
+    growth_left = max_load(new_capacity) - size;
+
+    for ( size_t i = 0; i < old_capacity; ++i ) {
+        if ( IsEmpty(old_ctrl[i]) )
+            continue;
+
+        size_t idx = FindEmpty(old_slots[i].hash);
+        new (&slots[idx]) Slot(std::move(old_slots[i]));
+        old_slots[i].~Slot();
+        SetCtrl(idx, old_ctrl[i]);
+    }
+
+    delete[] old_ctrl;
+    ::operator delete(old_slots, std::align_val_t{alignof(Slot)});
+}
+
+void SessionTable::Clear() {
+    for ( size_t i = 0; i < capacity; ++i ) {
+        if ( ! IsEmpty(ctrl[i]) )
+            slots[i].~Slot();
+    }
+
+    delete[] ctrl;
+    ::operator delete(slots, std::align_val_t{alignof(Slot)});
+
+    ctrl = nullptr;
+    slots = nullptr;
+    capacity = size = growth_left = 0;
+}
+
+TEST_CASE("session table") {
+    SessionTable table;
+    std::map<uint64_t, Session*> reference;
+
+    auto key = [](const uint64_t& k) { return Key(&k, sizeof(k), Key::CONNECTION_KEY_TYPE, true); };
+    auto session = [](uint64_t k) { return reinterpret_cast<Session*>(static_cast<uintptr_t>(k * 8 + 8)); };
+
+    auto check = [&]() {
+        CHECK(table.Size() == reference.size());
+
+        for ( const auto& [k, s] : reference )
+            CHECK(table.Find(key(k)) == s);
+
+        size_t n = 0;
+        for ( const auto& slot : table ) {
+            ++n;
+            CHECK(slot.session != nullptr);
+        }
+
+        CHECK(n == reference.size());
+    };
+
+    SUBCASE("empty") {
+        uint64_t k = 1;
+        CHECK(table.Find(key(k)) == nullptr);
+        CHECK(table.Erase(key(k)) == 0);
+        CHECK(table.begin() == table.end());
+    }
+
+    SUBCASE("insert, replace and erase") {
+        for ( uint64_t k = 0; k < 1000; ++k ) {
+            table.InsertOrAssign(key(k), session(k));
+            reference[k] = session(k);
+        }
+
+        check();
+
+        uint64_t k = 42;
+        table.InsertOrAssign(key(k), session(4242));
+        reference[k] = session(4242);
+        check();
+
+        for ( uint64_t k = 0; k < 1000; k += 3 ) {
+            CHECK(table.Erase(key(k)) == 1);
+            reference.erase(k);
+        }
+
+        check();
+
+        for ( uint64_t k = 0; k < 1000; k += 3 )
+            CHECK(table.Find(key(k)) == nullptr);
+    }
+
+    SUBCASE("churn") {
+        // Keeps the table at a constant size while replacing entries,
+        // exercising removal across wrapped-around runs.
+        uint64_t next = 0;
+
+        for ( int round = 0; round < 20000; ++round ) {
+            uint64_t k = next++;
+            table.InsertOrAssign(key(k), session(k));
+            reference[k] = session(k);
+
+            if ( reference.size() > 100 ) {
+                auto victim = reference.begin();
+                std::advance(victim, (k * 7919) % reference.size());
+                CHECK(table.Erase(key(victim->first)) == 1);
+                reference.erase(victim);
+            }
+        }
+
+        check();
+    }
+
+    SUBCASE("clear") {
+        for ( uint64_t k = 0; k < 100; ++k )
+            table.InsertOrAssign(key(k), session(k));
+
+        table.Clear();
+        CHECK(table.Size() == 0);
+        uint64_t k = 1;
+        CHECK(table.Find(key(k)) == nullptr);
+
+        table.InsertOrAssign(key(k), session(k));
+        CHECK(table.Find(key(k)) == session(k));
+    }
+}
+
+} // namespace zeek::session::detail
@@ -0,0 +1,150 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "zeek/session/Key.h"
+
+namespace zeek::session {
+
+class Session;
+
+namespace detail {
+
+/**
+ * Open-addressing hash table mapping session keys to sessions.
+ *
+ * Slots live in one flat array next to an array of control bytes, each
+ * holding seven bits of the slot's hash or a marker for an empty slot.
+ * Lookups scan the control bytes a group at a time (with SSE2 where
+ * available) and only compare keys of slots whose hash bits match.
+ * Collisions are resolved by linear probing, which allows removing
+ * entries by shifting later ones back instead of leaving tombstones, so
+ * lookups never slow down through churn.
+ */
+class SessionTable {
+public:
+    struct Slot {
+        Key key;
+        Session* session;
+        size_t hash;
+    };
+
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Slot;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Slot*;
+        using reference = Slot&;
+
+        Iterator(const SessionTable* table, size_t idx) : table(table), idx(idx) { SkipEmpty(); }
+
+        Slot& operator*() const { return table->slots[idx]; }
+        Slot* operator->() const { return &table->slots[idx]; }
+
+        Iterator& operator++() {
+            ++idx;
+            SkipEmpty();
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return idx == other.idx; }
+        bool operator!=(const Iterator& other) const { return idx != other.idx; }
+
+    private:
+        void SkipEmpty() {
+            while ( idx < table->capacity && IsEmpty(table->ctrl[idx]) )
+                ++idx;
+        }
+
+        const SessionTable* table;
+        size_t idx;
+    };
+
+    SessionTable() = default;
+    ~SessionTable();
+
+    SessionTable(const SessionTable&) = delete;
+    SessionTable& operator=(const SessionTable&) = delete;
+
+    /**
+     * Returns the hash used for a key, for passing to the methods taking
+     * a precomputed hash.
+     */
+    static size_t HashOf(const Key& key) { return key.Hash(); }
+
+    /**
+     * Returns the session stored for a key, or null if there's none.
+     */
+    Session* Find(const Key& key) const { return Find(key, HashOf(key)); }
+
+    /**
+     * Returns the session stored for a key with a precomputed hash, or
+     * null if there's none.
+     */
+    Session* Find(const Key& key, size_t hash) const;
+
+    /**
+     * Stores a session for a key, replacing any session stored before.
+     * The key is moved into the table; callers are responsible for having
+     * it own its data.
+     */
+    void InsertOrAssign(Key key, Session* session);
+
+    /**
+     * Removes the entry for a key.
+     *
+     * @return The number of entries removed, zero or one.
+     */
+    size_t Erase(const Key& key);
+
+    /**
+     * Brings the memory a lookup of the given hash will touch first into
+     * the CPU's caches.
+     */
+    void Prefetch(size_t hash) const;
+
+    /**
+     * Removes all entries and releases the table's memory.
+     */
+    void Clear();
+
+    size_t Size() const { return size; }
+    bool Empty() const { return size == 0; }
+
+    Iterator begin() const { return {this, 0}; }
+    Iterator end() const { return {this, capacity}; }
+
+private:
+    static constexpr uint8_t EMPTY = 0x80;
+
+    static bool IsEmpty(uint8_t c) { return c & EMPTY; }
+    static uint8_t H2(size_t hash) { return static_cast<uint8_t>(hash >> (sizeof(size_t) * 8 - 7)); }
+
+    // Returns the index of the key's slot, or capacity if there's none.
+    size_t FindIndex(const Key& key, size_t hash) const;
+
+    // Returns the index of the first empty slot in the key's probe sequence.
+    size_t FindEmpty(size_t hash) const;
+
+    void SetCtrl(size_t idx, uint8_t c);
+    void EraseIndex(size_t idx);
+    void Resize(size_t new_capacity);
+
+    // Control bytes: capacity entries followed by copies of the first
+    // GROUP_WIDTH - 1 entries, so that groups can be loaded at any index
+    // without wrapping.
+    uint8_t* ctrl = nullptr;
+    Slot* slots = nullptr;
+
+    size_t capacity = 0;
+    size_t size = 0;
+    size_t growth_left = 0;
+};
+
+} // namespace detail
+} // namespace zeek::session
@@ -5,6 +5,7 @@
 #include <cerrno>
 
 #include "zeek/3rdparty/zeek_inet_ntop.h"
+#include "zeek/Reporter.h"
 #include "zeek/threading/MsgThread.h"
 
 using zeek::threading::Field;
@@ -14,6 +15,13 @@ namespace zeek::threading {
 
 Formatter::Formatter(threading::MsgThread* t) { thread = t; }
 
+void Formatter::Error(const char* msg) const {
+    if ( thread )
+        thread->Error(msg);
+    else
+        reporter->Error("%s", msg);
+}
+
 std::string Formatter::Render(const threading::Value::addr_t& addr) {
     if ( addr.family == IPv4 ) {
         char s[INET_ADDRSTRLEN];
@@ -66,6 +66,20 @@ public:
      */
     virtual bool Describe(ODesc* desc, Value* val, const std::string& name = "") const = 0;
 
+    /**
+     * Prepares for converting records with the given fields, so that the
+     * formatter can work out once how to render each field instead of
+     * doing so for every record. Subsequent calls of the record version
+     * of Describe() with the same fields then follow that plan. The
+     * default implementation does nothing.
+     *
+     * @param num_fields The number of fields in the logging record.
+     *
+     * @param fields Information about the fields. They must remain valid
+     * for as long as records with them get converted.
+     */
+    virtual void Prepare(int num_fields, const Field* const* fields) {}
+
     /**
      * Convert an implementation-specific textual representation of a
      * field into a value.
@@ -158,6 +172,13 @@ protected:
      */
     MsgThread* GetThread() const { return thread; }
 
+    /**
+     * Reports an error through the associated thread. Without one, the
+     * error goes to the reporter instead, which is only safe when running
+     * on the main thread.
+     */
+    void Error(const char* msg) const;
+
 private:
     MsgThread* thread;
 };
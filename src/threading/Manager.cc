@@ -48,6 +48,8 @@ void Manager::InitPostScript() {
             if ( thread_mgr->bucketed_messages_last_updated < now - 1 ) {
                 thread_mgr->current_bucketed_messages.pending_in_total = 0;
                 thread_mgr->current_bucketed_messages.pending_out_total = 0;
+                thread_mgr->current_bucketed_messages.full_in_total = 0;
+                thread_mgr->current_bucketed_messages.full_out_total = 0;
                 for ( auto& m : thread_mgr->current_bucketed_messages.pending_in )
                     m.second = 0;
                 for ( auto& m : thread_mgr->current_bucketed_messages.pending_out )
@@ -59,6 +61,8 @@ void Manager::InitPostScript() {
 
                     thread_mgr->current_bucketed_messages.pending_in_total += thread_stats.pending_in;
                     thread_mgr->current_bucketed_messages.pending_out_total += thread_stats.pending_out;
+                    thread_mgr->current_bucketed_messages.full_in_total += thread_stats.queue_in_stats.num_full;
+                    thread_mgr->current_bucketed_messages.full_out_total += thread_stats.queue_out_stats.num_full;
 
                     for ( auto upper_limit : pending_bucket_brackets ) {
                         if ( thread_stats.pending_in <= upper_limit )
@@ -99,6 +103,19 @@ void Manager::InitPostScript() {
                                                                    return static_cast<double>(s->pending_out_total);
                                                                });
 
+    full_queues_in_metric =
+        telemetry_mgr->GaugeInstance("zeek", "msgthread_full_in_queues", {},
+                                     "Number of times the inbound queues of active threads filled up", "", []() {
+                                         auto* s = get_message_thread_stats();
+                                         return static_cast<double>(s->full_in_total);
+                                     });
+    full_queues_out_metric =
+        telemetry_mgr->GaugeInstance("zeek", "msgthread_full_out_queues", {},
+                                     "Number of times the outbound queues of active threads filled up", "", []() {
+                                         auto* s = get_message_thread_stats();
+                                         return static_cast<double>(s->full_out_total);
+                                     });
+
     pending_message_in_buckets_fam =
         telemetry_mgr->GaugeFamily("zeek", "msgthread_pending_messages_in_buckets", {"le"},
                                    "Number of threads with pending inbound messages split into buckets");
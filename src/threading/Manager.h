@@ -186,6 +186,8 @@ private:
     telemetry::CounterPtr total_messages_out_metric;
     telemetry::GaugePtr pending_messages_in_metric;
     telemetry::GaugePtr pending_messages_out_metric;
+    telemetry::GaugePtr full_queues_in_metric;
+    telemetry::GaugePtr full_queues_out_metric;
 
     telemetry::GaugeFamilyPtr pending_message_in_buckets_fam;
     telemetry::GaugeFamilyPtr pending_message_out_buckets_fam;
@@ -195,6 +197,8 @@ private:
     struct BucketedMessages {
         uint64_t pending_in_total;
         uint64_t pending_out_total;
+        uint64_t full_in_total;
+        uint64_t full_out_total;
         std::map<uint64_t, uint64_t> pending_in;
         std::map<uint64_t, uint64_t> pending_out;
     };
@@ -0,0 +1,120 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/Queue.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+#include <thread>
+#include <vector>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::threading::detail {
+
+#ifdef __linux__
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+
+void WakeupSignal::Wait(uint32_t token, std::chrono::milliseconds timeout) {
+    auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    auto nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - secs);
+    struct timespec ts = {static_cast<time_t>(secs.count()), static_cast<long>(nsecs.count())};
+
+    // Returns right away if seq no longer matches the token. Any errors
+    // (like EINTR) just count as spurious wakeups.
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAIT_PRIVATE, token, &ts, nullptr, 0);
+}
+
+void WakeupSignal::Wake() {
+    seq.fetch_add(1);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&seq), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+void WakeupSignal::Wait(uint32_t token, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait_for(lock, timeout, [this, token] { return seq.load() != token; });
+}
+
+void WakeupSignal::Wake() {
+    {
+        // Taking the lock makes sure the waiter either hasn't checked
+        // seq yet or is waiting on the condition variable.
+        std::lock_guard<std::mutex> lock(mtx);
+        seq.fetch_add(1);
+    }
+
+    cv.notify_all();
+}
+
+#endif
+
+TEST_CASE("threading queue") {
+    Queue<uintptr_t*> q(nullptr, nullptr);
+
+    SUBCASE("empty") {
+        CHECK_FALSE(q.Ready());
+        CHECK(q.Size() == 0);
+    }
+
+    SUBCASE("ring overflow") {
+        // Enough elements to chain a few rings, all read back in order.
+        constexpr uintptr_t n = 5000;
+
+        for ( uintptr_t i = 1; i <= n; ++i )
+            q.Put(reinterpret_cast<uintptr_t*>(i));
+
+        CHECK(q.Size() == n);
+
+        for ( uintptr_t i = 1; i <= n; ++i ) {
+            REQUIRE(q.Ready());
+            CHECK(q.Get() == reinterpret_cast<uintptr_t*>(i));
+        }
+
+        CHECK_FALSE(q.Ready());
+
+        Queue<uintptr_t*>::Stats stats;
+        q.GetStats(&stats);
+        CHECK(stats.num_reads == n);
+        CHECK(stats.num_writes == n);
+        CHECK(stats.num_full == 4);
+        CHECK(stats.max_pending == n);
+    }
+
+    SUBCASE("threads") {
+        constexpr uintptr_t n = 200000;
+        std::vector<uintptr_t> received;
+
+        std::thread consumer([&] {
+            while ( received.size() < n ) {
+                if ( auto* p = q.Get() )
+                    received.push_back(reinterpret_cast<uintptr_t>(p));
+            }
+        });
+
+        for ( uintptr_t i = 1; i <= n; ++i ) {
+            q.Put(reinterpret_cast<uintptr_t*>(i));
+
+            // Let the consumer go to sleep now and then.
+            if ( i % 10000 == 0 )
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        consumer.join();
+
+        bool in_order = true;
+
+        for ( uintptr_t i = 0; i < n; ++i )
+            in_order = in_order && received[i] == i + 1;
+
+        CHECK(in_order);
+    }
+}
+
+} // namespace zeek::threading::detail
@@ -2,11 +2,15 @@
 
 #pragma once
 
-#include <sys/time.h>
-#include <condition_variable>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+
+#ifndef __linux__
+#include <condition_variable>
 #include <mutex>
-#include <queue>
+#endif
 
 #include "zeek/Reporter.h"
 #include "zeek/threading/BasicThread.h"
@@ -15,16 +19,76 @@
 
 namespace zeek::threading {
 
+namespace detail {
+
+/**
+ * Lets the consumer of a queue sleep until the producer signals more
+ * input. On Linux, this is a futex. Elsewhere, it's a mutex and condition
+ * variable. Either way, the producer only makes a system call when the
+ * consumer is actually asleep.
+ */
+class WakeupSignal {
+public:
+    /**
+     * Announces that the consumer is about to sleep. It must check for
+     * input once more afterwards, and then either call Wait() or Cancel().
+     *
+     * @return A token to pass to Wait().
+     */
+    uint32_t Prepare() {
+        waiting.store(true);
+        return seq.load();
+    }
+
+    /**
+     * Blocks until Wake() gets called, unless that has already happened
+     * since Prepare() returned the token. May return early spuriously.
+     */
+    void Wait(uint32_t token, std::chrono::milliseconds timeout);
+
+    /**
+     * Signals that the consumer is awake again.
+     */
+    void Cancel() { waiting.store(false, std::memory_order_relaxed); }
+
+    /**
+     * Wakes up the consumer if it's asleep. For the producer to call
+     * after publishing input. Both sides must publish and check for
+     * input with sequentially consistent operations, so that either the
+     * producer sees the consumer waiting or the consumer sees the input.
+     */
+    void Notify() {
+        if ( waiting.load() )
+            Wake();
+    }
+
+    /**
+     * Wakes up the consumer unconditionally.
+     */
+    void Wake();
+
+private:
+    std::atomic<uint32_t> seq = 0;
+    std::atomic<bool> waiting = false;
+
+#ifndef __linux__
+    std::mutex mtx;
+    std::condition_variable cv;
+#endif
+};
+
+} // namespace detail
+
 /**
  * A thread-safe single-reader single-writer queue.
  *
- * The implementation uses multiple queues and reads/writes in rotary fashion
- * in an attempt to limit contention.
+ * The implementation is lock-free: elements go into a ring buffer the
+ * writer and reader each advance their own index of. When the ring fills
+ * up, the writer chains a new one to it rather than blocking, as our
+ * threads exchange messages in both directions and blocking could
+ * deadlock them. The Stats record how often that happens.
  *
  * All Queue instances must be instantiated by Zeek's main thread.
- *
- * TODO: Unclear how critical performance is for this queue. We could likely
- * optimize it further if helpful.
  */
 template<typename T>
 class Queue {
@@ -56,38 +120,40 @@ public:
     void Put(T data);
 
     /**
-     * Returns true if the next Get() operation will succeed.
+     * Returns true if the next Get() operation will succeed. Must only be
+     * called by the reader.
      */
-    bool Ready();
+    bool Ready() { return num_reads.load(std::memory_order_relaxed) != num_writes.load(std::memory_order_acquire); }
 
     /**
      * Returns true if the next Get() operation might succeed. This
      * function may occasionally return a value not indicating the actual
-     * state, but won't do so very often. Note that this means that it can
-     * consistently return false even if there is something in the Queue.
-     * You have to check real queue status from time to time to be sure that
-     * it is empty. In other words, this method helps to avoid locking the queue
-     * frequently, but doesn't allow you to forgo it completely.
+     * state, but won't do so very often. It's cheap to call from any
+     * thread.
      */
-    bool MaybeReady() { return (num_reads != num_writes); }
+    bool MaybeReady() {
+        return num_reads.load(std::memory_order_relaxed) != num_writes.load(std::memory_order_relaxed);
+    }
 
     /**
      * Wake up the reader if it's currently blocked for input. This is
      * primarily to give it a chance to check termination quickly.
      */
-    void WakeUp();
+    void WakeUp() { signal.Wake(); }
 
     /**
      * Returns the number of queued items not yet retrieved.
      */
-    uint64_t Size();
+    uint64_t Size() { return num_writes.load() - num_reads.load(); }
 
     /**
      * Statistics about inter-thread communication.
      */
     struct Stats {
-        uint64_t num_reads;  //! Number of messages read from the queue.
-        uint64_t num_writes; //! Number of messages written to the queue.
+        uint64_t num_reads;   //! Number of messages read from the queue.
+        uint64_t num_writes;  //! Number of messages written to the queue.
+        uint64_t num_full;    //! Number of times the writer found the ring full.
+        uint64_t max_pending; //! Largest number of messages queued at once.
     };
 
     /**
@@ -99,147 +165,155 @@ public:
     void GetStats(Stats* stats);
 
 private:
-    static const int NUM_QUEUES = 8;
+    static constexpr uint64_t RING_SIZE = 1024;
 
-    std::vector<std::unique_lock<std::mutex>> LocksForAllQueues();
+    struct Ring {
+        std::array<T, RING_SIZE> slots;
+        alignas(64) std::atomic<uint64_t> head = 0; // Next slot to read, advanced by the reader.
+        alignas(64) std::atomic<uint64_t> tail = 0; // Next slot to write, advanced by the writer.
+        std::atomic<Ring*> next = nullptr;          // Set by the writer once this one is full.
+    };
 
-    std::mutex mutex[NUM_QUEUES];                 // Mutex protected shared accesses.
-    std::condition_variable has_data[NUM_QUEUES]; // Signals when data becomes available
-    std::queue<T> messages[NUM_QUEUES];           // Actually holds the queued messages
+    // Increments a counter only ever written by one thread.
+    static void Increment(std::atomic<uint64_t>& counter, std::memory_order order = std::memory_order_relaxed) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, order);
+    }
 
-    int read_ptr;  // Where the next operation will read from
-    int write_ptr; // Where the next operation will write to
+    // Removes the next element, if any. Reader only.
+    bool Pop(T* data);
 
     BasicThread* reader;
     BasicThread* writer;
 
+    detail::WakeupSignal signal;
+
+    // The writer's state.
+    alignas(64) Ring* write_ring;
+    uint64_t write_ring_head = 0; // Last seen head of write_ring.
+
+    // The reader's state.
+    alignas(64) Ring* read_ring;
+    uint64_t read_ring_tail = 0; // Last seen tail of read_ring.
+
     // Statistics.
-    uint64_t num_reads;
-    uint64_t num_writes;
+    alignas(64) std::atomic<uint64_t> num_reads = 0;
+    alignas(64) std::atomic<uint64_t> num_writes = 0;
+    std::atomic<uint64_t> num_full = 0;
+    std::atomic<uint64_t> max_pending = 0;
 };
 
-inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m) {
-    try {
-        return std::unique_lock<std::mutex>(m);
-    } catch ( const std::system_error& e ) {
-        reporter->FatalErrorWithCore("cannot lock mutex: %s", e.what());
-        // Never gets here.
-        throw std::exception();
-    }
-}
-
 template<typename T>
 inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer) {
-    read_ptr = 0;
-    write_ptr = 0;
-    num_reads = num_writes = 0;
     reader = arg_reader;
     writer = arg_writer;
+    write_ring = read_ring = new Ring();
 }
 
 template<typename T>
-inline Queue<T>::~Queue() {}
+inline Queue<T>::~Queue() {
+    while ( read_ring ) {
+        Ring* next = read_ring->next.load();
+        delete read_ring;
+        read_ring = next;
+    }
+}
 
 template<typename T>
-inline T Queue<T>::Get() {
-    auto lock = acquire_lock(mutex[read_ptr]);
+inline bool Queue<T>::Pop(T* data) {
+    while ( true ) {
+        uint64_t head = read_ring->head.load(std::memory_order_relaxed);
 
-    int old_read_ptr = read_ptr;
+        if ( head == read_ring_tail )
+            read_ring_tail = read_ring->tail.load();
 
-    if ( messages[read_ptr].empty() && ! ((reader && reader->Killed()) || (writer && writer->Killed())) ) {
-        if ( has_data[read_ptr].wait_for(lock, std::chrono::seconds(5)) == std::cv_status::timeout )
-            return nullptr;
-    }
+        if ( head != read_ring_tail ) {
+            *data = read_ring->slots[head % RING_SIZE];
+            read_ring->head.store(head + 1, std::memory_order_release);
+            Increment(num_reads);
+            return true;
+        }
+
+        // This ring is empty. If the writer has moved on to another one,
+        // it's done with this one after a last check for elements that
+        // it wrote before linking the next.
+        Ring* next = read_ring->next.load();
 
-    if ( messages[read_ptr].empty() )
-        return nullptr;
+        if ( ! next )
+            return false;
 
-    T data = messages[read_ptr].front();
-    messages[read_ptr].pop();
+        read_ring_tail = read_ring->tail.load(std::memory_order_acquire);
 
-    read_ptr = (read_ptr + 1) % NUM_QUEUES;
-    ++num_reads;
+        if ( head != read_ring_tail )
+            continue;
 
-    return data;
+        delete read_ring;
+        read_ring = next;
+        read_ring_tail = 0;
+    }
 }
 
 template<typename T>
-inline void Queue<T>::Put(T data) {
-    auto lock = acquire_lock(mutex[write_ptr]);
-
-    int old_write_ptr = write_ptr;
-
-    bool need_signal = messages[write_ptr].empty();
+inline T Queue<T>::Get() {
+    T data;
 
-    messages[write_ptr].push(data);
+    if ( Pop(&data) )
+        return data;
 
-    write_ptr = (write_ptr + 1) % NUM_QUEUES;
-    ++num_writes;
+    auto token = signal.Prepare();
 
-    if ( need_signal ) {
-        lock.unlock();
-        has_data[old_write_ptr].notify_one();
+    if ( Pop(&data) ) {
+        signal.Cancel();
+        return data;
     }
-}
 
-template<typename T>
-inline bool Queue<T>::Ready() {
-    auto lock = acquire_lock(mutex[read_ptr]);
+    if ( ! ((reader && reader->Killed()) || (writer && writer->Killed())) )
+        signal.Wait(token, std::chrono::seconds(5));
+
+    signal.Cancel();
 
-    bool ret = (messages[read_ptr].size());
+    if ( Pop(&data) )
+        return data;
 
-    return ret;
+    return nullptr;
 }
 
 template<typename T>
-inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues() {
-    std::vector<std::unique_lock<std::mutex>> locks;
-
-    try {
-        // NOLINTNEXTLINE(modernize-loop-convert)
-        for ( int i = 0; i < NUM_QUEUES; i++ )
-            locks.emplace_back(std::unique_lock<std::mutex>(mutex[i]));
-    }
-
-    catch ( const std::system_error& e ) {
-        reporter->FatalErrorWithCore("cannot lock all mutexes: %s", e.what());
-        // Never gets here.
-        throw std::exception();
+inline void Queue<T>::Put(T data) {
+    uint64_t tail = write_ring->tail.load(std::memory_order_relaxed);
+
+    if ( tail - write_ring_head == RING_SIZE ) {
+        write_ring_head = write_ring->head.load(std::memory_order_acquire);
+
+        if ( tail - write_ring_head == RING_SIZE ) {
+            // Full: continue in a new ring, which the reader moves to
+            // once it has drained this one.
+            auto* ring = new Ring();
+            write_ring->next.store(ring);
+            write_ring = ring;
+            write_ring_head = 0;
+            tail = 0;
+            Increment(num_full);
+        }
     }
 
-    return locks;
-}
-
-template<typename T>
-inline uint64_t Queue<T>::Size() {
-    // Need to lock all queues.
-    auto locks = LocksForAllQueues();
+    write_ring->slots[tail % RING_SIZE] = data;
+    write_ring->tail.store(tail + 1);
+    Increment(num_writes, std::memory_order_release);
 
-    uint64_t size = 0;
+    uint64_t pending = num_writes.load(std::memory_order_relaxed) - num_reads.load(std::memory_order_relaxed);
 
-    // NOLINTNEXTLINE(modernize-loop-convert)
-    for ( int i = 0; i < NUM_QUEUES; i++ )
-        size += messages[i].size();
+    if ( pending > max_pending.load(std::memory_order_relaxed) )
+        max_pending.store(pending, std::memory_order_relaxed);
 
-    return size;
+    signal.Notify();
 }
 
 template<typename T>
 inline void Queue<T>::GetStats(Stats* stats) {
-    // To be safe, we look all queues. That's probably unnecessary, but
-    // doesn't really hurt.
-    auto locks = LocksForAllQueues();
-
-    stats->num_reads = num_reads;
-    stats->num_writes = num_writes;
-}
-
-template<typename T>
-inline void Queue<T>::WakeUp() {
-    for ( int i = 0; i < NUM_QUEUES; i++ ) {
-        auto lock = acquire_lock(mutex[i]);
-        has_data[i].notify_all();
-    }
+    stats->num_reads = num_reads.load();
+    stats->num_writes = num_writes.load();
+    stats->num_full = num_full.load();
+    stats->max_pending = max_pending.load();
 }
 
 } // namespace zeek::threading
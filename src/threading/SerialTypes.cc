@@ -125,16 +125,18 @@ Value::Value(Value&& other) noexcept {
     type = other.type;
     subtype = other.type;
     line_number = other.line_number;
+    in_arena = other.in_arena;
 
     val = other.val; // take ownership.
 
     other.val = _val();
     other.line_number = -1;
     other.present = false;
+    other.in_arena = false;
 }
 
 Value::~Value() {
-    if ( ! present )
+    if ( ! present || in_arena )
         return;
 
     if ( type == TYPE_ENUM || type == TYPE_STRING || type == TYPE_FILE || type == TYPE_FUNC )
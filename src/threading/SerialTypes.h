@@ -188,6 +188,11 @@ struct Value {
 
     bool present = false; //! False for optional record fields that are not set.
 
+    //! True if the value's string, set and vector data, including nested
+    //! values, lives in a logging::detail::RecordArena rather than being
+    //! owned by the value. Copies of such values own their data.
+    bool in_arena = false;
+
     /**
      * Constructor.
      *
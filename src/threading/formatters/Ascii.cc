@@ -44,127 +44,179 @@ Ascii::SeparatorInfo::SeparatorInfo(const string& arg_separator, const string& a
 Ascii::Ascii(MsgThread* t, const SeparatorInfo& info) : Formatter(t) { separators = info; }
 
 bool Ascii::Describe(ODesc* desc, int num_fields, const Field* const* fields, Value** vals) const {
+    bool use_plan = (fields == plan_fields && static_cast<size_t>(num_fields) == plan.size());
+
     for ( int i = 0; i < num_fields; i++ ) {
         if ( i > 0 )
             desc->AddRaw(separators.separator);
 
-        if ( ! Describe(desc, vals[i], fields[i]->name) )
+        if ( use_plan && vals[i]->present && vals[i]->type == fields[i]->type ) {
+            if ( ! (this->*plan[i])(desc, vals[i]) )
+                return false;
+        }
+
+        else if ( ! Describe(desc, vals[i], fields[i]->name) )
             return false;
     }
 
     return true;
 }
 
+void Ascii::Prepare(int num_fields, const Field* const* fields) {
+    plan_fields = nullptr;
+    plan.clear();
+
+    for ( int i = 0; i < num_fields; i++ ) {
+        auto func = DescribeFuncFor(fields[i]->type);
+
+        // Leave unsupported types to Describe() for reporting.
+        if ( ! func ) {
+            plan.clear();
+            return;
+        }
+
+        plan.push_back(func);
+    }
+
+    plan_fields = fields;
+}
+
 bool Ascii::Describe(ODesc* desc, Value* val, const string& name) const {
     if ( ! val->present ) {
         desc->Add(separators.unset_field);
         return true;
     }
 
-    switch ( val->type ) {
-        case TYPE_BOOL: desc->Add(val->val.int_val ? "T" : "F"); break;
-
-        case TYPE_INT: desc->Add(val->val.int_val); break;
-
-        case TYPE_COUNT: desc->Add(val->val.uint_val); break;
-
-        case TYPE_PORT: desc->Add(val->val.port_val.port); break;
+    auto func = DescribeFuncFor(val->type);
 
-        case TYPE_SUBNET: desc->Add(Render(val->val.subnet_val)); break;
+    if ( ! func ) {
+        GetThread()->Warning(GetThread()->Fmt("Ascii writer unsupported field format %d", val->type));
+        return false;
+    }
 
-        case TYPE_ADDR: desc->Add(Render(val->val.addr_val)); break;
+    return (this->*func)(desc, val);
+}
 
-        case TYPE_DOUBLE:
-            // Rendering via Add() truncates trailing 0s after the
-            // decimal point. The difference with TIME/INTERVAL is mainly
-            // to keep the log format consistent.
-            desc->Add(val->val.double_val, true);
-            break;
+Ascii::DescribeFunc Ascii::DescribeFuncFor(TypeTag type) {
+    switch ( type ) {
+        case TYPE_BOOL: return &Ascii::DescribeBool;
+        case TYPE_INT: return &Ascii::DescribeInt;
+        case TYPE_COUNT: return &Ascii::DescribeCount;
+        case TYPE_PORT: return &Ascii::DescribePort;
+        case TYPE_SUBNET: return &Ascii::DescribeSubnet;
+        case TYPE_ADDR: return &Ascii::DescribeAddr;
+        case TYPE_DOUBLE: return &Ascii::DescribeDouble;
 
         case TYPE_INTERVAL:
-        case TYPE_TIME:
-            // Rendering via Render() keeps trailing 0s after the decimal
-            // point. The difference with DOUBLE is mainly to keep the
-            // log format consistent.
-            desc->Add(Render(val->val.double_val));
-            break;
+        case TYPE_TIME: return &Ascii::DescribeTime;
 
         case TYPE_ENUM:
         case TYPE_STRING:
         case TYPE_FILE:
-        case TYPE_FUNC: {
-            int size = val->val.string_val.length;
-            const char* data = val->val.string_val.data;
+        case TYPE_FUNC: return &Ascii::DescribeString;
 
-            if ( ! size ) {
-                desc->Add(separators.empty_field);
-                break;
-            }
+        case TYPE_TABLE: return &Ascii::DescribeTable;
+        case TYPE_VECTOR: return &Ascii::DescribeVector;
 
-            if ( escapeReservedContent(desc, separators.unset_field, data, size) )
-                break;
+        default: return nullptr;
+    }
+}
 
-            if ( escapeReservedContent(desc, separators.empty_field, data, size) )
-                break;
+bool Ascii::DescribeBool(ODesc* desc, const Value* val) const {
+    desc->Add(val->val.int_val ? "T" : "F");
+    return true;
+}
 
-            desc->AddN(data, size);
-            break;
-        }
+bool Ascii::DescribeInt(ODesc* desc, const Value* val) const {
+    desc->Add(val->val.int_val);
+    return true;
+}
 
-        case TYPE_TABLE: {
-            if ( ! val->val.set_val.size ) {
-                desc->Add(separators.empty_field);
-                break;
-            }
+bool Ascii::DescribeCount(ODesc* desc, const Value* val) const {
+    desc->Add(val->val.uint_val);
+    return true;
+}
 
-            desc->AddEscapeSequence(separators.set_separator);
+bool Ascii::DescribePort(ODesc* desc, const Value* val) const {
+    desc->Add(val->val.port_val.port);
+    return true;
+}
 
-            for ( zeek_int_t j = 0; j < val->val.set_val.size; j++ ) {
-                if ( j > 0 )
-                    desc->AddRaw(separators.set_separator);
+bool Ascii::DescribeSubnet(ODesc* desc, const Value* val) const {
+    desc->Add(Render(val->val.subnet_val));
+    return true;
+}
 
-                if ( ! Describe(desc, val->val.set_val.vals[j]) ) {
-                    desc->RemoveEscapeSequence(separators.set_separator);
-                    return false;
-                }
-            }
+bool Ascii::DescribeAddr(ODesc* desc, const Value* val) const {
+    desc->Add(Render(val->val.addr_val));
+    return true;
+}
 
-            desc->RemoveEscapeSequence(separators.set_separator);
+bool Ascii::DescribeDouble(ODesc* desc, const Value* val) const {
+    // Rendering via Add() truncates trailing 0s after the
+    // decimal point. The difference with TIME/INTERVAL is mainly
+    // to keep the log format consistent.
+    desc->Add(val->val.double_val, true);
+    return true;
+}
 
-            break;
-        }
+bool Ascii::DescribeTime(ODesc* desc, const Value* val) const {
+    // Rendering via Render() keeps trailing 0s after the decimal
+    // point. The difference with DOUBLE is mainly to keep the
+    // log format consistent.
+    desc->Add(Render(val->val.double_val));
+    return true;
+}
 
-        case TYPE_VECTOR: {
-            if ( ! val->val.vector_val.size ) {
-                desc->Add(separators.empty_field);
-                break;
-            }
+bool Ascii::DescribeString(ODesc* desc, const Value* val) const {
+    int size = val->val.string_val.length;
+    const char* data = val->val.string_val.data;
 
-            desc->AddEscapeSequence(separators.set_separator);
+    if ( ! size ) {
+        desc->Add(separators.empty_field);
+        return true;
+    }
 
-            for ( zeek_int_t j = 0; j < val->val.vector_val.size; j++ ) {
-                if ( j > 0 )
-                    desc->AddRaw(separators.set_separator);
+    if ( escapeReservedContent(desc, separators.unset_field, data, size) )
+        return true;
 
-                if ( ! Describe(desc, val->val.vector_val.vals[j]) ) {
-                    desc->RemoveEscapeSequence(separators.set_separator);
-                    return false;
-                }
-            }
+    if ( escapeReservedContent(desc, separators.empty_field, data, size) )
+        return true;
 
-            desc->RemoveEscapeSequence(separators.set_separator);
+    desc->AddN(data, size);
+    return true;
+}
 
-            break;
-        }
+bool Ascii::DescribeElements(ODesc* desc, Value* const* vals, zeek_int_t size) const {
+    if ( ! size ) {
+        desc->Add(separators.empty_field);
+        return true;
+    }
 
-        default:
-            GetThread()->Warning(GetThread()->Fmt("Ascii writer unsupported field format %d", val->type));
+    desc->AddEscapeSequence(separators.set_separator);
+
+    for ( zeek_int_t j = 0; j < size; j++ ) {
+        if ( j > 0 )
+            desc->AddRaw(separators.set_separator);
+
+        if ( ! Describe(desc, vals[j]) ) {
+            desc->RemoveEscapeSequence(separators.set_separator);
             return false;
+        }
     }
 
+    desc->RemoveEscapeSequence(separators.set_separator);
     return true;
 }
 
+bool Ascii::DescribeTable(ODesc* desc, const Value* val) const {
+    return DescribeElements(desc, val->val.set_val.vals, val->val.set_val.size);
+}
+
+bool Ascii::DescribeVector(ODesc* desc, const Value* val) const {
+    return DescribeElements(desc, val->val.vector_val.vals, val->val.vector_val.size);
+}
+
 Value* Ascii::ParseValue(const string& s, const string& name, TypeTag type, TypeTag subtype) const {
     if ( ! separators.unset_field.empty() && s.compare(separators.unset_field) == 0 ) // field is not set...
         return new Value(type, false);
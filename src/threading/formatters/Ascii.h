@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "zeek/threading/Formatter.h"
 
 namespace zeek::threading::formatter {
@@ -48,13 +50,37 @@ public:
 
     bool Describe(ODesc* desc, Value* val, const std::string& name = "") const override;
     bool Describe(ODesc* desc, int num_fields, const Field* const* fields, Value** vals) const override;
+    void Prepare(int num_fields, const Field* const* fields) override;
     Value* ParseValue(const std::string& s, const std::string& name, TypeTag type,
                       TypeTag subtype = TYPE_ERROR) const override;
 
 private:
+    // Renders a present value of a specific type.
+    using DescribeFunc = bool (Ascii::*)(ODesc* desc, const Value* val) const;
+
+    // Returns null for types we can't render.
+    static DescribeFunc DescribeFuncFor(TypeTag type);
+
+    bool DescribeBool(ODesc* desc, const Value* val) const;
+    bool DescribeInt(ODesc* desc, const Value* val) const;
+    bool DescribeCount(ODesc* desc, const Value* val) const;
+    bool DescribePort(ODesc* desc, const Value* val) const;
+    bool DescribeSubnet(ODesc* desc, const Value* val) const;
+    bool DescribeAddr(ODesc* desc, const Value* val) const;
+    bool DescribeDouble(ODesc* desc, const Value* val) const;
+    bool DescribeTime(ODesc* desc, const Value* val) const;
+    bool DescribeString(ODesc* desc, const Value* val) const;
+    bool DescribeElements(ODesc* desc, Value* const* vals, zeek_int_t size) const;
+    bool DescribeTable(ODesc* desc, const Value* val) const;
+    bool DescribeVector(ODesc* desc, const Value* val) const;
+
     bool CheckNumberError(const char* start, const char* end, bool nonneg_only = false) const;
 
     SeparatorInfo separators;
+
+    // The plan set up by Prepare(): the render function for each field.
+    const Field* const* plan_fields = nullptr;
+    std::vector<DescribeFunc> plan;
 };
 
 } // namespace zeek::threading::formatter
@@ -13,6 +13,9 @@
 #include <cerrno>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 
 #include "zeek/Desc.h"
 #include "zeek/threading/MsgThread.h"
@@ -27,11 +30,27 @@ bool JSON::Describe(ODesc* desc, int num_fields, const Field* const* fields, Val
     rapidjson::StringBuffer buffer;
     zeek::json::detail::NullDoubleWriter writer(buffer);
 
+    bool use_plan = (fields == plan_fields && static_cast<size_t>(num_fields) == plan.size());
+
     writer.StartObject();
 
     for ( int i = 0; i < num_fields; i++ ) {
-        if ( vals[i]->present || include_unset_fields )
-            BuildJSON(writer, vals[i], fields[i]->name);
+        Value* val = vals[i];
+
+        if ( ! val->present && ! include_unset_fields )
+            continue;
+
+        if ( use_plan && (! val->present || val->type == fields[i]->type) ) {
+            writer.RawKey(plan[i].key);
+
+            if ( val->present )
+                (this->*plan[i].build)(writer, val);
+            else
+                writer.Null();
+        }
+
+        else
+            BuildJSON(writer, val, fields[i]->name);
     }
 
     writer.EndObject();
@@ -40,9 +59,30 @@ bool JSON::Describe(ODesc* desc, int num_fields, const Field* const* fields, Val
     return true;
 }
 
+void JSON::Prepare(int num_fields, const Field* const* fields) {
+    plan_fields = nullptr;
+    plan.clear();
+
+    for ( int i = 0; i < num_fields; i++ ) {
+        auto build = BuildFuncFor(fields[i]->type);
+
+        // Leave unsupported types to BuildJSON() for reporting.
+        if ( ! build ) {
+            plan.clear();
+            return;
+        }
+
+        rapidjson::StringBuffer key;
+        zeek::json::detail::append_string(key, fields[i]->name, strlen(fields[i]->name));
+        plan.push_back({std::string(key.GetString(), key.GetSize()), build});
+    }
+
+    plan_fields = fields;
+}
+
 bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const {
     if ( desc->IsBinary() ) {
-        GetThread()->Error("json formatter: binary format not supported");
+        Error("json formatter: binary format not supported");
         return false;
     }
 
@@ -62,7 +102,7 @@ bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const {
 }
 
 Value* JSON::ParseValue(const std::string& s, const std::string& name, TypeTag type, TypeTag subtype) const {
-    GetThread()->Error("JSON formatter does not support parsing yet.");
+    Error("JSON formatter does not support parsing yet.");
     return nullptr;
 }
 
@@ -75,101 +115,165 @@ void JSON::BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, c
         return;
     }
 
-    switch ( val->type ) {
-        case TYPE_BOOL: writer.Bool(val->val.int_val != 0); break;
-
-        case TYPE_INT: writer.Int64(val->val.int_val); break;
-
-        case TYPE_COUNT: writer.Uint64(val->val.uint_val); break;
-
-        case TYPE_PORT: writer.Uint64(val->val.port_val.port); break;
-
-        case TYPE_SUBNET: writer.String(Formatter::Render(val->val.subnet_val)); break;
+    if ( auto build = BuildFuncFor(val->type) )
+        (this->*build)(writer, val);
+    else
+        reporter->Warning("Unhandled type in JSON::BuildJSON");
+}
 
-        case TYPE_ADDR: writer.String(Formatter::Render(val->val.addr_val)); break;
+JSON::BuildFunc JSON::BuildFuncFor(TypeTag type) const {
+    switch ( type ) {
+        case TYPE_BOOL: return &JSON::BuildBool;
+        case TYPE_INT: return &JSON::BuildInt;
+        case TYPE_COUNT: return &JSON::BuildCount;
+        case TYPE_PORT: return &JSON::BuildPort;
+        case TYPE_SUBNET: return &JSON::BuildSubnet;
+        case TYPE_ADDR: return &JSON::BuildAddr;
 
         case TYPE_DOUBLE:
-        case TYPE_INTERVAL: writer.Double(val->val.double_val); break;
-
-        case TYPE_TIME: {
-            if ( timestamps == TS_ISO8601 ) {
-                char buffer[40];
-                char buffer2[48];
-                time_t the_time = time_t(floor(val->val.double_val));
-                struct tm t;
-
-                if ( ! gmtime_r(&the_time, &t) || ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t) ) {
-                    GetThread()->Error(
-                        GetThread()->Fmt("json formatter: failure getting time: (%lf)", val->val.double_val));
-                    // This was a failure, doesn't really matter what gets put here
-                    // but it should probably stand out...
-                    writer.String("2000-01-01T00:00:00.000000");
-                }
-                else {
-                    double integ;
-                    double frac = modf(val->val.double_val, &integ);
-
-                    if ( frac < 0 )
-                        frac += 1;
-
-                    snprintf(buffer2, sizeof(buffer2), "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
-                    writer.String(buffer2, strlen(buffer2));
-                }
+        case TYPE_INTERVAL: return &JSON::BuildDouble;
+
+        case TYPE_TIME:
+            switch ( timestamps ) {
+                case TS_ISO8601: return &JSON::BuildTimeISO8601;
+                case TS_EPOCH: return &JSON::BuildDouble;
+                case TS_MILLIS: return &JSON::BuildTimeMillis;
+                case TS_MILLIS_UNSIGNED: return &JSON::BuildTimeMillisUnsigned;
             }
 
-            else if ( timestamps == TS_EPOCH )
-                writer.Double(val->val.double_val);
-
-            else if ( timestamps == TS_MILLIS ) {
-                // ElasticSearch uses milliseconds for timestamps
-                writer.Int64((int64_t)(val->val.double_val * 1000));
-            }
-            else if ( timestamps == TS_MILLIS_UNSIGNED ) {
-                // Without the cast through int64_t the resulting
-                // uint64_t value is zero for negative timestamps
-                // on arm64. This is UB territory, a negative value
-                // cannot be represented in uint64_t and so the
-                // compiler is free to do whatever. Prevent this by
-                // casting through an int64_t.
-                //
-                // https://stackoverflow.com/a/55057221
-                uint64_t v = static_cast<uint64_t>(static_cast<int64_t>(val->val.double_val * 1000));
-                writer.Uint64(v);
-            }
-
-            break;
-        }
+            return nullptr;
 
         case TYPE_ENUM:
         case TYPE_STRING:
         case TYPE_FILE:
-        case TYPE_FUNC: {
-            writer.String(util::json_escape_utf8(std::string(val->val.string_val.data, val->val.string_val.length)));
-            break;
-        }
+        case TYPE_FUNC: return &JSON::BuildString;
 
-        case TYPE_TABLE: {
-            writer.StartArray();
+        case TYPE_TABLE: return &JSON::BuildTable;
+        case TYPE_VECTOR: return &JSON::BuildVector;
 
-            for ( zeek_int_t idx = 0; idx < val->val.set_val.size; idx++ )
-                BuildJSON(writer, val->val.set_val.vals[idx]);
+        default: return nullptr;
+    }
+}
 
-            writer.EndArray();
-            break;
-        }
+void JSON::BuildBool(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.Bool(val->val.int_val != 0);
+}
 
-        case TYPE_VECTOR: {
-            writer.StartArray();
+void JSON::BuildInt(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.Int64(val->val.int_val);
+}
 
-            for ( zeek_int_t idx = 0; idx < val->val.vector_val.size; idx++ )
-                BuildJSON(writer, val->val.vector_val.vals[idx]);
+void JSON::BuildCount(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.Uint64(val->val.uint_val);
+}
+
+void JSON::BuildPort(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.Uint64(val->val.port_val.port);
+}
+
+void JSON::BuildSubnet(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.String(Formatter::Render(val->val.subnet_val));
+}
+
+void JSON::BuildAddr(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.String(Formatter::Render(val->val.addr_val));
+}
 
-            writer.EndArray();
-            break;
+void JSON::BuildDouble(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.Double(val->val.double_val);
+}
+
+void JSON::BuildTimeISO8601(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    char buffer[48];
+    double integ;
+    double frac = modf(val->val.double_val, &integ);
+    time_t the_time = time_t(floor(val->val.double_val));
+
+    if ( frac < 0 )
+        frac += 1;
+
+    // Timestamps in a log mostly fall into the same second as
+    // the previous one, so keep that one's formatted prefix.
+    if ( the_time != iso_time || iso_prefix_len == 0 ) {
+        struct tm t;
+
+        if ( ! gmtime_r(&the_time, &t) ||
+             ! (iso_prefix_len = strftime(iso_prefix, sizeof(iso_prefix), "%Y-%m-%dT%H:%M:%S", &t)) ) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "json formatter: failure getting time: (%lf)", val->val.double_val);
+            Error(msg);
+            // This was a failure, doesn't really matter what gets put here
+            // but it should probably stand out...
+            writer.String("2000-01-01T00:00:00.000000");
+            return;
         }
 
-        default: reporter->Warning("Unhandled type in JSON::BuildJSON"); break;
+        iso_time = the_time;
     }
+
+    // Same as printf()'s "%06.0f", which rounds to nearest even.
+    auto usecs = static_cast<uint64_t>(nearbyint(fabs(frac) * 1000000));
+
+    memcpy(buffer, iso_prefix, iso_prefix_len);
+    char* p = buffer + iso_prefix_len;
+    *p++ = '.';
+
+    char digits[20];
+    int n = 0;
+
+    do {
+        digits[n++] = static_cast<char>('0' + usecs % 10);
+        usecs /= 10;
+    } while ( usecs > 0 );
+
+    for ( int i = n; i < 6; ++i )
+        *p++ = '0';
+
+    while ( n > 0 )
+        *p++ = digits[--n];
+
+    *p++ = 'Z';
+    writer.String(buffer, p - buffer);
+}
+
+void JSON::BuildTimeMillis(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    // ElasticSearch uses milliseconds for timestamps
+    writer.Int64((int64_t)(val->val.double_val * 1000));
+}
+
+void JSON::BuildTimeMillisUnsigned(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    // Without the cast through int64_t the resulting
+    // uint64_t value is zero for negative timestamps
+    // on arm64. This is UB territory, a negative value
+    // cannot be represented in uint64_t and so the
+    // compiler is free to do whatever. Prevent this by
+    // casting through an int64_t.
+    //
+    // https://stackoverflow.com/a/55057221
+    uint64_t v = static_cast<uint64_t>(static_cast<int64_t>(val->val.double_val * 1000));
+    writer.Uint64(v);
+}
+
+void JSON::BuildString(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.String(util::json_escape_utf8(val->val.string_val.data, val->val.string_val.length));
+}
+
+void JSON::BuildTable(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.StartArray();
+
+    for ( zeek_int_t idx = 0; idx < val->val.set_val.size; idx++ )
+        BuildJSON(writer, val->val.set_val.vals[idx]);
+
+    writer.EndArray();
+}
+
+void JSON::BuildVector(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const {
+    writer.StartArray();
+
+    for ( zeek_int_t idx = 0; idx < val->val.vector_val.size; idx++ )
+        BuildJSON(writer, val->val.vector_val.vals[idx]);
+
+    writer.EndArray();
 }
 
 } // namespace zeek::threading::formatter
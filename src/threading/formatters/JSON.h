@@ -2,7 +2,9 @@
 
 #pragma once
 
+#include <ctime>
 #include <string>
+#include <vector>
 
 #include "zeek/threading/Formatter.h"
 
@@ -31,14 +33,49 @@ public:
 
     bool Describe(ODesc* desc, Value* val, const std::string& name = "") const override;
     bool Describe(ODesc* desc, int num_fields, const Field* const* fields, Value** vals) const override;
+    void Prepare(int num_fields, const Field* const* fields) override;
     Value* ParseValue(const std::string& s, const std::string& name, TypeTag type,
                       TypeTag subtype = TYPE_ERROR) const override;
 
 private:
     void BuildJSON(zeek::json::detail::NullDoubleWriter& writer, Value* val, const std::string& name = "") const;
 
+    // Writes a present value of a specific type.
+    using BuildFunc = void (JSON::*)(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+
+    // Returns null for types we can't write.
+    BuildFunc BuildFuncFor(TypeTag type) const;
+
+    void BuildBool(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildInt(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildCount(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildPort(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildSubnet(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildAddr(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildDouble(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildTimeISO8601(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildTimeMillis(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildTimeMillisUnsigned(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildString(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildTable(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+    void BuildVector(zeek::json::detail::NullDoubleWriter& writer, const Value* val) const;
+
+    // A field of the plan set up by Prepare().
+    struct PlanField {
+        std::string key; // The field's name, quoted and escaped.
+        BuildFunc build;
+    };
+
     TimeFormat timestamps;
     bool include_unset_fields;
+
+    const Field* const* plan_fields = nullptr;
+    std::vector<PlanField> plan;
+
+    // The last second formatted as ISO 8601, without the fractional part.
+    mutable time_t iso_time = 0;
+    mutable char iso_prefix[40];
+    mutable size_t iso_prefix_len = 0;
 };
 
 } // namespace zeek::threading::formatter
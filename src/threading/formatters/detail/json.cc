@@ -0,0 +1,318 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/formatters/detail/json.h"
+
+#include <rapidjson/internal/dtoa.h>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::json::detail {
+
+namespace {
+
+bool needs_escape(unsigned char c) { return c < 0x20 || c == '"' || c == '\\'; }
+
+// Returns the length of the prefix of s that append_string() can copy
+// as it is.
+size_t unescaped_prefix(const char* s, size_t len) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i max_control = _mm_set1_epi8(0x1f);
+
+    for ( ; i + 16 <= len; i += 16 ) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash));
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(x, max_control), x);
+
+        if ( int mask = _mm_movemask_epi8(_mm_or_si128(special, control)) )
+            return i + __builtin_ctz(mask);
+    }
+#else
+    // Checks 8 bytes at a time, leaving it to the loop below to locate
+    // the byte that needs escaping.
+    constexpr uint64_t lsbs = 0x0101010101010101ULL;
+    constexpr uint64_t msbs = 0x8080808080808080ULL;
+
+    auto has_zero = [](uint64_t x) { return (x - lsbs) & ~x & msbs; };
+
+    for ( ; i + 8 <= len; i += 8 ) {
+        uint64_t x;
+        memcpy(&x, s + i, sizeof(x));
+
+        if ( has_zero(x ^ (lsbs * '"')) || has_zero(x ^ (lsbs * '\\')) || ((x - lsbs * 0x20) & ~x & msbs) )
+            break;
+    }
+#endif
+
+    while ( i < len && ! needs_escape(s[i]) )
+        ++i;
+
+    return i;
+}
+
+char* write_exponent(int k, char* p) {
+    if ( k < 0 ) {
+        *p++ = '-';
+        k = -k;
+    }
+
+    if ( k >= 100 ) {
+        *p++ = static_cast<char>('0' + k / 100);
+        k %= 100;
+        *p++ = static_cast<char>('0' + k / 10);
+        *p++ = static_cast<char>('0' + k % 10);
+    }
+    else if ( k >= 10 ) {
+        *p++ = static_cast<char>('0' + k / 10);
+        *p++ = static_cast<char>('0' + k % 10);
+    }
+    else
+        *p++ = static_cast<char>('0' + k);
+
+    return p;
+}
+
+} // namespace
+
+char* format_double(double d, char* buf) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    char* p = buf;
+
+    if ( std::signbit(d) ) {
+        *p++ = '-';
+        d = -d;
+    }
+
+    if ( d == 0 ) {
+        memcpy(p, "0.0", 3);
+        return p + 3;
+    }
+
+    // to_chars() gives the shortest representation that round-trips. Asking
+    // for scientific notation gets us its digits and decimal exponent, which
+    // we then lay out the way rapidjson does.
+    char sci[MAX_DOUBLE_LEN];
+    auto res = std::to_chars(sci, sci + sizeof(sci), d, std::chars_format::scientific);
+
+    char digits[MAX_DOUBLE_LEN];
+    int n = 0;
+    const char* c = sci;
+
+    for ( ; c < res.ptr && *c != 'e'; ++c ) {
+        if ( *c != '.' )
+            digits[n++] = *c;
+    }
+
+    // Skip the 'e', parse the exponent's sign and value.
+    bool negative_exp = (++c < res.ptr && *c == '-');
+    int exp = 0;
+
+    for ( ++c; c < res.ptr; ++c )
+        exp = exp * 10 + (*c - '0');
+
+    // The position of the decimal point relative to the first digit.
+    int kk = (negative_exp ? -exp : exp) + 1;
+
+    if ( kk >= n && kk <= 21 ) {
+        // An integer: 1234e7 -> 12340000000.0
+        memcpy(p, digits, n);
+        p += n;
+        memset(p, '0', kk - n);
+        p += kk - n;
+        memcpy(p, ".0", 2);
+        return p + 2;
+    }
+
+    if ( kk > 0 && kk <= 21 ) {
+        // 1234e-2 -> 12.34
+        memcpy(p, digits, kk);
+        p += kk;
+        *p++ = '.';
+        memcpy(p, digits + kk, n - kk);
+        return p + n - kk;
+    }
+
+    if ( kk > -6 && kk <= 0 ) {
+        // 1234e-6 -> 0.001234
+        memcpy(p, "0.", 2);
+        p += 2;
+        memset(p, '0', -kk);
+        p += -kk;
+        memcpy(p, digits, n);
+        return p + n;
+    }
+
+    // 1e30, 1.234e30
+    *p++ = digits[0];
+
+    if ( n > 1 ) {
+        *p++ = '.';
+        memcpy(p, digits + 1, n - 1);
+        p += n - 1;
+    }
+
+    *p++ = 'e';
+    return write_exponent(kk - 1, p);
+#else
+    return rapidjson::internal::dtoa(d, buf);
+#endif
+}
+
+void append_string(rapidjson::StringBuffer& buf, const char* s, size_t len) {
+    static constexpr char hex_digits[] = "0123456789ABCDEF";
+
+    buf.Put('"');
+
+    size_t i = 0;
+
+    while ( i < len ) {
+        if ( size_t n = unescaped_prefix(s + i, len - i); n > 0 ) {
+            memcpy(buf.Push(n), s + i, n);
+            i += n;
+
+            if ( i == len )
+                break;
+        }
+
+        auto c = static_cast<unsigned char>(s[i++]);
+        char* out;
+
+        switch ( c ) {
+            case '"':
+            case '\\':
+                out = buf.Push(2);
+                out[0] = '\\';
+                out[1] = static_cast<char>(c);
+                break;
+
+            case '\b': memcpy(buf.Push(2), "\\b", 2); break;
+            case '\f': memcpy(buf.Push(2), "\\f", 2); break;
+            case '\n': memcpy(buf.Push(2), "\\n", 2); break;
+            case '\r': memcpy(buf.Push(2), "\\r", 2); break;
+            case '\t': memcpy(buf.Push(2), "\\t", 2); break;
+
+            default:
+                out = buf.Push(6);
+                memcpy(out, "\\u00", 4);
+                out[4] = hex_digits[c >> 4];
+                out[5] = hex_digits[c & 0xf];
+                break;
+        }
+    }
+
+    buf.Put('"');
+}
+
+TEST_CASE("json format_double") {
+    auto format = [](double d) {
+        char buf[MAX_DOUBLE_LEN];
+        return std::string(buf, format_double(d, buf));
+    };
+
+    CHECK(format(0.0) == "0.0");
+    CHECK(format(-0.0) == "-0.0");
+    CHECK(format(1.0) == "1.0");
+    CHECK(format(-42.0) == "-42.0");
+    CHECK(format(0.1) == "0.1");
+    CHECK(format(1.5) == "1.5");
+    CHECK(format(0.001234) == "0.001234");
+    CHECK(format(1e-7) == "1e-7");
+    CHECK(format(1.5e-7) == "1.5e-7");
+    CHECK(format(1e20) == "100000000000000000000.0");
+    CHECK(format(1e21) == "1e21");
+    CHECK(format(1.234e30) == "1.234e30");
+    CHECK(format(1300475167.096535) == "1300475167.096535");
+    CHECK(format(5e-324) == "5e-324");
+    CHECK(format(1.7976931348623157e308) == "1.7976931348623157e308");
+}
+
+TEST_CASE("json format_double vs rapidjson") {
+    // Rapidjson's Grisu2 doesn't always find the shortest digits, so the
+    // two can differ. Ours still need to round-trip, can't be longer, and
+    // must use the same notation.
+    const double values[] = {
+        // Subnormals, and the smallest normal.
+        5e-324,
+        1.5e-323,
+        2.225073858507201e-308,
+        2.2250738585072014e-308,
+
+        // Around the switch from 0.00x to exponent notation.
+        1e-7,
+        1e-6,
+        1.2345e-6,
+
+        // Digits that don't terminate.
+        0.1 + 0.2,
+        1.0 / 3.0,
+
+        // Integers beyond 2^53.
+        9007199254740992.0,
+        9007199254740994.0,
+        18014398509481988.0,
+
+        // Around the switch from integer to exponent notation.
+        123456789012345678901.0,
+        std::nextafter(1e21, 0.0),
+        1e21,
+        std::nextafter(1e21, 1e22),
+
+        1.7976931348623157e308,
+    };
+
+    for ( auto d : values ) {
+        for ( auto v : {d, -d} ) {
+            char ours_buf[MAX_DOUBLE_LEN];
+            char theirs_buf[MAX_DOUBLE_LEN];
+            std::string ours(ours_buf, format_double(v, ours_buf));
+            std::string theirs(theirs_buf, rapidjson::internal::dtoa(v, theirs_buf));
+
+            CAPTURE(ours);
+            CAPTURE(theirs);
+            CHECK(std::strtod(ours.c_str(), nullptr) == v);
+            CHECK(ours.size() <= theirs.size());
+            CHECK((ours.find('e') == std::string::npos) == (theirs.find('e') == std::string::npos));
+        }
+    }
+}
+
+TEST_CASE("json append_string") {
+    auto escape = [](std::string_view s) {
+        rapidjson::StringBuffer buf;
+        append_string(buf, s.data(), s.size());
+        return std::string(buf.GetString(), buf.GetSize());
+    };
+
+    CHECK(escape("") == R"("")");
+    CHECK(escape("GET") == R"("GET")");
+    CHECK(escape("a \"quoted\" \\ string") == R"("a \"quoted\" \\ string")");
+    CHECK(escape("\b\f\n\r\t\x01\x1f\x7f") == "\"\\b\\f\\n\\r\\t\\u0001\\u001F\x7f\"");
+    CHECK(escape(std::string_view("nul\0byte", 8)) == R"("nul\u0000byte")");
+    CHECK(escape("\xc3\xb1") == "\"\xc3\xb1\"");
+
+    // Escapes at every position of runs longer than one vector.
+    std::string long_str(40, 'x');
+
+    for ( size_t i = 0; i < long_str.size(); ++i ) {
+        auto s = long_str;
+        s[i] = '"';
+
+        auto expected = "\"" + long_str.substr(0, i) + "\\\"" + long_str.substr(i + 1) + "\"";
+        CHECK(escape(s) == expected);
+    }
+}
+
+} // namespace zeek::json::detail
@@ -6,8 +6,36 @@
 #include <rapidjson/document.h>
 #include <rapidjson/internal/ieee754.h>
 #include <rapidjson/writer.h>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
 
 namespace zeek::json::detail {
+
+constexpr size_t MAX_DOUBLE_LEN = 32;
+
+/**
+ * Formats a finite double the way rapidjson's writer does (always with a
+ * decimal point or an exponent, e.g. "1.0", "0.001", "1e30"), but with the
+ * shortest digits that round-trip.
+ *
+ * @param d The value to format. Must not be NaN or infinite.
+ *
+ * @param buf The buffer to write into, which must have room for at least
+ * MAX_DOUBLE_LEN characters. It does not get NUL-terminated.
+ *
+ * @return A pointer past the last character written.
+ */
+char* format_double(double d, char* buf);
+
+/**
+ * Appends a JSON string literal holding the given bytes, escaped the same
+ * way rapidjson's writer does. Runs of bytes that don't need escaping get
+ * copied in bulk. Bytes outside of ASCII are copied as they are: the
+ * caller is responsible for them forming valid UTF-8.
+ */
+void append_string(rapidjson::StringBuffer& buf, const char* s, size_t len);
+
 // A rapidjson Writer that writes null for inf or nan numbers.
 class NullDoubleWriter : public rapidjson::Writer<rapidjson::StringBuffer> {
 public:
@@ -16,7 +44,27 @@ public:
         if ( rapidjson::internal::Double(d).IsNanOrInf() )
             return rapidjson::Writer<rapidjson::StringBuffer>::Null();
 
-        return rapidjson::Writer<rapidjson::StringBuffer>::Double(d);
+        Prefix(rapidjson::kNumberType);
+        char* start = os_->Push(MAX_DOUBLE_LEN);
+        char* end = format_double(d, start);
+        os_->Pop(MAX_DOUBLE_LEN - (end - start));
+        return EndValue(true);
+    }
+
+    bool String(const char* s, size_t len) {
+        Prefix(rapidjson::kStringType);
+        append_string(*os_, s, len);
+        return EndValue(true);
+    }
+
+    bool String(std::string_view s) { return String(s.data(), s.size()); }
+
+    // Writes an object key that's already been quoted and escaped, such
+    // as one produced by append_string().
+    bool RawKey(std::string_view json) {
+        Prefix(rapidjson::kStringType);
+        memcpy(os_->Push(json.size()), json.data(), json.size());
+        return EndValue(true);
     }
 };
 
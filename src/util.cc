@@ -39,12 +39,17 @@
 
 #include <algorithm>
 #include <array>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "zeek/3rdparty/ConvertUTF.h"
 #include "zeek/Desc.h"
 #include "zeek/Hash.h"
@@ -2231,6 +2236,47 @@ void zeek_strerror_r(int zeek_errno, char* buf, size_t buflen) {
     strerror_r_helper(res, buf, buflen);
 }
 
+// Returns the length of the prefix of val consisting of printable ASCII
+// characters, which json_escape_utf8() passes through as they are.
+static size_t printable_ascii_prefix(const char* val, size_t val_size) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // Bytes of 0x80 and above are negative as signed chars, so one signed
+    // comparison catches them along with the control characters.
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+
+    for ( ; i + 16 <= val_size; i += 16 ) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(val + i));
+        __m128i bad = _mm_or_si128(_mm_cmplt_epi8(x, space), _mm_cmpeq_epi8(x, del));
+
+        if ( int mask = _mm_movemask_epi8(bad) )
+            return i + __builtin_ctz(mask);
+    }
+#else
+    // Checks 8 bytes at a time, leaving it to the loop below to locate
+    // the first one that's not printable.
+    constexpr uint64_t lsbs = 0x0101010101010101ULL;
+    constexpr uint64_t msbs = 0x8080808080808080ULL;
+
+    for ( ; i + 8 <= val_size; i += 8 ) {
+        uint64_t x;
+        memcpy(&x, val + i, sizeof(x));
+
+        uint64_t del = x ^ (lsbs * 0x7f);
+
+        if ( (x & msbs) || ((x - lsbs * 0x20) & ~x & msbs) || ((del - lsbs) & ~del & msbs) )
+            break;
+    }
+#endif
+
+    while ( i < val_size && val[i] >= 32 && val[i] < 127 )
+        ++i;
+
+    return i;
+}
+
 static string json_escape_byte(char c) {
     char hex[2] = {'0', '0'};
     bytetohex(c, hex);
@@ -2306,6 +2352,20 @@ TEST_CASE("util json_escape_utf8") {
 
     // Valid UTF-8 character followed by an invalid one
     CHECK(json_escape_utf8("\xc3\xb1\xc0\x81") == "\\xc3\\xb1\\xc0\\x81");
+
+    // Escapes within and after runs of printable characters longer than
+    // the bulk checks.
+    std::string ascii(40, 'x');
+    CHECK(json_escape_utf8(ascii) == ascii);
+    CHECK(json_escape_utf8(ascii + "\x7f" + ascii) == ascii + "\\x7f" + ascii);
+    CHECK(json_escape_utf8(ascii + "\xc3\xb1" + ascii) == ascii + "\xc3\xb1" + ascii);
+    CHECK(json_escape_utf8(ascii + "\xc3\xb1" + ascii + "\x82") == ascii + "\\xc3\\xb1" + ascii + "\\x82");
+
+    for ( size_t i = 0; i < ascii.size(); ++i ) {
+        auto s = ascii;
+        s[i] = '\x01';
+        CHECK(json_escape_utf8(s) == ascii.substr(0, i) + "\\x01" + ascii.substr(i + 1));
+    }
 }
 
 static bool check_ok_utf8(const unsigned char* start, const unsigned char* end) {
@@ -2334,6 +2394,12 @@ string json_escape_utf8(const string& val, bool escape_printable_controls) {
 string json_escape_utf8(const char* val, size_t val_size, bool escape_printable_controls) {
     auto val_data = reinterpret_cast<const unsigned char*>(val);
 
+    // Most strings are plain ASCII, which needs no escaping at all.
+    size_t idx = printable_ascii_prefix(val, val_size);
+
+    if ( idx == val_size )
+        return {val, val_size};
+
     // Reserve at least the size of the existing string to avoid resizing the string in the
     // best-case scenario where we don't have any multi-byte characters. We keep two versions of
     // this string: one that has a valid utf8 string and one that has a fully-escaped version. The
@@ -2342,12 +2408,23 @@ string json_escape_utf8(const char* val, size_t val_size, bool escape_printable_
     // looping through all of the characters a second time in the case of a bad utf8 sequence.
     string utf_result;
     utf_result.reserve(val_size);
+    utf_result.append(val, idx);
     string escaped_result;
     escaped_result.reserve(val_size);
+    escaped_result.append(val, idx);
 
     bool found_bad = false;
-    size_t idx = 0;
     while ( idx < val_size ) {
+        // Copy runs of printable characters in bulk.
+        if ( size_t n = printable_ascii_prefix(val + idx, val_size - idx); n > 0 ) {
+            if ( ! found_bad )
+                utf_result.append(val + idx, n);
+
+            escaped_result.append(val + idx, n);
+            idx += n;
+            continue;
+        }
+
         const char ch = val[idx];
 
         // Normal ASCII characters plus a few of the control characters can be inserted directly.
@@ -202,6 +202,7 @@ extern "C" const char zeek_build_info[];
 
 const char* zeek::detail::command_line_policy = nullptr;
 std::vector<std::string> zeek::detail::params;
+std::string zeek::detail::command_line_scripts;
 std::set<std::string> requested_plugins;
 const char* proc_status_file = nullptr;
 
@@ -0,0 +1,42 @@
+#! /usr/bin/env bash
+#
+# Runs scripts.zeek under ZAM over a fixed set of traces with each of the
+# given Zeek binaries, and reports the fastest of several runs per trace in
+# CPU seconds. To measure the gain of threaded ZAM dispatch, build Zeek
+# once with and once without --enable-ZAM-threaded-dispatch:
+#
+#   ./run.sh /path/to/switch/build/src/zeek /path/to/threaded/build/src/zeek
+#
+# The number of runs per trace defaults to 10, set RUNS to change it.
+
+set -e
+
+if [ $# -eq 0 ]; then
+    echo "usage: $(basename "$0") <zeek binary> [<zeek binary> ...]" >&2
+    exit 1
+fi
+
+here=$(cd "$(dirname "$0")" && pwd)
+traces=$here/../../btest/Traces
+runs=${RUNS:-10}
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+for zeek in "$@"; do
+    echo "$zeek"
+
+    for trace in workshop_2011_browse.trace wikipedia.trace http/bro.org.pcap dns53.pcap; do
+        best=
+
+        for _ in $(seq "$runs"); do
+            t=$(cd "$tmp" && "$zeek" -b -O ZAM -r "$traces/$trace" "$here/scripts.zeek")
+
+            if [ -z "$best" ] || awk "BEGIN { exit !($t < $best) }"; then
+                best=$t
+            fi
+        done
+
+        printf "    %-30s %ss\n" "$trace" "$best"
+    done
+done